@@ -8,8 +8,8 @@
 bin_PROGRAMS += crc 
 bin_PROGRAMS += createcrc
 
-crc_LDFLAGS = -lm @SEARCHFLAGS@ @LIBFLAGS@ @RPATHFLAGS@
-crc_SOURCES = combinational-logic/crc/src/crc_algo.c combinational-logic/crc/src-common/crc_formats.c
+crc_LDFLAGS = -lm -lpthread @SEARCHFLAGS@ @LIBFLAGS@ @RPATHFLAGS@
+crc_SOURCES = combinational-logic/crc/src/crc_algo.c combinational-logic/crc/src/crc_engine.c combinational-logic/crc/src/crc_host.c combinational-logic/crc/src-common/crc_formats.c
 
 createcrc_SOURCES = combinational-logic/crc/src-test/createcrc.c combinational-logic/crc/src-common/crc_formats.c
 
@@ -0,0 +1,46 @@
+#ifndef CRC_ENGINE_H
+#define CRC_ENGINE_H
+
+#include<stdint.h>
+#include<stddef.h>
+
+/**
+ * Parameterised CRC model in the usual "Rocksoft" notation: 'poly', 'init' and
+ * 'xorout' are given MSB-first, 'refin'/'refout' select bit-reflected input and
+ * output, and 'check' is the CRC of the ASCII string "123456789".
+ */
+typedef struct crc_model
+{
+	const char* name;
+	unsigned int width;
+	uint64_t poly;
+	uint64_t init;
+	int refin;
+	int refout;
+	uint64_t xorout;
+	uint64_t check;
+} crc_model;
+
+/**
+ * A model together with its generated Slice-by-8 tables. Reflected models keep
+ * the register in the low 'width' bits, non-reflected models keep it left-aligned
+ * in the 64-bit register so that both use the same table layout on the device.
+ */
+typedef struct crc_engine
+{
+	const crc_model* model;
+	uint64_t table[8][256];
+} crc_engine;
+
+extern const crc_model crc_models[];
+
+const crc_model* crc_find_model(const char* name);
+void crc_engine_init(crc_engine* engine,const crc_model* model);
+uint64_t crc_engine_bitwise(const crc_model* model,const void* data,size_t length);
+uint64_t crc_engine_start(const crc_engine* engine);
+uint64_t crc_engine_update(const crc_engine* engine,uint64_t crc,const void* data,size_t length);
+uint64_t crc_engine_finish(const crc_engine* engine,uint64_t crc);
+uint64_t crc_engine_compute(const crc_engine* engine,const void* data,size_t length);
+void crc_engine_build_options(const crc_engine* engine,char* options,size_t length);
+
+#endif
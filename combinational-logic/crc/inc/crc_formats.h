@@ -7,6 +7,8 @@
 #include "../../../include/common_util.h"
 
 unsigned int* read_crc(unsigned int* num_pages,unsigned int* page_size,const char* file_path);
+FILE* open_crc(unsigned int* num_pages,unsigned int* page_size,const char* file_path);
+unsigned int read_crc_pages(FILE* fp,unsigned int* pages,const unsigned int count,const unsigned int page_size);
 void write_crc(const unsigned int** pages, const unsigned int num_pages, const unsigned int page_size,const char* file_path);
 unsigned int** rand_crc(const unsigned int num_pages,const unsigned int page_size,const unsigned int seed);
 void free_crc(unsigned int** pages, const unsigned int num_pages);
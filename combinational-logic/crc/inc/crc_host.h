@@ -0,0 +1,38 @@
+#ifndef CRC_HOST_H
+#define CRC_HOST_H
+
+#include<stdint.h>
+#include<stddef.h>
+
+#include "crc_engine.h"
+
+/**
+ * Host (CPU) CRC implementations used as the baseline for the device kernels.
+ * CRC_HOST_SSE42 uses the SSE4.2 crc32 instruction and only computes CRC-32C,
+ * CRC_HOST_PCLMUL folds with carry-less multiplies and only computes the
+ * Ethernet CRC-32. CRC_HOST_AUTO picks the fastest one the CPU and model allow.
+ */
+typedef enum crc_host_algo
+{
+	CRC_HOST_AUTO,
+	CRC_HOST_BITWISE,
+	CRC_HOST_SLICE8,
+	CRC_HOST_SSE42,
+	CRC_HOST_PCLMUL,
+	CRC_HOST_NUM_ALGOS
+} crc_host_algo;
+
+extern const char* crc_host_algo_names[];
+
+typedef struct crc_host_pool crc_host_pool;
+
+int crc_host_find_algo(const char* name);
+int crc_host_supported(crc_host_algo algo,const crc_model* model);
+crc_host_algo crc_host_select(crc_host_algo algo,const crc_model* model);
+uint64_t crc_host_compute(crc_host_algo algo,const crc_engine* engine,const void* data,size_t length);
+
+crc_host_pool* crc_host_pool_create(unsigned int num_threads);
+void crc_host_pool_run(crc_host_pool* pool,crc_host_algo algo,const crc_engine* engine,const void* pages,unsigned int num_pages,unsigned int page_size,uint64_t* results);
+void crc_host_pool_destroy(crc_host_pool* pool);
+
+#endif
@@ -3,28 +3,51 @@
 unsigned int* read_crc(unsigned int* num_pages,unsigned int* page_size,const char* file_path)
 {
 	FILE* fp;
-	unsigned int i,j,read_count,num_words;
+	unsigned int num_words;
 	unsigned int* page;
 
+	fp = open_crc(num_pages,page_size,file_path);
+	num_words = *page_size / 4;
+
+	page = int_new_array(sizeof(int)*(*num_pages)*num_words,"crc_formats.read_crc() - Heap Overflow! Cannot allocate space for page");
+	read_crc_pages(fp,page,*num_pages,*page_size);
+
+	fclose(fp);
+	return page;
+}
+
+/**
+ * Opens a CRC file and reads its header, leaving 'fp' positioned at the first page
+ * so that pages can be streamed with read_crc_pages()
+ */
+FILE* open_crc(unsigned int* num_pages,unsigned int* page_size,const char* file_path)
+{
+	FILE* fp;
+
 	fp = fopen(file_path,"r");
-	check(fp != NULL,"crc_formats.read_crc() - Cannot Open File");
+	check(fp != NULL,"crc_formats.open_crc() - Cannot Open File");
 	fscanf(fp,"%u\n",num_pages);
 	fscanf(fp,"%u\n\n",page_size);
-	num_words = *page_size / 4;
+	return fp;
+}
 
-	page = int_new_array(sizeof(int)*(*num_pages)*num_words,"crc_formats.read_crc() - Heap Overflow! Cannot allocate space for page");
+/**
+ * Reads the next 'count' pages of an open CRC file into 'pages'
+ */
+unsigned int read_crc_pages(FILE* fp,unsigned int* pages,const unsigned int count,const unsigned int page_size)
+{
+	unsigned int i,j,read_count,num_words;
 
-	for(j=0; j<*num_pages; j++)
+	num_words = page_size / 4;
+	for(j=0; j<count; j++)
 	{
 		read_count = 0;
 		for(i=0; i<num_words; i++)
-		  read_count += fscanf(fp,"%u ",&page[j*num_words+i]);
-		check(read_count == num_words,"crc_formats.read_crc() - Input file corrupted! Read count differs from page size");
+		  read_count += fscanf(fp,"%u ",&pages[j*num_words+i]);
+		check(read_count == num_words,"crc_formats.read_crc_pages() - Input file corrupted! Read count differs from page size");
 		fscanf(fp,"\n");
 	}
-
-	fclose(fp);
-	return page;
+	return count;
 }
 
 void write_crc(const unsigned int** pages, const unsigned int num_pages, const unsigned int page_size,const char* file_path)
@@ -11,13 +11,19 @@
 #include <unistd.h>
 #include <string.h>
 #include <math.h>
+#include <pthread.h>
 
 #include "../../../include/rdtsc.h"
 #include "../../../include/common_ocl.h"
 #include "../inc/crc_formats.h"
 #include "../inc/eth_crc32_lut.h"
+#include "../inc/crc_engine.h"
+#include "../inc/crc_host.h"
 
 #define DATA_SIZE 100000000
+#define COMBINE_WG_SIZE 64 //work-group size of the single-stream reduction when -w is not given
+#define MAX_COMBINE_PASSES 64
+#define MAX_STREAM_BUFFERS 8
 
 //The CRC algorithms used in this dwarf were copied and/or adapted from
 //versions posted by Stephan Brumme on the website:
@@ -31,7 +37,7 @@ cl_device_id device_id;
 cl_context context;
 cl_command_queue write_queue,kernel_queue,read_queue;
 cl_program program;
-cl_kernel kernel_compute;
+cl_kernel kernel_compute,kernel_chunk,kernel_combine;
 cl_mem dev_table;
 
 
@@ -40,6 +46,16 @@ int64_t kernelExecutionTime = 0;
 
 unsigned int* num_parallel_crcs;
 unsigned int page_size=DATA_SIZE,num_wg_sizes=0,num_words,num_blocks,num_pages_last_block,num_block_sizes=0;
+unsigned int chunk_size=0,num_threads=0,stream_pages=0,num_stream_buffers=3;
+uint32_t crc32_x2n_table[64];
+
+const crc_model* model=NULL; //generic CRC engine model selected with -m, NULL for the Ethernet CRC-32 kernel
+crc_engine engine; //tables of 'model', or of CRC-32 for the host baseline when no model is given
+size_t result_size=sizeof(cl_uint);
+
+crc_host_algo host_algo=CRC_HOST_AUTO;
+crc_host_pool* host_pool=NULL;
+uint64_t* cpu_remainders=NULL;
 size_t* wg_sizes=NULL;
 
 void printTimeDiff(struct timeval start, struct timeval end)
@@ -55,6 +71,12 @@ int64_t computeTimeDiff(struct timeval start, struct timeval end)
 	return diff;
 }
 
+void printThroughput(const char* label, uint64_t bytes, struct timeval start, struct timeval end)
+{
+	int64_t diff = computeTimeDiff(start,end);
+	printf("%s: %.3f GB/s\n", label, diff ? (double)bytes/(diff*1000.0) : 0.0);
+}
+
 // /////Bitwise version of CRC///////////////////////
 ////////altered from the fastest version of crc32_bitwise() by Stephan Brumme////////
 // Copyright (c) 2013 Stephan Brumme. All rights reserved.
@@ -106,7 +128,109 @@ uint32_t crc32_8bytes(const void* data, size_t length)
 	return ~crc;
 }
 
-void enqueueCRCDevice(unsigned int* h_num, unsigned int* h_answer, size_t global_size, size_t local_size, cl_mem d_input, cl_mem d_output,cl_event* write_page,cl_event* kernel_exec,cl_event* read_page)
+// /////Single-stream CRC via polynomial combine///////////////////////
+////////adapted from crc32_combine() in zlib 1.2.12 by Mark Adler////////
+//
+// CRC(A|B) = CRC(A) * x^(8*len(B)) mod P  xor  CRC(B), so a message can be split
+// into chunks whose CRCs are computed independently and merged afterwards.
+
+//Multiply a and b modulo the CRC polynomial (bit-reflected representation)
+uint32_t crc32_multmodp(uint32_t a, uint32_t b)
+{
+	uint32_t m = (uint32_t)1 << 31;
+	uint32_t p = 0;
+	for (;;)
+	{
+		if (a & m)
+		{
+			p ^= b;
+			if ((a & (m - 1)) == 0)
+				break;
+		}
+		m >>= 1;
+		b = b & 1 ? (b >> 1) ^ Polynomial : b >> 1;
+	}
+	return p;
+}
+
+//crc32_x2n_table[k] = x^(2^k) mod P, shared with the device reduction
+void crc32_init_x2n_table()
+{
+	unsigned int k;
+	uint32_t p = (uint32_t)1 << 30; // x^1
+	crc32_x2n_table[0] = p;
+	for (k = 1; k < 64; k++)
+		crc32_x2n_table[k] = p = crc32_multmodp(p, p);
+}
+
+//x^(8*n) mod P, i.e. the operator that shifts a CRC over n zero bytes
+uint32_t crc32_x8nmodp(uint64_t n)
+{
+	unsigned int k = 3;
+	uint32_t p = (uint32_t)1 << 31; // x^0
+	while (n)
+	{
+		if (n & 1)
+			p = crc32_multmodp(crc32_x2n_table[k], p);
+		n >>= 1;
+		k++;
+	}
+	return p;
+}
+
+uint32_t crc32_combine(uint32_t crc1, uint32_t crc2, uint64_t len2)
+{
+	return crc32_multmodp(crc32_x8nmodp(len2), crc1) ^ crc2;
+}
+
+typedef struct crc_thread_arg
+{
+	const unsigned char* data;
+	uint64_t length;
+	uint32_t crc;
+} crc_thread_arg;
+
+void* crc32_thread(void* arg)
+{
+	crc_thread_arg* t = (crc_thread_arg*) arg;
+	t->crc = crc32_8bytes(t->data, t->length);
+	return NULL;
+}
+
+//Slice-by-8 CRC of one message split across 'threads' host threads, merged with crc32_combine()
+uint32_t parallelHostCRC(const void* data, uint64_t length, unsigned int threads)
+{
+	unsigned int t;
+	uint64_t offset,stride;
+	uint32_t crc;
+	pthread_t tid[threads];
+	crc_thread_arg args[threads];
+
+	stride = (((length + threads - 1) / threads) + 7) & ~(uint64_t)7; // round the share up, then keep every slice 8-byte aligned
+	for(t=0; t<threads; t++)
+	{
+		offset = stride * t;
+		args[t].data = (const unsigned char*) data + offset;
+		args[t].length = (offset >= length) ? 0 : (length - offset < stride ? length - offset : stride);
+		check(pthread_create(&tid[t],NULL,crc32_thread,&args[t]) == 0,"crc_algo.parallelHostCRC() - Cannot create thread");
+	}
+
+	for(t=0; t<threads; t++)
+		pthread_join(tid[t],NULL);
+
+	crc = args[0].crc;
+	for(t=1; t<threads; t++)
+		crc = crc32_combine(crc, args[t].crc, args[t].length);
+	return crc;
+}
+
+//Element 'i' of a device results array; results are 64-bit wide when the generic engine is used
+uint64_t getResult(const void* results, size_t i)
+{
+	return model ? ((const cl_ulong*) results)[i] : ((const cl_uint*) results)[i];
+}
+
+void enqueueCRCDevice(unsigned int* h_num, void* h_answer, size_t global_size, size_t local_size, cl_mem d_input, cl_mem d_output,cl_event* write_page,cl_event* kernel_exec,cl_event* read_page)
 {
 	int err,i;
 
@@ -123,22 +247,38 @@ void enqueueCRCDevice(unsigned int* h_num, unsigned int* h_answer, size_t global
 	CHKERR(err, "Failed to set kernel argument 2!");
 	err = clSetKernelArg(kernel_compute, 3, sizeof(cl_mem), &d_output);
 	CHKERR(err, "Failed to set kernel argument 3!");
+	if(model)
+	{
+		err = clSetKernelArg(kernel_compute, 4, sizeof(cl_mem), &dev_table);
+		CHKERR(err, "Failed to set kernel argument 4!");
+	}
 
 	if(verbosity >=2) printf("enqueueCRCDevice(): global_size=%zd - local_size=%zd\n",global_size,local_size);
 	err = clEnqueueNDRangeKernel(kernel_queue, kernel_compute, 1, NULL, &global_size, &local_size, 1, write_page, kernel_exec);
 	CHKERR(err, "Failed to enqueue compute kernel!");
 
 	// Read back the results from the device to verify the output
-	err = clEnqueueReadBuffer(read_queue, d_output, CL_FALSE, 0, sizeof(int)*global_size, h_answer, 1, kernel_exec, read_page);
+	err = clEnqueueReadBuffer(read_queue, d_output, CL_FALSE, 0, result_size*global_size, h_answer, 1, kernel_exec, read_page);
 	CHKERR(err, "Failed to enqueue output read!");
 }
 
 void setup_device(const char* kernel_file)
 {
 	cl_int err;
+	char options[256];
 	
-	program = ocdBuildProgramFromFile(context,device_id,kernel_file);
-	kernel_compute = clCreateKernel(program, "crc32_slice8", &err); // Create the compute kernel in the program we wish to run
+	if(model) //specialise the generic kernel for the selected model
+	{
+		crc_engine_build_options(&engine,options,sizeof(options));
+		if(verbosity) printf("Building '%s' for model %s: %s\n",kernel_file,model->name,options);
+		program = ocdBuildProgramFromFileWithOptions(context,device_id,kernel_file,options);
+		kernel_compute = clCreateKernel(program, "crc_slice8_generic", &err);
+	}
+	else
+	{
+		program = ocdBuildProgramFromFile(context,device_id,kernel_file);
+		kernel_compute = clCreateKernel(program, "crc32_slice8", &err); // Create the compute kernel in the program we wish to run
+	}
 	CHKERR(err, "Failed to create a compute kernel!");
 
 	if(!wg_sizes)
@@ -149,9 +289,484 @@ void setup_device(const char* kernel_file)
 	}
 }
 
+//Computes the CRC of one 'length_bytes' long message: chunk CRCs in parallel, then an ordered tree of crc32_combine() reductions
+uint32_t runSingleStreamDevice(unsigned int* h_num, uint64_t length_bytes, size_t local_size, cl_mem d_input, cl_mem* d_crc, cl_mem* d_len, cl_mem d_x2n)
+{
+	cl_int err;
+	cl_uint n,num_chunks;
+	cl_ulong length = length_bytes;
+	size_t global_size,combine_local;
+	unsigned int src,num_passes=0,i;
+	uint32_t h_crc;
+	cl_event write_stream,chunk_exec,combine_exec[MAX_COMBINE_PASSES],read_crc;
+
+	num_chunks = (length_bytes + chunk_size - 1) / chunk_size;
+	global_size = ((num_chunks + local_size - 1) / local_size) * local_size;
+
+	err = clEnqueueWriteBuffer(write_queue, d_input, CL_FALSE, 0, length_bytes, h_num, 0, NULL, &write_stream);
+	CHKERR(err, "Failed to enqueue data write!");
+
+	err = clSetKernelArg(kernel_chunk, 0, sizeof(cl_mem), &d_input);
+	err |= clSetKernelArg(kernel_chunk, 1, sizeof(cl_ulong), &length);
+	err |= clSetKernelArg(kernel_chunk, 2, sizeof(cl_uint), &chunk_size);
+	err |= clSetKernelArg(kernel_chunk, 3, sizeof(cl_uint), &num_chunks);
+	err |= clSetKernelArg(kernel_chunk, 4, sizeof(cl_mem), &d_crc[0]);
+	err |= clSetKernelArg(kernel_chunk, 5, sizeof(cl_mem), &d_len[0]);
+	CHKERR(err, "Failed to set chunk kernel arguments!");
+
+	if(verbosity >=2) printf("runSingleStreamDevice(): num_chunks=%u - global_size=%zd - local_size=%zd\n",num_chunks,global_size,local_size);
+	err = clEnqueueNDRangeKernel(kernel_queue, kernel_chunk, 1, NULL, &global_size, &local_size, 1, &write_stream, &chunk_exec);
+	CHKERR(err, "Failed to enqueue chunk kernel!");
+
+	// a work-group of one would never shrink the problem
+	combine_local = (local_size > 1) ? local_size : COMBINE_WG_SIZE;
+	src = 0;
+	for(n=num_chunks; n>1; n=global_size/combine_local)
+	{
+		check(num_passes < MAX_COMBINE_PASSES,"crc_algo.runSingleStreamDevice() - Too many combine passes");
+		global_size = ((n + combine_local - 1) / combine_local) * combine_local;
+		err = clSetKernelArg(kernel_combine, 0, sizeof(cl_mem), &d_crc[src]);
+		err |= clSetKernelArg(kernel_combine, 1, sizeof(cl_mem), &d_len[src]);
+		err |= clSetKernelArg(kernel_combine, 2, sizeof(cl_uint), &n);
+		err |= clSetKernelArg(kernel_combine, 3, sizeof(cl_mem), &d_x2n);
+		err |= clSetKernelArg(kernel_combine, 4, sizeof(cl_mem), &d_crc[1-src]);
+		err |= clSetKernelArg(kernel_combine, 5, sizeof(cl_mem), &d_len[1-src]);
+		err |= clSetKernelArg(kernel_combine, 6, sizeof(cl_uint)*combine_local, NULL);
+		err |= clSetKernelArg(kernel_combine, 7, sizeof(cl_ulong)*combine_local, NULL);
+		CHKERR(err, "Failed to set combine kernel arguments!");
+
+		if(verbosity >=2) printf("runSingleStreamDevice(): combine pass %u - n=%u - global_size=%zd - local_size=%zd\n",num_passes,n,global_size,combine_local);
+		err = clEnqueueNDRangeKernel(kernel_queue, kernel_combine, 1, NULL, &global_size, &combine_local, 0, NULL, &combine_exec[num_passes]);
+		CHKERR(err, "Failed to enqueue combine kernel!");
+		num_passes++;
+		src = 1-src;
+	}
+
+	err = clEnqueueReadBuffer(read_queue, d_crc[src], CL_FALSE, 0, sizeof(cl_uint), &h_crc, 1, num_passes ? &combine_exec[num_passes-1] : &chunk_exec, &read_crc);
+	CHKERR(err, "Failed to enqueue output read!");
+	clFinish(write_queue);
+	clFinish(kernel_queue);
+	clFinish(read_queue);
+
+	START_TIMER(write_stream, OCD_TIMER_H2D, "CRC Data Copy", ocdTempTimer)
+	END_TIMER(ocdTempTimer)
+	clReleaseEvent(write_stream);
+
+	START_TIMER(chunk_exec, OCD_TIMER_KERNEL, "CRC Chunk Kernel", ocdTempTimer)
+	END_TIMER(ocdTempTimer)
+	clReleaseEvent(chunk_exec);
+
+	for(i=0; i<num_passes; i++)
+	{
+		START_TIMER(combine_exec[i], OCD_TIMER_KERNEL, "CRC Combine Kernel", ocdTempTimer)
+		END_TIMER(ocdTempTimer)
+		clReleaseEvent(combine_exec[i]);
+	}
+
+	START_TIMER(read_crc, OCD_TIMER_D2H, "CRC Data Copy", ocdTempTimer)
+	END_TIMER(ocdTempTimer)
+	clReleaseEvent(read_crc);
+
+	return h_crc;
+}
+
+void runSingleStream(unsigned int* h_num, uint64_t length_bytes, char** kernel_files, unsigned int num_kernels, unsigned int num_execs, unsigned int run_serial)
+{
+	cl_int err;
+	cl_mem d_input,d_crc[2],d_len[2],d_x2n;
+	unsigned int ii,k,l,num_chunks;
+	uint32_t ocl_crc,cpu_crc;
+	struct timeval start,end;
+
+	check(chunk_size % 8 == 0,"crc_algo.runSingleStream() - Chunk size must be a multiple of 8 bytes");
+	num_chunks = (length_bytes + chunk_size - 1) / chunk_size;
+	if(verbosity) printf("Single-stream mode: %llu bytes in %u chunks of %u bytes\n",(unsigned long long)length_bytes,num_chunks,chunk_size);
+
+	crc32_init_x2n_table();
+
+	d_input = clCreateBuffer(context, CL_MEM_READ_ONLY, length_bytes, NULL, &err);
+	CHKERR(err, "Failed to allocate device memory!");
+	for(ii=0; ii<2; ii++)
+	{
+		d_crc[ii] = clCreateBuffer(context, CL_MEM_READ_WRITE, sizeof(cl_uint)*num_chunks, NULL, &err);
+		CHKERR(err, "Failed to allocate device memory!");
+		d_len[ii] = clCreateBuffer(context, CL_MEM_READ_WRITE, sizeof(cl_ulong)*num_chunks, NULL, &err);
+		CHKERR(err, "Failed to allocate device memory!");
+	}
+	d_x2n = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, sizeof(crc32_x2n_table), crc32_x2n_table, &err);
+	CHKERR(err, "Failed to allocate device memory!");
+
+	for(l=0; l<num_kernels; l++)
+	{
+		if(verbosity) printf("Executing with kernel #%u of %u: %s\n",l+1,num_kernels,kernel_files[l]);
+		setup_device(kernel_files[l]);
+		kernel_chunk = clCreateKernel(program, "crc32_slice8_chunk", &err);
+		CHKERR(err, "Failed to create the chunk kernel!");
+		kernel_combine = clCreateKernel(program, "crc32_combine_reduce", &err);
+		CHKERR(err, "Failed to create the combine kernel!");
+
+		for(k=0; k<num_wg_sizes; k++)
+		{
+			if(verbosity) printf("Executing with Workgroup size #%u of %u: %zu\n",k+1,num_wg_sizes,wg_sizes[k]);
+
+			for(ii=0; ii<num_execs; ii++)
+			{
+				if(verbosity) printf("Beginning execution #%u of %u...\n",ii+1,num_execs);
+
+				#ifdef ENABLE_TIMER
+					TIMER_INIT
+				#endif
+				ocl_crc = runSingleStreamDevice(h_num,length_bytes,wg_sizes[k],d_input,d_crc,d_len,d_x2n);
+				#ifdef ENABLE_TIMER
+					TIMER_STOP
+					TIMER_PRINT
+				#endif
+				printf("Single-stream CRC: '%X'\n",ocl_crc);
+
+				if(run_serial)
+				{
+					printf("Validating results with serial CRC...\n");
+					gettimeofday(&start,NULL);
+					cpu_crc = crc32_8bytes(h_num, length_bytes);
+					gettimeofday(&end,NULL);
+					printf("CPU Slice-by-8 CRC Time: ");
+					printTimeDiff(start,end);
+					if(cpu_crc != ocl_crc)
+						fprintf(stderr,"ERROR: OCL and CPU Slice-by-8 single-stream CRCs differ [OCL: '%X', CPU: '%X']\n",ocl_crc,cpu_crc);
+
+					gettimeofday(&start,NULL);
+					cpu_crc = parallelHostCRC(h_num, length_bytes, num_threads);
+					gettimeofday(&end,NULL);
+					printf("CPU Slice-by-8 CRC Time (%u threads): ",num_threads);
+					printTimeDiff(start,end);
+					if(cpu_crc != ocl_crc)
+						fprintf(stderr,"ERROR: OCL and threaded CPU single-stream CRCs differ [OCL: '%X', CPU: '%X']\n",ocl_crc,cpu_crc);
+				}
+			}
+		}
+		clReleaseKernel(kernel_chunk);
+		clReleaseKernel(kernel_combine);
+		clReleaseKernel(kernel_compute);
+	}
+
+	#ifdef ENABLE_TIMER
+		TIMER_DEST
+	#endif
+	clReleaseMemObject(d_input);
+	for(ii=0; ii<2; ii++)
+	{
+		clReleaseMemObject(d_crc[ii]);
+		clReleaseMemObject(d_len[ii]);
+	}
+	clReleaseMemObject(d_x2n);
+}
+
+//One slot of the streaming ring: pinned staging buffers, device buffers and the events of the batch in flight
+typedef struct crc_stream_slot
+{
+	cl_mem pinned_input,pinned_output;
+	cl_mem d_input,d_output;
+	unsigned int* h_input;
+	void* h_output;
+	unsigned int first_page,num_pages;
+	cl_event write_page,kernel_exec,read_page;
+	int busy;
+} crc_stream_slot;
+
+//Waits for the batch held by 'slot' and verifies it while its pages are still in the pinned buffer
+unsigned int retireStreamSlot(crc_stream_slot* slot, unsigned int run_serial)
+{
+	unsigned int i,errors=0;
+
+	if(!slot->busy)
+		return 0;
+	clWaitForEvents(1,&slot->read_page);
+
+	START_TIMER(slot->write_page, OCD_TIMER_H2D, "CRC Data Copy", ocdTempTimer)
+	END_TIMER(ocdTempTimer)
+	clReleaseEvent(slot->write_page);
+
+	START_TIMER(slot->kernel_exec, OCD_TIMER_KERNEL, "CRC Kernel", ocdTempTimer)
+	END_TIMER(ocdTempTimer)
+	clReleaseEvent(slot->kernel_exec);
+
+	START_TIMER(slot->read_page, OCD_TIMER_D2H, "CRC Data Copy", ocdTempTimer)
+	END_TIMER(ocdTempTimer)
+	clReleaseEvent(slot->read_page);
+
+	if(run_serial)
+		crc_host_pool_run(host_pool,host_algo,&engine,slot->h_input,slot->num_pages,page_size,cpu_remainders);
+	for(i=0; i<slot->num_pages; i++)
+	{
+		if(verbosity >= 2) printf("Parallel Computation (page %u): '%llX'\n",slot->first_page+i+1,(unsigned long long)getResult(slot->h_output,i));
+		if(run_serial && cpu_remainders[i] != getResult(slot->h_output,i))
+		{
+			fprintf(stderr,"ERROR: OCL and CPU %s remainders for page %u differ [OCL: '%llX', CPU: '%llX']\n",crc_host_algo_names[host_algo],slot->first_page+i+1,(unsigned long long)getResult(slot->h_output,i),(unsigned long long)cpu_remainders[i]);
+			errors++;
+		}
+	}
+	slot->busy = 0;
+	return errors;
+}
+
+//Streams the input file through a ring of 'num_stream_buffers' pinned batches of 'stream_pages' pages, so that
+//reading the file, H2D, kernel and D2H of consecutive batches overlap on the write/kernel/read queues
+void runStream(const char* file, char** kernel_files, unsigned int num_kernels, unsigned int num_execs, unsigned int run_serial)
+{
+	cl_int err;
+	FILE* fp;
+	crc_stream_slot slots[MAX_STREAM_BUFFERS];
+	crc_stream_slot* slot;
+	size_t global_size,local_size;
+	unsigned int b,ii,k,l,num_pages,first_page,errors;
+	struct timeval start,end;
+	int64_t elapsed;
+
+	check(num_stream_buffers >= 1 && num_stream_buffers <= MAX_STREAM_BUFFERS,"crc_algo.runStream() - Number of stream buffers out of range");
+	if(verbosity) printf("Streaming mode: %u pages per batch, %u buffers in flight\n",stream_pages,num_stream_buffers);
+
+	for(b=0; b<num_stream_buffers; b++)
+	{
+		slot = &slots[b];
+		slot->pinned_input = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_ALLOC_HOST_PTR, sizeof(char)*page_size*stream_pages, NULL, &err);
+		CHKERR(err, "Failed to allocate pinned host memory!");
+		slot->pinned_output = clCreateBuffer(context, CL_MEM_WRITE_ONLY | CL_MEM_ALLOC_HOST_PTR, result_size*stream_pages, NULL, &err);
+		CHKERR(err, "Failed to allocate pinned host memory!");
+		slot->h_input = clEnqueueMapBuffer(write_queue, slot->pinned_input, CL_TRUE, CL_MAP_WRITE, 0, sizeof(char)*page_size*stream_pages, 0, NULL, NULL, &err);
+		CHKERR(err, "Failed to map pinned host memory!");
+		slot->h_output = clEnqueueMapBuffer(read_queue, slot->pinned_output, CL_TRUE, CL_MAP_READ, 0, result_size*stream_pages, 0, NULL, NULL, &err);
+		CHKERR(err, "Failed to map pinned host memory!");
+		slot->d_input = clCreateBuffer(context, CL_MEM_READ_ONLY, sizeof(char)*page_size*stream_pages, NULL, &err);
+		CHKERR(err, "Failed to allocate device memory!");
+		slot->d_output = clCreateBuffer(context, CL_MEM_READ_WRITE, result_size*stream_pages, NULL, &err);
+		CHKERR(err, "Failed to allocate device memory!");
+		slot->busy = 0;
+	}
+
+	for(l=0; l<num_kernels; l++)
+	{
+		if(verbosity) printf("Executing with kernel #%u of %u: %s\n",l+1,num_kernels,kernel_files[l]);
+		setup_device(kernel_files[l]);
+
+		for(k=0; k<num_wg_sizes; k++)
+		{
+			if(verbosity) printf("Executing with Workgroup size #%u of %u: %zu\n",k+1,num_wg_sizes,wg_sizes[k]);
+
+			for(ii=0; ii<num_execs; ii++)
+			{
+				if(verbosity) printf("Beginning execution #%u of %u...\n",ii+1,num_execs);
+
+				#ifdef ENABLE_TIMER
+					TIMER_INIT
+				#endif
+				gettimeofday(&start,NULL);
+				fp = open_crc(&num_pages,&page_size,file);
+				errors = 0;
+				for(first_page=0,b=0; first_page<num_pages; first_page+=stream_pages,b++)
+				{
+					slot = &slots[b % num_stream_buffers];
+					errors += retireStreamSlot(slot,run_serial); // the batch from 'num_stream_buffers' iterations ago
+
+					slot->first_page = first_page;
+					slot->num_pages = MINIMUM(stream_pages,num_pages-first_page);
+					read_crc_pages(fp,slot->h_input,slot->num_pages,page_size);
+
+					global_size = slot->num_pages;
+					local_size = wg_sizes[k];
+					if((global_size % local_size) != 0)
+					{
+						local_size = 1;
+						while((global_size % local_size) == 0) local_size = local_size << 1;
+						local_size = local_size >> 1;
+					}
+					if(verbosity >= 2) printf("\tEnqueuing commmands for batch #%u (pages %u-%u)...\n",b+1,first_page+1,first_page+slot->num_pages);
+					enqueueCRCDevice(slot->h_input,slot->h_output,global_size,local_size,slot->d_input,slot->d_output,&slot->write_page,&slot->kernel_exec,&slot->read_page);
+					slot->busy = 1;
+					clFlush(write_queue);
+					clFlush(kernel_queue);
+					clFlush(read_queue);
+				}
+				for(b=0; b<num_stream_buffers; b++)
+					errors += retireStreamSlot(&slots[b],run_serial);
+				fclose(fp);
+				gettimeofday(&end,NULL);
+
+				#ifdef ENABLE_TIMER
+					TIMER_STOP
+					TIMER_PRINT
+				#endif
+
+				elapsed = computeTimeDiff(start,end);
+				printf("Streamed %u pages (%llu bytes) in %lld microseconds - %.2f MB/s\n",num_pages,(unsigned long long)num_pages*page_size,(long long)elapsed,elapsed ? ((double)num_pages*page_size)/elapsed : 0.0);
+				if(run_serial)
+					printf("Validated %u pages with serial CRC: %u mismatches\n",num_pages,errors);
+			}
+		}
+		clReleaseKernel(kernel_compute);
+	}
+
+	#ifdef ENABLE_TIMER
+		TIMER_DEST
+	#endif
+	for(b=0; b<num_stream_buffers; b++)
+	{
+		slot = &slots[b];
+		clEnqueueUnmapMemObject(write_queue, slot->pinned_input, slot->h_input, 0, NULL, NULL);
+		clEnqueueUnmapMemObject(read_queue, slot->pinned_output, slot->h_output, 0, NULL, NULL);
+		clFinish(write_queue);
+		clFinish(read_queue);
+		clReleaseMemObject(slot->pinned_input);
+		clReleaseMemObject(slot->pinned_output);
+		clReleaseMemObject(slot->d_input);
+		clReleaseMemObject(slot->d_output);
+	}
+}
+
+//Runs the in-memory input through the kernels once per block size, enqueuing blocks of 'num_parallel_crcs[h]'
+//pages on the write/kernel/read queues
+void runBlocks(unsigned int* h_num, unsigned int num_pages, char** kernel_files, unsigned int num_kernels, unsigned int num_execs, unsigned int run_serial)
+{
+	cl_int err;
+	size_t global_size,local_size;
+	unsigned int h,ii,i,k,l;
+	struct timeval start,end;
+
+	for(h=0; h<num_block_sizes; h++)
+	{
+		if(verbosity) printf("Executing with block size #%u of %u: %u\n",h+1,num_block_sizes,num_parallel_crcs[h]);
+
+		num_blocks = num_pages/num_parallel_crcs[h];
+		if(num_pages % num_parallel_crcs[h] != 0)
+		{
+			num_blocks++;
+			num_pages_last_block = num_pages % num_parallel_crcs[h];
+		}
+		else
+		{
+			num_pages_last_block = num_parallel_crcs[h];
+		}
+
+		if(verbosity) printf("Num Pages: %u - Num Parallel CRCs: %u - Num blocks = %u\n",num_pages,num_parallel_crcs[h],num_blocks);
+		cl_mem dev_input[num_blocks],dev_output[num_blocks];
+		cl_event write_page[num_blocks],kernel_exec[num_blocks],read_page[num_blocks];
+		char* ocl_remainders;
+		ocl_remainders = char_new_array(result_size*num_pages,"crc_algo.runBlocks() - Heap Overflow! Cannot allocate space for ocl_remainders");
+
+		for(i=0; i<num_blocks; i++)
+		{
+			dev_input[i] = clCreateBuffer(context, CL_MEM_READ_ONLY, sizeof(char)*page_size*num_parallel_crcs[h], NULL, &err);
+			CHKERR(err, "Failed to allocate device memory!");
+			dev_output[i] = clCreateBuffer(context, CL_MEM_READ_WRITE, result_size*num_parallel_crcs[h], NULL, &err);
+			CHKERR(err, "Failed to allocate device memory!");
+		}
+
+		for(l=0; l<num_kernels; l++)
+		{
+			if(verbosity) printf("Executing with kernel #%u of %u: %s\n",l+1,num_kernels,kernel_files[l]);
+			setup_device(kernel_files[l]);
+
+			for(k=0; k<num_wg_sizes; k++)
+			{
+				if(verbosity) printf("Executing with Workgroup size #%u of %u: %zu\n",k+1,num_wg_sizes,wg_sizes[k]);
+
+				for(ii=0; ii<num_execs; ii++)
+				{
+					if(verbosity) printf("Beginning execution #%u of %u...\n",ii+1,num_execs);
+
+					#ifdef ENABLE_TIMER
+						TIMER_INIT
+					#endif
+					gettimeofday(&start,NULL);
+					for(i=0; i<num_blocks; i++)
+					{
+						if(verbosity >= 2) printf("\tEnqueuing commmands for block #%d of %d...\n",i+1,num_blocks);
+						if(i == num_blocks -1) //last iteration
+						{
+							global_size = num_pages_last_block;
+							local_size = wg_sizes[k];
+							if((global_size % local_size) != 0)
+							{
+								local_size = 1;
+								while((global_size % local_size) == 0) local_size = local_size << 1;
+								local_size = local_size >> 1;
+							}
+						}
+						else
+						{
+							global_size = num_parallel_crcs[h];
+							local_size = wg_sizes[k];
+						}
+						if(verbosity >= 2) printf("\tmain(): global_size=%zd - local_size=%zd\n",global_size,local_size);
+						enqueueCRCDevice(&h_num[i*num_parallel_crcs[h]*num_words],&ocl_remainders[result_size*i*num_parallel_crcs[h]],global_size,local_size,dev_input[i],dev_output[i],&write_page[i],&kernel_exec[i],&read_page[i]);
+					}
+					clFinish(write_queue);
+					clFinish(kernel_queue);
+					clFinish(read_queue);
+					gettimeofday(&end,NULL);
+					printThroughput("OCL CRC Throughput (H2D + kernel + D2H)",(uint64_t)num_pages*page_size,start,end);
+
+					#ifdef ENABLE_TIMER
+						TIMER_STOP
+					#endif
+
+					for(i=0; i<num_blocks; i++)
+					{
+						if(verbosity >= 2) printf("Parallel Computation: '%llX'\n", (unsigned long long)getResult(ocl_remainders,i));
+
+						START_TIMER(write_page[i], OCD_TIMER_H2D, "CRC Data Copy", ocdTempTimer)
+						END_TIMER(ocdTempTimer)
+						clReleaseEvent(write_page[i]);
+
+						START_TIMER(kernel_exec[i], OCD_TIMER_KERNEL, "CRC Kernel", ocdTempTimer)
+						END_TIMER(ocdTempTimer)
+						clReleaseEvent(kernel_exec[i]);
+
+						START_TIMER(read_page[i], OCD_TIMER_D2H, "CRC Data Copy", ocdTempTimer)
+						END_TIMER(ocdTempTimer)
+						clReleaseEvent(read_page[i]);
+					}
+
+					#ifdef ENABLE_TIMER
+						TIMER_PRINT
+					#endif
+
+					if(run_serial) // verify that we have the correct answer with regular C
+					{
+						printf("Validating results with host CRC...\n");
+						gettimeofday(&start,NULL);
+						crc_host_pool_run(host_pool,host_algo,&engine,h_num,num_pages,page_size,cpu_remainders);
+						gettimeofday(&end,NULL);
+						printf("CPU %s CRC Time (%u threads): ",crc_host_algo_names[host_algo],num_threads);
+						printTimeDiff(start,end);
+						printThroughput("CPU CRC Throughput",(uint64_t)num_pages*page_size,start,end);
+
+						for(i=0; i<num_pages; i++)
+						{
+							if(verbosity >= 3) printf("CPU - %s Computation: '%llX'\n", crc_host_algo_names[host_algo], (unsigned long long)cpu_remainders[i]);
+							if(cpu_remainders[i] != getResult(ocl_remainders,i))
+								fprintf(stderr,"ERROR: OCL and CPU %s remainders for page %u differ [OCL: '%llX', CPU: '%llX']\n",crc_host_algo_names[host_algo],i+1,(unsigned long long)getResult(ocl_remainders,i),(unsigned long long)cpu_remainders[i]);
+						}
+					}
+				}
+			}
+			clReleaseKernel(kernel_compute);
+		}
+
+
+		#ifdef ENABLE_TIMER
+			TIMER_DEST
+		#endif
+		for(i=0; i<num_blocks; i++)
+		{
+			clReleaseMemObject(dev_input[i]);
+			clReleaseMemObject(dev_output[i]);
+		}
+	}
+}
+
 void usage()
 {
-	printf("crc -i <input_file> [hvp] [-r <num_execs>] [-w <wg_size-1>][-w <wg_size-2>]...[-w <wg_size-m>] [-k <kernel_file-1>][-k <kernel_file-2>]...[-k <kernel_file-n>]\n");
+	printf("crc -i <input_file> [hvp] [-r <num_execs>] [-c <chunk_size>] [-t <num_threads>] [-s <batch_pages> [-b <num_buffers>]] [-m <model>] [-H <host_algo>] [-w <wg_size-1>][-w <wg_size-2>]...[-w <wg_size-m>] [-k <kernel_file-1>][-k <kernel_file-2>]...[-k <kernel_file-n>]\n");
 	printf("Common arguments:\n");
 	ocd_usage();
 	printf("Program-specific arguments:\n");
@@ -163,6 +778,12 @@ void usage()
 	printf("\t-r | 'Execute program with same data exactly <num_execs> times to increase sample size - Default is 1\n");
 	printf("\t-w | 'Loop through each kernel execution 'm' times, once with each wg_size-'1..m' - Default is 1 iteration with wg_size set to the maximum possible (limited either by the device or the size of the input)\n");
 	printf("\t-k | 'Test CRC 'n' times, once with each kernel_file-'1..n' - Default is 1 kernel named './crc_kernel.xxx' where xxx is 'aocx' if USE_AFPGA is defined, 'cl' otherwise.\n");
+	printf("\t-c | 'Single-stream mode: treat all pages as one message, CRC it in <chunk_size> byte chunks (multiple of 8) and merge the chunk CRCs with crc32_combine()\n");
+	printf("\t-t | 'Number of host threads used for verification (-a) - Default is the number of online processors\n");
+	printf("\t-s | 'Streaming mode: read the input in batches of <batch_pages> pages instead of loading it into memory\n");
+	printf("\t-b | 'Number of pinned batches in flight in streaming mode (2 = double, 3 = triple buffering) - Default is 3\n");
+	printf("\t-m | 'Use the generic CRC engine with model <model> (crc32, crc32c, crc32-bzip2, crc64-ecma, crc64-xz) - Default is the Ethernet CRC-32 kernel\n");
+	printf("\t-H | 'Host CRC algorithm used for verification (auto, bitwise, slice8, sse42, pclmul) - Default is auto, the fastest one supported by the CPU and model\n");
 
 	printf("\nNOTE: Seperate common arguments and program specific arguments with the '--' delimeter\n");
 	exit(0);
@@ -171,21 +792,20 @@ void usage()
 int main(int argc, char** argv)
 {
 	cl_int err,dev_type;
-	size_t maxSize=DATA_SIZE,global_size,local_size;
+	size_t maxSize=DATA_SIZE;
 	FILE* fp=NULL;
 	void* tmp;
-	unsigned int *h_num,cpu_remainder;
-	unsigned int run_serial=0,seed=time(NULL),h,ii,i,j,k,l,m,num_pages=1,num_execs=1,num_kernels=0;
+	unsigned int *h_num;
+	unsigned int run_serial=0,seed=time(NULL),j,m,num_pages=1,num_execs=1,num_kernels=0;
 	char* file=NULL,*optptr;
 	char** kernel_files=NULL;
 	int c;
-	struct timeval start,end;
 
 	ocd_requirements req;
 	ocd_parse(&argc, &argv);
 	ocd_check_requirements(NULL);
 	
-	while((c = getopt (argc, argv, "avn:s:i:p:w:k:hr:")) != -1)
+	while((c = getopt (argc, argv, "avn:s:i:p:w:k:hr:c:t:b:m:H:")) != -1)
 	{
 		switch(c)
 		{
@@ -247,6 +867,49 @@ int main(int argc, char** argv)
 				kernel_files[num_kernels-1] = optptr;
 				printf("Testing with Kernel File: '%s'\n",kernel_files[num_kernels-1]);
 				break;
+			case 'c':
+				if(optarg != NULL)
+					chunk_size = atoi(optarg);
+				else
+					chunk_size = atoi(argv[optind]);
+				printf("Single-stream mode with %u byte chunks\n",chunk_size);
+				break;
+			case 't':
+				if(optarg != NULL)
+					num_threads = atoi(optarg);
+				else
+					num_threads = atoi(argv[optind]);
+				break;
+			case 's':
+				if(optarg != NULL)
+					stream_pages = atoi(optarg);
+				else
+					stream_pages = atoi(argv[optind]);
+				printf("Streaming mode with %u pages per batch\n",stream_pages);
+				break;
+			case 'b':
+				if(optarg != NULL)
+					num_stream_buffers = atoi(optarg);
+				else
+					num_stream_buffers = atoi(argv[optind]);
+				break;
+			case 'm':
+				if(optarg != NULL)
+					optptr = optarg;
+				else
+					optptr = argv[optind];
+				model = crc_find_model(optptr);
+				check(model != NULL,"-m: unknown CRC model!");
+				printf("Using CRC model '%s'\n",model->name);
+				break;
+			case 'H':
+				if(optarg != NULL)
+					optptr = optarg;
+				else
+					optptr = argv[optind];
+				check(crc_host_find_algo(optptr) >= 0,"-H: unknown host CRC algorithm!");
+				host_algo = crc_host_find_algo(optptr);
+				break;
 			default:
 				fprintf(stderr, "Invalid argument: '%s'\n\n",optarg);
 				usage();
@@ -254,7 +917,16 @@ int main(int argc, char** argv)
 	}
 
 	check(file != NULL,"-i option must be supplied!");
-	h_num = read_crc(&num_pages,&page_size,file);
+	check(!(stream_pages && chunk_size),"-s and -c cannot be combined!");
+	check(!(model && chunk_size),"-m and -c cannot be combined, single-stream mode is CRC-32 only!");
+	if(stream_pages) //only the header is read up front
+	{
+		fp = open_crc(&num_pages,&page_size,file);
+		fclose(fp);
+		h_num = NULL;
+	}
+	else
+		h_num = read_crc(&num_pages,&page_size,file);
 
 	if(!num_block_sizes)
 	{
@@ -266,6 +938,23 @@ int main(int argc, char** argv)
 	num_words = page_size / 4;
 	if(verbosity) printf("num_words = %u\n",num_words);
 
+	if(!num_threads)
+		num_threads = sysconf(_SC_NPROCESSORS_ONLN);
+
+	//generate the Slice-by-8 tables; crc_engine_init() checks them against the model's check value
+	crc_engine_init(&engine,model ? model : crc_find_model("crc32"));
+	if(model)
+		result_size = sizeof(cl_ulong);
+
+	if(run_serial)
+	{
+		host_algo = crc_host_select(host_algo,engine.model);
+		printf("Host CRC algorithm: %s with %u threads\n",crc_host_algo_names[host_algo],num_threads);
+		host_pool = crc_host_pool_create(num_threads);
+		cpu_remainders = malloc(sizeof(uint64_t)*(stream_pages ? stream_pages : num_pages));
+		check(cpu_remainders != NULL,"crc_algo.main() - Heap Overflow! Cannot allocate space for cpu_remainders");
+	}
+
 	ocd_options opts = ocd_get_options();
 	platform_id = opts.platform_id;
 	n_device = opts.device_id;
@@ -303,148 +992,27 @@ int main(int argc, char** argv)
 		#endif
 	}
 
-	for(h=0; h<num_block_sizes; h++)
+	if(model)
 	{
-		if(verbosity) printf("Executing with block size #%u of %u: %u\n",h+1,num_block_sizes,num_parallel_crcs[h]);
-
-		num_blocks = num_pages/num_parallel_crcs[h];
-		if(num_pages % num_parallel_crcs[h] != 0)
-		{
-			num_blocks++;
-			num_pages_last_block = num_pages % num_parallel_crcs[h];
-		}
-		else
-		{
-			num_pages_last_block = num_parallel_crcs[h];
-		}
-
-		if(verbosity) printf("Num Pages: %u - Num Parallel CRCs: %u - Num blocks = %u\n",num_pages,num_parallel_crcs[h],num_blocks);
-		cl_mem dev_input[num_blocks],dev_output[num_blocks];
-		cl_event write_page[num_blocks],kernel_exec[num_blocks],read_page[num_blocks];
-		unsigned int* ocl_remainders;
-		ocl_remainders = int_new_array(num_pages,"crc_algo.main() - Heap Overflow! Cannot allocate space for ocl_remainders");
-
-		for(i=0; i<num_blocks; i++)
-		{
-			dev_input[i] = clCreateBuffer(context, CL_MEM_READ_ONLY, sizeof(char)*page_size*num_parallel_crcs[h], NULL, &err);
-			CHKERR(err, "Failed to allocate device memory!");
-			dev_output[i] = clCreateBuffer(context, CL_MEM_READ_WRITE, sizeof(int)*num_parallel_crcs[h], NULL, &err);
-			CHKERR(err, "Failed to allocate device memory!");
-		}
-
-		for(l=0; l<num_kernels; l++)
-		{
-			if(verbosity) printf("Executing with kernel #%u of %u: %s\n",l+1,num_kernels,kernel_files[l]);
-			setup_device(kernel_files[l]);
-
-			for(k=0; k<num_wg_sizes; k++)
-			{
-				if(verbosity) printf("Executing with Workgroup size #%u of %u: %zu\n",k+1,num_wg_sizes,wg_sizes[k]);
-
-				for(ii=0; ii<num_execs; ii++)
-				{
-					if(verbosity) printf("Beginning execution #%u of %u...\n",ii+1,num_execs);
-
-					#ifdef ENABLE_TIMER
-						TIMER_INIT
-					#endif
-					for(i=0; i<num_blocks; i++)
-					{
-						if(verbosity >= 2) printf("\tEnqueuing commmands for block #%d of %d...\n",i+1,num_blocks);
-						if(i == num_blocks -1) //last iteration
-						{
-							global_size = num_pages_last_block;
-							local_size = wg_sizes[k];
-							if((global_size % local_size) != 0)
-							{
-								local_size = 1;
-								while((global_size % local_size) == 0) local_size = local_size << 1;
-								local_size = local_size >> 1;
-							}
-						}
-						else
-						{
-							global_size = num_parallel_crcs[h];
-							local_size = wg_sizes[k];
-						}
-						if(verbosity >= 2) printf("\tmain(): global_size=%zd - local_size=%zd\n",global_size,local_size);
-						enqueueCRCDevice(&h_num[i*num_parallel_crcs[h]*num_words],&ocl_remainders[i*num_parallel_crcs[h]],global_size,local_size,dev_input[i],dev_output[i],&write_page[i],&kernel_exec[i],&read_page[i]);
-					}
-					clFinish(write_queue);
-					clFinish(kernel_queue);
-					clFinish(read_queue);
-
-					#ifdef ENABLE_TIMER
-						TIMER_STOP
-					#endif
-
-					for(i=0; i<num_blocks; i++)
-					{
-						if(verbosity >= 2) printf("Parallel Computation: '%X'\n", ocl_remainders[i]);
-
-						START_TIMER(write_page[i], OCD_TIMER_H2D, "CRC Data Copy", ocdTempTimer)
-						END_TIMER(ocdTempTimer)
-						clReleaseEvent(write_page[i]);
-
-						START_TIMER(kernel_exec[i], OCD_TIMER_KERNEL, "CRC Kernel", ocdTempTimer)
-						END_TIMER(ocdTempTimer)
-						clReleaseEvent(kernel_exec[i]);
-
-						START_TIMER(read_page[i], OCD_TIMER_D2H, "CRC Data Copy", ocdTempTimer)
-						END_TIMER(ocdTempTimer)
-						clReleaseEvent(read_page[i]);
-					}
-
-					#ifdef ENABLE_TIMER
-						TIMER_PRINT
-					#endif
-
-					if(run_serial) // verify that we have the correct answer with regular C
-					{
-						printf("Validating results with serial CRC...\n");
-//						gettimeofday(&start,NULL);
-//						for(i=0; i<num_pages; i++)
-//						{
-//							cpu_remainder = serialCRC(&h_num[i*num_words], page_size);
-//							if(verbosity >= 2) printf("Bitwise Computation: '%X'\n", cpu_remainder);
-//							if(cpu_remainder != ocl_remainders[i])
-//								fprintf(stderr,"ERROR: OCL and bitwise remainders for page %u differ [OCL: '%X', Bitwise: '%X']\n",i+1,ocl_remainders[i],cpu_remainder);
-//						}
-//						gettimeofday(&end,NULL);
-//						printf("Bitwise CRC Time: ");
-//						printTimeDiff(start,end);
-
-						gettimeofday(&start,NULL);
-						for(i=0; i<num_pages; i++)
-						{
-							cpu_remainder = crc32_8bytes(&h_num[i*num_words], page_size);
-							if(verbosity >= 3) printf("CPU - Slice-by-8 Computation: '%X'\n", cpu_remainder);
-							if(cpu_remainder != ocl_remainders[i])
-								fprintf(stderr,"ERROR: OCL and CPU Slice-by-8 remainders for page %u differ [OCL: '%X', CPU: '%X']\n",i+1,ocl_remainders[i],cpu_remainder);
-						}
-						gettimeofday(&end,NULL);
-						printf("CPU Slice-by-8 CRC Time: ");
-						printTimeDiff(start,end);
-					}
-				}
-			}
-			clReleaseKernel(kernel_compute);
-		}
-
-
-		#ifdef ENABLE_TIMER
-			TIMER_DEST
-		#endif
-		for(i=0; i<num_blocks; i++)
-		{
-			clReleaseMemObject(dev_input[i]);
-			clReleaseMemObject(dev_output[i]);
-		}
+		dev_table = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, sizeof(engine.table), engine.table, &err);
+		CHKERR(err, "Failed to allocate device memory!");
 	}
+
+	if(stream_pages)
+		runStream(file,kernel_files,num_kernels,num_execs,run_serial);
+	else if(chunk_size)
+		runSingleStream(h_num,(uint64_t)num_pages*page_size,kernel_files,num_kernels,num_execs,run_serial);
+	else
+		runBlocks(h_num,num_pages,kernel_files,num_kernels,num_execs,run_serial);
 	clReleaseCommandQueue(write_queue);
 	clReleaseCommandQueue(kernel_queue);
 	clReleaseCommandQueue(read_queue);
+	if(model)
+		clReleaseMemObject(dev_table);
 	clReleaseContext(context);
+	if(host_pool)
+		crc_host_pool_destroy(host_pool);
+	free(cpu_remainders);
 	free(h_num);
 
 	return 0;
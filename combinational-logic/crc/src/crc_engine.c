@@ -0,0 +1,196 @@
+/*Width/polynomial parameterised CRC engine for the combinational-logic dwarf.
+ *
+ * Slice-by-8 tables are generated at startup for the selected model, and the
+ * same tables are handed to the crc_slice8_generic kernel, which is specialised
+ * for the model at build time through -D options.
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "../../../include/common_util.h"
+#include "../inc/crc_engine.h"
+
+const crc_model crc_models[] =
+{
+	/* name             width  poly                 init                 refin refout xorout               check */
+	{"crc32",           32, 0x04C11DB7ULL,         0xFFFFFFFFULL,         1, 1, 0xFFFFFFFFULL,         0xCBF43926ULL},
+	{"crc32c",          32, 0x1EDC6F41ULL,         0xFFFFFFFFULL,         1, 1, 0xFFFFFFFFULL,         0xE3069283ULL},
+	{"crc32-bzip2",     32, 0x04C11DB7ULL,         0xFFFFFFFFULL,         0, 0, 0xFFFFFFFFULL,         0xFC891918ULL},
+	{"crc64-ecma",      64, 0x42F0E1EBA9EA3693ULL, 0x0000000000000000ULL, 0, 0, 0x0000000000000000ULL, 0x6C40DF5F0B497347ULL},
+	{"crc64-xz",        64, 0x42F0E1EBA9EA3693ULL, 0xFFFFFFFFFFFFFFFFULL, 1, 1, 0xFFFFFFFFFFFFFFFFULL, 0x995DC9BBDF1939FAULL},
+	{NULL,0,0,0,0,0,0,0}
+};
+
+static uint64_t crc_mask(unsigned int width)
+{
+	return width == 64 ? ~0ULL : (1ULL << width) - 1;
+}
+
+static uint64_t crc_reflect(uint64_t value,unsigned int width)
+{
+	uint64_t r = 0;
+	unsigned int i;
+	for(i=0; i<width; i++)
+	{
+		r = (r << 1) | (value & 1);
+		value >>= 1;
+	}
+	return r;
+}
+
+const crc_model* crc_find_model(const char* name)
+{
+	const crc_model* m;
+	for(m=crc_models; m->name; m++)
+		if(strcmp(m->name,name) == 0)
+			return m;
+	return NULL;
+}
+
+//Reference bit-at-a-time implementation, straight from the model definition
+uint64_t crc_engine_bitwise(const crc_model* model,const void* data,size_t length)
+{
+	const unsigned char* current = (const unsigned char*) data;
+	uint64_t topbit = 1ULL << (model->width - 1);
+	uint64_t crc = model->init;
+	unsigned int j;
+	unsigned char c;
+
+	while(length--)
+	{
+		c = *current++;
+		if(model->refin)
+			c = (unsigned char) crc_reflect(c,8);
+		crc ^= (uint64_t)c << (model->width - 8);
+		for(j=0; j<8; j++)
+			crc = (crc & topbit) ? (crc << 1) ^ model->poly : crc << 1;
+	}
+	crc &= crc_mask(model->width);
+	if(model->refout)
+		crc = crc_reflect(crc,model->width);
+	return (crc ^ model->xorout) & crc_mask(model->width);
+}
+
+void crc_engine_init(crc_engine* engine,const crc_model* model)
+{
+	unsigned int i,j,k;
+	uint64_t crc,poly;
+	char msg[128];
+
+	check(model->width >= 8 && model->width <= 64,"crc_engine.crc_engine_init() - CRC width must be between 8 and 64 bits");
+	engine->model = model;
+
+	for(i=0; i<256; i++)
+	{
+		if(model->refin)
+		{
+			poly = crc_reflect(model->poly,model->width);
+			crc = i;
+			for(j=0; j<8; j++)
+				crc = (crc & 1) ? (crc >> 1) ^ poly : crc >> 1;
+		}
+		else
+		{
+			poly = model->poly << (64 - model->width);
+			crc = (uint64_t)i << 56;
+			for(j=0; j<8; j++)
+				crc = (crc >> 63) ? (crc << 1) ^ poly : crc << 1;
+		}
+		engine->table[0][i] = crc;
+	}
+
+	for(k=1; k<8; k++)
+		for(i=0; i<256; i++)
+		{
+			crc = engine->table[k-1][i];
+			if(model->refin)
+				engine->table[k][i] = (crc >> 8) ^ engine->table[0][crc & 0xFF];
+			else
+				engine->table[k][i] = (crc << 8) ^ engine->table[0][crc >> 56];
+		}
+
+	snprintf(msg,sizeof(msg),"crc_engine.crc_engine_init() - Generated tables fail the check value of model '%s'",model->name);
+	check(crc_engine_compute(engine,"123456789",9) == model->check,msg);
+	check(crc_engine_bitwise(model,"123456789",9) == model->check,msg);
+}
+
+//Initial register value: bit-reflected for reflected models, left-aligned in 64 bits otherwise
+uint64_t crc_engine_start(const crc_engine* engine)
+{
+	const crc_model* model = engine->model;
+	return model->refin ? crc_reflect(model->init,model->width) : model->init << (64 - model->width);
+}
+
+//Slice-by-8 update of the raw register 'crc'; 'data' is read eight bytes at a time in little-endian order
+uint64_t crc_engine_update(const crc_engine* engine,uint64_t crc,const void* data,size_t length)
+{
+	const unsigned char* current = (const unsigned char*) data;
+	uint64_t (*t)[256] = (uint64_t (*)[256]) engine->table;
+	uint64_t word;
+	unsigned int j;
+
+	if(engine->model->refin)
+	{
+		while(length >= 8)
+		{
+			memcpy(&word,current,8);
+			crc ^= word;
+			crc = t[7][ crc      & 0xFF] ^ t[6][(crc>> 8) & 0xFF] ^
+			      t[5][(crc>>16) & 0xFF] ^ t[4][(crc>>24) & 0xFF] ^
+			      t[3][(crc>>32) & 0xFF] ^ t[2][(crc>>40) & 0xFF] ^
+			      t[1][(crc>>48) & 0xFF] ^ t[0][ crc>>56        ];
+			current += 8;
+			length -= 8;
+		}
+		while(length--)
+			crc = (crc >> 8) ^ t[0][(crc ^ *current++) & 0xFF];
+	}
+	else
+	{
+		while(length >= 8)
+		{
+			word = 0;
+			for(j=0; j<8; j++)
+				word = (word << 8) | current[j];
+			crc ^= word;
+			crc = t[7][ crc>>56        ] ^ t[6][(crc>>48) & 0xFF] ^
+			      t[5][(crc>>40) & 0xFF] ^ t[4][(crc>>32) & 0xFF] ^
+			      t[3][(crc>>24) & 0xFF] ^ t[2][(crc>>16) & 0xFF] ^
+			      t[1][(crc>> 8) & 0xFF] ^ t[0][ crc      & 0xFF];
+			current += 8;
+			length -= 8;
+		}
+		while(length--)
+			crc = (crc << 8) ^ t[0][(crc >> 56) ^ *current++];
+	}
+	return crc;
+}
+
+//Turns a raw register into the final CRC value of the model
+uint64_t crc_engine_finish(const crc_engine* engine,uint64_t crc)
+{
+	const crc_model* model = engine->model;
+
+	if(!model->refin)
+		crc >>= 64 - model->width;
+	if(model->refin != model->refout)
+		crc = crc_reflect(crc,model->width);
+	return (crc ^ model->xorout) & crc_mask(model->width);
+}
+
+uint64_t crc_engine_compute(const crc_engine* engine,const void* data,size_t length)
+{
+	return crc_engine_finish(engine,crc_engine_update(engine,crc_engine_start(engine),data,length));
+}
+
+//-D options that specialise crc_slice8_generic in crc_kernel.cl for this engine's model
+void crc_engine_build_options(const crc_engine* engine,char* options,size_t length)
+{
+	const crc_model* model = engine->model;
+	uint64_t init = crc_engine_start(engine);
+
+	snprintf(options,length,"-DCRC_WIDTH=%u -DCRC_REFIN=%d -DCRC_REFOUT=%d -DCRC_INIT=0x%llXUL -DCRC_XOROUT=0x%llXUL",
+		model->width,model->refin,model->refout,(unsigned long long)init,(unsigned long long)model->xorout);
+}
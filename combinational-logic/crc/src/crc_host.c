@@ -0,0 +1,324 @@
+/*Host CRC baselines for the combinational-logic dwarf.
+ *
+ * Besides the table-driven engine this provides the SSE4.2 crc32 instruction
+ * (CRC-32C) and carry-less multiply folding (CRC-32), selected at runtime from
+ * the CPU's feature flags, and a small thread pool that computes independent
+ * pages in parallel.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "../../../include/common_util.h"
+#include "../inc/crc_host.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CRC_HOST_X86
+#include <nmmintrin.h>
+#include <wmmintrin.h>
+#endif
+
+#define CRC_HOST_PAGES_PER_GRAB 8 //pages a pool thread takes from the shared counter at once
+
+const char* crc_host_algo_names[] = {"auto","bitwise","slice8","sse42","pclmul"};
+
+int crc_host_find_algo(const char* name)
+{
+	int i;
+	for(i=0; i<CRC_HOST_NUM_ALGOS; i++)
+		if(strcmp(crc_host_algo_names[i],name) == 0)
+			return i;
+	return -1;
+}
+
+static int crc_host_is(const crc_model* model,uint64_t poly)
+{
+	return model->width == 32 && model->poly == poly && model->refin && model->refout &&
+	       model->init == 0xFFFFFFFF && model->xorout == 0xFFFFFFFF;
+}
+
+int crc_host_supported(crc_host_algo algo,const crc_model* model)
+{
+	switch(algo)
+	{
+		case CRC_HOST_AUTO:
+		case CRC_HOST_BITWISE:
+		case CRC_HOST_SLICE8:
+			return 1;
+		#ifdef CRC_HOST_X86
+		case CRC_HOST_SSE42:
+			return crc_host_is(model,0x1EDC6F41) && __builtin_cpu_supports("sse4.2");
+		case CRC_HOST_PCLMUL:
+			return crc_host_is(model,0x04C11DB7) && __builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse4.1");
+		#endif
+		default:
+			return 0;
+	}
+}
+
+crc_host_algo crc_host_select(crc_host_algo algo,const crc_model* model)
+{
+	if(algo != CRC_HOST_AUTO)
+	{
+		check(crc_host_supported(algo,model),"crc_host.crc_host_select() - Host CRC algorithm not supported for this model or CPU");
+		return algo;
+	}
+	if(crc_host_supported(CRC_HOST_PCLMUL,model))
+		return CRC_HOST_PCLMUL;
+	if(crc_host_supported(CRC_HOST_SSE42,model))
+		return CRC_HOST_SSE42;
+	return CRC_HOST_SLICE8;
+}
+
+#ifdef CRC_HOST_X86
+//CRC-32C of the raw (reflected) register with the SSE4.2 crc32 instruction
+__attribute__((target("sse4.2")))
+static uint32_t crc_host_sse42(uint32_t crc,const unsigned char* data,size_t length)
+{
+	#ifdef __x86_64__
+	uint64_t crc64 = crc,word;
+	while(length >= 8)
+	{
+		memcpy(&word,data,8);
+		crc64 = _mm_crc32_u64(crc64,word);
+		data += 8;
+		length -= 8;
+	}
+	crc = (uint32_t) crc64;
+	#endif
+	while(length--)
+		crc = _mm_crc32_u8(crc,*data++);
+	return crc;
+}
+
+// /////Carry-less multiply folding for the Ethernet CRC-32///////////////////////
+////////adapted from crc32_sse42_simd_() in Chromium's zlib, after Gopal et al.,////////
+////////"Fast CRC Computation for Generic Polynomials Using PCLMULQDQ Instruction", Intel 2009////////
+//
+//Folds 'length' bytes (at least 64, a multiple of 16) into the raw (reflected) register 'crc'
+__attribute__((target("pclmul,sse4.1")))
+static uint32_t crc_host_pclmul_fold(uint32_t crc,const unsigned char* buf,size_t length)
+{
+	static const uint64_t __attribute__((aligned(16))) k1k2[] = { 0x0154442bd4ULL, 0x01c6e41596ULL };
+	static const uint64_t __attribute__((aligned(16))) k3k4[] = { 0x01751997d0ULL, 0x00ccaa009eULL };
+	static const uint64_t __attribute__((aligned(16))) k5k0[] = { 0x0163cd6124ULL, 0x0000000000ULL };
+	static const uint64_t __attribute__((aligned(16))) poly[] = { 0x01db710641ULL, 0x01f7011641ULL };
+	__m128i x0,x1,x2,x3,x4,x5,x6,x7,x8,y5,y6,y7,y8;
+
+	x1 = _mm_loadu_si128((const __m128i*)(buf + 0x00));
+	x2 = _mm_loadu_si128((const __m128i*)(buf + 0x10));
+	x3 = _mm_loadu_si128((const __m128i*)(buf + 0x20));
+	x4 = _mm_loadu_si128((const __m128i*)(buf + 0x30));
+	x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(crc));
+	x0 = _mm_load_si128((const __m128i*)k1k2);
+	buf += 64;
+	length -= 64;
+
+	while(length >= 64) // fold four 128-bit lanes in parallel
+	{
+		x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+		x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+		x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+		x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+		x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+		x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+		x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+		x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+		y5 = _mm_loadu_si128((const __m128i*)(buf + 0x00));
+		y6 = _mm_loadu_si128((const __m128i*)(buf + 0x10));
+		y7 = _mm_loadu_si128((const __m128i*)(buf + 0x20));
+		y8 = _mm_loadu_si128((const __m128i*)(buf + 0x30));
+		x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), y5);
+		x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), y6);
+		x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), y7);
+		x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), y8);
+		buf += 64;
+		length -= 64;
+	}
+
+	// fold the four lanes into one
+	x0 = _mm_load_si128((const __m128i*)k3k4);
+	x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+	x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+	x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+	while(length >= 16) // single lane folds
+	{
+		x2 = _mm_loadu_si128((const __m128i*)buf);
+		x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+		x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+		x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+		buf += 16;
+		length -= 16;
+	}
+
+	// fold 128 bits to 64 bits
+	x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+	x3 = _mm_setr_epi32(~0, 0, ~0, 0);
+	x1 = _mm_srli_si128(x1, 8);
+	x1 = _mm_xor_si128(x1, x2);
+	x0 = _mm_loadl_epi64((const __m128i*)k5k0);
+	x2 = _mm_srli_si128(x1, 4);
+	x1 = _mm_and_si128(x1, x3);
+	x1 = _mm_clmulepi64_si128(x1, x0, 0x00);
+	x1 = _mm_xor_si128(x1, x2);
+
+	// Barrett reduction to 32 bits
+	x0 = _mm_load_si128((const __m128i*)poly);
+	x2 = _mm_and_si128(x1, x3);
+	x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+	x2 = _mm_and_si128(x2, x3);
+	x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+	x1 = _mm_xor_si128(x1, x2);
+	return (uint32_t) _mm_extract_epi32(x1, 1);
+}
+#endif
+
+uint64_t crc_host_compute(crc_host_algo algo,const crc_engine* engine,const void* data,size_t length)
+{
+	uint64_t crc;
+	size_t head;
+
+	switch(algo)
+	{
+		case CRC_HOST_BITWISE:
+			return crc_engine_bitwise(engine->model,data,length);
+		#ifdef CRC_HOST_X86
+		case CRC_HOST_SSE42:
+			crc = crc_host_sse42((uint32_t) crc_engine_start(engine),data,length);
+			return crc_engine_finish(engine,crc);
+		case CRC_HOST_PCLMUL:
+			crc = crc_engine_start(engine);
+			if(length >= 64)
+			{
+				head = length & ~(size_t)15;
+				crc = crc_host_pclmul_fold((uint32_t) crc,data,head);
+				data = (const unsigned char*) data + head;
+				length -= head;
+			}
+			crc = crc_engine_update(engine,crc,data,length); // tail of less than 16 bytes
+			return crc_engine_finish(engine,crc);
+		#endif
+		default:
+			return crc_engine_compute(engine,data,length);
+	}
+}
+
+// /////Thread pool///////////////////////
+//
+// Workers sleep on 'start' until a new job generation is posted, then take pages from the shared
+// 'next_page' counter until none are left; the last worker to finish signals 'done'.
+
+struct crc_host_pool
+{
+	unsigned int num_threads;
+	pthread_t* threads;
+	pthread_mutex_t lock;
+	pthread_cond_t start,done;
+	unsigned int generation,active;
+	int shutdown;
+
+	crc_host_algo algo;
+	const crc_engine* engine;
+	const unsigned char* pages;
+	unsigned int num_pages,page_size;
+	unsigned int next_page;
+	uint64_t* results;
+};
+
+static void* crc_host_worker(void* arg)
+{
+	crc_host_pool* pool = (crc_host_pool*) arg;
+	unsigned int generation = 0,first,last,i;
+
+	for(;;)
+	{
+		pthread_mutex_lock(&pool->lock);
+		while(pool->generation == generation && !pool->shutdown)
+			pthread_cond_wait(&pool->start,&pool->lock);
+		if(pool->shutdown)
+		{
+			pthread_mutex_unlock(&pool->lock);
+			return NULL;
+		}
+		generation = pool->generation;
+		pthread_mutex_unlock(&pool->lock);
+
+		while((first = __sync_fetch_and_add(&pool->next_page,CRC_HOST_PAGES_PER_GRAB)) < pool->num_pages)
+		{
+			last = MINIMUM(first + CRC_HOST_PAGES_PER_GRAB,pool->num_pages);
+			for(i=first; i<last; i++)
+				pool->results[i] = crc_host_compute(pool->algo,pool->engine,pool->pages + (size_t)i*pool->page_size,pool->page_size);
+		}
+
+		pthread_mutex_lock(&pool->lock);
+		if(--pool->active == 0)
+			pthread_cond_signal(&pool->done);
+		pthread_mutex_unlock(&pool->lock);
+	}
+}
+
+crc_host_pool* crc_host_pool_create(unsigned int num_threads)
+{
+	crc_host_pool* pool;
+	unsigned int t;
+
+	pool = calloc(1,sizeof(crc_host_pool));
+	check(pool != NULL,"crc_host.crc_host_pool_create() - Heap Overflow! Cannot allocate space for pool");
+	pool->num_threads = num_threads ? num_threads : 1;
+	pool->threads = malloc(sizeof(pthread_t)*pool->num_threads);
+	check(pool->threads != NULL,"crc_host.crc_host_pool_create() - Heap Overflow! Cannot allocate space for threads");
+	pthread_mutex_init(&pool->lock,NULL);
+	pthread_cond_init(&pool->start,NULL);
+	pthread_cond_init(&pool->done,NULL);
+
+	for(t=0; t<pool->num_threads; t++)
+		check(pthread_create(&pool->threads[t],NULL,crc_host_worker,pool) == 0,"crc_host.crc_host_pool_create() - Cannot create thread");
+	return pool;
+}
+
+//CRCs 'num_pages' contiguous pages of 'page_size' bytes into 'results', blocking until all are done
+void crc_host_pool_run(crc_host_pool* pool,crc_host_algo algo,const crc_engine* engine,const void* pages,unsigned int num_pages,unsigned int page_size,uint64_t* results)
+{
+	pthread_mutex_lock(&pool->lock);
+	pool->algo = algo;
+	pool->engine = engine;
+	pool->pages = (const unsigned char*) pages;
+	pool->num_pages = num_pages;
+	pool->page_size = page_size;
+	pool->next_page = 0;
+	pool->results = results;
+	pool->active = pool->num_threads;
+	pool->generation++;
+	pthread_cond_broadcast(&pool->start);
+	while(pool->active)
+		pthread_cond_wait(&pool->done,&pool->lock);
+	pthread_mutex_unlock(&pool->lock);
+}
+
+void crc_host_pool_destroy(crc_host_pool* pool)
+{
+	unsigned int t;
+
+	pthread_mutex_lock(&pool->lock);
+	pool->shutdown = 1;
+	pthread_cond_broadcast(&pool->start);
+	pthread_mutex_unlock(&pool->lock);
+	for(t=0; t<pool->num_threads; t++)
+		pthread_join(pool->threads[t],NULL);
+
+	pthread_mutex_destroy(&pool->lock);
+	pthread_cond_destroy(&pool->start);
+	pthread_cond_destroy(&pool->done);
+	free(pool->threads);
+	free(pool);
+}
@@ -6,20 +6,18 @@
 
 #include "../combinational-logic/crc/inc/eth_crc32_lut.h"
 
-__kernel void crc32_slice8(	__global const uint* restrict data, 
-							uint length_bytes, 
-							const uint length_ints,
-							__global uint* restrict res)
+#define CRC32_POLYNOMIAL 0xEDB88320
+
+// Slice-by-8 CRC of 'length_bytes' bytes starting at word 'i' of 'data'
+uint crc32_slice8_block(__global const uint* restrict data, size_t i, uint length_bytes)
 {
   __private uint crc;
   __private uchar* currentChar;
   __private uint one,two;
-  __private size_t i,j,gid;
-  
+  __private size_t j;
+
   crc = 0xFFFFFFFF;
-  gid = get_global_id(0);
-  i = gid * length_ints;
-  
+
   while (length_bytes >= 8) // process eight bytes at once
   {
     one = data[i++] ^ crc;
@@ -48,5 +46,232 @@ __kernel void crc32_slice8(	__global const uint* restrict data,
 	  }
   }
 
-  res[gid] = ~crc;
+  return ~crc;
+}
+
+__kernel void crc32_slice8(	__global const uint* restrict data, 
+							uint length_bytes, 
+							const uint length_ints,
+							__global uint* restrict res)
+{
+  __private size_t gid;
+
+  gid = get_global_id(0);
+  res[gid] = crc32_slice8_block(data, gid * length_ints, length_bytes);
+}
+
+/*
+** Single-stream mode
+**
+** One large message is split into 'chunk_bytes' sized chunks whose CRCs are computed
+** independently and then merged pairwise with crc32_combine(), i.e.
+** CRC(A|B) = CRC(A) * x^(8*len(B)) mod P  xor  CRC(B).
+** The powers x^(2^k) mod P are precomputed on the host and passed in 'x2n_table'.
+*/
+
+// Multiply a and b modulo the CRC polynomial (bit-reflected representation)
+uint crc32_multmodp(uint a, uint b)
+{
+  __private uint m,p;
+
+  m = 1u << 31;
+  p = 0;
+  for (;;)
+  {
+    if (a & m)
+    {
+      p ^= b;
+      if ((a & (m - 1)) == 0)
+        break;
+    }
+    m >>= 1;
+    b = (b & 1) ? (b >> 1) ^ CRC32_POLYNOMIAL : b >> 1;
+  }
+  return p;
+}
+
+// x^(8*n) mod P, i.e. the operator that shifts a CRC over n zero bytes
+uint crc32_x8nmodp(ulong n, __constant uint* x2n_table)
+{
+  __private uint p;
+  __private int k;
+
+  p = 1u << 31; // x^0
+  k = 3;
+  while (n)
+  {
+    if (n & 1)
+      p = crc32_multmodp(x2n_table[k], p);
+    n >>= 1;
+    k++;
+  }
+  return p;
+}
+
+uint crc32_combine(uint crc1, uint crc2, ulong len2, __constant uint* x2n_table)
+{
+  return crc32_multmodp(crc32_x8nmodp(len2, x2n_table), crc1) ^ crc2;
+}
+
+__kernel void crc32_slice8_chunk(	__global const uint* restrict data,
+									const ulong length_bytes,
+									const uint chunk_bytes,
+									const uint num_chunks,
+									__global uint* restrict res,
+									__global ulong* restrict res_len)
+{
+  __private size_t gid;
+  __private ulong offset;
+  __private uint len;
+
+  gid = get_global_id(0);
+  if (gid >= num_chunks)
+    return;
+
+  offset = (ulong)gid * chunk_bytes;
+  len = (length_bytes - offset < chunk_bytes) ? (uint)(length_bytes - offset) : chunk_bytes;
+  res[gid] = crc32_slice8_block(data, offset / 4, len);
+  res_len[gid] = len;
+}
+
+// Ordered work-group reduction of (crc,length) pairs, one partial result per work-group
+__kernel void crc32_combine_reduce(	__global const uint* restrict crc_in,
+									__global const ulong* restrict len_in,
+									const uint n,
+									__constant uint* x2n_table,
+									__global uint* restrict crc_out,
+									__global ulong* restrict len_out,
+									__local uint* l_crc,
+									__local ulong* l_len)
+{
+  __private size_t gid,lid,lsize,s;
+
+  gid = get_global_id(0);
+  lid = get_local_id(0);
+  lsize = get_local_size(0);
+
+  // empty (crc=0,len=0) entries are the identity of crc32_combine()
+  l_crc[lid] = (gid < n) ? crc_in[gid] : 0;
+  l_len[lid] = (gid < n) ? len_in[gid] : 0;
+  barrier(CLK_LOCAL_MEM_FENCE);
+
+  // interleaved addressing keeps the left/right order that crc32_combine() depends on
+  for (s = 1; s < lsize; s <<= 1)
+  {
+    if ((lid % (2*s)) == 0 && lid + s < lsize)
+    {
+      l_crc[lid] = crc32_combine(l_crc[lid], l_crc[lid+s], l_len[lid+s], x2n_table);
+      l_len[lid] += l_len[lid+s];
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+  }
+
+  if (lid == 0)
+  {
+    crc_out[get_group_id(0)] = l_crc[0];
+    len_out[get_group_id(0)] = l_len[0];
+  }
+}
+
+/*
+** Generic CRC engine
+**
+** Slice-by-8 CRC for any width/polynomial/reflection model. The tables are generated on the host
+** (crc_engine.c) and passed in 'table' as ulong[8][256]; the rest of the model is fixed at build time.
+** CRC_INIT is the initial register value: bit-reflected for reflected models, left-aligned in
+** 64 bits otherwise. Without -D options the kernel computes the Ethernet CRC-32.
+*/
+
+#ifndef CRC_WIDTH
+#define CRC_WIDTH 32
+#define CRC_REFIN 1
+#define CRC_REFOUT 1
+#define CRC_INIT 0xFFFFFFFFUL
+#define CRC_XOROUT 0xFFFFFFFFUL
+#endif
+
+#if CRC_WIDTH == 64
+#define CRC_MASK 0xFFFFFFFFFFFFFFFFUL
+#else
+#define CRC_MASK ((1UL << CRC_WIDTH) - 1)
+#endif
+
+ulong crc_reflect(ulong value, uint width)
+{
+  __private ulong r;
+  __private uint i;
+
+  r = 0;
+  for (i = 0; i < width; i++)
+  {
+    r = (r << 1) | (value & 1);
+    value >>= 1;
+  }
+  return r;
+}
+
+uint crc_bswap32(uint x)
+{
+  return (x >> 24) | ((x >> 8) & 0xFF00) | ((x << 8) & 0xFF0000) | (x << 24);
+}
+
+__kernel void crc_slice8_generic(	__global const uint* restrict data,
+									uint length_bytes,
+									const uint length_ints,
+									__global ulong* restrict res,
+									__constant ulong* restrict table)
+{
+  __private ulong crc,word;
+  __private uint one;
+  __private size_t i,j,gid;
+
+  crc = CRC_INIT;
+  gid = get_global_id(0);
+  i = gid * length_ints;
+
+#if CRC_REFIN
+  while (length_bytes >= 8) // process eight bytes at once
+  {
+    word = (ulong)data[i] | ((ulong)data[i+1] << 32);
+    i += 2;
+    crc ^= word;
+    crc = table[7*256 + ( crc      & 0xFF)] ^ table[6*256 + ((crc>> 8) & 0xFF)] ^
+          table[5*256 + ((crc>>16) & 0xFF)] ^ table[4*256 + ((crc>>24) & 0xFF)] ^
+          table[3*256 + ((crc>>32) & 0xFF)] ^ table[2*256 + ((crc>>40) & 0xFF)] ^
+          table[1*256 + ((crc>>48) & 0xFF)] ^ table[          crc>>56         ];
+    length_bytes -= 8;
+  }
+
+  while (length_bytes) // remaining 1 to 7 bytes
+  {
+    one = data[i++];
+    for (j = 0; length_bytes && j < 4; j++, length_bytes--)
+      crc = (crc >> 8) ^ table[(crc ^ (one >> (8*j))) & 0xFF];
+  }
+#else
+  while (length_bytes >= 8) // process eight bytes at once, most significant byte first
+  {
+    word = ((ulong)crc_bswap32(data[i]) << 32) | crc_bswap32(data[i+1]);
+    i += 2;
+    crc ^= word;
+    crc = table[7*256 + ( crc>>56        )] ^ table[6*256 + ((crc>>48) & 0xFF)] ^
+          table[5*256 + ((crc>>40) & 0xFF)] ^ table[4*256 + ((crc>>32) & 0xFF)] ^
+          table[3*256 + ((crc>>24) & 0xFF)] ^ table[2*256 + ((crc>>16) & 0xFF)] ^
+          table[1*256 + ((crc>> 8) & 0xFF)] ^ table[          crc      & 0xFF ];
+    length_bytes -= 8;
+  }
+
+  while (length_bytes) // remaining 1 to 7 bytes
+  {
+    one = data[i++];
+    for (j = 0; length_bytes && j < 4; j++, length_bytes--)
+      crc = (crc << 8) ^ table[(crc >> 56) ^ ((one >> (8*j)) & 0xFF)];
+  }
+  crc >>= 64 - CRC_WIDTH;
+#endif
+
+#if CRC_REFIN != CRC_REFOUT
+  crc = crc_reflect(crc, CRC_WIDTH);
+#endif
+  res[gid] = (crc ^ CRC_XOROUT) & CRC_MASK;
 }
@@ -11,8 +11,14 @@ kmeans_SOURCES = dense-linear-algebra/kmeans/kmeans.c \
 	dense-linear-algebra/kmeans/cluster.c \
 	dense-linear-algebra/kmeans/getopt.c \
 	dense-linear-algebra/kmeans/kmeans_clustering.c \
+	dense-linear-algebra/kmeans/kmeans_cpu.c \
+	dense-linear-algebra/kmeans/kmeans_minibatch.c \
 	dense-linear-algebra/kmeans/kmeans_opencl.cpp \
+	dense-linear-algebra/kmeans/kmeans_seed.c \
+	dense-linear-algebra/kmeans/kmeans_sweep.c \
 	dense-linear-algebra/kmeans/rmse.c
+kmeans_CFLAGS = $(OPENMP_CFLAGS)
+kmeans_LDFLAGS = $(OPENMP_CFLAGS) @SEARCHFLAGS@ @LIBFLAGS@ @RPATHFLAGS@
 
 all_local += kmeans-all-local
 exec_local += kmeans-exec-local
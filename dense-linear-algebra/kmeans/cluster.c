@@ -94,7 +94,7 @@ int cluster(int      npoints,				/* number of data points */
 {    
 	int		nclusters;						/* number of clusters k */	
 	int		index =0;						/* number of iteration to reach the best RMSE */
-	int		rmse;							/* RMSE for each clustering */
+	float	rmse;							/* RMSE for each clustering */
     int    *membership;						/* which cluster a data point belongs to */
     float **tmp_cluster_centres;			/* hold coordinates of cluster centers */
 	int		i;
@@ -108,7 +108,10 @@ int cluster(int      npoints,				/* number of data points */
 		if (nclusters > npoints) break;	/* cannot have more clusters than points */
 
 		/* allocate device memory, invert data array (@ kmeans_cuda.cu) */
-		allocateMemory(npoints, nfeatures, nclusters, features);
+		if (kmeans_host)
+			allocateHostMemory(npoints, nfeatures, nclusters);
+		else
+			allocateMemory(npoints, nfeatures, nclusters, features);
 
 		/* iterate nloops times for each number of clusters */
 		for(i = 0; i < nloops; i++)
@@ -146,7 +149,10 @@ int cluster(int      npoints,				/* number of data points */
 			}			
 		}
 		
-		deallocateMemory();							/* free device memory (@ kmeans_cuda.cu) */
+		if (kmeans_host)
+			deallocateHostMemory();
+		else
+			deallocateMemory();						/* free device memory (@ kmeans_cuda.cu) */
 	}
 
     free(membership);
@@ -85,6 +85,12 @@ extern double wtime(void);
 extern int platform_id;
 extern int device_id; 
 
+int kmeans_assign = KMEANS_ASSIGN_AUTO;
+int kmeans_host = 0;
+int kmeans_resident = 0;
+int kmeans_seed = KMEANS_SEED_FIRST;
+int kmeans_sweep_jobs = 0;
+
 
 /*---< usage() >------------------------------------------------------------*/
 void usage(char *argv0) {
@@ -97,13 +103,34 @@ void usage(char *argv0) {
 		"    -l nloops        :iteration for each number of clusters [default=1]\n"
 		"    -b               :input file is in binary format\n"
         "    -r               :calculate RMSE                        [default=off]\n"
-		"    -o               :output cluster center coordinates     [default=off]\n  "
+		"    -o               :output cluster center coordinates     [default=off]\n"
+		"    -a algorithm     :naive, hamerly, gemm or auto          [default=auto]\n"
+		"    -c               :cluster on the host (OpenMP)          [default=off]\n"
+		"    -g               :keep the iteration loop on the device [default=off]\n"
+		"    -B batch         :mini-batch mode, points per batch     [default=off]\n"
+		"    -e npasses       :passes over the file in -B mode       [default=1]\n"
+		"    -s seeding       :initial centres: first or parallel    [default=first]\n"
+		"    -S njobs         :sweep k with njobs concurrent jobs    [default=off]\n  "
 	"  -p               :platform\n   "
 	" -d               :device\n";
     fprintf(stderr, help, argv0);
     exit(-1);
 }
 
+/*---< print_centres() >----------------------------------------------------*/
+static void print_centres(float **cluster_centres, int nclusters, int nfeatures) {
+	int i, j;
+
+	printf("\n================= Centroid Coordinates =================\n");
+	for(i = 0; i < nclusters; i++){
+		printf("%d:", i);
+		for(j = 0; j < nfeatures; j++){
+			printf(" %.2f", cluster_centres[i][j]);
+		}
+		printf("\n\n");
+	}
+}
+
 /*---< main() >-------------------------------------------------------------*/
 int setup(int argc, char **argv) {
 		int		opt;
@@ -130,6 +157,8 @@ int setup(int argc, char **argv) {
 		float	rmse;
 		
 		int		isOutput = 0;
+		int		batch_size = 0;			/* mini-batch mode when > 0 */
+		int		npasses = 1;
 		//float	cluster_timing, io_timing;		
 
 	ocd_init(&argc, &argv, NULL);
@@ -138,7 +167,7 @@ int setup(int argc, char **argv) {
 	device_id = opts.device_id;
 		
 		/* obtain command line arguments and change appropriate options */
-		while ( (opt=getopt(argc,argv,"i:t:m:n:l:bro"))!= EOF) {
+		while ( (opt=getopt(argc,argv,"i:t:m:n:l:broa:cgB:e:s:S:"))!= EOF) {
         switch (opt) {
             case 'i': filename=optarg;
                       break;
@@ -156,6 +185,34 @@ int setup(int argc, char **argv) {
 					  break;
 		    case 'l': nloops = atoi(optarg);
 					  break;
+			case 'a': if (strcmp(optarg, "naive") == 0)
+						  kmeans_assign = KMEANS_ASSIGN_NAIVE;
+					  else if (strcmp(optarg, "hamerly") == 0)
+						  kmeans_assign = KMEANS_ASSIGN_HAMERLY;
+					  else if (strcmp(optarg, "gemm") == 0)
+						  kmeans_assign = KMEANS_ASSIGN_GEMM;
+					  else if (strcmp(optarg, "auto") == 0)
+						  kmeans_assign = KMEANS_ASSIGN_AUTO;
+					  else
+						  usage(argv[0]);
+					  break;
+			case 'c': kmeans_host = 1;
+					  break;
+			case 'g': kmeans_resident = 1;
+					  break;
+			case 'B': batch_size = atoi(optarg);
+					  break;
+			case 'e': npasses = atoi(optarg);
+					  break;
+			case 'S': kmeans_sweep_jobs = atoi(optarg);
+					  break;
+			case 's': if (strcmp(optarg, "first") == 0)
+						  kmeans_seed = KMEANS_SEED_FIRST;
+					  else if (strcmp(optarg, "parallel") == 0)
+						  kmeans_seed = KMEANS_SEED_PARALLEL;
+					  else
+						  usage(argv[0]);
+					  break;
             case '?': usage(argv[0]);
                       break;
             default: usage(argv[0]);
@@ -164,6 +221,38 @@ int setup(int argc, char **argv) {
     }
 
     if (filename == 0) usage(argv[0]);
+	if (kmeans_resident && (kmeans_host || kmeans_assign == KMEANS_ASSIGN_HAMERLY ||
+							kmeans_assign == KMEANS_ASSIGN_GEMM)) {
+		fprintf(stderr, "Error: -g runs naive assignment on the device only\n");
+		exit(1);
+	}
+	if (kmeans_sweep_jobs && (kmeans_host || kmeans_resident || batch_size > 0 ||
+							  kmeans_assign == KMEANS_ASSIGN_HAMERLY ||
+							  kmeans_assign == KMEANS_ASSIGN_GEMM)) {
+		fprintf(stderr, "Error: -S runs naive assignment on the device only, without -g or -B\n");
+		exit(1);
+	}
+
+	/* ============== mini-batch: stream the file, never load it ==============*/
+	if (batch_size > 0) {
+		if (min_nclusters != max_nclusters || kmeans_resident ||
+			kmeans_assign == KMEANS_ASSIGN_HAMERLY || kmeans_assign == KMEANS_ASSIGN_GEMM ||
+			kmeans_seed != KMEANS_SEED_FIRST || npasses < 1) {
+			fprintf(stderr, "Error: -B takes a single k (-m == -n), at least one pass, and no -g, -a or -s\n");
+			exit(1);
+		}
+		if (!kmeans_host)
+			initCL();
+		cluster_centres = minibatch_cluster(filename, isBinaryFile, max_nclusters,
+											batch_size, npasses, &nfeatures, &rmse, isRMSE);
+		if (isOutput == 1)
+			print_centres(cluster_centres, max_nclusters, nfeatures);
+		if (isRMSE)
+			printf("Root Mean Squared Error: %.3f\n", rmse);
+		free(cluster_centres[0]);
+		free(cluster_centres);
+		return(0);
+	}
 		
 	/* ============== I/O begin ==============*/
     /* get nfeatures and npoints */
@@ -243,13 +332,15 @@ int setup(int argc, char **argv) {
 
     /* ============ Initialize OpenCL Environment ============ */
 
-    initCL();
+    if (!kmeans_host)
+        initCL();
 
 	/* ======================= core of the clustering ===================*/
 
     //cluster_timing = omp_get_wtime();		/* Total clustering time */
 	cluster_centres = NULL;
-    index = cluster(npoints,				/* number of data points */
+    index = (kmeans_sweep_jobs > 0 ? cluster_sweep : cluster)(
+					npoints,				/* number of data points */
 					nfeatures,				/* number of features for each point */
 					features,				/* array: [npoints][nfeatures] */
 					min_nclusters,			/* range of min to max number of clusters */
@@ -268,16 +359,8 @@ int setup(int argc, char **argv) {
 
 	/* cluster center coordinates
 	   :displayed only for when k=1*/
-	if((min_nclusters == max_nclusters) && (isOutput == 1)) {
-		printf("\n================= Centroid Coordinates =================\n");
-		for(i = 0; i < max_nclusters; i++){
-			printf("%d:", i);
-			for(j = 0; j < nfeatures; j++){
-				printf(" %.2f", cluster_centres[i][j]);
-			}
-			printf("\n\n");
-		}
-	}
+	if((min_nclusters == max_nclusters) && (isOutput == 1))
+		print_centres(cluster_centres, max_nclusters, nfeatures);
 	
 	len = (float) ((max_nclusters - min_nclusters + 1)*nloops);
 
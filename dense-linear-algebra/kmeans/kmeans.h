@@ -44,6 +44,51 @@
 #define FLT_MAX 3.40282347e+38
 #endif
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* nearest-centre assignment algorithms (-a) */
+enum {
+	KMEANS_ASSIGN_NAIVE = 0,		/* every point against every centre */
+	KMEANS_ASSIGN_HAMERLY,			/* skip points whose bounds prove no change */
+	KMEANS_ASSIGN_GEMM,				/* ||c||^2 - 2 X.C^T as a tiled matrix multiply */
+	KMEANS_ASSIGN_AUTO				/* gemm for wide data and many centres, else naive */
+};
+
+/* -a auto picks gemm from this many features and clusters on */
+#define KMEANS_GEMM_MIN_FEATURES	64
+#define KMEANS_GEMM_MIN_CLUSTERS	16
+
+/* initial centres (-s) */
+enum {
+	KMEANS_SEED_FIRST = 0,			/* the first nclusters points */
+	KMEANS_SEED_PARALLEL			/* k-means|| */
+};
+
+extern int		kmeans_assign;			/* one of KMEANS_ASSIGN_* */
+extern int		kmeans_host;			/* cluster on the host instead of the device */
+extern int		kmeans_resident;		/* run the whole iteration loop on the device */
+extern int		kmeans_seed;			/* one of KMEANS_SEED_* */
+extern int		kmeans_sweep_jobs;		/* concurrent (k, restart) jobs, 0 = serial */
+
+/* per-iteration centre state shared by the Hamerly assignment paths */
+typedef struct {
+	float  *prev;					/* [nclusters*nfeatures] centres of the previous iteration */
+	float  *bounds;					/* [2*nclusters] distance moved, then half separation */
+	int		max_move_id;			/* centre that moved furthest */
+	float	max_move;				/* its distance moved */
+	float	second_move;			/* largest move of any other centre */
+} hamerly_centres;
+
+/* batch reader for the mini-batch mode (-B) */
+typedef struct {
+	FILE   *fp;
+	int		binary;
+	int		nfeatures;
+	char   *line;
+} kmeans_stream;
+
 /* rmse.c */
 float   euclid_dist_2        (float*, float*, int);
 int     find_nearest_point   (float* , int, float**, int);
@@ -55,4 +100,51 @@ int     cluster(int, int, float**, int, int, float, int*, float***, float*, int,
 /* kmeans_clustering.c */
 float **kmeans_clustering(float**, int, int, int, float, int*);
 
+/* kmeans_cpu.c */
+void	allocateHostMemory	 (int, int, int);
+void	deallocateHostMemory (void);
+int		kmeansCPU			 (float**, int, int, int, int*, float**, int*, float**);
+int		kmeans_assign_for	 (int, int);
+void	hamerly_alloc		 (hamerly_centres*, int, int);
+void	hamerly_free		 (hamerly_centres*);
+void	hamerly_update		 (hamerly_centres*, float**, int, int);
+
+/* kmeans_minibatch.c */
+int		stream_open			 (kmeans_stream*, const char*, int);
+int		stream_read			 (kmeans_stream*, float*, int);
+void	stream_rewind		 (kmeans_stream*);
+void	stream_close		 (kmeans_stream*);
+float **minibatch_cluster	 (const char*, int, int, int, int, int*, float*, int);
+
+/* kmeans_seed.c */
+void	kmeans_parallel_seed (float**, int, int, int, float**);
+
+/* kmeans_sweep.c */
+int     cluster_sweep(int, int, float**, int, int, float, int*, float***, float*, int, int);
+
+/* kmeans_opencl.cpp */
+void	initCL				 (void);
+void	allocateMemory		 (int, int, int, float**);
+void	deallocateMemory	 (void);
+int		kmeansCuda			 (float**, int, int, int, int*, float**, int*, float**);
+int		kmeansResident		 (int, int, int, float, int*, float**);
+void	minibatchAllocate	 (int, int, int);
+void	minibatchDeallocate	 (void);
+void	minibatchUpload		 (int, float*, int, int);
+void	minibatchEnqueueAssign(int, int, int, int, float**, int*);
+void	minibatchWaitAssign	 (void);
+void	seedAllocate		 (int, int, int, int);
+void	seedDeallocate		 (void);
+float	seedUpdate			 (float*, int, int, int, int);
+int		seedSample			 (float, unsigned int, int*, int, int);
+void	seedWeights			 (int*, int, int);
+void	sweepOpen			 (int, int, int, int);
+void	sweepClose			 (void);
+void	sweepEnqueue		 (int, int, int, int, float**);
+int		sweepWait			 (int, float**, int, int, int*, int*, float**);
+
+#ifdef __cplusplus
+}
+#endif
+
 #endif
@@ -106,28 +106,32 @@ float** kmeans_clustering(float **feature,    /* in: [npoints][nfeatures] */
     for (i=1; i<nclusters; i++)
         clusters[i] = clusters[i-1] + nfeatures;
 
-	/* initialize the random clusters */
-	initial = (int *) malloc (npoints * sizeof(int));
-	for (i = 0; i < npoints; i++)
-	{
-		initial[i] = i;
-	}
-	initial_points = npoints;
+    /* initialize the random clusters */
+    initial = (int *) malloc (npoints * sizeof(int));
+    for (i = 0; i < npoints; i++)
+    {
+        initial[i] = i;
+    }
+    initial_points = npoints;
 
     /* randomly pick cluster centers */
-    for (i=0; i<nclusters && initial_points >= 0; i++) {
-		//n = (int)rand() % initial_points;		
-		
-        for (j=0; j<nfeatures; j++)
-            clusters[i][j] = feature[initial[n]][j];	// remapped
-
-		/* swap the selected index to the end (not really necessary,
-		   could just move the end up) */
-		temp = initial[n];
-		initial[n] = initial[initial_points-1];
-		initial[initial_points-1] = temp;
-		initial_points--;
-		n++;
+    if (kmeans_seed == KMEANS_SEED_PARALLEL)
+		kmeans_parallel_seed(feature, nfeatures, npoints, nclusters, clusters);
+    else {
+        for (i=0; i<nclusters && initial_points >= 0; i++) {
+            //n = (int)rand() % initial_points;		
+
+            for (j=0; j<nfeatures; j++)
+                clusters[i][j] = feature[initial[n]][j];	// remapped
+
+            /* swap the selected index to the end (not really necessary,
+               could just move the end up) */
+            temp = initial[n];
+            initial[n] = initial[initial_points-1];
+            initial[initial_points-1] = temp;
+            initial_points--;
+            n++;
+        }
     }
 
 	/* initialize the membership to -1 for all */
@@ -142,11 +146,14 @@ float** kmeans_clustering(float **feature,    /* in: [npoints][nfeatures] */
     for (i=1; i<nclusters; i++)
         new_centers[i] = new_centers[i-1] + nfeatures;
 
-	/* iterate until convergence */
-	do {
+    /* iterate until convergence */
+    if (kmeans_resident)
+        c = kmeansResident(nfeatures, npoints, nclusters, threshold, membership, clusters);
+    else do {
         delta = 0.0;
 		// CUDA
-		delta = (float) kmeansCuda(feature,			/* in: [npoints][nfeatures] */
+		delta = (float) (kmeans_host ? kmeansCPU : kmeansCuda)(
+								   feature,			/* in: [npoints][nfeatures] */
 								   nfeatures,		/* number of attributes for each point */
 								   npoints,			/* number of data points */
 								   nclusters,		/* number of clusters */
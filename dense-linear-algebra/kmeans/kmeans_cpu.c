@@ -0,0 +1,324 @@
+/*************************************************************************/
+/**   File:         kmeans_cpu.c                                        **/
+/**   Description:  Host (OpenMP) implementation of the nearest-centre  **/
+/**                 assignment step, with the same interface as         **/
+/**                 kmeansCuda() in kmeans_opencl.cpp, and the centre   **/
+/**                 bookkeeping shared by both Hamerly paths.           **/
+/*************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+#include <math.h>
+#include <omp.h>
+
+#include "kmeans.h"
+
+static int		*membership_new;		/* newly assigned membership */
+static float	*upper;					/* [npoints] Hamerly upper bounds */
+static float	*lower;					/* [npoints] Hamerly lower bounds */
+static hamerly_centres hc;
+
+static float	*centre_norms;			/* [nclusters] for the gemm assignment */
+
+static long long dist_evals;			/* distances actually computed */
+static long long dist_total;			/* distances a full scan would compute */
+
+static float dist_2(const float *a, const float *b, int nfeatures)
+{
+	int   i;
+	float ans = 0.0;
+
+	for (i = 0; i < nfeatures; i++)
+		ans += (a[i]-b[i]) * (a[i]-b[i]);
+	return ans;
+}
+
+/*----< kmeans_assign_for() >-----------------------------------------------*/
+/* resolves -a auto for a given problem shape: the matrix-multiply form
+   only pays off once there are enough features to amortise staging the
+   tiles and enough centres to fill them */
+int kmeans_assign_for(int nfeatures, int nclusters)
+{
+	if (kmeans_assign != KMEANS_ASSIGN_AUTO)
+		return kmeans_assign;
+	if (nfeatures >= KMEANS_GEMM_MIN_FEATURES && nclusters >= KMEANS_GEMM_MIN_CLUSTERS)
+		return KMEANS_ASSIGN_GEMM;
+	return KMEANS_ASSIGN_NAIVE;
+}
+
+/*----< hamerly_alloc() >---------------------------------------------------*/
+void hamerly_alloc(hamerly_centres *h, int nclusters, int nfeatures)
+{
+	h->prev   = (float*) calloc(nclusters * nfeatures, sizeof(float));
+	h->bounds = (float*) calloc(2 * nclusters, sizeof(float));
+	h->max_move_id = 0;
+	h->max_move = h->second_move = 0.0;
+}
+
+void hamerly_free(hamerly_centres *h)
+{
+	free(h->prev);
+	free(h->bounds);
+}
+
+/*----< hamerly_update() >--------------------------------------------------*/
+/* record how far each centre moved since the last call, and half the
+   distance from each centre to its nearest neighbour, then remember the
+   current centres. The moves are meaningless on the first iteration of a
+   run, but every point then has membership -1 and is fully scanned. */
+void hamerly_update(hamerly_centres *h, float **clusters, int nclusters, int nfeatures)
+{
+	float *moves    = h->bounds;
+	float *half_sep = h->bounds + nclusters;
+	int    i, j;
+
+	h->max_move_id = 0;
+	h->max_move = h->second_move = 0.0;
+	for (i = 0; i < nclusters; i++) {
+		moves[i] = sqrtf(dist_2(clusters[i], h->prev + i*nfeatures, nfeatures));
+		if (moves[i] > h->max_move) {
+			h->second_move = h->max_move;
+			h->max_move    = moves[i];
+			h->max_move_id = i;
+		}
+		else if (moves[i] > h->second_move)
+			h->second_move = moves[i];
+	}
+
+	#pragma omp parallel for private(j) schedule(static)
+	for (i = 0; i < nclusters; i++) {
+		float min_dist = FLT_MAX;
+		for (j = 0; j < nclusters; j++) {
+			float dist;
+			if (j == i) continue;
+			dist = dist_2(clusters[i], clusters[j], nfeatures);
+			if (dist < min_dist)
+				min_dist = dist;
+		}
+		half_sep[i] = 0.5f * sqrtf(min_dist);
+	}
+
+	memcpy(h->prev, clusters[0], nclusters*nfeatures*sizeof(float));
+}
+
+/*----< allocateHostMemory() >----------------------------------------------*/
+void allocateHostMemory(int npoints, int nfeatures, int nclusters)
+{
+	int i;
+
+	membership_new = (int*) malloc(npoints * sizeof(int));
+	for (i = 0; i < npoints; i++)
+		membership_new[i] = -1;
+
+	if (kmeans_assign == KMEANS_ASSIGN_HAMERLY) {
+		upper = (float*) malloc(npoints * sizeof(float));
+		lower = (float*) malloc(npoints * sizeof(float));
+		hamerly_alloc(&hc, nclusters, nfeatures);
+	}
+	centre_norms = (float*) malloc(nclusters * sizeof(float));
+	dist_evals = dist_total = 0;
+}
+
+void deallocateHostMemory(void)
+{
+	free(membership_new);
+	free(centre_norms);
+	if (kmeans_assign == KMEANS_ASSIGN_HAMERLY) {
+		if (dist_total > 0)
+			printf("Hamerly: %lld of %lld distances computed (%.1f%% skipped)\n",
+				   dist_evals, dist_total,
+				   100.0 * (double)(dist_total - dist_evals) / (double)dist_total);
+		free(upper);
+		free(lower);
+		hamerly_free(&hc);
+	}
+}
+
+/*----< assign_naive() >----------------------------------------------------*/
+static void assign_naive(float **feature, int nfeatures, int npoints,
+						 float **clusters, int nclusters)
+{
+	int i, j;
+
+	#pragma omp parallel for private(j) schedule(static)
+	for (i = 0; i < npoints; i++) {
+		float min_dist = FLT_MAX;
+		int   index = -1;
+		for (j = 0; j < nclusters; j++) {
+			float dist = dist_2(feature[i], clusters[j], nfeatures);
+			if (dist < min_dist) {
+				min_dist = dist;
+				index    = j;
+			}
+		}
+		membership_new[i] = index;
+	}
+	dist_evals += (long long) npoints * nclusters;
+}
+
+/*----< assign_gemm() >-----------------------------------------------------*/
+/* argmin_c ||c||^2 - 2 x.c, blocked like kmeansPointGemm: GEMM_CB centres
+   are transposed to [nfeatures][GEMM_CB] so the innermost loop runs over
+   independent accumulators and vectorises without reassociating sums,
+   and GEMM_PB points reuse each transposed block while it is in cache. */
+#define GEMM_CB	16
+#define GEMM_PB	64
+
+static void assign_gemm(float **feature, int nfeatures, int npoints,
+						float **clusters, int nclusters)
+{
+	float	*ct = (float*) malloc(nfeatures * GEMM_CB * sizeof(float));
+	float	*best = (float*) malloc(npoints * sizeof(float));
+	int		 c0, p0, i, j, c;
+
+	for (c = 0; c < nclusters; c++) {
+		float n = 0.0;
+		for (j = 0; j < nfeatures; j++)
+			n += clusters[c][j] * clusters[c][j];
+		centre_norms[c] = n;
+	}
+	for (i = 0; i < npoints; i++)
+		best[i] = FLT_MAX;
+
+	for (c0 = 0; c0 < nclusters; c0 += GEMM_CB) {
+		int nc = nclusters - c0 < GEMM_CB ? nclusters - c0 : GEMM_CB;
+
+		/* pad the last block with zero centres, never selected */
+		for (j = 0; j < nfeatures; j++)
+			for (c = 0; c < GEMM_CB; c++)
+				ct[j*GEMM_CB + c] = c < nc ? clusters[c0 + c][j] : 0.0f;
+
+		#pragma omp parallel for private(i, j, c) schedule(static)
+		for (p0 = 0; p0 < npoints; p0 += GEMM_PB) {
+			int pend = p0 + GEMM_PB < npoints ? p0 + GEMM_PB : npoints;
+			for (i = p0; i < pend; i++) {
+				const float *x = feature[i];
+				float acc[GEMM_CB];
+
+				for (c = 0; c < GEMM_CB; c++)
+					acc[c] = 0.0f;
+				for (j = 0; j < nfeatures; j++) {
+					const float  xj = x[j];
+					const float *row = ct + j*GEMM_CB;
+					#pragma omp simd
+					for (c = 0; c < GEMM_CB; c++)
+						acc[c] += xj * row[c];
+				}
+				for (c = 0; c < nc; c++) {
+					float d = centre_norms[c0 + c] - 2.0f*acc[c];
+					if (d < best[i]) {
+						best[i] = d;
+						membership_new[i] = c0 + c;
+					}
+				}
+			}
+		}
+	}
+	dist_evals += (long long) npoints * nclusters;
+	free(ct);
+	free(best);
+}
+
+/*----< assign_hamerly() >--------------------------------------------------*/
+/* upper[i] bounds the distance from point i to its own centre and lower[i]
+   the distance to every other centre. After moving both by how far the
+   centres moved, the point cannot change cluster while upper[i] is below
+   max(lower[i], half the gap to the nearest other centre); only then is
+   the upper bound tightened and, failing that, every centre scanned. */
+static void assign_hamerly(float **feature, int nfeatures, int npoints,
+						   int *membership, float **clusters, int nclusters)
+{
+	const float *moves    = hc.bounds;
+	const float *half_sep = hc.bounds + nclusters;
+	long long	 evals = 0;
+	int			 i, j;
+
+	hamerly_update(&hc, clusters, nclusters, nfeatures);
+
+	#pragma omp parallel for private(j) reduction(+:evals) schedule(static)
+	for (i = 0; i < npoints; i++) {
+		int   a = membership[i];
+		float u, l, m;
+		float d1, d2;
+
+		if (a >= 0) {
+			u = upper[i] + moves[a];
+			l = lower[i] - (a == hc.max_move_id ? hc.second_move : hc.max_move);
+			m = half_sep[a] > l ? half_sep[a] : l;
+			if (u > m) {
+				u = sqrtf(dist_2(feature[i], clusters[a], nfeatures));
+				evals++;
+			}
+			if (u <= m) {
+				upper[i] = u;
+				lower[i] = l;
+				membership_new[i] = a;
+				continue;
+			}
+		}
+
+		/* full scan for the nearest and second nearest centres */
+		d1 = d2 = FLT_MAX;
+		a  = -1;
+		for (j = 0; j < nclusters; j++) {
+			float dist = dist_2(feature[i], clusters[j], nfeatures);
+			if (dist < d1) {
+				d2 = d1;
+				d1 = dist;
+				a  = j;
+			}
+			else if (dist < d2)
+				d2 = dist;
+		}
+		evals += nclusters;
+		upper[i] = sqrtf(d1);
+		lower[i] = sqrtf(d2);
+		membership_new[i] = a;
+	}
+	dist_evals += evals;
+}
+
+/*----< kmeansCPU() >-------------------------------------------------------*/
+int	// delta
+kmeansCPU(float  **feature,				/* in: [npoints][nfeatures] */
+		  int      nfeatures,			/* number of attributes for each point */
+		  int      npoints,				/* number of data points */
+		  int      nclusters,			/* number of clusters */
+		  int     *membership,			/* which cluster the point belongs to */
+		  float  **clusters,			/* coordinates of cluster centers */
+		  int     *new_centers_len,		/* number of elements in each cluster */
+		  float  **new_centers			/* sum of elements in each cluster */
+		  )
+{
+	int delta = 0;
+	int i, j;
+	int assign = kmeans_assign_for(nfeatures, nclusters);
+
+	if (assign == KMEANS_ASSIGN_HAMERLY)
+		assign_hamerly(feature, nfeatures, npoints, membership, clusters, nclusters);
+	else if (assign == KMEANS_ASSIGN_GEMM)
+		assign_gemm(feature, nfeatures, npoints, clusters, nclusters);
+	else
+		assign_naive(feature, nfeatures, npoints, clusters, nclusters);
+	dist_total += (long long) npoints * nclusters;
+
+	/* same reduction as the device path */
+	for (i = 0; i < npoints; i++)
+	{
+		int cluster_id = membership_new[i];
+		new_centers_len[cluster_id]++;
+		if (membership_new[i] != membership[i])
+		{
+			delta++;
+			membership[i] = membership_new[i];
+		}
+		for (j = 0; j < nfeatures; j++)
+		{
+			new_centers[cluster_id][j] += feature[i][j];
+		}
+	}
+
+	return delta;
+}
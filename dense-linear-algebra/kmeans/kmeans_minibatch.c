@@ -0,0 +1,253 @@
+/*************************************************************************/
+/**   File:         kmeans_minibatch.c                                  **/
+/**   Description:  Mini-batch k-means (Sculley, WWW 2010) over a       **/
+/**                 stream of fixed-size batches read from the input    **/
+/**                 file, so memory is bounded by the batch size and    **/
+/**                 not by the number of points. Assignment runs on     **/
+/**                 the device (or the host with -c) while the next     **/
+/**                 batch is read and uploaded.                         **/
+/*************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+#include <math.h>
+#include <sys/time.h>
+#include <omp.h>
+
+#include "kmeans.h"
+
+#define STREAM_LINE_LEN 65536
+
+/*----< stream_open() >-----------------------------------------------------*/
+/* same formats as kmeans.c: text lines "id f0 f1 ...", or a binary file
+   starting with int npoints, int nfeatures followed by the floats */
+int stream_open(kmeans_stream *s, const char *filename, int binary)
+{
+	s->binary = binary;
+	s->nfeatures = 0;
+	s->line = (char*) malloc(STREAM_LINE_LEN);
+	if ((s->fp = fopen(filename, binary ? "rb" : "r")) == NULL) {
+		fprintf(stderr, "Error: no such file (%s)\n", filename);
+		return -1;
+	}
+	if (binary) {
+		int npoints;
+		if (fread(&npoints, sizeof(int), 1, s->fp) != 1 ||
+			fread(&s->nfeatures, sizeof(int), 1, s->fp) != 1)
+			return -1;
+	}
+	else {
+		while (fgets(s->line, STREAM_LINE_LEN, s->fp) != NULL) {
+			if (strtok(s->line, " \t\n") != 0) {
+				/* ignore the id (first attribute) */
+				while (strtok(NULL, " ,\t\n") != NULL) s->nfeatures++;
+				break;
+			}
+		}
+	}
+	stream_rewind(s);
+	return s->nfeatures > 0 ? 0 : -1;
+}
+
+void stream_rewind(kmeans_stream *s)
+{
+	fseek(s->fp, s->binary ? 2*sizeof(int) : 0, SEEK_SET);
+}
+
+void stream_close(kmeans_stream *s)
+{
+	fclose(s->fp);
+	free(s->line);
+}
+
+/*----< stream_read() >-----------------------------------------------------*/
+/* reads up to max_points points into rows[max_points][nfeatures];
+   returns the number read, 0 at end of file */
+int stream_read(kmeans_stream *s, float *rows, int max_points)
+{
+	int n = 0, j;
+
+	if (s->binary)
+		return (int) fread(rows, s->nfeatures*sizeof(float), max_points, s->fp);
+
+	while (n < max_points && fgets(s->line, STREAM_LINE_LEN, s->fp) != NULL) {
+		if (strtok(s->line, " \t\n") == NULL) continue;
+		for (j = 0; j < s->nfeatures; j++) {
+			char *tok = strtok(NULL, " ,\t\n");
+			rows[n*s->nfeatures + j] = tok ? atof(tok) : 0.0f;
+		}
+		n++;
+	}
+	return n;
+}
+
+/* host assignment for -c, same result as kmeansPoint */
+static void assign_batch_host(const float *rows, int n, int nfeatures,
+							  float **clusters, int nclusters, int *membership)
+{
+	int i, j, c;
+
+	#pragma omp parallel for private(j, c) schedule(static)
+	for (i = 0; i < n; i++) {
+		float min_dist = FLT_MAX;
+		for (c = 0; c < nclusters; c++) {
+			float dist = 0.0;
+			for (j = 0; j < nfeatures; j++) {
+				float diff = rows[i*nfeatures + j] - clusters[c][j];
+				dist += diff*diff;
+			}
+			if (dist < min_dist) {
+				min_dist = dist;
+				membership[i] = c;
+			}
+		}
+	}
+}
+
+/* row-major batch to the inverted layout kmeansPoint expects */
+static void invert_batch(const float *rows, float *inv, int n, int nfeatures)
+{
+	int i, j;
+
+	for (i = 0; i < n; i++)
+		for (j = 0; j < nfeatures; j++)
+			inv[j*n + i] = rows[i*nfeatures + j];
+}
+
+/* pulls the next batch, wrapping around for the remaining passes */
+static int next_batch(kmeans_stream *s, float *rows, int batch, int *pass, int npasses)
+{
+	int n = stream_read(s, rows, batch);
+
+	if (n == 0 && ++(*pass) < npasses) {
+		stream_rewind(s);
+		n = stream_read(s, rows, batch);
+	}
+	return n;
+}
+
+/*----< minibatch_cluster() >-----------------------------------------------*/
+/* clusters the file in batches of `batch` points for `npasses` passes and
+   returns [nclusters][nfeatures] centres. Batch b+1 is read, inverted and
+   uploaded into the other of two buffers while batch b is assigned; the
+   centres then move towards each assigned point with a per-centre rate
+   of 1/(points seen by that centre). */
+float** minibatch_cluster(const char *filename,
+						  int		 binary,
+						  int		 nclusters,
+						  int		 batch,
+						  int		 npasses,
+						  int		*nfeatures_out,
+						  float		*rmse,				/* out: RMSE over one more pass */
+						  int		 isRMSE)
+{
+	kmeans_stream s;
+	float	*rows[2], *inv[2];
+	int		 n[2];
+	int		*membership;
+	int		*counts;
+	float  **clusters;
+	int		 nfeatures, cur, pass = 0;
+	long long total = 0;
+	struct timeval start, end;
+	double	 secs;
+	int		 i, j;
+
+	if (stream_open(&s, filename, binary) != 0) {
+		fprintf(stderr, "Error: cannot read features from %s\n", filename);
+		exit(1);
+	}
+	nfeatures = s.nfeatures;
+	*nfeatures_out = nfeatures;
+
+	for (i = 0; i < 2; i++) {
+		rows[i] = (float*) malloc(batch*nfeatures*sizeof(float));
+		inv[i]  = (float*) malloc(batch*nfeatures*sizeof(float));
+	}
+	membership = (int*) malloc(batch*sizeof(int));
+	counts = (int*) calloc(nclusters, sizeof(int));
+	clusters    = (float**) malloc(nclusters *             sizeof(float*));
+	clusters[0] = (float*)  malloc(nclusters * nfeatures * sizeof(float));
+	for (i=1; i<nclusters; i++)
+		clusters[i] = clusters[i-1] + nfeatures;
+
+	if (!kmeans_host)
+		minibatchAllocate(batch, nfeatures, nclusters);
+
+	gettimeofday(&start, NULL);
+
+	/* seed with the first points, as kmeans_clustering() does */
+	n[0] = stream_read(&s, rows[0], batch);
+	if (n[0] < nclusters) {
+		fprintf(stderr, "Error: batch of %d points cannot seed %d clusters\n", n[0], nclusters);
+		exit(1);
+	}
+	memcpy(clusters[0], rows[0], nclusters*nfeatures*sizeof(float));
+	if (!kmeans_host) {
+		invert_batch(rows[0], inv[0], n[0], nfeatures);
+		minibatchUpload(0, inv[0], n[0], nfeatures);
+	}
+
+	for (cur = 0; n[cur] > 0; cur = 1 - cur) {
+		int next = 1 - cur;
+		const float *x = rows[cur];
+
+		if (kmeans_host)
+			assign_batch_host(x, n[cur], nfeatures, clusters, nclusters, membership);
+		else
+			minibatchEnqueueAssign(cur, n[cur], nfeatures, nclusters, clusters, membership);
+
+		/* overlap reading and uploading the next batch with the assignment */
+		n[next] = next_batch(&s, rows[next], batch, &pass, npasses);
+		if (n[next] > 0 && !kmeans_host) {
+			invert_batch(rows[next], inv[next], n[next], nfeatures);
+			minibatchUpload(next, inv[next], n[next], nfeatures);
+		}
+
+		if (!kmeans_host)
+			minibatchWaitAssign();
+
+		for (i = 0; i < n[cur]; i++) {
+			int   c = membership[i];
+			float eta = 1.0f / ++counts[c];
+			for (j = 0; j < nfeatures; j++)
+				clusters[c][j] += eta * (x[i*nfeatures + j] - clusters[c][j]);
+		}
+		total += n[cur];
+	}
+
+	gettimeofday(&end, NULL);
+	secs = (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) * 1e-6;
+	printf("Mini-batch: %lld points in %d pass(es) of batch %d, %.3f s (%.0f points/s)\n",
+		   total, npasses, batch, secs, secs > 0 ? total / secs : 0.0);
+
+	if (isRMSE) {
+		double sum = 0.0;
+		long long npoints = 0;
+
+		stream_rewind(&s);
+		while ((n[0] = stream_read(&s, rows[0], batch)) > 0) {
+			assign_batch_host(rows[0], n[0], nfeatures, clusters, nclusters, membership);
+			for (i = 0; i < n[0]; i++)
+				for (j = 0; j < nfeatures; j++) {
+					float diff = rows[0][i*nfeatures + j] - clusters[membership[i]][j];
+					sum += diff*diff;
+				}
+			npoints += n[0];
+		}
+		*rmse = (float) sqrt(sum / npoints);
+	}
+
+	if (!kmeans_host)
+		minibatchDeallocate();
+	stream_close(&s);
+	for (i = 0; i < 2; i++) {
+		free(rows[i]);
+		free(inv[i]);
+	}
+	free(membership);
+	free(counts);
+	return clusters;
+}
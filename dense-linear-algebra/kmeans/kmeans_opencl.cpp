@@ -5,6 +5,7 @@
 #include <assert.h>
 #include "../../include/rdtsc.h"
 #include "../../include/common_ocl.h"
+#include "kmeans.h"
 
 #include <omp.h>
 
@@ -26,6 +27,10 @@
 #define CPU_DELTA_REDUCE
 #define CPU_CENTER_REDUCE
 
+/* the device-resident loop (-g) splits the centre sums into at most this
+   many chunks of points */
+#define RESIDENT_MAX_CHUNKS 1024
+
 extern "C"
 int setup(int argc, char** argv);									/* function prototype */
 int platform_id=PLATFORM_ID, device_id=DEVICE_ID;
@@ -42,6 +47,14 @@ cl_command_queue clCommands;
 cl_program clProgram;
 cl_kernel clKernel_invert_mapping;
 cl_kernel clKernel_kmeansPoint;
+cl_kernel clKernel_kmeansHamerly;
+cl_kernel clKernel_kmeansPointGemm;
+cl_kernel clKernel_kmeansPointDelta;
+cl_kernel clKernel_kmeansPartialSums;
+cl_kernel clKernel_kmeansUpdateCentres;
+cl_kernel clKernel_kmeansSeedUpdate;
+cl_kernel clKernel_kmeansSeedSample;
+cl_kernel clKernel_kmeansSeedWeights;
 
 /* _d denotes it resides on the device */
 int    *membership_new;												/* newly assignment membership */
@@ -52,6 +65,40 @@ float  *block_new_centers;											/* sum of points in a cluster (per block) *
 cl_mem clusters_d;													/* cluster centers on the device */
 cl_mem block_clusters_d;											/* per block calculation of cluster centers */
 cl_mem block_deltas_d;												/* per block calculation of deltas */
+cl_mem upper_d;														/* Hamerly upper bound per point */
+cl_mem lower_d;														/* Hamerly lower bound per point */
+cl_mem centre_bounds_d;												/* centre moves and half separations */
+hamerly_centres hamerly_h;											/* host side of the centre bounds */
+cl_mem centre_norms_d;												/* ||c||^2 for the gemm assignment */
+float  *centre_norms_h;
+cl_mem partial_d;													/* per chunk centre sums (-g) */
+cl_mem partial_len_d;												/* per chunk cluster sizes (-g) */
+cl_mem loop_state_d;												/* [0] delta, [1] not converged (-g) */
+int    resident_chunk, resident_nchunks;
+cl_command_queue clUploadQueue;										/* batch uploads (-B) */
+cl_mem batch_d[2];													/* double-buffered inverted batches (-B) */
+cl_event batch_upload[2];											/* last upload into each batch buffer */
+cl_event batch_events[3];											/* centre copy, kernel, membership copy */
+int    batch_slot;
+cl_mem seed_min_dist_d;												/* k-means|| (-s parallel) */
+cl_mem seed_nearest_d;
+cl_mem seed_cost_d;
+cl_mem seed_centres_d;
+cl_mem seed_picked_d;
+cl_mem seed_npicked_d;
+float *seed_cost_h;
+
+/* concurrent (k, restart) jobs of the sweep mode (-S), one queue each */
+struct sweep_queue {
+    cl_command_queue queue;
+    cl_kernel kernel;
+    cl_mem membership_d;
+    cl_mem clusters_d;
+    int *membership_new;
+    cl_event events[3];												/* centre copy, kernel, membership copy */
+};
+sweep_queue *sweep_queues;
+int sweep_nqueues;
 
 /* image memory */
 /*cl_mem t_features;
@@ -128,6 +175,22 @@ errcode = clGetDeviceInfo(clDevice, CL_DEVICE_MAX_WORK_ITEM_SIZES,sizeof(size_t)
     CHECKERR(errcode);
     clKernel_kmeansPoint = clCreateKernel(clProgram, "kmeansPoint", &errcode);
     CHECKERR(errcode);
+    clKernel_kmeansHamerly = clCreateKernel(clProgram, "kmeansHamerly", &errcode);
+    CHECKERR(errcode);
+    clKernel_kmeansPointGemm = clCreateKernel(clProgram, "kmeansPointGemm", &errcode);
+    CHECKERR(errcode);
+    clKernel_kmeansPointDelta = clCreateKernel(clProgram, "kmeansPointDelta", &errcode);
+    CHECKERR(errcode);
+    clKernel_kmeansPartialSums = clCreateKernel(clProgram, "kmeansPartialSums", &errcode);
+    CHECKERR(errcode);
+    clKernel_kmeansUpdateCentres = clCreateKernel(clProgram, "kmeansUpdateCentres", &errcode);
+    CHECKERR(errcode);
+    clKernel_kmeansSeedUpdate = clCreateKernel(clProgram, "kmeansSeedUpdate", &errcode);
+    CHECKERR(errcode);
+    clKernel_kmeansSeedSample = clCreateKernel(clProgram, "kmeansSeedSample", &errcode);
+    CHECKERR(errcode);
+    clKernel_kmeansSeedWeights = clCreateKernel(clProgram, "kmeansSeedWeights", &errcode);
+    CHECKERR(errcode);
 }
 /* -------------- initCL() end -------------- */
 
@@ -191,9 +254,37 @@ void allocateMemory(int npoints, int nfeatures, int nclusters, float **features)
 	/* allocate memory for membership_d[] and clusters_d[][] (device) */
     membership_d = clCreateBuffer(clContext, CL_MEM_READ_WRITE, npoints*sizeof(int), NULL, &errcode);
     CHECKERR(errcode);
-    clusters_d = clCreateBuffer(clContext, CL_MEM_READ_ONLY, nclusters*nfeatures*sizeof(float), NULL, &errcode);
+    clusters_d = clCreateBuffer(clContext, kmeans_resident ? CL_MEM_READ_WRITE : CL_MEM_READ_ONLY, nclusters*nfeatures*sizeof(float), NULL, &errcode);
     CHECKERR(errcode);
 
+	centre_norms_d = clCreateBuffer(clContext, CL_MEM_READ_ONLY, nclusters*sizeof(float), NULL, &errcode);
+	CHECKERR(errcode);
+	centre_norms_h = (float *) malloc(nclusters*sizeof(float));
+
+	if (kmeans_resident) {
+		resident_nchunks = npoints < RESIDENT_MAX_CHUNKS ? npoints : RESIDENT_MAX_CHUNKS;
+		resident_chunk = (npoints + resident_nchunks - 1) / resident_nchunks;
+		resident_nchunks = (npoints + resident_chunk - 1) / resident_chunk;
+		partial_d = clCreateBuffer(clContext, CL_MEM_READ_WRITE, resident_nchunks*nclusters*nfeatures*sizeof(float), NULL, &errcode);
+		CHECKERR(errcode);
+		partial_len_d = clCreateBuffer(clContext, CL_MEM_READ_WRITE, resident_nchunks*nclusters*sizeof(int), NULL, &errcode);
+		CHECKERR(errcode);
+		loop_state_d = clCreateBuffer(clContext, CL_MEM_READ_WRITE, 2*sizeof(int), NULL, &errcode);
+		CHECKERR(errcode);
+	}
+
+	if (kmeans_assign == KMEANS_ASSIGN_HAMERLY) {
+		/* bounds stay on the device between iterations; only the
+		   per-centre moves and separations are uploaded */
+		upper_d = clCreateBuffer(clContext, CL_MEM_READ_WRITE, npoints*sizeof(float), NULL, &errcode);
+		CHECKERR(errcode);
+		lower_d = clCreateBuffer(clContext, CL_MEM_READ_WRITE, npoints*sizeof(float), NULL, &errcode);
+		CHECKERR(errcode);
+		centre_bounds_d = clCreateBuffer(clContext, CL_MEM_READ_ONLY, 2*nclusters*sizeof(float), NULL, &errcode);
+		CHECKERR(errcode);
+		hamerly_alloc(&hamerly_h, nclusters, nfeatures);
+	}
+
 	
 #ifdef BLOCK_DELTA_REDUCE
 	// allocate array to hold the per block deltas on the gpu side
@@ -225,6 +316,19 @@ void deallocateMemory()
     clReleaseMemObject(membership_d);
 
     clReleaseMemObject(clusters_d);
+    clReleaseMemObject(centre_norms_d);
+    free(centre_norms_h);
+	if (kmeans_assign == KMEANS_ASSIGN_HAMERLY) {
+		clReleaseMemObject(upper_d);
+		clReleaseMemObject(lower_d);
+		clReleaseMemObject(centre_bounds_d);
+		hamerly_free(&hamerly_h);
+	}
+	if (kmeans_resident) {
+		clReleaseMemObject(partial_d);
+		clReleaseMemObject(partial_len_d);
+		clReleaseMemObject(loop_state_d);
+	}
 #ifdef BLOCK_CENTER_REDUCE
     clReleaseMemObject(block_clusters_d);
 #endif
@@ -233,6 +337,14 @@ void deallocateMemory()
 #endif
     clReleaseKernel(clKernel_invert_mapping);
     clReleaseKernel(clKernel_kmeansPoint);
+    clReleaseKernel(clKernel_kmeansHamerly);
+    clReleaseKernel(clKernel_kmeansPointGemm);
+    clReleaseKernel(clKernel_kmeansPointDelta);
+    clReleaseKernel(clKernel_kmeansPartialSums);
+    clReleaseKernel(clKernel_kmeansUpdateCentres);
+    clReleaseKernel(clKernel_kmeansSeedUpdate);
+    clReleaseKernel(clKernel_kmeansSeedSample);
+    clReleaseKernel(clKernel_kmeansSeedWeights);
     clReleaseProgram(clProgram);
     clReleaseCommandQueue(clCommands);
     clReleaseContext(clContext);
@@ -274,11 +386,18 @@ kmeansCuda(float  **feature,				/* in: [npoints][nfeatures] */
 
 	int delta = 0;			/* if point has moved */
 	int i,j;				/* counters */
+	int assign = kmeans_assign_for(nfeatures, nclusters);
 
+	/* the gemm kernel needs a 16x16 work-group */
+	if (assign == KMEANS_ASSIGN_GEMM && num_threads < 256)
+		assign = KMEANS_ASSIGN_NAIVE;
 
-	/* copy membership (host to device) */
+
+	/* copy membership (host to device). Hamerly needs the current
+	   assignment, which is -1 at the start of every run */
     	 
-	errcode = clEnqueueWriteBuffer(clCommands, membership_d, CL_TRUE, 0, npoints*sizeof(int), (void *) membership_new, 0, NULL, &ocdTempEvent);
+	errcode = clEnqueueWriteBuffer(clCommands, membership_d, CL_TRUE, 0, npoints*sizeof(int),
+		(void *) (kmeans_assign == KMEANS_ASSIGN_HAMERLY ? membership : membership_new), 0, NULL, &ocdTempEvent);
         clFinish(clCommands);
     	START_TIMER(ocdTempEvent, OCD_TIMER_H2D, "Membership Copy", ocdTempTimer)
 	END_TIMER(ocdTempTimer)
@@ -326,6 +445,69 @@ kmeansCuda(float  **feature,				/* in: [npoints][nfeatures] */
     size_t localWorkSize[2] = {num_threads_perdim*num_threads_perdim, 1};
     size_t globalWorkSize[2] = {num_blocks_perdim*localWorkSize[0], num_blocks_perdim*localWorkSize[1]};
 
+    if (assign == KMEANS_ASSIGN_HAMERLY) {
+	hamerly_update(&hamerly_h, clusters, nclusters, nfeatures);
+	errcode = clEnqueueWriteBuffer(clCommands, centre_bounds_d, CL_TRUE, 0, 2*nclusters*sizeof(float), (void *) hamerly_h.bounds, 0, NULL, &ocdTempEvent);
+	clFinish(clCommands);
+	START_TIMER(ocdTempEvent, OCD_TIMER_H2D, "Centre Bounds Copy", ocdTempTimer)
+	END_TIMER(ocdTempTimer)
+	CHECKERR(errcode);
+
+	unsigned int arg = 0;
+	errcode = clSetKernelArg(clKernel_kmeansHamerly, arg++, sizeof(cl_mem), (void *) &feature_d);
+	errcode |= clSetKernelArg(clKernel_kmeansHamerly, arg++, sizeof(int), (void *) &nfeatures);
+	errcode |= clSetKernelArg(clKernel_kmeansHamerly, arg++, sizeof(int), (void *) &npoints);
+	errcode |= clSetKernelArg(clKernel_kmeansHamerly, arg++, sizeof(int), (void *) &nclusters);
+	errcode |= clSetKernelArg(clKernel_kmeansHamerly, arg++, sizeof(cl_mem), (void *) &membership_d);
+	errcode |= clSetKernelArg(clKernel_kmeansHamerly, arg++, sizeof(cl_mem), (void *) &clusters_d);
+	errcode |= clSetKernelArg(clKernel_kmeansHamerly, arg++, sizeof(cl_mem), (void *) &upper_d);
+	errcode |= clSetKernelArg(clKernel_kmeansHamerly, arg++, sizeof(cl_mem), (void *) &lower_d);
+	errcode |= clSetKernelArg(clKernel_kmeansHamerly, arg++, sizeof(cl_mem), (void *) &centre_bounds_d);
+	errcode |= clSetKernelArg(clKernel_kmeansHamerly, arg++, sizeof(int), (void *) &hamerly_h.max_move_id);
+	errcode |= clSetKernelArg(clKernel_kmeansHamerly, arg++, sizeof(float), (void *) &hamerly_h.max_move);
+	errcode |= clSetKernelArg(clKernel_kmeansHamerly, arg++, sizeof(float), (void *) &hamerly_h.second_move);
+	CHECKERR(errcode);
+
+	errcode = clEnqueueNDRangeKernel(clCommands, clKernel_kmeansHamerly, 2, NULL, globalWorkSize, localWorkSize, 0, NULL, &ocdTempEvent);
+	CHECKERR(errcode);
+	errcode = clFinish(clCommands);
+	START_TIMER(ocdTempEvent, OCD_TIMER_KERNEL, "Hamerly Kernel", ocdTempTimer)
+	END_TIMER(ocdTempTimer)
+	CHECKERR(errcode);
+    } else if (assign == KMEANS_ASSIGN_GEMM) {
+	for (i = 0; i < nclusters; i++) {
+		float n = 0.0f;
+		for (j = 0; j < nfeatures; j++)
+			n += clusters[i][j] * clusters[i][j];
+		centre_norms_h[i] = n;
+	}
+	errcode = clEnqueueWriteBuffer(clCommands, centre_norms_d, CL_TRUE, 0, nclusters*sizeof(float), (void *) centre_norms_h, 0, NULL, &ocdTempEvent);
+	clFinish(clCommands);
+	START_TIMER(ocdTempEvent, OCD_TIMER_H2D, "Centre Norms Copy", ocdTempTimer)
+	END_TIMER(ocdTempTimer)
+	CHECKERR(errcode);
+
+	/* one 16x16 work-group per 64 points */
+	size_t gemmLocalWorkSize[2] = {16, 16};
+	size_t gemmGlobalWorkSize[2] = {16*(size_t)((npoints + 63) / 64), 16};
+
+	unsigned int arg = 0;
+	errcode = clSetKernelArg(clKernel_kmeansPointGemm, arg++, sizeof(cl_mem), (void *) &feature_flipped_d);
+	errcode |= clSetKernelArg(clKernel_kmeansPointGemm, arg++, sizeof(int), (void *) &nfeatures);
+	errcode |= clSetKernelArg(clKernel_kmeansPointGemm, arg++, sizeof(int), (void *) &npoints);
+	errcode |= clSetKernelArg(clKernel_kmeansPointGemm, arg++, sizeof(int), (void *) &nclusters);
+	errcode |= clSetKernelArg(clKernel_kmeansPointGemm, arg++, sizeof(cl_mem), (void *) &membership_d);
+	errcode |= clSetKernelArg(clKernel_kmeansPointGemm, arg++, sizeof(cl_mem), (void *) &clusters_d);
+	errcode |= clSetKernelArg(clKernel_kmeansPointGemm, arg++, sizeof(cl_mem), (void *) &centre_norms_d);
+	CHECKERR(errcode);
+
+	errcode = clEnqueueNDRangeKernel(clCommands, clKernel_kmeansPointGemm, 2, NULL, gemmGlobalWorkSize, gemmLocalWorkSize, 0, NULL, &ocdTempEvent);
+	CHECKERR(errcode);
+	errcode = clFinish(clCommands);
+	START_TIMER(ocdTempEvent, OCD_TIMER_KERNEL, "Gemm Point Kernel", ocdTempTimer)
+	END_TIMER(ocdTempTimer)
+	CHECKERR(errcode);
+    } else {
     unsigned int arg = 0;
     errcode = clSetKernelArg(clKernel_kmeansPoint, arg++, sizeof(cl_mem), (void *) &feature_d);
     errcode |= clSetKernelArg(clKernel_kmeansPoint, arg++, sizeof(cl_mem), (void *) &feature_flipped_d);
@@ -351,6 +533,7 @@ kmeansCuda(float  **feature,				/* in: [npoints][nfeatures] */
 
     END_TIMER(ocdTempTimer)
     CHECKERR(errcode);
+    }
 	/* copy back membership (device to host) */
     	 
 	errcode = clEnqueueReadBuffer(clCommands, membership_d, CL_TRUE, 0, npoints*sizeof(int), (void *) membership_new, 0, NULL, &ocdTempEvent);
@@ -460,3 +643,472 @@ kmeansCuda(float  **feature,				/* in: [npoints][nfeatures] */
 }
 /* ------------------- kmeansCuda() end ------------------------ */    
 
+/* ------------------- kmeansResident() ------------------------ */
+/* runs the whole iteration loop on the device: assignment, centre sums,
+   centre update and the convergence test. Membership and the initial
+   centres go over once, each iteration reads back a single flag, and the
+   final centres and membership are read once at the end.
+   Returns the number of iterations. */
+extern "C"
+int
+kmeansResident(int      nfeatures,				/* number of attributes for each point */
+               int      npoints,				/* number of data points */
+               int      nclusters,				/* number of clusters */
+               float    threshold,				/* loop terminating factor */
+               int     *membership,				/* in/out: which cluster the point belongs to */
+               float  **clusters				/* in/out: coordinates of cluster centers */
+               )
+{
+    cl_int errcode;
+    cl_event events[3];
+    int loop_state[2] = {0, 0};
+    int iterations = 0;
+
+	errcode = clEnqueueWriteBuffer(clCommands, membership_d, CL_TRUE, 0, npoints*sizeof(int), (void *) membership, 0, NULL, &ocdTempEvent);
+	clFinish(clCommands);
+	START_TIMER(ocdTempEvent, OCD_TIMER_H2D, "Membership Copy", ocdTempTimer)
+	END_TIMER(ocdTempTimer)
+	CHECKERR(errcode);
+	errcode = clEnqueueWriteBuffer(clCommands, clusters_d, CL_TRUE, 0, nclusters*nfeatures*sizeof(float), (void *) clusters[0], 0, NULL, &ocdTempEvent);
+	clFinish(clCommands);
+	START_TIMER(ocdTempEvent, OCD_TIMER_H2D, "Cluster Copy", ocdTempTimer)
+	END_TIMER(ocdTempTimer)
+	CHECKERR(errcode);
+	errcode = clEnqueueWriteBuffer(clCommands, loop_state_d, CL_TRUE, 0, 2*sizeof(int), (void *) loop_state, 0, NULL, &ocdTempEvent);
+	clFinish(clCommands);
+	START_TIMER(ocdTempEvent, OCD_TIMER_H2D, "Loop State Copy", ocdTempTimer)
+	END_TIMER(ocdTempTimer)
+	CHECKERR(errcode);
+
+    size_t localWorkSize[2] = {num_threads_perdim*num_threads_perdim, 1};
+    size_t globalWorkSize[2] = {num_blocks_perdim*localWorkSize[0], num_blocks_perdim*localWorkSize[1]};
+    size_t sumsWorkSize[2] = {(size_t) nfeatures, (size_t) resident_nchunks};
+    size_t updateWorkSize = nclusters*nfeatures;
+
+    unsigned int arg = 0;
+    errcode = clSetKernelArg(clKernel_kmeansPointDelta, arg++, sizeof(cl_mem), (void *) &feature_d);
+    errcode |= clSetKernelArg(clKernel_kmeansPointDelta, arg++, sizeof(int), (void *) &nfeatures);
+    errcode |= clSetKernelArg(clKernel_kmeansPointDelta, arg++, sizeof(int), (void *) &npoints);
+    errcode |= clSetKernelArg(clKernel_kmeansPointDelta, arg++, sizeof(int), (void *) &nclusters);
+    errcode |= clSetKernelArg(clKernel_kmeansPointDelta, arg++, sizeof(cl_mem), (void *) &membership_d);
+    errcode |= clSetKernelArg(clKernel_kmeansPointDelta, arg++, sizeof(cl_mem), (void *) &clusters_d);
+    errcode |= clSetKernelArg(clKernel_kmeansPointDelta, arg++, sizeof(cl_mem), (void *) &loop_state_d);
+    errcode |= clSetKernelArg(clKernel_kmeansPointDelta, arg++, localWorkSize[0]*sizeof(int), NULL);
+    CHECKERR(errcode);
+
+    arg = 0;
+    errcode = clSetKernelArg(clKernel_kmeansPartialSums, arg++, sizeof(cl_mem), (void *) &feature_flipped_d);
+    errcode |= clSetKernelArg(clKernel_kmeansPartialSums, arg++, sizeof(int), (void *) &nfeatures);
+    errcode |= clSetKernelArg(clKernel_kmeansPartialSums, arg++, sizeof(int), (void *) &npoints);
+    errcode |= clSetKernelArg(clKernel_kmeansPartialSums, arg++, sizeof(int), (void *) &nclusters);
+    errcode |= clSetKernelArg(clKernel_kmeansPartialSums, arg++, sizeof(int), (void *) &resident_chunk);
+    errcode |= clSetKernelArg(clKernel_kmeansPartialSums, arg++, sizeof(cl_mem), (void *) &membership_d);
+    errcode |= clSetKernelArg(clKernel_kmeansPartialSums, arg++, sizeof(cl_mem), (void *) &partial_d);
+    errcode |= clSetKernelArg(clKernel_kmeansPartialSums, arg++, sizeof(cl_mem), (void *) &partial_len_d);
+    CHECKERR(errcode);
+
+    arg = 0;
+    errcode = clSetKernelArg(clKernel_kmeansUpdateCentres, arg++, sizeof(cl_mem), (void *) &partial_d);
+    errcode |= clSetKernelArg(clKernel_kmeansUpdateCentres, arg++, sizeof(cl_mem), (void *) &partial_len_d);
+    errcode |= clSetKernelArg(clKernel_kmeansUpdateCentres, arg++, sizeof(int), (void *) &nfeatures);
+    errcode |= clSetKernelArg(clKernel_kmeansUpdateCentres, arg++, sizeof(int), (void *) &nclusters);
+    errcode |= clSetKernelArg(clKernel_kmeansUpdateCentres, arg++, sizeof(int), (void *) &resident_nchunks);
+    errcode |= clSetKernelArg(clKernel_kmeansUpdateCentres, arg++, sizeof(float), (void *) &threshold);
+    errcode |= clSetKernelArg(clKernel_kmeansUpdateCentres, arg++, sizeof(cl_mem), (void *) &clusters_d);
+    errcode |= clSetKernelArg(clKernel_kmeansUpdateCentres, arg++, sizeof(cl_mem), (void *) &loop_state_d);
+    CHECKERR(errcode);
+
+	/* the three kernels run back to back on the in-order queue; the only
+	   synchronisation per iteration is the read of the convergence flag */
+	do {
+		errcode = clEnqueueNDRangeKernel(clCommands, clKernel_kmeansPointDelta, 2, NULL, globalWorkSize, localWorkSize, 0, NULL, &events[0]);
+		CHECKERR(errcode);
+		errcode = clEnqueueNDRangeKernel(clCommands, clKernel_kmeansPartialSums, 2, NULL, sumsWorkSize, NULL, 0, NULL, &events[1]);
+		CHECKERR(errcode);
+		errcode = clEnqueueNDRangeKernel(clCommands, clKernel_kmeansUpdateCentres, 1, NULL, &updateWorkSize, NULL, 0, NULL, &events[2]);
+		CHECKERR(errcode);
+		errcode = clEnqueueReadBuffer(clCommands, loop_state_d, CL_TRUE, sizeof(int), sizeof(int), (void *) &loop_state[1], 0, NULL, &ocdTempEvent);
+		CHECKERR(errcode);
+		START_TIMER(events[0], OCD_TIMER_KERNEL, "Point Delta Kernel", ocdTempTimer)
+		END_TIMER(ocdTempTimer)
+		START_TIMER(events[1], OCD_TIMER_KERNEL, "Partial Sums Kernel", ocdTempTimer)
+		END_TIMER(ocdTempTimer)
+		START_TIMER(events[2], OCD_TIMER_KERNEL, "Update Centres Kernel", ocdTempTimer)
+		END_TIMER(ocdTempTimer)
+		START_TIMER(ocdTempEvent, OCD_TIMER_D2H, "Convergence Flag Copy", ocdTempTimer)
+		END_TIMER(ocdTempTimer)
+		iterations++;
+	} while (loop_state[1] && iterations <= 500);	/* same cap as kmeans_clustering() */
+
+	errcode = clEnqueueReadBuffer(clCommands, membership_d, CL_TRUE, 0, npoints*sizeof(int), (void *) membership, 0, NULL, &ocdTempEvent);
+	clFinish(clCommands);
+	START_TIMER(ocdTempEvent, OCD_TIMER_D2H, "Membership Copy", ocdTempTimer)
+	END_TIMER(ocdTempTimer)
+	CHECKERR(errcode);
+	errcode = clEnqueueReadBuffer(clCommands, clusters_d, CL_TRUE, 0, nclusters*nfeatures*sizeof(float), (void *) clusters[0], 0, NULL, &ocdTempEvent);
+	clFinish(clCommands);
+	START_TIMER(ocdTempEvent, OCD_TIMER_D2H, "Cluster Copy", ocdTempTimer)
+	END_TIMER(ocdTempTimer)
+	CHECKERR(errcode);
+
+	return iterations;
+}
+/* ------------------- kmeansResident() end ------------------------ */
+
+/* ------------------- mini-batch (-B) ------------------------ */
+/* batches are uploaded on their own queue so the copy of batch b+1 can
+   overlap the assignment of batch b; the assignment waits on the upload
+   event of its buffer. */
+extern "C"
+void minibatchAllocate(int batch, int nfeatures, int nclusters)
+{
+    cl_int errcode;
+
+    clUploadQueue = clCreateCommandQueue(clContext, clDevice, CL_QUEUE_PROFILING_ENABLE, &errcode);
+    CHECKERR(errcode);
+    for (int i = 0; i < 2; i++) {
+        batch_d[i] = clCreateBuffer(clContext, CL_MEM_READ_ONLY, batch*nfeatures*sizeof(float), NULL, &errcode);
+        CHECKERR(errcode);
+    }
+    membership_d = clCreateBuffer(clContext, CL_MEM_READ_WRITE, batch*sizeof(int), NULL, &errcode);
+    CHECKERR(errcode);
+    clusters_d = clCreateBuffer(clContext, CL_MEM_READ_ONLY, nclusters*nfeatures*sizeof(float), NULL, &errcode);
+    CHECKERR(errcode);
+}
+
+extern "C"
+void minibatchDeallocate()
+{
+    clReleaseMemObject(batch_d[0]);
+    clReleaseMemObject(batch_d[1]);
+    clReleaseMemObject(membership_d);
+    clReleaseMemObject(clusters_d);
+    clReleaseCommandQueue(clUploadQueue);
+}
+
+/* non-blocking: inv must stay untouched until the batch has been assigned */
+extern "C"
+void minibatchUpload(int slot, float *inv, int n, int nfeatures)
+{
+    cl_int errcode;
+
+    errcode = clEnqueueWriteBuffer(clUploadQueue, batch_d[slot], CL_FALSE, 0, n*nfeatures*sizeof(float), (void *) inv, 0, NULL, &batch_upload[slot]);
+    CHECKERR(errcode);
+    clFlush(clUploadQueue);
+}
+
+/* non-blocking: membership is valid after minibatchWaitAssign() */
+extern "C"
+void minibatchEnqueueAssign(int slot, int n, int nfeatures, int nclusters, float **clusters, int *membership)
+{
+    cl_int errcode;
+    unsigned int blocks = (n + num_threads - 1) / num_threads;
+    unsigned int blocks_perdim = sqrt((double) blocks);
+
+    while (blocks_perdim * blocks_perdim < blocks)
+        blocks_perdim++;
+    size_t localWorkSize[2] = {num_threads, 1};
+    size_t globalWorkSize[2] = {blocks_perdim*localWorkSize[0], blocks_perdim*localWorkSize[1]};
+
+    errcode = clEnqueueWriteBuffer(clCommands, clusters_d, CL_FALSE, 0, nclusters*nfeatures*sizeof(float), (void *) clusters[0], 0, NULL, &batch_events[0]);
+    CHECKERR(errcode);
+
+    unsigned int arg = 0;
+    errcode = clSetKernelArg(clKernel_kmeansPoint, arg++, sizeof(cl_mem), (void *) &batch_d[slot]);
+    errcode |= clSetKernelArg(clKernel_kmeansPoint, arg++, sizeof(cl_mem), (void *) &batch_d[slot]);
+    errcode |= clSetKernelArg(clKernel_kmeansPoint, arg++, sizeof(int), (void *) &nfeatures);
+    errcode |= clSetKernelArg(clKernel_kmeansPoint, arg++, sizeof(int), (void *) &n);
+    errcode |= clSetKernelArg(clKernel_kmeansPoint, arg++, sizeof(int), (void *) &nclusters);
+    errcode |= clSetKernelArg(clKernel_kmeansPoint, arg++, sizeof(cl_mem), (void *) &membership_d);
+    errcode |= clSetKernelArg(clKernel_kmeansPoint, arg++, sizeof(cl_mem), (void *) &clusters_d);
+    CHECKERR(errcode);
+    errcode = clEnqueueNDRangeKernel(clCommands, clKernel_kmeansPoint, 2, NULL, globalWorkSize, localWorkSize, 1, &batch_upload[slot], &batch_events[1]);
+    CHECKERR(errcode);
+
+    errcode = clEnqueueReadBuffer(clCommands, membership_d, CL_FALSE, 0, n*sizeof(int), (void *) membership, 0, NULL, &batch_events[2]);
+    CHECKERR(errcode);
+    clFlush(clCommands);
+    batch_slot = slot;
+}
+
+extern "C"
+void minibatchWaitAssign()
+{
+    cl_int errcode = clWaitForEvents(1, &batch_events[2]);
+    CHECKERR(errcode);
+    START_TIMER(batch_upload[batch_slot], OCD_TIMER_H2D, "Batch Copy", ocdTempTimer)
+    END_TIMER(ocdTempTimer)
+    START_TIMER(batch_events[0], OCD_TIMER_H2D, "Cluster Copy", ocdTempTimer)
+    END_TIMER(ocdTempTimer)
+    START_TIMER(batch_events[1], OCD_TIMER_KERNEL, "Point Kernel", ocdTempTimer)
+    END_TIMER(ocdTempTimer)
+    START_TIMER(batch_events[2], OCD_TIMER_D2H, "Membership Copy", ocdTempTimer)
+    END_TIMER(ocdTempTimer)
+}
+/* ------------------- mini-batch (-B) end ------------------------ */
+
+/* ------------------- k-means|| seeding (-s parallel) ------------------------ */
+/* the rounds of kmeans_parallel_seed() over the resident feature_d, using
+   the launch geometry from allocateMemory() */
+extern "C"
+void seedAllocate(int npoints, int nfeatures, int max_picked, int max_candidates)
+{
+    cl_int errcode;
+
+    seed_min_dist_d = clCreateBuffer(clContext, CL_MEM_READ_WRITE, npoints*sizeof(float), NULL, &errcode);
+    CHECKERR(errcode);
+    seed_nearest_d = clCreateBuffer(clContext, CL_MEM_READ_WRITE, npoints*sizeof(int), NULL, &errcode);
+    CHECKERR(errcode);
+    seed_cost_d = clCreateBuffer(clContext, CL_MEM_WRITE_ONLY, num_blocks*sizeof(float), NULL, &errcode);
+    CHECKERR(errcode);
+    /* new candidates of one round, and later the candidate weights */
+    seed_centres_d = clCreateBuffer(clContext, CL_MEM_READ_WRITE,
+        (max_picked*nfeatures > max_candidates ? max_picked*nfeatures : max_candidates)*sizeof(float), NULL, &errcode);
+    CHECKERR(errcode);
+    seed_picked_d = clCreateBuffer(clContext, CL_MEM_WRITE_ONLY, max_picked*sizeof(int), NULL, &errcode);
+    CHECKERR(errcode);
+    seed_npicked_d = clCreateBuffer(clContext, CL_MEM_READ_WRITE, sizeof(int), NULL, &errcode);
+    CHECKERR(errcode);
+    seed_cost_h = (float *) malloc(num_blocks*sizeof(float));
+}
+
+extern "C"
+void seedDeallocate()
+{
+    clReleaseMemObject(seed_min_dist_d);
+    clReleaseMemObject(seed_nearest_d);
+    clReleaseMemObject(seed_cost_d);
+    clReleaseMemObject(seed_centres_d);
+    clReleaseMemObject(seed_picked_d);
+    clReleaseMemObject(seed_npicked_d);
+    free(seed_cost_h);
+}
+
+/* folds m new candidates (ids first..first+m-1) into the nearest-candidate
+   distances; returns the total cost */
+extern "C"
+float seedUpdate(float *centres, int m, int first, int nfeatures, int npoints)
+{
+    cl_int errcode;
+    size_t localWorkSize[2] = {num_threads, 1};
+    size_t globalWorkSize[2] = {num_blocks_perdim*localWorkSize[0], num_blocks_perdim*localWorkSize[1]};
+    double cost = 0.0;
+
+    errcode = clEnqueueWriteBuffer(clCommands, seed_centres_d, CL_TRUE, 0, m*nfeatures*sizeof(float), (void *) centres, 0, NULL, &ocdTempEvent);
+    clFinish(clCommands);
+    START_TIMER(ocdTempEvent, OCD_TIMER_H2D, "Seed Candidate Copy", ocdTempTimer)
+    END_TIMER(ocdTempTimer)
+    CHECKERR(errcode);
+
+    unsigned int arg = 0;
+    errcode = clSetKernelArg(clKernel_kmeansSeedUpdate, arg++, sizeof(cl_mem), (void *) &feature_d);
+    errcode |= clSetKernelArg(clKernel_kmeansSeedUpdate, arg++, sizeof(int), (void *) &nfeatures);
+    errcode |= clSetKernelArg(clKernel_kmeansSeedUpdate, arg++, sizeof(int), (void *) &npoints);
+    errcode |= clSetKernelArg(clKernel_kmeansSeedUpdate, arg++, sizeof(cl_mem), (void *) &seed_centres_d);
+    errcode |= clSetKernelArg(clKernel_kmeansSeedUpdate, arg++, sizeof(int), (void *) &m);
+    errcode |= clSetKernelArg(clKernel_kmeansSeedUpdate, arg++, sizeof(int), (void *) &first);
+    errcode |= clSetKernelArg(clKernel_kmeansSeedUpdate, arg++, sizeof(cl_mem), (void *) &seed_min_dist_d);
+    errcode |= clSetKernelArg(clKernel_kmeansSeedUpdate, arg++, sizeof(cl_mem), (void *) &seed_nearest_d);
+    errcode |= clSetKernelArg(clKernel_kmeansSeedUpdate, arg++, sizeof(cl_mem), (void *) &seed_cost_d);
+    errcode |= clSetKernelArg(clKernel_kmeansSeedUpdate, arg++, localWorkSize[0]*sizeof(float), NULL);
+    CHECKERR(errcode);
+    errcode = clEnqueueNDRangeKernel(clCommands, clKernel_kmeansSeedUpdate, 2, NULL, globalWorkSize, localWorkSize, 0, NULL, &ocdTempEvent);
+    CHECKERR(errcode);
+    errcode = clFinish(clCommands);
+    START_TIMER(ocdTempEvent, OCD_TIMER_KERNEL, "Seed Update Kernel", ocdTempTimer)
+    END_TIMER(ocdTempTimer)
+    CHECKERR(errcode);
+
+    errcode = clEnqueueReadBuffer(clCommands, seed_cost_d, CL_TRUE, 0, num_blocks*sizeof(float), (void *) seed_cost_h, 0, NULL, &ocdTempEvent);
+    clFinish(clCommands);
+    START_TIMER(ocdTempEvent, OCD_TIMER_D2H, "Seed Cost Copy", ocdTempTimer)
+    END_TIMER(ocdTempTimer)
+    CHECKERR(errcode);
+    for (unsigned int i = 0; i < num_blocks; i++)
+        cost += seed_cost_h[i];
+    return (float) cost;
+}
+
+/* returns how many points were picked, of which the first max_picked are
+   in picked (in no particular order) */
+extern "C"
+int seedSample(float scale, unsigned int seed, int *picked, int max_picked, int npoints)
+{
+    cl_int errcode;
+    size_t localWorkSize[2] = {num_threads, 1};
+    size_t globalWorkSize[2] = {num_blocks_perdim*localWorkSize[0], num_blocks_perdim*localWorkSize[1]};
+    int npicked = 0;
+
+    errcode = clEnqueueWriteBuffer(clCommands, seed_npicked_d, CL_TRUE, 0, sizeof(int), (void *) &npicked, 0, NULL, &ocdTempEvent);
+    clFinish(clCommands);
+    START_TIMER(ocdTempEvent, OCD_TIMER_H2D, "Seed Count Copy", ocdTempTimer)
+    END_TIMER(ocdTempTimer)
+    CHECKERR(errcode);
+
+    unsigned int arg = 0;
+    errcode = clSetKernelArg(clKernel_kmeansSeedSample, arg++, sizeof(cl_mem), (void *) &seed_min_dist_d);
+    errcode |= clSetKernelArg(clKernel_kmeansSeedSample, arg++, sizeof(int), (void *) &npoints);
+    errcode |= clSetKernelArg(clKernel_kmeansSeedSample, arg++, sizeof(float), (void *) &scale);
+    errcode |= clSetKernelArg(clKernel_kmeansSeedSample, arg++, sizeof(cl_uint), (void *) &seed);
+    errcode |= clSetKernelArg(clKernel_kmeansSeedSample, arg++, sizeof(cl_mem), (void *) &seed_picked_d);
+    errcode |= clSetKernelArg(clKernel_kmeansSeedSample, arg++, sizeof(cl_mem), (void *) &seed_npicked_d);
+    errcode |= clSetKernelArg(clKernel_kmeansSeedSample, arg++, sizeof(int), (void *) &max_picked);
+    CHECKERR(errcode);
+    errcode = clEnqueueNDRangeKernel(clCommands, clKernel_kmeansSeedSample, 2, NULL, globalWorkSize, localWorkSize, 0, NULL, &ocdTempEvent);
+    CHECKERR(errcode);
+    errcode = clFinish(clCommands);
+    START_TIMER(ocdTempEvent, OCD_TIMER_KERNEL, "Seed Sample Kernel", ocdTempTimer)
+    END_TIMER(ocdTempTimer)
+    CHECKERR(errcode);
+
+    errcode = clEnqueueReadBuffer(clCommands, seed_npicked_d, CL_TRUE, 0, sizeof(int), (void *) &npicked, 0, NULL, &ocdTempEvent);
+    clFinish(clCommands);
+    START_TIMER(ocdTempEvent, OCD_TIMER_D2H, "Seed Count Copy", ocdTempTimer)
+    END_TIMER(ocdTempTimer)
+    CHECKERR(errcode);
+    if (npicked > 0) {
+        errcode = clEnqueueReadBuffer(clCommands, seed_picked_d, CL_TRUE, 0, (npicked < max_picked ? npicked : max_picked)*sizeof(int), (void *) picked, 0, NULL, &ocdTempEvent);
+        clFinish(clCommands);
+        START_TIMER(ocdTempEvent, OCD_TIMER_D2H, "Seed Pick Copy", ocdTempTimer)
+        END_TIMER(ocdTempTimer)
+        CHECKERR(errcode);
+    }
+    return npicked;
+}
+
+/* weights[c] = number of points whose nearest candidate is c; weights
+   comes in zeroed */
+extern "C"
+void seedWeights(int *weights, int ncandidates, int npoints)
+{
+    cl_int errcode;
+    size_t localWorkSize[2] = {num_threads, 1};
+    size_t globalWorkSize[2] = {num_blocks_perdim*localWorkSize[0], num_blocks_perdim*localWorkSize[1]};
+
+    errcode = clEnqueueWriteBuffer(clCommands, seed_centres_d, CL_TRUE, 0, ncandidates*sizeof(int), (void *) weights, 0, NULL, &ocdTempEvent);
+    clFinish(clCommands);
+    START_TIMER(ocdTempEvent, OCD_TIMER_H2D, "Seed Weight Copy", ocdTempTimer)
+    END_TIMER(ocdTempTimer)
+    CHECKERR(errcode);
+
+    unsigned int arg = 0;
+    errcode = clSetKernelArg(clKernel_kmeansSeedWeights, arg++, sizeof(cl_mem), (void *) &seed_nearest_d);
+    errcode |= clSetKernelArg(clKernel_kmeansSeedWeights, arg++, sizeof(int), (void *) &npoints);
+    errcode |= clSetKernelArg(clKernel_kmeansSeedWeights, arg++, sizeof(cl_mem), (void *) &seed_centres_d);
+    CHECKERR(errcode);
+    errcode = clEnqueueNDRangeKernel(clCommands, clKernel_kmeansSeedWeights, 2, NULL, globalWorkSize, localWorkSize, 0, NULL, &ocdTempEvent);
+    CHECKERR(errcode);
+    errcode = clFinish(clCommands);
+    START_TIMER(ocdTempEvent, OCD_TIMER_KERNEL, "Seed Weights Kernel", ocdTempTimer)
+    END_TIMER(ocdTempTimer)
+    CHECKERR(errcode);
+
+    errcode = clEnqueueReadBuffer(clCommands, seed_centres_d, CL_TRUE, 0, ncandidates*sizeof(int), (void *) weights, 0, NULL, &ocdTempEvent);
+    clFinish(clCommands);
+    START_TIMER(ocdTempEvent, OCD_TIMER_D2H, "Seed Weight Copy", ocdTempTimer)
+    END_TIMER(ocdTempTimer)
+    CHECKERR(errcode);
+}
+/* ------------------- k-means|| seeding end ------------------------ */
+
+/* ------------------- multi-k sweep (-S) ------------------------ */
+/* each job slot gets its own queue, kernel object and membership/centre
+   buffers; feature_d and feature_flipped_d from allocateMemory() are
+   shared by all of them. */
+extern "C"
+void sweepOpen(int njobs, int npoints, int max_nclusters, int nfeatures)
+{
+    cl_int errcode;
+
+    sweep_nqueues = njobs;
+    sweep_queues = (sweep_queue *) calloc(njobs, sizeof(sweep_queue));
+    for (int i = 0; i < njobs; i++) {
+        sweep_queue *q = &sweep_queues[i];
+        q->queue = clCreateCommandQueue(clContext, clDevice, CL_QUEUE_PROFILING_ENABLE, &errcode);
+        CHECKERR(errcode);
+        q->kernel = clCreateKernel(clProgram, "kmeansPoint", &errcode);
+        CHECKERR(errcode);
+        q->membership_d = clCreateBuffer(clContext, CL_MEM_READ_WRITE, npoints*sizeof(int), NULL, &errcode);
+        CHECKERR(errcode);
+        q->clusters_d = clCreateBuffer(clContext, CL_MEM_READ_ONLY, max_nclusters*nfeatures*sizeof(float), NULL, &errcode);
+        CHECKERR(errcode);
+        q->membership_new = (int *) malloc(npoints*sizeof(int));
+    }
+}
+
+extern "C"
+void sweepClose()
+{
+    for (int i = 0; i < sweep_nqueues; i++) {
+        sweep_queue *q = &sweep_queues[i];
+        clReleaseMemObject(q->membership_d);
+        clReleaseMemObject(q->clusters_d);
+        clReleaseKernel(q->kernel);
+        clReleaseCommandQueue(q->queue);
+        free(q->membership_new);
+    }
+    free(sweep_queues);
+}
+
+/* non-blocking assignment step of the job in slot; clusters must stay
+   untouched until sweepWait() */
+extern "C"
+void sweepEnqueue(int slot, int nfeatures, int npoints, int nclusters, float **clusters)
+{
+    cl_int errcode;
+    sweep_queue *q = &sweep_queues[slot];
+    size_t localWorkSize[2] = {num_threads_perdim*num_threads_perdim, 1};
+    size_t globalWorkSize[2] = {num_blocks_perdim*localWorkSize[0], num_blocks_perdim*localWorkSize[1]};
+
+    errcode = clEnqueueWriteBuffer(q->queue, q->clusters_d, CL_FALSE, 0, nclusters*nfeatures*sizeof(float), (void *) clusters[0], 0, NULL, &q->events[0]);
+    CHECKERR(errcode);
+
+    unsigned int arg = 0;
+    errcode = clSetKernelArg(q->kernel, arg++, sizeof(cl_mem), (void *) &feature_d);
+    errcode |= clSetKernelArg(q->kernel, arg++, sizeof(cl_mem), (void *) &feature_flipped_d);
+    errcode |= clSetKernelArg(q->kernel, arg++, sizeof(int), (void *) &nfeatures);
+    errcode |= clSetKernelArg(q->kernel, arg++, sizeof(int), (void *) &npoints);
+    errcode |= clSetKernelArg(q->kernel, arg++, sizeof(int), (void *) &nclusters);
+    errcode |= clSetKernelArg(q->kernel, arg++, sizeof(cl_mem), (void *) &q->membership_d);
+    errcode |= clSetKernelArg(q->kernel, arg++, sizeof(cl_mem), (void *) &q->clusters_d);
+    CHECKERR(errcode);
+    errcode = clEnqueueNDRangeKernel(q->queue, q->kernel, 2, NULL, globalWorkSize, localWorkSize, 0, NULL, &q->events[1]);
+    CHECKERR(errcode);
+
+    errcode = clEnqueueReadBuffer(q->queue, q->membership_d, CL_FALSE, 0, npoints*sizeof(int), (void *) q->membership_new, 0, NULL, &q->events[2]);
+    CHECKERR(errcode);
+    clFlush(q->queue);
+}
+
+/* waits for the step enqueued on slot and reduces it on the host as
+   kmeansCuda() does; returns delta */
+extern "C"
+int sweepWait(int slot, float **feature, int nfeatures, int npoints, int *membership,
+              int *new_centers_len, float **new_centers)
+{
+    cl_int errcode;
+    sweep_queue *q = &sweep_queues[slot];
+    int delta = 0;
+
+    errcode = clWaitForEvents(1, &q->events[2]);
+    CHECKERR(errcode);
+    START_TIMER(q->events[0], OCD_TIMER_H2D, "Cluster Copy", ocdTempTimer)
+    END_TIMER(ocdTempTimer)
+    START_TIMER(q->events[1], OCD_TIMER_KERNEL, "Point Kernel", ocdTempTimer)
+    END_TIMER(ocdTempTimer)
+    START_TIMER(q->events[2], OCD_TIMER_D2H, "Membership Copy", ocdTempTimer)
+    END_TIMER(ocdTempTimer)
+
+    for (int i = 0; i < npoints; i++) {
+        int cluster_id = q->membership_new[i];
+        new_centers_len[cluster_id]++;
+        if (q->membership_new[i] != membership[i]) {
+            delta++;
+            membership[i] = q->membership_new[i];
+        }
+        for (int j = 0; j < nfeatures; j++)
+            new_centers[cluster_id][j] += feature[i][j];
+    }
+    return delta;
+}
+/* ------------------- multi-k sweep end ------------------------ */
@@ -185,4 +185,430 @@ kmeansPoint(__global float  *features,			/* in: [npoints*nfeatures] */
 #endif
 
 }
+
+/* ----------------- kmeansHamerly() --------------------- */
+/* nearest-centre assignment with Hamerly's bounds. upper[p] bounds the
+   distance from point p to its own centre and lower[p] the distance to
+   every other centre; both are moved by how far the centres moved
+   (centre_bounds[0..nclusters)), and the centres are only scanned when
+   upper[p] exceeds max(lower[p], half the gap from its centre to the
+   nearest other one, centre_bounds[nclusters..2*nclusters)).
+   membership[p] < 0 forces a full scan. */
+__kernel void
+kmeansHamerly(__global float  *features,		/* in: [nfeatures*npoints], inverted */
+              int     nfeatures,
+              int     npoints,
+              int     nclusters,
+              __global int    *membership,
+              __constant float  *clusters,
+              __global float  *upper,
+              __global float  *lower,
+              __constant float  *centre_bounds,
+              int     max_move_id,
+              float   max_move,
+              float   second_move)
+{
+	const unsigned int block_id = get_num_groups(0)*get_group_id(1)+get_group_id(0);
+	const unsigned int point_id = block_id*get_local_size(0)*get_local_size(1) + get_local_id(0);
+	int   i, j;
+	int   index;
+	float u, l, m;
+	float d1, d2;
+
+	if (point_id >= npoints)
+		return;
+
+	index = membership[point_id];
+	if (index >= 0) {
+		u = upper[point_id] + centre_bounds[index];
+		l = lower[point_id] - (index == max_move_id ? second_move : max_move);
+		m = max(centre_bounds[nclusters + index], l);
+		if (u > m) {
+			float ans = 0.0f;
+			for (j = 0; j < nfeatures; j++) {
+				float diff = features[point_id + j*npoints] - clusters[index*nfeatures + j];
+				ans += diff*diff;
+			}
+			u = sqrt(ans);
+		}
+		if (u <= m) {
+			upper[point_id] = u;
+			lower[point_id] = l;
+			return;
+		}
+	}
+
+	/* bounds failed: find the nearest and second nearest centres */
+	d1 = d2 = FLT_MAX;
+	index = -1;
+	for (i = 0; i < nclusters; i++) {
+		float ans = 0.0f;
+		for (j = 0; j < nfeatures; j++) {
+			float diff = features[point_id + j*npoints] - clusters[i*nfeatures + j];
+			ans += diff*diff;
+		}
+		if (ans < d1) {
+			d2 = d1;
+			d1 = ans;
+			index = i;
+		}
+		else if (ans < d2)
+			d2 = ans;
+	}
+	upper[point_id] = sqrt(d1);
+	lower[point_id] = sqrt(d2);
+	membership[point_id] = index;
+}
+/* ----------------- kmeansHamerly() end --------------------- */
+
+/* ----------------- kmeansPointDelta() --------------------- */
+/* device-resident loop, step 1: nearest-centre assignment as in
+   kmeansPoint, counting the points that changed cluster into
+   loop_state[0] with one atomic per work-group */
+__kernel void
+kmeansPointDelta(__global float  *features,		/* in: [nfeatures*npoints], inverted */
+                 int     nfeatures,
+                 int     npoints,
+                 int     nclusters,
+                 __global int    *membership,
+                 __constant float  *clusters,
+                 __global int    *loop_state,
+                 __local  int    *deltas)		/* [local size] */
+{
+	const unsigned int block_id = get_num_groups(0)*get_group_id(1)+get_group_id(0);
+	const unsigned int point_id = block_id*get_local_size(0)*get_local_size(1) + get_local_id(0);
+	const unsigned int lid = get_local_id(0);
+	unsigned int s;
+	int changed = 0;
+
+	if (point_id < npoints)
+	{
+		int i, j;
+		int index = -1;
+		float min_dist = FLT_MAX;
+
+		for (i=0; i<nclusters; i++) {
+			float ans = 0.0f;
+			for (j=0; j < nfeatures; j++) {
+				float diff = features[point_id + j*npoints] - clusters[i*nfeatures + j];
+				ans += diff*diff;
+			}
+			if (ans < min_dist) {
+				min_dist = ans;
+				index    = i;
+			}
+		}
+		if (membership[point_id] != index) {
+			membership[point_id] = index;
+			changed = 1;
+		}
+	}
+
+	deltas[lid] = changed;
+	barrier(CLK_LOCAL_MEM_FENCE);
+	for (s = get_local_size(0)/2; s > 0; s >>= 1) {
+		if (lid < s)
+			deltas[lid] += deltas[lid + s];
+		barrier(CLK_LOCAL_MEM_FENCE);
+	}
+	if (lid == 0 && deltas[0] > 0)
+		atomic_add(&loop_state[0], deltas[0]);
+}
+/* ----------------- kmeansPointDelta() end --------------------- */
+
+/* ----------------- kmeansPartialSums() --------------------- */
+/* device-resident loop, step 2: work-item (f, ch) sums feature f of the
+   points in chunk ch into partial[ch][cluster][f]. Each work-item owns its
+   slice of partial, so no atomics are needed; the f == 0 work-item also
+   counts the points per cluster. */
+__kernel void
+kmeansPartialSums(__global float  *features_flipped,	/* in: [npoints*nfeatures] */
+                  int     nfeatures,
+                  int     npoints,
+                  int     nclusters,
+                  int     chunk,						/* points per chunk */
+                  __global int    *membership,
+                  __global float  *partial,				/* [nchunks][nclusters][nfeatures] */
+                  __global int    *partial_len)			/* [nchunks][nclusters] */
+{
+	const int f  = get_global_id(0);
+	const int ch = get_global_id(1);
+	__global float *sums = partial + ch*nclusters*nfeatures;
+	__global int   *lens = partial_len + ch*nclusters;
+	int start = ch*chunk;
+	int end   = min(start + chunk, npoints);
+	int i;
+
+	if (f >= nfeatures)
+		return;
+
+	for (i = 0; i < nclusters; i++) {
+		sums[i*nfeatures + f] = 0.0f;
+		if (f == 0)
+			lens[i] = 0;
+	}
+	for (i = start; i < end; i++) {
+		int c = membership[i];
+		sums[c*nfeatures + f] += features_flipped[i*nfeatures + f];
+		if (f == 0)
+			lens[c]++;
+	}
+}
+/* ----------------- kmeansPartialSums() end --------------------- */
+
+/* ----------------- kmeansUpdateCentres() --------------------- */
+/* device-resident loop, step 3: one work-item per centre coordinate folds
+   the chunk sums into the new centre (empty clusters keep theirs). Work-item
+   0 also runs the convergence test, leaving the result in loop_state[1]
+   for the host and clearing the delta count for the next iteration. */
+__kernel void
+kmeansUpdateCentres(__global float  *partial,
+                    __global int    *partial_len,
+                    int     nfeatures,
+                    int     nclusters,
+                    int     nchunks,
+                    float   threshold,
+                    __global float  *clusters,
+                    __global int    *loop_state)
+{
+	const int id = get_global_id(0);
+	int c, f, ch;
+
+	if (id < nclusters*nfeatures) {
+		float sum = 0.0f;
+		int   len = 0;
+
+		c = id / nfeatures;
+		f = id - c*nfeatures;
+		for (ch = 0; ch < nchunks; ch++) {
+			sum += partial[(ch*nclusters + c)*nfeatures + f];
+			len += partial_len[ch*nclusters + c];
+		}
+		if (len > 0)
+			clusters[id] = sum / len;
+	}
+
+	if (id == 0) {
+		loop_state[1] = ((float) loop_state[0] > threshold);
+		loop_state[0] = 0;
+	}
+}
+/* ----------------- kmeansUpdateCentres() end --------------------- */
+
+/* ----------------- k-means|| seeding --------------------- */
+/* per-point hash so the device and host seeding sample the same points */
+uint seed_hash(uint x, uint seed)
+{
+	x ^= seed * 0x9E3779B9u;
+	x ^= x >> 16;
+	x *= 0x7FEB352Du;
+	x ^= x >> 15;
+	x *= 0x846CA68Bu;
+	x ^= x >> 16;
+	return x;
+}
+
+/* lowers min_dist[p] (squared distance to the nearest candidate so far)
+   with the m new candidates, whose ids start at first; first == 0 starts
+   afresh. Each work-group leaves the sum of its min_dist in block_cost. */
+__kernel void
+kmeansSeedUpdate(__global float  *features,			/* in: [nfeatures*npoints], inverted */
+                 int     nfeatures,
+                 int     npoints,
+                 __global float  *centres,			/* [m][nfeatures] new candidates */
+                 int     m,
+                 int     first,
+                 __global float  *min_dist,
+                 __global int    *nearest,
+                 __global float  *block_cost,
+                 __local  float  *cost)				/* [local size] */
+{
+	const unsigned int block_id = get_num_groups(0)*get_group_id(1)+get_group_id(0);
+	const unsigned int point_id = block_id*get_local_size(0)*get_local_size(1) + get_local_id(0);
+	const unsigned int lid = get_local_id(0);
+	unsigned int s;
+	float d = 0.0f;
+
+	if (point_id < npoints) {
+		int i, j;
+		int index = first == 0 ? -1 : nearest[point_id];
+
+		d = first == 0 ? FLT_MAX : min_dist[point_id];
+		for (i = 0; i < m; i++) {
+			float ans = 0.0f;
+			for (j = 0; j < nfeatures; j++) {
+				float diff = features[point_id + j*npoints] - centres[i*nfeatures + j];
+				ans += diff*diff;
+			}
+			if (ans < d) {
+				d = ans;
+				index = first + i;
+			}
+		}
+		min_dist[point_id] = d;
+		nearest[point_id] = index;
+	}
+
+	cost[lid] = d;
+	barrier(CLK_LOCAL_MEM_FENCE);
+	for (s = get_local_size(0)/2; s > 0; s >>= 1) {
+		if (lid < s)
+			cost[lid] += cost[lid + s];
+		barrier(CLK_LOCAL_MEM_FENCE);
+	}
+	if (lid == 0)
+		block_cost[block_id] = cost[0];
+}
+
+/* picks point p with probability min(1, scale*min_dist[p]); the first
+   max_picked picks are appended to picked, npicked counts them all */
+__kernel void
+kmeansSeedSample(__global float  *min_dist,
+                 int     npoints,
+                 float   scale,						/* oversampling / total cost */
+                 uint    seed,
+                 __global int    *picked,
+                 __global int    *npicked,
+                 int     max_picked)
+{
+	const unsigned int block_id = get_num_groups(0)*get_group_id(1)+get_group_id(0);
+	const unsigned int point_id = block_id*get_local_size(0)*get_local_size(1) + get_local_id(0);
+
+	if (point_id < npoints) {
+		float u = (seed_hash(point_id, seed) >> 8) * (1.0f / 16777216.0f);
+		if (u < scale * min_dist[point_id]) {
+			int i = atomic_inc(npicked);
+			if (i < max_picked)
+				picked[i] = point_id;
+		}
+	}
+}
+
+/* weight of each candidate: the number of points nearest to it */
+__kernel void
+kmeansSeedWeights(__global int    *nearest,
+                  int     npoints,
+                  __global int    *weights)
+{
+	const unsigned int block_id = get_num_groups(0)*get_group_id(1)+get_group_id(0);
+	const unsigned int point_id = block_id*get_local_size(0)*get_local_size(1) + get_local_id(0);
+
+	if (point_id < npoints)
+		atomic_inc(&weights[nearest[point_id]]);
+}
+/* ----------------- k-means|| seeding end --------------------- */
+
+/* ----------------- kmeansPointGemm() --------------------- */
+/* nearest-centre assignment as a matrix multiply: ||x-c||^2 is
+   ||x||^2 - 2 x.c + ||c||^2, and ||x||^2 does not change the argmin, so
+   each point takes the centre minimising centre_norms[c] - 2 x.c.
+   A 16x16 work-group owns GEMM_BLOCK points and sweeps all centres in
+   blocks of GEMM_BLOCK; features are staged through local memory GEMM_TK
+   at a time and every work-item accumulates a 4x4 register tile of dot
+   products (points ty+16i, centres tx+16j). Launched with local size
+   (16, 16) and one work-group per GEMM_BLOCK points along dimension 0. */
+#define GEMM_TK		16
+#define GEMM_WPT	4
+#define GEMM_BLOCK	(16*GEMM_WPT)
+
+__kernel void
+kmeansPointGemm(__global float  *features_flipped,	/* in: [npoints*nfeatures] */
+                int     nfeatures,
+                int     npoints,
+                int     nclusters,
+                __global int    *membership,
+                __global float  *clusters,			/* [nclusters*nfeatures] */
+                __global float  *centre_norms)		/* [nclusters] */
+{
+	__local float xs[GEMM_BLOCK][GEMM_TK+1];
+	__local float cs[GEMM_BLOCK][GEMM_TK+1];
+	__local float best_d[GEMM_BLOCK][16];
+	__local int   best_i[GEMM_BLOCK][16];
+
+	const int tx = get_local_id(0);
+	const int ty = get_local_id(1);
+	const int lid = ty*16 + tx;
+	const int p0 = get_group_id(0) * GEMM_BLOCK;
+	float bd[GEMM_WPT];
+	int   bi[GEMM_WPT];
+	int   c0, k0, i, j, l, kk;
+
+	for (i = 0; i < GEMM_WPT; i++) {
+		bd[i] = FLT_MAX;
+		bi[i] = -1;
+	}
+
+	for (c0 = 0; c0 < nclusters; c0 += GEMM_BLOCK) {
+		float acc[GEMM_WPT][GEMM_WPT];
+
+		for (i = 0; i < GEMM_WPT; i++)
+			for (j = 0; j < GEMM_WPT; j++)
+				acc[i][j] = 0.0f;
+
+		for (k0 = 0; k0 < nfeatures; k0 += GEMM_TK) {
+			/* 256 work-items stage a GEMM_BLOCK x GEMM_TK tile of each */
+			for (l = 0; l < GEMM_BLOCK*GEMM_TK/256; l++) {
+				int e = lid + 256*l;
+				int row = e / GEMM_TK;
+				int col = e - row*GEMM_TK;
+				int k = k0 + col;
+				xs[row][col] = (p0 + row < npoints && k < nfeatures) ?
+					features_flipped[(p0 + row)*nfeatures + k] : 0.0f;
+				cs[row][col] = (c0 + row < nclusters && k < nfeatures) ?
+					clusters[(c0 + row)*nfeatures + k] : 0.0f;
+			}
+			barrier(CLK_LOCAL_MEM_FENCE);
+
+			for (kk = 0; kk < GEMM_TK; kk++) {
+				float a[GEMM_WPT], b[GEMM_WPT];
+				for (i = 0; i < GEMM_WPT; i++)
+					a[i] = xs[ty + 16*i][kk];
+				for (j = 0; j < GEMM_WPT; j++)
+					b[j] = cs[tx + 16*j][kk];
+				for (i = 0; i < GEMM_WPT; i++)
+					for (j = 0; j < GEMM_WPT; j++)
+						acc[i][j] = mad(a[i], b[j], acc[i][j]);
+			}
+			barrier(CLK_LOCAL_MEM_FENCE);
+		}
+
+		/* centres are visited in increasing order per work-item, so a
+		   strict < keeps the lowest index on ties like kmeansPoint */
+		for (j = 0; j < GEMM_WPT; j++) {
+			int c = c0 + tx + 16*j;
+			if (c < nclusters) {
+				float cn = centre_norms[c];
+				for (i = 0; i < GEMM_WPT; i++) {
+					float d = cn - 2.0f*acc[i][j];
+					if (d < bd[i]) {
+						bd[i] = d;
+						bi[i] = c;
+					}
+				}
+			}
+		}
+	}
+
+	/* each point's best over the 16 work-items of its row */
+	for (i = 0; i < GEMM_WPT; i++) {
+		best_d[ty + 16*i][tx] = bd[i];
+		best_i[ty + 16*i][tx] = bi[i];
+	}
+	barrier(CLK_LOCAL_MEM_FENCE);
+	if (lid < GEMM_BLOCK && p0 + lid < npoints) {
+		float d = best_d[lid][0];
+		int   index = best_i[lid][0];
+		for (j = 1; j < 16; j++) {
+			float dj = best_d[lid][j];
+			int   ij = best_i[lid][j];
+			if (dj < d || (dj == d && ij < index)) {
+				d = dj;
+				index = ij;
+			}
+		}
+		membership[p0 + lid] = index;
+	}
+}
+/* ----------------- kmeansPointGemm() end --------------------- */
+
 #endif // #ifndef _KMEANS_CUDA_KERNEL_H_
@@ -0,0 +1,242 @@
+/*************************************************************************/
+/**   File:         kmeans_seed.c                                       **/
+/**   Description:  k-means|| seeding (Bahmani et al., VLDB 2012).      **/
+/**                 A few rounds oversample points with probability     **/
+/**                 proportional to their squared distance from the     **/
+/**                 candidates so far; the weighted candidates are then **/
+/**                 reduced to nclusters centres with k-means++ and a   **/
+/**                 short weighted Lloyd run. The distance and sampling **/
+/**                 rounds run on the device, or on the host with -c.   **/
+/*************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+#include <math.h>
+#include <omp.h>
+
+#include "kmeans.h"
+
+#define SEED_ROUNDS			5		/* the paper finds 5 rounds enough */
+#define SEED_OVERSAMPLE		2		/* expected picks per round, times nclusters */
+#define SEED_REDUCE_LOOPS	50		/* weighted Lloyd iterations over candidates */
+
+/* same hash as seed_hash() in kmeans_opencl_kernel.cl */
+static unsigned int seed_hash(unsigned int x, unsigned int seed)
+{
+	x ^= seed * 0x9E3779B9u;
+	x ^= x >> 16;
+	x *= 0x7FEB352Du;
+	x ^= x >> 15;
+	x *= 0x846CA68Bu;
+	x ^= x >> 16;
+	return x;
+}
+
+static float dist_2(const float *a, const float *b, int nfeatures)
+{
+	int   i;
+	float ans = 0.0;
+
+	for (i = 0; i < nfeatures; i++)
+		ans += (a[i]-b[i]) * (a[i]-b[i]);
+	return ans;
+}
+
+static int compare_int(const void *a, const void *b)
+{
+	return *(const int*) a - *(const int*) b;
+}
+
+/* host rounds, mirroring kmeansSeedUpdate/Sample/Weights */
+static float	*min_dist;
+static int		*nearest;
+
+static float host_update(float **feature, int nfeatures, int npoints,
+						 const float *centres, int m, int first)
+{
+	double cost = 0.0;
+	int    p, i;
+
+	#pragma omp parallel for private(i) reduction(+:cost) schedule(static)
+	for (p = 0; p < npoints; p++) {
+		float d = first == 0 ? FLT_MAX : min_dist[p];
+		int   index = first == 0 ? -1 : nearest[p];
+		for (i = 0; i < m; i++) {
+			float dist = dist_2(feature[p], centres + i*nfeatures, nfeatures);
+			if (dist < d) {
+				d = dist;
+				index = first + i;
+			}
+		}
+		min_dist[p] = d;
+		nearest[p] = index;
+		cost += d;
+	}
+	return (float) cost;
+}
+
+static int host_sample(int npoints, float scale, unsigned int seed,
+					   int *picked, int max_picked)
+{
+	int p, n = 0;
+
+	for (p = 0; p < npoints; p++) {
+		float u = (seed_hash(p, seed) >> 8) * (1.0f / 16777216.0f);
+		if (u < scale * min_dist[p]) {
+			if (n < max_picked)
+				picked[n] = p;
+			n++;
+		}
+	}
+	return n;
+}
+
+/*----< reduce_candidates() >-----------------------------------------------*/
+/* weighted k-means++ over the candidates, polished by weighted Lloyd */
+static void reduce_candidates(const float *cand, const int *weights, int ncand,
+							  int nfeatures, float **clusters, int nclusters)
+{
+	float  *d2 = (float*) malloc(ncand * sizeof(float));
+	int    *assign = (int*) malloc(ncand * sizeof(int));
+	double *sums = (double*) malloc(nclusters * nfeatures * sizeof(double));
+	double *lens = (double*) malloc(nclusters * sizeof(double));
+	int		c, i, j, loop, pick = 0;
+	double	total = 0.0, r;
+
+	/* first centre with probability proportional to weight */
+	for (c = 0; c < ncand; c++)
+		total += weights[c];
+	r = (double) rand() / RAND_MAX * total;
+	for (c = 0; c < ncand - 1 && (r -= weights[c]) > 0; c++)
+		;
+	memcpy(clusters[0], cand + c*nfeatures, nfeatures*sizeof(float));
+	for (c = 0; c < ncand; c++)
+		d2[c] = dist_2(cand + c*nfeatures, clusters[0], nfeatures);
+
+	/* the rest with probability proportional to weight * D^2 */
+	for (i = 1; i < nclusters; i++) {
+		total = 0.0;
+		for (c = 0; c < ncand; c++)
+			total += (double) weights[c] * d2[c];
+		if (total > 0.0) {
+			r = (double) rand() / RAND_MAX * total;
+			for (pick = 0; pick < ncand - 1 && (r -= (double) weights[pick] * d2[pick]) > 0; pick++)
+				;
+		}
+		else	/* fewer distinct candidates than clusters */
+			pick = (pick + 1) % ncand;
+		memcpy(clusters[i], cand + pick*nfeatures, nfeatures*sizeof(float));
+		for (c = 0; c < ncand; c++) {
+			float d = dist_2(cand + c*nfeatures, clusters[i], nfeatures);
+			if (d < d2[c])
+				d2[c] = d;
+		}
+	}
+
+	for (c = 0; c < ncand; c++)
+		assign[c] = -1;
+	for (loop = 0; loop < SEED_REDUCE_LOOPS; loop++) {
+		int changed = 0;
+
+		memset(sums, 0, nclusters * nfeatures * sizeof(double));
+		memset(lens, 0, nclusters * sizeof(double));
+		for (c = 0; c < ncand; c++) {
+			float min = FLT_MAX;
+			int   index = 0;
+			for (i = 0; i < nclusters; i++) {
+				float d = dist_2(cand + c*nfeatures, clusters[i], nfeatures);
+				if (d < min) {
+					min = d;
+					index = i;
+				}
+			}
+			changed += assign[c] != index;
+			assign[c] = index;
+			lens[index] += weights[c];
+			for (j = 0; j < nfeatures; j++)
+				sums[index*nfeatures + j] += (double) weights[c] * cand[c*nfeatures + j];
+		}
+		for (i = 0; i < nclusters; i++)
+			if (lens[i] > 0)
+				for (j = 0; j < nfeatures; j++)
+					clusters[i][j] = (float) (sums[i*nfeatures + j] / lens[i]);
+		if (!changed)
+			break;
+	}
+
+	free(d2);
+	free(assign);
+	free(sums);
+	free(lens);
+}
+
+/*----< kmeans_parallel_seed() >--------------------------------------------*/
+/* fills clusters[nclusters][nfeatures]. On the device path the features
+   must already be resident, i.e. allocateMemory() has been called. */
+void kmeans_parallel_seed(float **feature, int nfeatures, int npoints,
+						  int nclusters, float **clusters)
+{
+	int		oversample = SEED_OVERSAMPLE * nclusters;
+	int		max_picked = 4 * oversample;
+	int		max_cand = 1 + SEED_ROUNDS * max_picked;
+	float  *cand = (float*) malloc(max_cand * nfeatures * sizeof(float));
+	int    *picked = (int*) malloc(max_picked * sizeof(int));
+	int    *weights = (int*) calloc(max_cand, sizeof(int));
+	int		ncand = 1, first = 0, round, i, n;
+	float	cost;
+
+	if (kmeans_host) {
+		min_dist = (float*) malloc(npoints * sizeof(float));
+		nearest = (int*) malloc(npoints * sizeof(int));
+	}
+	else
+		seedAllocate(npoints, nfeatures, max_picked, max_cand);
+
+	/* one uniformly random point to start */
+	memcpy(cand, feature[rand() % npoints], nfeatures*sizeof(float));
+
+	for (round = 0; ; round++) {
+		/* fold the candidates added last round into the distances */
+		if (kmeans_host)
+			cost = host_update(feature, nfeatures, npoints, cand + first*nfeatures, ncand - first, first);
+		else
+			cost = seedUpdate(cand + first*nfeatures, ncand - first, first, nfeatures, npoints);
+		if (round == SEED_ROUNDS || cost <= 0.0f)
+			break;
+
+		if (kmeans_host)
+			n = host_sample(npoints, oversample / cost, (unsigned int) rand(), picked, max_picked);
+		else
+			n = seedSample(oversample / cost, (unsigned int) rand(), picked, max_picked, npoints);
+		if (n > max_picked)
+			n = max_picked;
+		/* device picks arrive in any order */
+		qsort(picked, n, sizeof(int), compare_int);
+
+		first = ncand;
+		for (i = 0; i < n; i++, ncand++)
+			memcpy(cand + ncand*nfeatures, feature[picked[i]], nfeatures*sizeof(float));
+		if (ncand == first)
+			break;
+	}
+
+	if (kmeans_host) {
+		for (i = 0; i < npoints; i++)
+			weights[nearest[i]]++;
+		free(min_dist);
+		free(nearest);
+	}
+	else {
+		seedWeights(weights, ncand, npoints);
+		seedDeallocate();
+	}
+
+	printf("k-means|| seeding: %d candidates in %d rounds\n", ncand, round);
+	reduce_candidates(cand, weights, ncand, nfeatures, clusters, nclusters);
+
+	free(cand);
+	free(picked);
+	free(weights);
+}
@@ -0,0 +1,195 @@
+/*************************************************************************/
+/**   File:         kmeans_sweep.c                                      **/
+/**   Description:  Sweep over k = min..max_nclusters with nloops       **/
+/**                 restarts each, running up to kmeans_sweep_jobs      **/
+/**                 (k, restart) jobs at once on their own queues. The  **/
+/**                 features are uploaded and inverted once for the     **/
+/**                 whole sweep.                                        **/
+/*************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+#include <math.h>
+#include <omp.h>
+
+#include "kmeans.h"
+
+typedef struct {
+	int		 active;
+	int		 nclusters;
+	int		 restart;
+	int		 loop;
+	int		*membership;
+	int		*new_centers_len;
+	float  **clusters;
+	float  **new_centers;
+} sweep_slot;
+
+static float **alloc_centres(int nclusters, int nfeatures)
+{
+	float **c;
+	int     i;
+
+	c    = (float**) malloc(nclusters *             sizeof(float*));
+	c[0] = (float*)  calloc(nclusters * nfeatures,  sizeof(float));
+	for (i=1; i<nclusters; i++)
+		c[i] = c[i-1] + nfeatures;
+	return c;
+}
+
+static void free_centres(float **c)
+{
+	free(c[0]);
+	free(c);
+}
+
+/* same initial centres as kmeans_clustering() */
+static void start_job(sweep_slot *s, float **feature, int nfeatures, int npoints,
+					  int nclusters, int restart)
+{
+	int i;
+
+	s->active = 1;
+	s->nclusters = nclusters;
+	s->restart = restart;
+	s->loop = 0;
+	s->clusters = alloc_centres(nclusters, nfeatures);
+	s->new_centers = alloc_centres(nclusters, nfeatures);
+	s->new_centers_len = (int*) calloc(nclusters, sizeof(int));
+	if (kmeans_seed == KMEANS_SEED_PARALLEL)
+		kmeans_parallel_seed(feature, nfeatures, npoints, nclusters, s->clusters);
+	else
+		memcpy(s->clusters[0], feature[0], nclusters*nfeatures*sizeof(float));
+	for (i = 0; i < npoints; i++)
+		s->membership[i] = -1;
+}
+
+static void keep_centres(float ***cluster_centres, sweep_slot *s, int nfeatures)
+{
+	if (*cluster_centres)
+		free_centres(*cluster_centres);
+	*cluster_centres = alloc_centres(s->nclusters, nfeatures);
+	memcpy((*cluster_centres)[0], s->clusters[0], s->nclusters*nfeatures*sizeof(float));
+}
+
+static void end_job(sweep_slot *s)
+{
+	s->active = 0;
+	free_centres(s->clusters);
+	free_centres(s->new_centers);
+	free(s->new_centers_len);
+}
+
+/*---< cluster_sweep() >----------------------------------------------------*/
+/* drop-in for cluster(): same arguments and results; with isRMSE the best
+   RMSE and its iteration count are also reported for each k */
+int cluster_sweep(int      npoints,
+				  int      nfeatures,
+				  float  **features,
+				  int      min_nclusters,
+				  int	   max_nclusters,
+				  float    threshold,
+				  int     *best_nclusters,
+				  float ***cluster_centres,
+				  float	  *min_rmse,
+				  int	   isRMSE,
+				  int	   nloops)
+{
+	int			 njobs = kmeans_sweep_jobs;
+	sweep_slot	*slots = (sweep_slot*) calloc(njobs, sizeof(sweep_slot));
+	int			 nk, k, next, active = 0, index = 0;
+	float		*best_rmse;
+	int			*best_iters;
+	int			 i, j;
+
+	if (max_nclusters > npoints)
+		max_nclusters = npoints;
+	nk = max_nclusters - min_nclusters + 1;
+	best_rmse = (float*) malloc(nk * sizeof(float));
+	best_iters = (int*) malloc(nk * sizeof(int));
+	for (k = 0; k < nk; k++)
+		best_rmse[k] = FLT_MAX;
+	*min_rmse = FLT_MAX;
+
+	allocateMemory(npoints, nfeatures, max_nclusters, features);
+	sweepOpen(njobs, npoints, max_nclusters, nfeatures);
+	for (i = 0; i < njobs; i++)
+		slots[i].membership = (int*) malloc(npoints * sizeof(int));
+
+	/* jobs are numbered k-major: job = (k - min_nclusters) * nloops + restart */
+	for (next = 0; next < njobs && next < nk*nloops; next++, active++)
+		start_job(&slots[next], features, nfeatures, npoints,
+				  min_nclusters + next / nloops, next % nloops);
+
+	while (active > 0) {
+		/* one assignment step of every running job, queued side by side */
+		for (i = 0; i < njobs; i++)
+			if (slots[i].active)
+				sweepEnqueue(i, nfeatures, npoints, slots[i].nclusters, slots[i].clusters);
+
+		for (i = 0; i < njobs; i++) {
+			sweep_slot *s = &slots[i];
+			float delta;
+
+			if (!s->active)
+				continue;
+			delta = (float) sweepWait(i, features, nfeatures, npoints, s->membership,
+									  s->new_centers_len, s->new_centers);
+			for (k = 0; k < s->nclusters; k++) {
+				for (j = 0; j < nfeatures; j++) {
+					if (s->new_centers_len[k] > 0)
+						s->clusters[k][j] = s->new_centers[k][j] / s->new_centers_len[k];
+					s->new_centers[k][j] = 0.0;
+				}
+				s->new_centers_len[k] = 0;
+			}
+			if ((delta > threshold) && (s->loop++ < 500))
+				continue;
+
+			/* converged: score it and hand the slot to the next job */
+			if (isRMSE) {
+				float rmse = rms_err(features, nfeatures, npoints, s->clusters, s->nclusters);
+				int   kk = s->nclusters - min_nclusters;
+
+				if (rmse < best_rmse[kk]) {
+					best_rmse[kk] = rmse;
+					best_iters[kk] = s->loop + 1;
+				}
+				if (rmse < *min_rmse) {
+					*min_rmse = rmse;
+					*best_nclusters = s->nclusters;
+					index = s->restart;
+					keep_centres(cluster_centres, s, nfeatures);
+				}
+			} else if (s->nclusters == max_nclusters && s->restart == nloops-1) {
+				/* like cluster(), keep the last clustering of the sweep */
+				keep_centres(cluster_centres, s, nfeatures);
+			}
+			end_job(s);
+			active--;
+			if (next < nk*nloops) {
+				start_job(s, features, nfeatures, npoints,
+						  min_nclusters + next / nloops, next % nloops);
+				next++;
+				active++;
+			}
+		}
+	}
+
+	if (isRMSE) {
+		printf("\n  k    RMSE      iterations (best of %d)\n", nloops);
+		for (k = 0; k < nk; k++)
+			printf("%3d    %-9.3f %d\n", min_nclusters + k, best_rmse[k], best_iters[k]);
+	}
+
+	sweepClose();
+	deallocateMemory();
+	for (i = 0; i < njobs; i++)
+		free(slots[i].membership);
+	free(slots);
+	free(best_rmse);
+	free(best_iters);
+	return index;
+}
@@ -7,7 +7,8 @@
 
 bin_PROGRAMS += lud
 
-lud_SOURCES = dense-linear-algebra/lud/lud.c dense-linear-algebra/lud/common.c
+lud_LDFLAGS = -lm -lpthread @SEARCHFLAGS@ @LIBFLAGS@ @RPATHFLAGS@
+lud_SOURCES = dense-linear-algebra/lud/lud.c dense-linear-algebra/lud/common.c dense-linear-algebra/lud/lud_cpu.c dense-linear-algebra/lud/lud_pivot.c
 
 all_local += lud-all-local
 exec_local += lud-exec-local
@@ -70,6 +70,54 @@ create_matrix_from_file(float **mp, const char* filename, int *size_p){
   return RET_SUCCESS;
 }
 
+/*
+   Binary batch file: int size, int count, then count row-major
+   size x size float matrices. Matrix k is stored at *mp + k*(*stride_p),
+   the stride being size*size rounded up to a multiple of 16 floats so
+   every matrix starts on a 64-byte boundary.
+ */
+func_ret_t
+create_batch_from_file(float **mp, const char* filename, int *size_p, int *count_p, int *stride_p){
+  int k, size, count, stride;
+  float *m;
+  FILE *fp = NULL;
+
+  fp = fopen(filename, "rb");
+  if ( fp == NULL) {
+      return RET_FAILURE;
+  }
+
+  if (fread(&size, sizeof(int), 1, fp) != 1 || fread(&count, sizeof(int), 1, fp) != 1
+      || size <= 0 || count <= 0) {
+      fclose(fp);
+      return RET_FAILURE;
+  }
+  stride = (size*size + 15) & ~15;
+
+  m = (float*) calloc((size_t)stride*count, sizeof(float));
+  if ( m == NULL) {
+      fclose(fp);
+      return RET_FAILURE;
+  }
+
+  for (k=0; k < count; k++) {
+      if (fread(m+(size_t)k*stride, sizeof(float), size*size, fp) != (size_t)(size*size)) {
+          free(m);
+          fclose(fp);
+          return RET_FAILURE;
+      }
+  }
+
+  fclose(fp);
+
+  *size_p = size;
+  *count_p = count;
+  *stride_p = stride;
+  *mp = m;
+
+  return RET_SUCCESS;
+}
+
 func_ret_t
 create_matrix_from_random(float **mp, int size){
   float *l, *u, *m;
@@ -185,6 +233,77 @@ lud_verify(float *m, float *lu, int matrix_dim){
   free(tmp);
 }
 
+/*
+   Checks L*U against the original for every matrix of a batch, relative
+   to the largest entry of each matrix, and only prints the ones that
+   fail: a batch is far too large to dump like lud_verify() does.
+ */
+func_ret_t
+lud_batch_verify(float *m, float *lu, int size, int count, int stride){
+  int i, j, k, b, failed = 0;
+
+  for (b=0; b < count; b++) {
+    float *orig = m + (size_t)b*stride;
+    float *f = lu + (size_t)b*stride;
+    float scale = 0, err = 0;
+
+    for (i=0; i < size*size; i++)
+      if (fabs(orig[i]) > scale)
+        scale = fabs(orig[i]);
+
+    for (i=0; i < size; i++)
+      for (j=0; j < size; j++) {
+        float sum = 0;
+        for (k=0; k <= MIN(i,j); k++)
+          sum += (i == k ? 1 : f[i*size+k]) * f[k*size+j];
+        if (fabs(orig[i*size+j]-sum) > err)
+          err = fabs(orig[i*size+j]-sum);
+      }
+
+    if (err > 0.0001*(scale > 1 ? scale : 1)) {
+      if (failed++ < 10)
+        printf("dismatch in matrix %d: max error %f\n", b, err);
+    }
+  }
+  printf("%d of %d matrices verified\n", count-failed, count);
+
+  return failed ? RET_FAILURE : RET_SUCCESS;
+}
+
+/*
+   Checks P*A = L*U for the pivoted path, where P applies the row swaps
+   (i, piv[i]) in order. Only mismatches are printed.
+ */
+func_ret_t
+lud_pivot_verify(float *m, float *lu, int *piv, int matrix_dim){
+  int i, j, k, failed = 0;
+  float *pa;
+
+  matrix_duplicate(m, &pa, matrix_dim);
+  for (i=0; i < matrix_dim; i++)
+    if (piv[i] != i)
+      for (j=0; j < matrix_dim; j++) {
+        float t = pa[i*matrix_dim+j];
+        pa[i*matrix_dim+j] = pa[piv[i]*matrix_dim+j];
+        pa[piv[i]*matrix_dim+j] = t;
+      }
+
+  for (i=0; i < matrix_dim; i++)
+    for (j=0; j < matrix_dim; j++) {
+      float sum = 0;
+      for (k=0; k <= MIN(i,j); k++)
+        sum += (i == k ? 1 : lu[i*matrix_dim+k]) * lu[k*matrix_dim+j];
+      if (fabs(pa[i*matrix_dim+j]-sum) > 0.0001) {
+        if (failed++ < 20)
+          printf("dismatch at (%d, %d): (o)%f (n)%f\n", i, j, pa[i*matrix_dim+j], sum);
+      }
+    }
+  printf("%d mismatches\n", failed);
+
+  free(pa);
+  return failed ? RET_FAILURE : RET_SUCCESS;
+}
+
 void
 matrix_duplicate(float *src, float **dst, int matrix_dim) {
     int s = matrix_dim*matrix_dim*sizeof(float);
@@ -43,9 +43,18 @@ create_matrix_from_file(float **mp, const char *filename, int *size_p);
 func_ret_t
 create_matrix_from_random(float **mp, int size);
 
+func_ret_t
+create_batch_from_file(float **mp, const char *filename, int *size_p, int *count_p, int *stride_p);
+
 func_ret_t
 lud_verify(float *m, float *lu, int size);
 
+func_ret_t
+lud_batch_verify(float *m, float *lu, int size, int count, int stride);
+
+func_ret_t
+lud_pivot_verify(float *m, float *lu, int *piv, int size);
+
 void
 matrix_multiply(float *inputa, float *inputb, float *output, int size);
 
@@ -55,6 +64,10 @@ matrix_duplicate(float *src, float **dst, int matrix_dim);
 void
 print_matrix(float *mm, int matrix_dim);
 
+/* lud_cpu.c */
+void
+lud_cpu(float *m, int matrix_dim, int block_size, int num_threads);
+
 #ifdef __cplusplus
 }
 #endif
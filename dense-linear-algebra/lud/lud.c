@@ -2,12 +2,14 @@
 #include <unistd.h>
 #include <getopt.h>
 #include <stdlib.h>
+#include <string.h>
 #include <assert.h>
 #include <math.h>
 #include "../../include/rdtsc.h"
 #include "../../include/common_ocl.h"
 
 #include "common.h"
+#include "lud_pivot.h"
 
 #define CHECKERR(err) \
     if (err != CL_SUCCESS) \
@@ -18,8 +20,14 @@
 
 //#define USEGPU 1
 int BLOCK_SIZE = 16;
+static int tile = 0;	/* lud_internal micro-tile edge, 0 = pick for the device */
 int platform_id=PLATFORM_ID, device_id=DEVICE_ID;
 static int do_verify = 0;
+static const char *batch_file = NULL;
+static int cpu_threads = -1;	/* -c: tiled LU on the host, 0 = one thread per core */
+static int block_set = 0;
+static int do_pivot = 0;
+static int nrhs = 0;		/* -r: right-hand sides to solve after the pivoted factorisation */
 
 static struct option long_options[] = {
       /* name, has_arg, flag, val */
@@ -28,17 +36,85 @@ static struct option long_options[] = {
       {"device", 1, NULL, 'd'},
       {"size", 1, NULL, 's'},
       {"verify", 0, NULL, 'v'},
+      {"block", 1, NULL, 'b'},
+      {"tile", 1, NULL, 't'},
+      {"batch", 1, NULL, 'B'},
+      {"cpu", 1, NULL, 'c'},
+      {"pivot", 0, NULL, 'P'},
+      {"rhs", 1, NULL, 'r'},
       {0,0,0,0}
 };
 
+/*
+   Factors every matrix of a batch with lud_batch, one work-group per
+   matrix, and reports the throughput of the factorisation kernel.
+ */
+static void
+lud_batch_run(cl_context clContext, cl_command_queue clCommands, cl_program clProgram,
+              float *m, int size, int count, int stride)
+{
+  cl_kernel clKernel_batch;
+  cl_int errcode;
+  cl_mem d_m;
+  size_t bytes = (size_t)stride*count*sizeof(float);
+  size_t localWorkSize[1], globalWorkSize[1];
+  stopwatch sw;
+  double secs;
+
+  clKernel_batch = clCreateKernel(clProgram, "lud_batch", &errcode);
+  CHECKERR(errcode);
+
+  d_m = clCreateBuffer(clContext, CL_MEM_READ_WRITE, bytes, NULL, &errcode);
+  CHECKERR(errcode);
+
+  errcode = clEnqueueWriteBuffer(clCommands, d_m, CL_TRUE, 0, bytes, (void *) m, 0, NULL, &ocdTempEvent);
+  clFinish(clCommands);
+	START_TIMER(ocdTempEvent, OCD_TIMER_H2D, "Batch Copy", ocdTempTimer)
+	END_TIMER(ocdTempTimer)
+	CHECKERR(errcode);
+
+  errcode = clSetKernelArg(clKernel_batch, 0, sizeof(cl_mem), (void *) &d_m);
+  errcode |= clSetKernelArg(clKernel_batch, 1, sizeof(int), (void *) &size);
+  errcode |= clSetKernelArg(clKernel_batch, 2, sizeof(int), (void *) &stride);
+  errcode |= clSetKernelArg(clKernel_batch, 3, size*(size+1)*sizeof(float), NULL);
+  CHECKERR(errcode);
+  localWorkSize[0] = size;
+  globalWorkSize[0] = (size_t)count*size;
+
+  stopwatch_start(&sw);
+	errcode = clEnqueueNDRangeKernel(clCommands, clKernel_batch, 1, NULL, globalWorkSize, localWorkSize, 0, NULL, &ocdTempEvent);
+        clFinish(clCommands);
+  stopwatch_stop(&sw);
+	START_TIMER(ocdTempEvent, OCD_TIMER_KERNEL, "Batch Kernel", ocdTempTimer)
+	END_TIMER(ocdTempTimer)
+	CHECKERR(errcode);
+
+  errcode = clEnqueueReadBuffer(clCommands, d_m, CL_TRUE, 0, bytes, (void *) m, 0, NULL, &ocdTempEvent);
+        clFinish(clCommands);
+	START_TIMER(ocdTempEvent, OCD_TIMER_D2H, "Batch copy", ocdTempTimer)
+	END_TIMER(ocdTempTimer)
+	CHECKERR(errcode);
+
+  secs = get_interval_by_sec(&sw);
+  printf("Batch: %d matrices of %dx%d in %lf ms, %.0f matrices/s, %.2f GFLOP/s\n",
+         count, size, size, 1000*secs, count/secs,
+         count*(2.0/3.0)*size*size*size/secs*1e-9);
+
+  clReleaseMemObject(d_m);
+  clReleaseKernel(clKernel_batch);
+}
+
 int
 main ( int argc, char *argv[] )
 {
   int matrix_dim = 32; /* default matrix_dim */
+  int batch_count = 0, batch_stride = 0;
   int opt, option_index=0;
   func_ret_t ret;
   const char *input_file = NULL;
-  float *m, *mm;
+  float *m, *mm, *ma = NULL;
+  int *piv = NULL;
+  cl_mem d_piv = NULL;
   stopwatch sw;
 
   cl_device_id clDevice;
@@ -52,9 +128,7 @@ main ( int argc, char *argv[] )
 
   cl_int errcode;
 
-  FILE *kernelFile;
-  char *kernelSource;
-  size_t kernelLength;
+  size_t internal_size;
 
   cl_mem d_m;
 
@@ -64,7 +138,7 @@ main ( int argc, char *argv[] )
   device_id = opts.device_id;
 
 
-  while ((opt = getopt_long(argc, argv, "::vs:i:", 
+  while ((opt = getopt_long(argc, argv, "::vs:i:b:t:B:c:Pr:", 
                             long_options, &option_index)) != -1 ) {
       switch(opt){
         case 'i':
@@ -73,10 +147,30 @@ main ( int argc, char *argv[] )
         case 'v':
           do_verify = 1;
           break;
+        case 'b':
+          BLOCK_SIZE = atoi(optarg);
+          block_set = 1;
+          break;
+        case 't':
+          tile = atoi(optarg);
+          break;
+        case 'B':
+          batch_file = optarg;
+          break;
+        case 'c':
+          cpu_threads = atoi(optarg);
+          break;
+        case 'P':
+          do_pivot = 1;
+          break;
+        case 'r':
+          nrhs = atoi(optarg);
+          do_pivot = 1;
+          break;
         case 's':
           matrix_dim = atoi(optarg);
           fprintf(stderr, "Currently not supported, use -i instead\n");
-          fprintf(stderr, "Usage: %s [-v] [-s matrix_size|-i input_file|-p platform|-d device]\n", argv[0]);
+          fprintf(stderr, "Usage: %s [-v] [-b block_size] [-t tile] [-c threads] [-P] [-r nrhs] [-s matrix_size|-i input_file|-B batch_file|-p platform|-d device]\n", argv[0]);
           exit(EXIT_FAILURE);
         case '?':
           fprintf(stderr, "invalid option\n");
@@ -85,18 +179,25 @@ main ( int argc, char *argv[] )
           fprintf(stderr, "missing argument\n");
           break;
         default:
-          fprintf(stderr, "Usage: %s [-v] [-s matrix_size|-i input_file||-p platform|-d device]\n",
+          fprintf(stderr, "Usage: %s [-v] [-b block_size] [-t tile] [-c threads] [-P] [-r nrhs] [-s matrix_size|-i input_file|-B batch_file|-p platform|-d device]\n",
                   argv[0]);
           exit(EXIT_FAILURE);
       }
   }
   
   if ( (optind < argc) || (optind == 1)) {
-      fprintf(stderr, "Usage: %s [-v] [-s matrix_size|-i input_file|-p platform|-d device]\n", argv[0]);
+      fprintf(stderr, "Usage: %s [-v] [-b block_size] [-t tile] [-c threads] [-P] [-r nrhs] [-s matrix_size|-i input_file|-B batch_file|-p platform|-d device]\n", argv[0]);
       exit(EXIT_FAILURE);
   }
 
-  if (input_file) {
+  if (batch_file) {
+      printf("Reading batch from file %s\n", batch_file);
+      ret = create_batch_from_file(&m, batch_file, &matrix_dim, &batch_count, &batch_stride);
+      if (ret != RET_SUCCESS) {
+          fprintf(stderr, "error create batch from file %s\n", batch_file);
+          exit(EXIT_FAILURE);
+      }
+  } else if (input_file) {
       printf("Reading matrix from file %s\n", input_file);
       ret = create_matrix_from_file(&m, input_file, &matrix_dim);
       if (ret != RET_SUCCESS) {
@@ -109,11 +210,57 @@ main ( int argc, char *argv[] )
     exit(EXIT_FAILURE);
   }
 
-  if (do_verify){
+  if (cpu_threads >= 0 && batch_file) {
+      fprintf(stderr, "-c cannot be combined with -B\n");
+      exit(EXIT_FAILURE);
+  }
+  if (do_pivot && (batch_file || cpu_threads >= 0)) {
+      fprintf(stderr, "-P and -r cannot be combined with -B or -c\n");
+      exit(EXIT_FAILURE);
+  }
+  /* host tiles must be large enough to vectorise and keep the task count down */
+  if (cpu_threads >= 0 && !block_set) {
+      BLOCK_SIZE = 64;
+      while (matrix_dim % BLOCK_SIZE)
+          BLOCK_SIZE /= 2;
+  }
+
+  if (!batch_file && (BLOCK_SIZE < 2 || BLOCK_SIZE % 2 || matrix_dim % BLOCK_SIZE)) {
+      fprintf(stderr, "block size %d must be even and divide the matrix size %d\n", BLOCK_SIZE, matrix_dim);
+      exit(EXIT_FAILURE);
+  }
+
+  if (do_verify && batch_file) {
+    size_t bytes = (size_t)batch_stride*batch_count*sizeof(float);
+    mm = (float *) malloc(bytes);
+    memcpy(mm, m, bytes);
+  } else if (do_verify){
     printf("Before LUD\n");
     print_matrix(m, matrix_dim);
     matrix_duplicate(m, &mm, matrix_dim);
   }
+  if (nrhs > 0)
+    matrix_duplicate(m, &ma, matrix_dim);
+
+  if (cpu_threads >= 0) {
+    if (cpu_threads == 0)
+      cpu_threads = sysconf(_SC_NPROCESSORS_ONLN);
+    printf("Tiled LU on the host: block size %d, %d threads\n", BLOCK_SIZE, cpu_threads);
+    stopwatch_start(&sw);
+    lud_cpu(m, matrix_dim, BLOCK_SIZE, cpu_threads);
+    stopwatch_stop(&sw);
+    printf("Time consumed(ms): %lf\n", 1000*get_interval_by_sec(&sw));
+    if (do_verify){
+      printf("After LUD\n");
+      print_matrix(m, matrix_dim);
+      printf(">>>Verify<<<<\n");
+      lud_verify(mm, m, matrix_dim);
+      free(mm);
+    }
+    free(m);
+    ocd_finalize();
+    return EXIT_SUCCESS;
+  }
 
 //  errcode = clGetPlatformIDs(NUM_PLATFORM, clPlatform, NULL);
 //  CHECKERR(errcode);
@@ -133,8 +280,40 @@ clDevice = GetDevice(platform_id, device_id,dev_type);
  size_t max_worksize[3];
  errcode = clGetDeviceInfo(clDevice, CL_DEVICE_MAX_WORK_ITEM_SIZES,sizeof(size_t)*3, &max_worksize, NULL);
  CHECKERR(errcode);
-	while(BLOCK_SIZE*BLOCK_SIZE>max_worksize[0])
+ cl_ulong local_mem;
+ errcode = clGetDeviceInfo(clDevice, CL_DEVICE_LOCAL_MEM_SIZE, sizeof(cl_ulong), &local_mem, NULL);
+ CHECKERR(errcode);
+	/* lud_batch: one work-item per row and the whole matrix in local memory;
+	   create_batch_from_file() has rejected sizes below 1 */
+	if (batch_file && ((size_t)matrix_dim > max_worksize[0] || matrix_dim*(matrix_dim+1)*sizeof(float) > local_mem)) {
+		fprintf(stderr, "batch matrices of %dx%d do not fit one work-group\n", matrix_dim, matrix_dim);
+		exit(EXIT_FAILURE);
+	}
+	/* register tiles pay off where work-items are threads, not SIMD lanes */
+	if (tile == 0)
+		tile = dev_type == CL_DEVICE_TYPE_CPU ? 4 : 1;
+	if (BLOCK_SIZE < 1) {
+		fprintf(stderr, "block size %d must be positive\n", BLOCK_SIZE);
+		exit(EXIT_FAILURE);
+	}
+	if (tile < 1 || BLOCK_SIZE % tile) {
+		fprintf(stderr, "tile %d must divide the block size %d\n", tile, BLOCK_SIZE);
+		exit(EXIT_FAILURE);
+	}
+	/* lud_perimeter needs 2*BLOCK_SIZE work-items and three blocks of local memory */
+	while((size_t)((BLOCK_SIZE/tile)*(BLOCK_SIZE/tile))>max_worksize[0] || (size_t)(2*BLOCK_SIZE)>max_worksize[0]
+	      || 3*BLOCK_SIZE*BLOCK_SIZE*sizeof(float)>local_mem) {
 		BLOCK_SIZE = BLOCK_SIZE/2;
+		if (BLOCK_SIZE % tile)
+			tile = 1;
+	}
+	internal_size = BLOCK_SIZE/tile;
+	if (!batch_file) {
+		printf("Block size %d, %s internal kernel", BLOCK_SIZE, tile > 1 ? "tiled" : "plain");
+		if (tile > 1)
+			printf(" (%dx%d per work-item)", tile, tile);
+		printf("\n");
+	}
 	
   clContext = clCreateContext(NULL, 1, &clDevice, NULL, NULL, &errcode);
   CHECKERR(errcode);
@@ -142,43 +321,38 @@ clDevice = GetDevice(platform_id, device_id,dev_type);
   clCommands = clCreateCommandQueue(clContext, clDevice, CL_QUEUE_PROFILING_ENABLE, &errcode);
   CHECKERR(errcode);
 
-  kernelFile = fopen("lud_kernel.cl", "r");
-  fseek(kernelFile, 0, SEEK_END);
-  kernelLength = (size_t) ftell(kernelFile);
-  kernelSource = (char *) malloc(sizeof(char)*kernelLength);
-  rewind(kernelFile);
-  fread((void *) kernelSource, kernelLength, 1, kernelFile);
-  fclose(kernelFile);
-
-  clProgram = clCreateProgramWithSource(clContext, 1, (const char **) &kernelSource, &kernelLength, &errcode);
-  CHECKERR(errcode);
-
-  free(kernelSource);
 	char arg[100];
-	sprintf(arg,"-D BLOCK_SIZE=%d", (int)BLOCK_SIZE);
-  errcode = clBuildProgram(clProgram, 1, &clDevice, arg, NULL, NULL);
-  if (errcode == CL_BUILD_PROGRAM_FAILURE)                                                                                                                                       
-  {
-    char *log;
-    size_t logLength;
-    errcode = clGetProgramBuildInfo(clProgram, clDevice, CL_PROGRAM_BUILD_LOG, 0, NULL, &logLength);
-    log = (char *) malloc(sizeof(char)*logLength);
-    errcode = clGetProgramBuildInfo(clProgram, clDevice, CL_PROGRAM_BUILD_LOG, logLength, (void *) log, NULL);
-    fprintf(stderr, "Kernel build error! Log:\n%s", log);
-    free(log);
-    return 0;
+	sprintf(arg,"-D BLOCK_SIZE=%d -D LUD_TILE=%d", BLOCK_SIZE, tile);
+  clProgram = ocdBuildProgramFromFileWithOptions(clContext, clDevice, "lud_kernel.cl", arg);
+
+  if (batch_file) {
+    lud_batch_run(clContext, clCommands, clProgram, m, matrix_dim, batch_count, batch_stride);
+    if (do_verify) {
+      printf(">>>Verify<<<<\n");
+      lud_batch_verify(mm, m, matrix_dim, batch_count, batch_stride);
+      free(mm);
+    }
+    clReleaseProgram(clProgram);
+    clReleaseCommandQueue(clCommands);
+    clReleaseContext(clContext);
+    free(m);
+    ocd_finalize();
+    return EXIT_SUCCESS;
   }
-  CHECKERR(errcode);
 
   clKernel_diagonal = clCreateKernel(clProgram, "lud_diagonal", &errcode);
   CHECKERR(errcode);
   clKernel_perimeter = clCreateKernel(clProgram, "lud_perimeter", &errcode);
   CHECKERR(errcode);
-  clKernel_internal = clCreateKernel(clProgram, "lud_internal", &errcode);
+  clKernel_internal = clCreateKernel(clProgram, tile > 1 ? "lud_internal_tiled" : "lud_internal", &errcode);
   CHECKERR(errcode);
 
   d_m = clCreateBuffer(clContext, CL_MEM_READ_WRITE, matrix_dim*matrix_dim*sizeof(float), NULL, &errcode);
   CHECKERR(errcode);
+  if (do_pivot) {
+    d_piv = clCreateBuffer(clContext, CL_MEM_READ_WRITE, matrix_dim*sizeof(int), NULL, &errcode);
+    CHECKERR(errcode);
+  }
 
   /* beginning of timing point */
   stopwatch_start(&sw);
@@ -195,6 +369,10 @@ clDevice = GetDevice(platform_id, device_id,dev_type);
   size_t globalWorkSize[2];
 	//printf("BLOCK_SIZE: %d\n",BLOCK_SIZE);	
 //	printf("max Work-item Size: %d\n",(int)max_worksize[0]);	
+  if (do_pivot)
+    lud_pivot_factor(clCommands, clProgram, clKernel_internal, internal_size,
+                     d_m, d_piv, matrix_dim, max_worksize[0]);
+  else {
   	#ifdef START_POWER
 	for( int iter = 0; iter < 1000; iter++)
 	#endif
@@ -228,8 +406,8 @@ clDevice = GetDevice(platform_id, device_id,dev_type);
       errcode |= clSetKernelArg(clKernel_internal, 1, sizeof(int), (void *) &matrix_dim);
       errcode |= clSetKernelArg(clKernel_internal, 2, sizeof(int), (void *) &i);
       CHECKERR(errcode);
-      localWorkSize[0] = BLOCK_SIZE;
-      localWorkSize[1] = BLOCK_SIZE;
+      localWorkSize[0] = internal_size;
+      localWorkSize[1] = internal_size;
       globalWorkSize[0] = ((matrix_dim-i)/BLOCK_SIZE-1)*localWorkSize[0];
       globalWorkSize[1] = ((matrix_dim-i)/BLOCK_SIZE-1)*localWorkSize[1];
       	 
@@ -252,6 +430,7 @@ clDevice = GetDevice(platform_id, device_id,dev_type);
 	 CHECKERR(errcode);
 
   END_TIMER(ocdTempTimer)
+  }
 	 
   errcode = clEnqueueReadBuffer(clCommands, d_m, CL_TRUE, 0, matrix_dim*matrix_dim*sizeof(float), (void *) m, 0, NULL, &ocdTempEvent);
         clFinish(clCommands);
@@ -261,16 +440,32 @@ clDevice = GetDevice(platform_id, device_id,dev_type);
   stopwatch_stop(&sw);
   printf("Time consumed(ms): %lf\n", 1000*get_interval_by_sec(&sw));
 
+  if (do_pivot) {
+    piv = (int *) malloc(matrix_dim*sizeof(int));
+    errcode = clEnqueueReadBuffer(clCommands, d_piv, CL_TRUE, 0, matrix_dim*sizeof(int), (void *) piv, 0, NULL, NULL);
+    CHECKERR(errcode);
+  }
+  if (nrhs > 0) {
+    lud_pivot_solve(clContext, clCommands, clProgram, d_m, d_piv, ma, matrix_dim, nrhs);
+    free(ma);
+  }
+
   clReleaseMemObject(d_m);
+  if (do_pivot)
+    clReleaseMemObject(d_piv);
 
   if (do_verify){
     printf("After LUD\n");
     print_matrix(m, matrix_dim);
     printf(">>>Verify<<<<\n");
 	printf("matrix_dim: %d\n",matrix_dim);
-    lud_verify(mm, m, matrix_dim); 
+    if (do_pivot)
+      lud_pivot_verify(mm, m, piv, matrix_dim);
+    else
+      lud_verify(mm, m, matrix_dim); 
     free(mm);
   }
+  free(piv);
 
   clReleaseKernel(clKernel_diagonal);
   clReleaseKernel(clKernel_perimeter);
@@ -0,0 +1,341 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "common.h"
+
+/*
+   Native tiled LU for the host, using the same block operations as
+   lud_kernel.cl. Each operation on a tile is a task in a dependency graph
+   run by a work-stealing pool, so there is no barrier between the
+   diagonal, perimeter and internal phases of a step:
+
+     D(k)      factor tile (k,k)                      lud_diagonal
+     R(k,j)    tile (k,j) = L(k,k)^-1 * tile (k,j)      lud_perimeter, row
+     C(k,i)    tile (i,k) = tile (i,k) * U(k,k)^-1      lud_perimeter, column
+     U(k,i,j)  tile (i,j) -= tile (i,k) * tile (k,j)   lud_internal
+
+   A task starts once the tasks it reads from and the previous task on its
+   own tile have finished. Panel tasks, and the updates the next panel
+   reads, go on a high priority deque. So D(k+1) and its perimeter are
+   factored as soon as their tiles are updated, while the rest of the
+   trailing update of step k is still running (lookahead).
+ */
+
+enum { TASK_D, TASK_R, TASK_C, TASK_U };
+
+typedef struct {
+  int k, i, j;
+} lud_task;
+
+/* owner pushes and pops at the bottom, thieves take from the top */
+typedef struct {
+  pthread_mutex_t lock;
+  lud_task *tasks;
+  int top, bottom, capacity;
+} lud_deque;
+
+typedef struct {
+  float *m;
+  int matrix_dim, bs, nb;
+  int num_threads;
+  unsigned char *deps;      /* tasks still to finish before (k,i,j), i,j >= k */
+  size_t *step;             /* [nb] index in deps of the first task of step k */
+  lud_deque *deques;        /* [num_threads][2], 0 = high priority */
+  long total, finished;
+  long queued;              /* tasks pushed and not yet taken */
+  pthread_mutex_t idle_lock;
+  pthread_cond_t idle;      /* a task was queued or the last one finished */
+} lud_pool;
+
+typedef struct {
+  lud_pool *pool;
+  int id;
+} lud_worker;
+
+static int
+task_type(int k, int i, int j)
+{
+  if (i == k)
+    return j == k ? TASK_D : TASK_R;
+  return j == k ? TASK_C : TASK_U;
+}
+
+static void
+deque_push(lud_deque *d, lud_task t)
+{
+  pthread_mutex_lock(&d->lock);
+  if (d->bottom == d->capacity) {
+    if (d->top > 0) {
+      memmove(d->tasks, d->tasks+d->top, (d->bottom-d->top)*sizeof(lud_task));
+      d->bottom -= d->top;
+      d->top = 0;
+    } else {
+      d->capacity = d->capacity ? 2*d->capacity : 64;
+      d->tasks = (lud_task *) realloc(d->tasks, d->capacity*sizeof(lud_task));
+    }
+  }
+  d->tasks[d->bottom++] = t;
+  pthread_mutex_unlock(&d->lock);
+}
+
+static int
+deque_take(lud_deque *d, lud_task *t, int steal)
+{
+  int found = 0;
+
+  pthread_mutex_lock(&d->lock);
+  if (d->bottom > d->top) {
+    *t = steal ? d->tasks[d->top++] : d->tasks[--d->bottom];
+    found = 1;
+  }
+  pthread_mutex_unlock(&d->lock);
+  return found;
+}
+
+/*---- tile operations, lda = matrix_dim ----*/
+
+static void
+tile_diagonal(float *a, int lda, int bs)
+{
+  int i, j, k;
+
+  for (k=0; k < bs; k++)
+    for (i=k+1; i < bs; i++) {
+      float l = a[i*lda+k] /= a[k*lda+k];
+      for (j=k+1; j < bs; j++)
+        a[i*lda+j] -= l * a[k*lda+j];
+    }
+}
+
+static void
+tile_row(const float *dia, float *a, int lda, int bs)
+{
+  int i, j, k;
+
+  for (i=1; i < bs; i++)
+    for (k=0; k < i; k++) {
+      float l = dia[i*lda+k];
+      for (j=0; j < bs; j++)
+        a[i*lda+j] -= l * a[k*lda+j];
+    }
+}
+
+static void
+tile_col(const float *dia, float *a, int lda, int bs)
+{
+  int i, j, k;
+
+  for (i=0; i < bs; i++)
+    for (k=0; k < bs; k++) {
+      float x = a[i*lda+k] /= dia[k*lda+k];
+      for (j=k+1; j < bs; j++)
+        a[i*lda+j] -= x * dia[k*lda+j];
+    }
+}
+
+static void
+tile_update(const float *col, const float *row, float *a, int lda, int bs)
+{
+  int i, j, k;
+
+  for (i=0; i < bs; i++)
+    for (k=0; k < bs; k++) {
+      float x = col[i*lda+k];
+      for (j=0; j < bs; j++)
+        a[i*lda+j] -= x * row[k*lda+j];
+    }
+}
+
+#define TILE(p, i, j) ((p)->m + ((size_t)(i)*(p)->matrix_dim + (j))*(p)->bs)
+
+/* step k holds the (nb-k) x (nb-k) tasks with i,j >= k */
+#define DEP(p, k, i, j) ((p)->deps[(p)->step[k] + (size_t)((i)-(k))*((p)->nb-(k)) + (j)-(k)])
+
+static void
+run_task(lud_pool *p, lud_task t)
+{
+  int lda = p->matrix_dim;
+
+  switch (task_type(t.k, t.i, t.j)) {
+    case TASK_D:
+      tile_diagonal(TILE(p, t.k, t.k), lda, p->bs);
+      break;
+    case TASK_R:
+      tile_row(TILE(p, t.k, t.k), TILE(p, t.k, t.j), lda, p->bs);
+      break;
+    case TASK_C:
+      tile_col(TILE(p, t.k, t.k), TILE(p, t.i, t.k), lda, p->bs);
+      break;
+    default:
+      tile_update(TILE(p, t.i, t.k), TILE(p, t.k, t.j), TILE(p, t.i, t.j), lda, p->bs);
+  }
+}
+
+/* one dependency of (k,i,j) has finished; queue it on 'id' once all have */
+static void
+release(lud_pool *p, int id, int k, int i, int j)
+{
+  lud_task t;
+  int high;
+
+  if (__sync_sub_and_fetch(&DEP(p, k, i, j), 1) != 0)
+    return;
+  t.k = k;
+  t.i = i;
+  t.j = j;
+  high = task_type(k, i, j) != TASK_U || i == k+1 || j == k+1;
+  deque_push(&p->deques[2*id + (high ? 0 : 1)], t);
+
+  pthread_mutex_lock(&p->idle_lock);
+  __sync_fetch_and_add(&p->queued, 1);
+  pthread_cond_signal(&p->idle);
+  pthread_mutex_unlock(&p->idle_lock);
+}
+
+static void
+finish_task(lud_pool *p, int id, lud_task t)
+{
+  int k = t.k, i = t.i, j = t.j, n;
+
+  switch (task_type(k, i, j)) {
+    case TASK_D:
+      for (n=k+1; n < p->nb; n++) {
+        release(p, id, k, k, n);
+        release(p, id, k, n, k);
+      }
+      break;
+    case TASK_R:
+      for (n=k+1; n < p->nb; n++)
+        release(p, id, k, n, j);
+      break;
+    case TASK_C:
+      for (n=k+1; n < p->nb; n++)
+        release(p, id, k, i, n);
+      break;
+    default:
+      /* the next task on this tile is one step later */
+      release(p, id, k+1, i, j);
+  }
+  if (__sync_add_and_fetch(&p->finished, 1) == p->total) {
+    pthread_mutex_lock(&p->idle_lock);
+    pthread_cond_broadcast(&p->idle);
+    pthread_mutex_unlock(&p->idle_lock);
+  }
+}
+
+static int
+find_task(lud_pool *p, int id, lud_task *t)
+{
+  int prio, v;
+
+  for (prio=0; prio < 2; prio++) {
+    if (deque_take(&p->deques[2*id+prio], t, 0))
+      goto found;
+    for (v=1; v < p->num_threads; v++)
+      if (deque_take(&p->deques[2*((id+v)%p->num_threads)+prio], t, 1))
+        goto found;
+  }
+  return 0;
+
+found:
+  __sync_fetch_and_sub(&p->queued, 1);
+  return 1;
+}
+
+static void *
+lud_cpu_worker(void *arg)
+{
+  lud_worker *w = (lud_worker *) arg;
+  lud_pool *p = w->pool;
+  lud_task t;
+
+  for (;;) {
+    if (find_task(p, w->id, &t)) {
+      run_task(p, t);
+      finish_task(p, w->id, t);
+      continue;
+    }
+    /* nothing to take: sleep until a task is queued or all are done */
+    pthread_mutex_lock(&p->idle_lock);
+    while (__sync_fetch_and_add(&p->queued, 0) == 0
+           && __sync_fetch_and_add(&p->finished, 0) < p->total)
+      pthread_cond_wait(&p->idle, &p->idle_lock);
+    pthread_mutex_unlock(&p->idle_lock);
+    if (__sync_fetch_and_add(&p->finished, 0) == p->total)
+      return NULL;
+  }
+}
+
+/*
+   Factors m (matrix_dim x matrix_dim, a multiple of block_size) in place
+   with num_threads threads.
+ */
+void
+lud_cpu(float *m, int matrix_dim, int block_size, int num_threads)
+{
+  lud_pool pool;
+  lud_worker *workers;
+  pthread_t *threads;
+  int k, i, j, t, nb = matrix_dim/block_size;
+  lud_task first = {0, 0, 0};
+
+  pool.m = m;
+  pool.matrix_dim = matrix_dim;
+  pool.bs = block_size;
+  pool.nb = nb;
+  pool.num_threads = num_threads;
+  pool.finished = 0;
+  pool.total = 0;
+  pool.queued = 1;
+  pthread_mutex_init(&pool.idle_lock, NULL);
+  pthread_cond_init(&pool.idle, NULL);
+
+  pool.step = (size_t *) malloc(nb*sizeof(size_t));
+  for (k=0; k < nb; k++) {
+    pool.step[k] = pool.total;
+    pool.total += (long)(nb-k)*(nb-k);
+  }
+
+  /* D and the perimeter tasks wait for one update of their tile and the
+     diagonal of their step, updates for the two perimeter tiles they read */
+  pool.deps = (unsigned char *) malloc(pool.total);
+  for (k=0; k < nb; k++)
+    for (i=k; i < nb; i++)
+      for (j=k; j < nb; j++) {
+        int type = task_type(k, i, j);
+        DEP(&pool, k, i, j) = (k > 0) + (type == TASK_R || type == TASK_C)
+                              + (type == TASK_U ? 2 : 0);
+      }
+
+  pool.deques = (lud_deque *) calloc(2*num_threads, sizeof(lud_deque));
+  for (t=0; t < 2*num_threads; t++)
+    pthread_mutex_init(&pool.deques[t].lock, NULL);
+  deque_push(&pool.deques[0], first);
+
+  workers = (lud_worker *) malloc(num_threads*sizeof(lud_worker));
+  threads = (pthread_t *) malloc(num_threads*sizeof(pthread_t));
+  for (t=0; t < num_threads; t++) {
+    workers[t].pool = &pool;
+    workers[t].id = t;
+    if (pthread_create(&threads[t], NULL, lud_cpu_worker, &workers[t]) != 0) {
+      fprintf(stderr, "lud_cpu: cannot create thread\n");
+      exit(EXIT_FAILURE);
+    }
+  }
+  for (t=0; t < num_threads; t++)
+    pthread_join(threads[t], NULL);
+
+  for (t=0; t < 2*num_threads; t++) {
+    pthread_mutex_destroy(&pool.deques[t].lock);
+    free(pool.deques[t].tasks);
+  }
+  free(pool.deques);
+  pthread_mutex_destroy(&pool.idle_lock);
+  pthread_cond_destroy(&pool.idle);
+  free(pool.deps);
+  free(pool.step);
+  free(workers);
+  free(threads);
+}
@@ -1,3 +1,14 @@
+/*
+   BLOCK_SIZE and LUD_TILE are passed by lud.c as -D options, so the
+   kernels are specialised for the block size chosen at run time.
+ */
+#ifndef BLOCK_SIZE
+#define BLOCK_SIZE 16
+#endif
+#ifndef LUD_TILE
+#define LUD_TILE 1
+#endif
+#define LUD_THREADS (BLOCK_SIZE/LUD_TILE)
 
 __kernel void 
 lud_diagonal(__global float *m, int matrix_dim, int offset)
@@ -140,3 +151,259 @@ lud_internal(__global float *m, int matrix_dim, int offset)
 
 }
 
+/*
+   Same update as lud_internal, but each work-item of a
+   LUD_THREADS x LUD_THREADS group computes a LUD_TILE x LUD_TILE
+   micro-tile of the block in registers. Rows and columns of the
+   micro-tile are LUD_THREADS apart, so neighbouring work-items still
+   touch neighbouring addresses, and every value read from local memory
+   is used LUD_TILE times.
+ */
+__kernel void
+lud_internal_tiled(__global float *m, int matrix_dim, int offset)
+{
+  __local float peri_row[BLOCK_SIZE][BLOCK_SIZE];
+  __local float peri_col[BLOCK_SIZE][BLOCK_SIZE];
+
+  float sum[LUD_TILE][LUD_TILE];
+  float col[LUD_TILE], row[LUD_TILE];
+  int i, r, c;
+  int tx = get_local_id(0);
+  int ty = get_local_id(1);
+
+  int global_row_id = offset + (get_group_id(1)+1)*BLOCK_SIZE;
+  int global_col_id = offset + (get_group_id(0)+1)*BLOCK_SIZE;
+
+  for (r=0; r < LUD_TILE; r++) {
+    int y = ty + r*LUD_THREADS;
+    for (c=0; c < LUD_TILE; c++) {
+      int x = tx + c*LUD_THREADS;
+      peri_row[y][x] = m[(offset+y)*matrix_dim+global_col_id+x];
+      peri_col[y][x] = m[(global_row_id+y)*matrix_dim+offset+x];
+      sum[r][c] = 0;
+    }
+  }
+
+  barrier(CLK_LOCAL_MEM_FENCE);
+
+  for (i=0; i < BLOCK_SIZE; i++) {
+    for (r=0; r < LUD_TILE; r++)
+      col[r] = peri_col[ty+r*LUD_THREADS][i];
+    for (c=0; c < LUD_TILE; c++)
+      row[c] = peri_row[i][tx+c*LUD_THREADS];
+    for (r=0; r < LUD_TILE; r++)
+      for (c=0; c < LUD_TILE; c++)
+        sum[r][c] += col[r] * row[c];
+  }
+
+  for (r=0; r < LUD_TILE; r++)
+    for (c=0; c < LUD_TILE; c++)
+      m[(global_row_id+ty+r*LUD_THREADS)*matrix_dim+global_col_id+tx+c*LUD_THREADS] -= sum[r][c];
+}
+
+/*
+   Batched LU for many small matrices: one work-group per matrix, matrix
+   k starting at m + k*stride. The matrix is factored in local memory
+   (rows padded by one to spread them over the banks) by work-item r
+   updating row r, with one barrier per pivot.
+ */
+__kernel void
+lud_batch(__global float *m, int size, int stride, __local float *a)
+{
+  int r = get_local_id(0);
+  int pitch = size+1;
+  int i, j, k;
+  __global float *g = m + (size_t)get_group_id(0)*stride;
+
+  for (i=r; i < size*size; i += size)
+    a[(i/size)*pitch+i%size] = g[i];
+
+  barrier(CLK_LOCAL_MEM_FENCE);
+
+  for (k=0; k < size-1; k++) {
+    if (r > k) {
+      float l = a[r*pitch+k] / a[k*pitch+k];
+      a[r*pitch+k] = l;
+      for (j=k+1; j < size; j++)
+        a[r*pitch+j] -= l * a[k*pitch+j];
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+  }
+
+  for (i=r; i < size*size; i += size)
+    g[i] = a[(i/size)*pitch+i%size];
+}
+
+/*
+   Partial pivoting. For each column c of a panel, lud_pivot finds the
+   row of largest magnitude at or below c (one work-group, ties to the
+   lowest row), lud_swap exchanges rows c and piv[c] across the whole
+   matrix, and lud_panel_col scales the column below c and updates the
+   rest of the panel. The perimeter row is then finished by
+   lud_trsm_row and the trailing update is lud_internal, unchanged.
+ */
+__kernel void
+lud_pivot(__global float *m, int matrix_dim, int c, __global int *piv,
+          __local float *best, __local int *best_row)
+{
+  int lid = get_local_id(0);
+  int n = get_local_size(0);
+  int r, s;
+  float v;
+
+  best[lid] = -1;
+  best_row[lid] = c;
+  for (r=c+lid; r < matrix_dim; r += n) {
+    v = fabs(m[r*matrix_dim+c]);
+    if (v > best[lid]) {
+      best[lid] = v;
+      best_row[lid] = r;
+    }
+  }
+  barrier(CLK_LOCAL_MEM_FENCE);
+
+  for (s=n/2; s > 0; s /= 2) {
+    if (lid < s && (best[lid+s] > best[lid] ||
+                    (best[lid+s] == best[lid] && best_row[lid+s] < best_row[lid]))) {
+      best[lid] = best[lid+s];
+      best_row[lid] = best_row[lid+s];
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+  }
+
+  if (lid == 0)
+    piv[c] = best_row[0];
+}
+
+__kernel void
+lud_swap(__global float *m, int matrix_dim, int c, __global int *piv)
+{
+  int j = get_global_id(0);
+  int p = piv[c];
+  float t;
+
+  if (j >= matrix_dim || p == c)
+    return;
+  t = m[c*matrix_dim+j];
+  m[c*matrix_dim+j] = m[p*matrix_dim+j];
+  m[p*matrix_dim+j] = t;
+}
+
+__kernel void
+lud_panel_col(__global float *m, int matrix_dim, int c, int panel_end)
+{
+  int r = c + 1 + get_global_id(0);
+  int j;
+  float l;
+
+  if (r >= matrix_dim)
+    return;
+  l = m[r*matrix_dim+c] / m[c*matrix_dim+c];
+  m[r*matrix_dim+c] = l;
+  for (j=c+1; j < panel_end; j++)
+    m[r*matrix_dim+j] -= l * m[c*matrix_dim+j];
+}
+
+/* U12 = L11^-1 A12, one work-item per column right of the panel */
+__kernel void
+lud_trsm_row(__global float *m, int matrix_dim, int offset)
+{
+  int j = offset + BLOCK_SIZE + get_global_id(0);
+  int i, t;
+  float sum;
+
+  for (i=1; i < BLOCK_SIZE; i++) {
+    sum = m[(offset+i)*matrix_dim+j];
+    for (t=0; t < i; t++)
+      sum -= m[(offset+i)*matrix_dim+offset+t] * m[(offset+t)*matrix_dim+j];
+    m[(offset+i)*matrix_dim+j] = sum;
+  }
+}
+
+/*
+   Solve with the factors left on the device by the pivoted path, for
+   nrhs right-hand sides stored row-major in b[matrix_dim][nrhs].
+   lud_rhs_permute applies the row swaps, then for each block of rows
+   lud_rhs_lower / lud_rhs_upper solve against the diagonal block (one
+   work-item per right-hand side) and lud_rhs_update subtracts the
+   solved block from the rows still to be solved, as a tiled product.
+ */
+__kernel void
+lud_rhs_permute(__global float *b, __global int *piv, int matrix_dim, int nrhs)
+{
+  int j = get_global_id(0);
+  int i, p;
+  float t;
+
+  if (j >= nrhs)
+    return;
+  for (i=0; i < matrix_dim; i++) {
+    p = piv[i];
+    if (p != i) {
+      t = b[i*nrhs+j];
+      b[i*nrhs+j] = b[p*nrhs+j];
+      b[p*nrhs+j] = t;
+    }
+  }
+}
+
+__kernel void
+lud_rhs_lower(__global float *m, __global float *b, int matrix_dim, int nrhs, int offset)
+{
+  int j = get_global_id(0);
+  int i, t;
+  float sum;
+
+  if (j >= nrhs)
+    return;
+  for (i=1; i < BLOCK_SIZE; i++) {
+    sum = b[(offset+i)*nrhs+j];
+    for (t=0; t < i; t++)
+      sum -= m[(offset+i)*matrix_dim+offset+t] * b[(offset+t)*nrhs+j];
+    b[(offset+i)*nrhs+j] = sum;
+  }
+}
+
+__kernel void
+lud_rhs_upper(__global float *m, __global float *b, int matrix_dim, int nrhs, int offset)
+{
+  int j = get_global_id(0);
+  int i, t;
+  float sum;
+
+  if (j >= nrhs)
+    return;
+  for (i=BLOCK_SIZE-1; i >= 0; i--) {
+    sum = b[(offset+i)*nrhs+j];
+    for (t=i+1; t < BLOCK_SIZE; t++)
+      sum -= m[(offset+i)*matrix_dim+offset+t] * b[(offset+t)*nrhs+j];
+    b[(offset+i)*nrhs+j] = sum / m[(offset+i)*matrix_dim+offset+i];
+  }
+}
+
+/* b[rows][:] -= m[rows][offset..+BLOCK_SIZE] * b[offset..+BLOCK_SIZE][:],
+   rows starting at row_start, one BLOCK_SIZE square tile per work-group */
+__kernel void
+lud_rhs_update(__global float *m, __global float *b, int matrix_dim, int nrhs,
+               int offset, int row_start)
+{
+  __local float l_tile[BLOCK_SIZE][BLOCK_SIZE];
+  __local float x_tile[BLOCK_SIZE][BLOCK_SIZE];
+
+  int tx = get_local_id(0);
+  int ty = get_local_id(1);
+  int row = row_start + get_group_id(1)*BLOCK_SIZE + ty;
+  int col = get_group_id(0)*BLOCK_SIZE + tx;
+  int i;
+  float sum = 0;
+
+  l_tile[ty][tx] = m[row*matrix_dim+offset+tx];
+  x_tile[ty][tx] = col < nrhs ? b[(offset+ty)*nrhs+col] : 0;
+
+  barrier(CLK_LOCAL_MEM_FENCE);
+
+  for (i=0; i < BLOCK_SIZE; i++)
+    sum += l_tile[ty][i] * x_tile[i][tx];
+  if (col < nrhs)
+    b[row*nrhs+col] -= sum;
+}
@@ -0,0 +1,266 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "../../include/rdtsc.h"
+#include "../../include/common_ocl.h"
+
+#include "common.h"
+#include "lud_pivot.h"
+
+#define CHECKERR(err) \
+    if (err != CL_SUCCESS) \
+    { \
+        fprintf(stderr, "Error: %d\n", err);\
+        exit(1); \
+    }
+
+/* enqueues a 1D kernel and times it the way the unpivoted loop does */
+static void
+run_kernel(cl_command_queue clCommands, cl_kernel kernel, cl_uint dims,
+           size_t *globalWorkSize, size_t *localWorkSize, const char *name)
+{
+  cl_int errcode;
+
+  errcode = clEnqueueNDRangeKernel(clCommands, kernel, dims, NULL, globalWorkSize, localWorkSize, 0, NULL, &ocdTempEvent);
+  clFinish(clCommands);
+	START_TIMER(ocdTempEvent, OCD_TIMER_KERNEL, name, ocdTempTimer)
+	END_TIMER(ocdTempTimer)
+	CHECKERR(errcode);
+}
+
+/*
+   Blocked right-looking LU with partial pivoting of d_m, in place. Row c
+   was swapped with row piv[c] before column c was eliminated; the swaps
+   are applied to whole rows, so the factors end up as P*A = L*U.
+ */
+void
+lud_pivot_factor(cl_command_queue clCommands, cl_program clProgram,
+                 cl_kernel clKernel_internal, size_t internal_size,
+                 cl_mem d_m, cl_mem d_piv, int matrix_dim, size_t max_group)
+{
+  cl_kernel clKernel_pivot, clKernel_swap, clKernel_panel, clKernel_trsm;
+  cl_int errcode;
+  size_t localWorkSize[2];
+  size_t globalWorkSize[2];
+  size_t pivot_size = 256;
+  int i, c, panel_end;
+
+  while (pivot_size > max_group)
+    pivot_size /= 2;
+
+  clKernel_pivot = clCreateKernel(clProgram, "lud_pivot", &errcode);
+  CHECKERR(errcode);
+  clKernel_swap = clCreateKernel(clProgram, "lud_swap", &errcode);
+  CHECKERR(errcode);
+  clKernel_panel = clCreateKernel(clProgram, "lud_panel_col", &errcode);
+  CHECKERR(errcode);
+  clKernel_trsm = clCreateKernel(clProgram, "lud_trsm_row", &errcode);
+  CHECKERR(errcode);
+
+  for (i=0; i < matrix_dim; i += BLOCK_SIZE) {
+    panel_end = i + BLOCK_SIZE;
+
+    for (c=i; c < panel_end; c++) {
+      errcode = clSetKernelArg(clKernel_pivot, 0, sizeof(cl_mem), (void *) &d_m);
+      errcode |= clSetKernelArg(clKernel_pivot, 1, sizeof(int), (void *) &matrix_dim);
+      errcode |= clSetKernelArg(clKernel_pivot, 2, sizeof(int), (void *) &c);
+      errcode |= clSetKernelArg(clKernel_pivot, 3, sizeof(cl_mem), (void *) &d_piv);
+      errcode |= clSetKernelArg(clKernel_pivot, 4, pivot_size*sizeof(float), NULL);
+      errcode |= clSetKernelArg(clKernel_pivot, 5, pivot_size*sizeof(int), NULL);
+      CHECKERR(errcode);
+      localWorkSize[0] = pivot_size;
+      globalWorkSize[0] = pivot_size;
+      run_kernel(clCommands, clKernel_pivot, 1, globalWorkSize, localWorkSize, "Pivot Kernel");
+
+      errcode = clSetKernelArg(clKernel_swap, 0, sizeof(cl_mem), (void *) &d_m);
+      errcode |= clSetKernelArg(clKernel_swap, 1, sizeof(int), (void *) &matrix_dim);
+      errcode |= clSetKernelArg(clKernel_swap, 2, sizeof(int), (void *) &c);
+      errcode |= clSetKernelArg(clKernel_swap, 3, sizeof(cl_mem), (void *) &d_piv);
+      CHECKERR(errcode);
+      localWorkSize[0] = BLOCK_SIZE;
+      globalWorkSize[0] = matrix_dim;
+      run_kernel(clCommands, clKernel_swap, 1, globalWorkSize, localWorkSize, "Swap Kernel");
+
+      if (c == matrix_dim-1)
+        break;
+      errcode = clSetKernelArg(clKernel_panel, 0, sizeof(cl_mem), (void *) &d_m);
+      errcode |= clSetKernelArg(clKernel_panel, 1, sizeof(int), (void *) &matrix_dim);
+      errcode |= clSetKernelArg(clKernel_panel, 2, sizeof(int), (void *) &c);
+      errcode |= clSetKernelArg(clKernel_panel, 3, sizeof(int), (void *) &panel_end);
+      CHECKERR(errcode);
+      localWorkSize[0] = BLOCK_SIZE;
+      globalWorkSize[0] = (matrix_dim-c-1+BLOCK_SIZE-1)/BLOCK_SIZE*BLOCK_SIZE;
+      run_kernel(clCommands, clKernel_panel, 1, globalWorkSize, localWorkSize, "Panel Kernel");
+    }
+
+    if (panel_end == matrix_dim)
+      break;
+
+    errcode = clSetKernelArg(clKernel_trsm, 0, sizeof(cl_mem), (void *) &d_m);
+    errcode |= clSetKernelArg(clKernel_trsm, 1, sizeof(int), (void *) &matrix_dim);
+    errcode |= clSetKernelArg(clKernel_trsm, 2, sizeof(int), (void *) &i);
+    CHECKERR(errcode);
+    localWorkSize[0] = BLOCK_SIZE;
+    globalWorkSize[0] = matrix_dim-panel_end;
+    run_kernel(clCommands, clKernel_trsm, 1, globalWorkSize, localWorkSize, "Perimeter Kernel");
+
+    errcode = clSetKernelArg(clKernel_internal, 0, sizeof(cl_mem), (void *) &d_m);
+    errcode |= clSetKernelArg(clKernel_internal, 1, sizeof(int), (void *) &matrix_dim);
+    errcode |= clSetKernelArg(clKernel_internal, 2, sizeof(int), (void *) &i);
+    CHECKERR(errcode);
+    localWorkSize[0] = internal_size;
+    localWorkSize[1] = internal_size;
+    globalWorkSize[0] = ((matrix_dim-i)/BLOCK_SIZE-1)*localWorkSize[0];
+    globalWorkSize[1] = ((matrix_dim-i)/BLOCK_SIZE-1)*localWorkSize[1];
+    run_kernel(clCommands, clKernel_internal, 2, globalWorkSize, localWorkSize, "Internal Kernel");
+  }
+
+  clReleaseKernel(clKernel_pivot);
+  clReleaseKernel(clKernel_swap);
+  clReleaseKernel(clKernel_panel);
+  clReleaseKernel(clKernel_trsm);
+}
+
+/*
+   Solves A*X = B for nrhs random solutions X against the factors left in
+   d_m and d_piv, with B = A*X built on the host from the original matrix
+   a. Reports the solve time on its own and the largest error in X.
+ */
+void
+lud_pivot_solve(cl_context clContext, cl_command_queue clCommands, cl_program clProgram,
+                cl_mem d_m, cl_mem d_piv, float *a, int matrix_dim, int nrhs)
+{
+  cl_kernel clKernel_permute, clKernel_lower, clKernel_upper, clKernel_update;
+  cl_int errcode;
+  cl_mem d_b;
+  float *x, *b;
+  size_t bytes = (size_t)matrix_dim*nrhs*sizeof(float);
+  size_t localWorkSize[2];
+  size_t globalWorkSize[2];
+  size_t rhs_groups = (nrhs+BLOCK_SIZE-1)/BLOCK_SIZE;
+  int i, j, k, row_start;
+  float err = 0, norm = 0;
+  stopwatch sw;
+  double secs;
+
+  x = (float *) malloc(bytes);
+  b = (float *) calloc((size_t)matrix_dim*nrhs, sizeof(float));
+  for (i=0; i < matrix_dim*nrhs; i++)
+    x[i] = GET_RAND_FP*2 - 1;
+  for (i=0; i < matrix_dim; i++)
+    for (k=0; k < matrix_dim; k++)
+      for (j=0; j < nrhs; j++)
+        b[i*nrhs+j] += a[i*matrix_dim+k] * x[k*nrhs+j];
+
+  clKernel_permute = clCreateKernel(clProgram, "lud_rhs_permute", &errcode);
+  CHECKERR(errcode);
+  clKernel_lower = clCreateKernel(clProgram, "lud_rhs_lower", &errcode);
+  CHECKERR(errcode);
+  clKernel_upper = clCreateKernel(clProgram, "lud_rhs_upper", &errcode);
+  CHECKERR(errcode);
+  clKernel_update = clCreateKernel(clProgram, "lud_rhs_update", &errcode);
+  CHECKERR(errcode);
+
+  d_b = clCreateBuffer(clContext, CL_MEM_READ_WRITE, bytes, NULL, &errcode);
+  CHECKERR(errcode);
+  errcode = clEnqueueWriteBuffer(clCommands, d_b, CL_TRUE, 0, bytes, (void *) b, 0, NULL, &ocdTempEvent);
+  clFinish(clCommands);
+	START_TIMER(ocdTempEvent, OCD_TIMER_H2D, "RHS Copy", ocdTempTimer)
+	END_TIMER(ocdTempTimer)
+	CHECKERR(errcode);
+
+  stopwatch_start(&sw);
+
+  errcode = clSetKernelArg(clKernel_permute, 0, sizeof(cl_mem), (void *) &d_b);
+  errcode |= clSetKernelArg(clKernel_permute, 1, sizeof(cl_mem), (void *) &d_piv);
+  errcode |= clSetKernelArg(clKernel_permute, 2, sizeof(int), (void *) &matrix_dim);
+  errcode |= clSetKernelArg(clKernel_permute, 3, sizeof(int), (void *) &nrhs);
+  CHECKERR(errcode);
+  localWorkSize[0] = BLOCK_SIZE;
+  globalWorkSize[0] = rhs_groups*BLOCK_SIZE;
+  run_kernel(clCommands, clKernel_permute, 1, globalWorkSize, localWorkSize, "Permute Kernel");
+
+  /* L*Y = P*B, top block first */
+  for (i=0; i < matrix_dim; i += BLOCK_SIZE) {
+    errcode = clSetKernelArg(clKernel_lower, 0, sizeof(cl_mem), (void *) &d_m);
+    errcode |= clSetKernelArg(clKernel_lower, 1, sizeof(cl_mem), (void *) &d_b);
+    errcode |= clSetKernelArg(clKernel_lower, 2, sizeof(int), (void *) &matrix_dim);
+    errcode |= clSetKernelArg(clKernel_lower, 3, sizeof(int), (void *) &nrhs);
+    errcode |= clSetKernelArg(clKernel_lower, 4, sizeof(int), (void *) &i);
+    CHECKERR(errcode);
+    localWorkSize[0] = BLOCK_SIZE;
+    globalWorkSize[0] = rhs_groups*BLOCK_SIZE;
+    run_kernel(clCommands, clKernel_lower, 1, globalWorkSize, localWorkSize, "Forward Kernel");
+
+    if (i+BLOCK_SIZE == matrix_dim)
+      break;
+    row_start = i+BLOCK_SIZE;
+    errcode = clSetKernelArg(clKernel_update, 0, sizeof(cl_mem), (void *) &d_m);
+    errcode |= clSetKernelArg(clKernel_update, 1, sizeof(cl_mem), (void *) &d_b);
+    errcode |= clSetKernelArg(clKernel_update, 2, sizeof(int), (void *) &matrix_dim);
+    errcode |= clSetKernelArg(clKernel_update, 3, sizeof(int), (void *) &nrhs);
+    errcode |= clSetKernelArg(clKernel_update, 4, sizeof(int), (void *) &i);
+    errcode |= clSetKernelArg(clKernel_update, 5, sizeof(int), (void *) &row_start);
+    CHECKERR(errcode);
+    localWorkSize[0] = BLOCK_SIZE;
+    localWorkSize[1] = BLOCK_SIZE;
+    globalWorkSize[0] = rhs_groups*BLOCK_SIZE;
+    globalWorkSize[1] = matrix_dim-row_start;
+    run_kernel(clCommands, clKernel_update, 2, globalWorkSize, localWorkSize, "Forward Update Kernel");
+  }
+
+  /* U*X = Y, bottom block first */
+  for (i=matrix_dim-BLOCK_SIZE; i >= 0; i -= BLOCK_SIZE) {
+    errcode = clSetKernelArg(clKernel_upper, 0, sizeof(cl_mem), (void *) &d_m);
+    errcode |= clSetKernelArg(clKernel_upper, 1, sizeof(cl_mem), (void *) &d_b);
+    errcode |= clSetKernelArg(clKernel_upper, 2, sizeof(int), (void *) &matrix_dim);
+    errcode |= clSetKernelArg(clKernel_upper, 3, sizeof(int), (void *) &nrhs);
+    errcode |= clSetKernelArg(clKernel_upper, 4, sizeof(int), (void *) &i);
+    CHECKERR(errcode);
+    localWorkSize[0] = BLOCK_SIZE;
+    globalWorkSize[0] = rhs_groups*BLOCK_SIZE;
+    run_kernel(clCommands, clKernel_upper, 1, globalWorkSize, localWorkSize, "Backward Kernel");
+
+    if (i == 0)
+      break;
+    row_start = 0;
+    errcode = clSetKernelArg(clKernel_update, 0, sizeof(cl_mem), (void *) &d_m);
+    errcode |= clSetKernelArg(clKernel_update, 1, sizeof(cl_mem), (void *) &d_b);
+    errcode |= clSetKernelArg(clKernel_update, 2, sizeof(int), (void *) &matrix_dim);
+    errcode |= clSetKernelArg(clKernel_update, 3, sizeof(int), (void *) &nrhs);
+    errcode |= clSetKernelArg(clKernel_update, 4, sizeof(int), (void *) &i);
+    errcode |= clSetKernelArg(clKernel_update, 5, sizeof(int), (void *) &row_start);
+    CHECKERR(errcode);
+    localWorkSize[0] = BLOCK_SIZE;
+    localWorkSize[1] = BLOCK_SIZE;
+    globalWorkSize[0] = rhs_groups*BLOCK_SIZE;
+    globalWorkSize[1] = i;
+    run_kernel(clCommands, clKernel_update, 2, globalWorkSize, localWorkSize, "Backward Update Kernel");
+  }
+
+  stopwatch_stop(&sw);
+
+  errcode = clEnqueueReadBuffer(clCommands, d_b, CL_TRUE, 0, bytes, (void *) b, 0, NULL, &ocdTempEvent);
+  clFinish(clCommands);
+	START_TIMER(ocdTempEvent, OCD_TIMER_D2H, "RHS copy", ocdTempTimer)
+	END_TIMER(ocdTempTimer)
+	CHECKERR(errcode);
+
+  for (i=0; i < matrix_dim*nrhs; i++) {
+    if (fabs(b[i]-x[i]) > err)
+      err = fabs(b[i]-x[i]);
+    if (fabs(x[i]) > norm)
+      norm = fabs(x[i]);
+  }
+  secs = get_interval_by_sec(&sw);
+  printf("Solve: %d right-hand sides in %lf ms, %.0f solves/s, %.2f GFLOP/s, max relative error %g\n",
+         nrhs, 1000*secs, nrhs/secs, 2.0*matrix_dim*matrix_dim*nrhs/secs*1e-9, err/norm);
+
+  clReleaseMemObject(d_b);
+  clReleaseKernel(clKernel_permute);
+  clReleaseKernel(clKernel_lower);
+  clReleaseKernel(clKernel_upper);
+  clReleaseKernel(clKernel_update);
+  free(x);
+  free(b);
+}
@@ -0,0 +1,25 @@
+#ifndef _LUD_PIVOT_H
+#define _LUD_PIVOT_H
+
+#include "../../include/common_ocl.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern int BLOCK_SIZE;
+
+void
+lud_pivot_factor(cl_command_queue clCommands, cl_program clProgram,
+                 cl_kernel clKernel_internal, size_t internal_size,
+                 cl_mem d_m, cl_mem d_piv, int matrix_dim, size_t max_group);
+
+void
+lud_pivot_solve(cl_context clContext, cl_command_queue clCommands, cl_program clProgram,
+                cl_mem d_m, cl_mem d_piv, float *a, int matrix_dim, int nrhs);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -7,7 +7,8 @@
 
 bin_PROGRAMS += needle
 
-needle_SOURCES = dynamic-programming/nw/needle.c
+needle_SOURCES = dynamic-programming/nw/needle.c dynamic-programming/nw/needle_batch.c \
+	dynamic-programming/nw/needle_hirschberg.c dynamic-programming/nw/needle_cpu.c
 
 all_local += nw-all-local
 exec_local += nw-exec-local
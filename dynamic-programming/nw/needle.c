@@ -1,13 +1,16 @@
-#define LIMIT -999
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 #include <math.h>
+#include <unistd.h>
 #include "needle.h"
 #include <sys/time.h>
 #include "../../include/rdtsc.h"
 #include "../../include/common_ocl.h"
 
+/* cells outside the band; low enough to lose every maximum, high enough not to wrap */
+#define NW_BAND_NEG (-(1 << 28))
+
 #define CHECKERR(err) \
     if (err != CL_SUCCESS) \
     { \
@@ -17,7 +20,9 @@
 //#define USEGPU 1  
 ////////////////////////////////////////////////////////////////////////////////
 // declaration, forward
-void runTest( int argc, char** argv);
+void runTest( const unsigned char *a, int m, const unsigned char *b, int n,
+              int penalty, int show, int band, int xdrop, int verify);
+void usage(int argc, char **argv);
 
 int platform_id = PLATFORM_ID, n_device = DEVICE_ID;
 
@@ -48,6 +53,9 @@ int blosum62[24][24] = {
 {-4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4,  1}
 };
 
+/* scores of the alignment, BLOSUM62 unless -s gives a matrix file */
+int nw_matrix[NW_ALPHABET][NW_ALPHABET];
+
 double gettime() {
   struct timeval t;
   gettimeofday(&t,NULL);
@@ -72,33 +80,253 @@ return(k);
 
 }
 
+/* the random pair of sequences of the single alignment modes */
+void
+nw_random_pair(unsigned char *a, int m, unsigned char *b, int n)
+{
+	int i;
+
+	srand ( 7 );
+	for (i = 0; i < m; i++)
+		a[i] = rand() % 10 + 1;
+	for (i = 0; i < n; i++)
+		b[i] = rand() % 10 + 1;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 // Program main
 ////////////////////////////////////////////////////////////////////////////////
 int
 main( int argc, char** argv) 
 {
+	const char *batch_file = NULL, *fasta_file = NULL, *matrix_file = NULL;
+	int group_size = -1, verify = 0, hirschberg = 0, show = 0, opt;
+	int band = 0, xdrop = 0, engine = -1;
+	unsigned char *seq_a, *seq_b;
+	int m, n, penalty;
+	nw_pairs pairs;
+
 	ocd_init(&argc, &argv, NULL);
-	runTest( argc, argv);
+	while ((opt = getopt(argc, argv, "ab:e:f:g:Hs:vw:x:")) != -1) {
+		switch (opt) {
+		case 'a':
+			show = 1;
+			break;
+		case 'b':
+			batch_file = optarg;
+			break;
+		case 'e':
+			if ((engine = nw_cpu_engine(optarg)) < 0)
+				usage(argc, argv);
+			break;
+		case 'f':
+			fasta_file = optarg;
+			break;
+		case 'g':
+			group_size = atoi(optarg);
+			break;
+		case 'H':
+			hirschberg = 1;
+			break;
+		case 's':
+			matrix_file = optarg;
+			break;
+		case 'v':
+			verify = 1;
+			break;
+		case 'w':
+			band = atoi(optarg);
+			break;
+		case 'x':
+			xdrop = atoi(optarg);
+			break;
+		default:
+			usage(argc, argv);
+		}
+	}
+	// only the single-pair matrix fill has a banded schedule
+	if ((band || xdrop) && (hirschberg || engine >= 0 || batch_file))
+		usage(argc, argv);
+
+	memcpy(nw_matrix, blosum62, sizeof(nw_matrix));
+	if (matrix_file && nw_read_matrix(matrix_file) != 0)
+		exit(1);
+
+	if (batch_file) {
+		if (optind != argc - 1)
+			usage(argc, argv);
+		if (engine >= 0) {
+			if (nw_read_pairs(batch_file, &pairs) != 0)
+				exit(1);
+			runCPU(&pairs, atoi(argv[optind]), engine, verify);
+			nw_free_pairs(&pairs);
+		}
+		else
+			runBatch(batch_file, atoi(argv[optind]), group_size, verify);
+	}
+	else {
+		// the first pair of a FASTA file, or two random sequences
+		if (fasta_file) {
+			if (optind != argc - 1)
+				usage(argc, argv);
+			if (nw_read_pairs(fasta_file, &pairs) != 0)
+				exit(1);
+			seq_a = pairs.res + pairs.index[0];
+			m = pairs.index[1];
+			seq_b = pairs.res + pairs.index[2];
+			n = pairs.index[3];
+			penalty = atoi(argv[optind]);
+		}
+		else {
+			if (optind != argc - 2 || atoi(argv[optind]) <= 0)
+				usage(argc, argv);
+			m = n = atoi(argv[optind]);
+			pairs.res = (unsigned char *)malloc(m + n);
+			pairs.index = (int *)malloc(4 * sizeof(int));
+			pairs.index[0] = 0;
+			pairs.index[1] = m;
+			pairs.index[2] = m;
+			pairs.index[3] = n;
+			seq_a = pairs.res;
+			seq_b = pairs.res + m;
+			nw_random_pair(seq_a, m, seq_b, n);
+			penalty = atoi(argv[optind + 1]);
+		}
+
+		if (engine >= 0) {
+			pairs.npairs = 1;
+			runCPU(&pairs, penalty, engine, verify);
+		}
+		else if (hirschberg)
+			runHirschberg(seq_a, m, seq_b, n, penalty, group_size, show, verify);
+		else
+			runTest(seq_a, m, seq_b, n, penalty, show, band, xdrop, verify);
+		nw_free_pairs(&pairs);
+	}
         ocd_finalize();
     return EXIT_SUCCESS;
 }
 
 void usage(int argc, char **argv)
 {
-	fprintf(stderr, "Usage: %s <max_rows/max_cols> <penalty> [platform & device]\n", argv[0]);
+	fprintf(stderr, "Usage: %s [-a] [-w band | -x xdrop] [-s matrix] [-v] <max_rows/max_cols> <penalty> [platform & device]\n", argv[0]);
+	fprintf(stderr, "       %s -f <fasta_file> [-a] [-w band | -x xdrop] [-s matrix] [-v] <penalty>\n", argv[0]);
+	fprintf(stderr, "       %s -H [-a] [-g group_size] [-s matrix] [-v] <max_rows/max_cols> <penalty>\n", argv[0]);
+	fprintf(stderr, "       %s -b <pairs_file> [-g group_size] [-v] <penalty>\n", argv[0]);
+	fprintf(stderr, "       %s -e <engine> [-b pairs_file | -f fasta_file] [-s matrix] [-v] [<max_rows/max_cols>] <penalty>\n", argv[0]);
 	fprintf(stderr, "\t<dimension>  - x and y dimensions\n");
 	fprintf(stderr, "\t<penalty> - penalty(positive integer)\n");
 	fprintf(stderr, "\t[platform] - index of platform)\n");
 	fprintf(stderr, "\t[device] - index of device)\n");
+	fprintf(stderr, "\t-b <pairs_file> - align every pair of a FASTA or pair list file\n");
+	fprintf(stderr, "\t-f <fasta_file> - align the first two sequences of a FASTA file\n");
+	fprintf(stderr, "\t-s <matrix> - substitution matrix file in the NCBI format (default BLOSUM62)\n");
+	fprintf(stderr, "\t-a - print the alignment\n");
+	fprintf(stderr, "\t-w <band> - only compute the tiles within band cells of the diagonal\n");
+	fprintf(stderr, "\t-x <xdrop> - only compute the tiles within xdrop of the best score\n");
+	fprintf(stderr, "\t-H - linear memory (Hirschberg) alignment\n");
+	fprintf(stderr, "\t-e <engine> - score on the host with the scalar, striped or inter engine\n");
+	fprintf(stderr, "\t-g <group_size> - work-items per pair, 0 = one pair per work-item\n");
+	fprintf(stderr, "\t-v - check the score or alignment against the host\n");
 	exit(1);
 }
 
-void runTest( int argc, char** argv) 
+/*
+   Banded schedule: launches the block anti-diagonals in order, each with
+   only its tiles lo .. hi. With band > 0 these are the tiles holding cells
+   within band of the main diagonal. With xdrop > 0 the range of the next
+   anti-diagonal covers the tiles right of and below those scoring within
+   xdrop of the best tile of this one, so the band follows the best
+   diagonal. Returns the number of tiles computed.
+ */
+static long
+needle_band(cl_context clContext, cl_command_queue clCommands, cl_program clProgram,
+			cl_mem referrence_cuda, cl_mem matrix_cuda, int max_cols, int penalty,
+			int band, int xdrop)
+{
+	int block_width = ( max_cols - 1 )/BLOCK_SIZE;
+	int w = ( band + BLOCK_SIZE - 1 )/BLOCK_SIZE;
+	int d, x, lo = 0, hi = 0, *best;
+	long tiles = 0;
+	size_t localWorkSize[1] = {BLOCK_SIZE}, globalWorkSize[1];
+	cl_kernel clKernel_band;
+	cl_mem best_cuda;
+	cl_int errcode;
+
+	best = (int *)malloc( block_width * sizeof(int) );
+	clKernel_band = clCreateKernel(clProgram, "needle_opencl_band", &errcode);
+	CHECKERR(errcode);
+	best_cuda = clCreateBuffer(clContext, CL_MEM_WRITE_ONLY, sizeof(int)*block_width, NULL, &errcode);
+	CHECKERR(errcode);
+
+	errcode = clSetKernelArg(clKernel_band, 0, sizeof(cl_mem), (void *) &referrence_cuda);
+	errcode |= clSetKernelArg(clKernel_band, 1, sizeof(cl_mem), (void *) &matrix_cuda);
+	errcode |= clSetKernelArg(clKernel_band, 2, sizeof(int), (void *) &max_cols);
+	errcode |= clSetKernelArg(clKernel_band, 3, sizeof(int), (void *) &penalty);
+	errcode |= clSetKernelArg(clKernel_band, 6, sizeof(cl_mem), (void *) &best_cuda);
+	CHECKERR(errcode);
+
+	for (d = 0; d < 2 * block_width - 1; d++) {
+		int first = d < block_width ? 0 : d - block_width + 1;
+		int last = d < block_width ? d : block_width - 1;
+
+		/* tiles (x, d-x) with |2x - d| <= w */
+		if (xdrop <= 0) {
+			lo = d - w <= 0 ? 0 : (d - w + 1) / 2;
+			hi = (d + w) / 2;
+		}
+		lo = lo < first ? first : lo > last ? last : lo;
+		hi = hi < first ? first : hi > last ? last : hi;
+
+		globalWorkSize[0] = (hi - lo + 1) * localWorkSize[0];
+		errcode = clSetKernelArg(clKernel_band, 4, sizeof(int), (void *) &d);
+		errcode |= clSetKernelArg(clKernel_band, 5, sizeof(int), (void *) &lo);
+		CHECKERR(errcode);
+		errcode = clEnqueueNDRangeKernel(clCommands, clKernel_band, 1, NULL, globalWorkSize, localWorkSize, 0, NULL, &ocdTempEvent);
+		clFinish(clCommands);
+		START_TIMER(ocdTempEvent, OCD_TIMER_KERNEL, "NW Band Kernels", ocdTempTimer)
+		END_TIMER(ocdTempTimer)
+		CHECKERR(errcode);
+		tiles += hi - lo + 1;
+
+		if (xdrop > 0) {
+			int top, next_lo = hi, next_hi = lo;
+
+			errcode = clEnqueueReadBuffer(clCommands, best_cuda, CL_TRUE, 0, sizeof(int)*(hi - lo + 1), (void *) best, 0, NULL, &ocdTempEvent);
+			clFinish(clCommands);
+			START_TIMER(ocdTempEvent, OCD_TIMER_D2H, "NW Band Copy", ocdTempTimer)
+			END_TIMER(ocdTempTimer)
+			CHECKERR(errcode);
+
+			for (x = lo, top = best[0]; x <= hi; x++)
+				if (best[x - lo] > top)
+					top = best[x - lo];
+			for (x = lo; x <= hi; x++)
+				if (best[x - lo] >= top - xdrop) {
+					next_lo = x < next_lo ? x : next_lo;
+					next_hi = x > next_hi ? x : next_hi;
+				}
+			lo = next_lo;
+			hi = next_hi + 1;
+		}
+	}
+
+	clReleaseMemObject(best_cuda);
+	clReleaseKernel(clKernel_band);
+	free(best);
+	return tiles;
+}
+
+void runTest( const unsigned char *a, int m, const unsigned char *b, int n,
+              int penalty, int show, int band, int xdrop, int verify) 
 {
-    int max_rows, max_cols, penalty;
-    int *input_itemsets, *output_itemsets, *referrence;
-	cl_mem matrix_cuda, matrix_cuda_out, referrence_cuda;
+    int max_rows, max_cols, dim;
+    int *input_itemsets, *referrence;
+    unsigned char *seq_a, *seq_b;
+    char *moves;
+    int result[2];
+	cl_mem matrix_cuda, referrence_cuda;
+	cl_mem moves_cuda, result_cuda;
 	int size;
 	
     int i, j;
@@ -107,56 +335,45 @@ void runTest( int argc, char** argv)
 	platform_id = opts.platform_id;
 	n_device = opts.device_id;
 
-    // the lengths of the two sequences should be able to divided by 16.
-	// And at current stage  max_rows needs to equal max_cols
-	if (argc == 3)
-	{
-		max_rows = atoi(argv[1]);
-		max_cols = atoi(argv[1]);
-		penalty = atoi(argv[2]);
-	}
-    else{
-	usage(argc, argv);
-    }
-	
-	if(atoi(argv[1])%16!=0){
-	fprintf(stderr,"The dimension values must be a multiple of 16\n");
-	exit(1);
-	}
-	
+    // the kernels need a square matrix with sides a multiple of 16, so the
+	// sequences are padded; a cell only depends on the residues before it,
+	// so the alignment is traced back from (m, n)
+	dim = m > n ? m : n;
+	dim = ( dim + BLOCK_SIZE - 1 ) / BLOCK_SIZE * BLOCK_SIZE;
 
-	max_rows = max_rows + 1;
-	max_cols = max_cols + 1;
+	max_rows = dim + 1;
+	max_cols = dim + 1;
 	referrence = (int *)malloc( max_rows * max_cols * sizeof(int) );
     input_itemsets = (int *)malloc( max_rows * max_cols * sizeof(int) );
-	output_itemsets = (int *)malloc( max_rows * max_cols * sizeof(int) );
 	
 
 	if (!input_itemsets)
 		fprintf(stderr, "error: can not allocate memory");
 
-    srand ( 7 );
-	
+	seq_a = (unsigned char *)calloc( dim, 1 );
+	seq_b = (unsigned char *)calloc( dim, 1 );
+	memcpy(seq_a, a, m);
+	memcpy(seq_b, b, n);
 	
     for (i = 0 ; i < max_cols; i++){
 		for (j = 0 ; j < max_rows; j++){
-			input_itemsets[i*max_cols+j] = 0;
+			input_itemsets[i*max_cols+j] = (i && j && (band > 0 || xdrop > 0)) ? NW_BAND_NEG : 0;
 		}
 	}
 	
 	printf("Start Needleman-Wunsch\n");
 	
 	for(i=1; i< max_rows ; i++){    //please define your own sequence. 
-       input_itemsets[i*max_cols] = rand() % 10 + 1;
+       input_itemsets[i*max_cols] = seq_a[i-1];
 	}
     for(j=1; j< max_cols ; j++){    //please define your own sequence.
-       input_itemsets[j] = rand() % 10 + 1;
+       input_itemsets[j] = seq_b[j-1];
 	}
 
 
 	for (i = 1 ; i < max_cols; i++){
 		for (j = 1 ; j < max_rows; j++){
-		referrence[i*max_cols+j] = blosum62[input_itemsets[i*max_cols]][input_itemsets[j]];
+		referrence[i*max_cols+j] = nw_matrix[input_itemsets[i*max_cols]][input_itemsets[j]];
 		}
 	}
 
@@ -171,6 +388,7 @@ void runTest( int argc, char** argv)
     cl_program clProgram;
     cl_kernel clKernel_nw1;
     cl_kernel clKernel_nw2;
+    cl_kernel clKernel_tb;
 
     cl_int errcode,dev_type;
 
@@ -232,8 +450,6 @@ void runTest( int argc, char** argv)
     CHECKERR(errcode);
     matrix_cuda = clCreateBuffer(clContext, CL_MEM_READ_WRITE, sizeof(int)*size, NULL, &errcode);
     CHECKERR(errcode);
-    matrix_cuda_out = clCreateBuffer(clContext, CL_MEM_READ_WRITE, sizeof(int)*size, NULL, &errcode);
-    CHECKERR(errcode);
     errcode = clEnqueueWriteBuffer(clCommands, referrence_cuda, CL_TRUE, 0, sizeof(int)*size, (void *) referrence, 0, NULL, &ocdTempEvent);
 
     START_TIMER(ocdTempEvent, OCD_TIMER_H2D, "NW Reference Copy", ocdTempTimer)
@@ -248,6 +464,13 @@ void runTest( int argc, char** argv)
     size_t globalWorkSize[2];
 	int block_width = ( max_cols - 1 )/BLOCK_SIZE;
 
+	if (band > 0 || xdrop > 0) {
+		long tiles = needle_band(clContext, clCommands, clProgram, referrence_cuda, matrix_cuda,
+		                         max_cols, penalty, band, xdrop);
+		printf("Processed %ld of %d tiles (%.1f%%)\n", tiles, block_width * block_width,
+		       100.0 * tiles / ((double)block_width * block_width));
+	}
+	else {
 	printf("Processing top-left matrix\n");
 	//process top-left matrix
 	for(i = 1 ; i <= block_width ; i++){
@@ -255,11 +478,10 @@ void runTest( int argc, char** argv)
         globalWorkSize[1] = 1*localWorkSize[1];
         errcode = clSetKernelArg(clKernel_nw1, 0, sizeof(cl_mem), (void *) &referrence_cuda);
         errcode |= clSetKernelArg(clKernel_nw1, 1, sizeof(cl_mem), (void *) &matrix_cuda);
-        errcode |= clSetKernelArg(clKernel_nw1, 2, sizeof(cl_mem), (void *) &matrix_cuda_out);
-        errcode |= clSetKernelArg(clKernel_nw1, 3, sizeof(int), (void *) &max_cols);
-        errcode |= clSetKernelArg(clKernel_nw1, 4, sizeof(int), (void *) &penalty);
-        errcode |= clSetKernelArg(clKernel_nw1, 5, sizeof(int), (void *) &i);
-        errcode |= clSetKernelArg(clKernel_nw1, 6, sizeof(int), (void *) &block_width);
+        errcode |= clSetKernelArg(clKernel_nw1, 2, sizeof(int), (void *) &max_cols);
+        errcode |= clSetKernelArg(clKernel_nw1, 3, sizeof(int), (void *) &penalty);
+        errcode |= clSetKernelArg(clKernel_nw1, 4, sizeof(int), (void *) &i);
+        errcode |= clSetKernelArg(clKernel_nw1, 5, sizeof(int), (void *) &block_width);
         CHECKERR(errcode);
         errcode = clEnqueueNDRangeKernel(clCommands, clKernel_nw1, 2, NULL, globalWorkSize, localWorkSize, 0, NULL, &ocdTempEvent);
         clFinish(clCommands);
@@ -274,11 +496,10 @@ void runTest( int argc, char** argv)
         globalWorkSize[1] = 1*localWorkSize[1];
         errcode = clSetKernelArg(clKernel_nw2, 0, sizeof(cl_mem), (void *) &referrence_cuda);
         errcode |= clSetKernelArg(clKernel_nw2, 1, sizeof(cl_mem), (void *) &matrix_cuda);
-        errcode |= clSetKernelArg(clKernel_nw2, 2, sizeof(cl_mem), (void *) &matrix_cuda_out);
-        errcode |= clSetKernelArg(clKernel_nw2, 3, sizeof(int), (void *) &max_cols);
-        errcode |= clSetKernelArg(clKernel_nw2, 4, sizeof(int), (void *) &penalty);
-        errcode |= clSetKernelArg(clKernel_nw2, 5, sizeof(int), (void *) &i);
-        errcode |= clSetKernelArg(clKernel_nw2, 6, sizeof(int), (void *) &block_width);
+        errcode |= clSetKernelArg(clKernel_nw2, 2, sizeof(int), (void *) &max_cols);
+        errcode |= clSetKernelArg(clKernel_nw2, 3, sizeof(int), (void *) &penalty);
+        errcode |= clSetKernelArg(clKernel_nw2, 4, sizeof(int), (void *) &i);
+        errcode |= clSetKernelArg(clKernel_nw2, 5, sizeof(int), (void *) &block_width);
         CHECKERR(errcode);
 	errcode = clEnqueueNDRangeKernel(clCommands, clKernel_nw2, 2, NULL, globalWorkSize, localWorkSize, 0, NULL, &ocdTempEvent);
         clFinish(clCommands);
@@ -286,74 +507,86 @@ void runTest( int argc, char** argv)
         END_TIMER(ocdTempTimer)
         CHECKERR(errcode);
 	}
+	}
 
-    errcode = clEnqueueReadBuffer(clCommands, matrix_cuda, CL_TRUE, 0, sizeof(float)*size, (void *) output_itemsets, 0, NULL, &ocdTempEvent);
-    clFinish(clCommands);
-    	START_TIMER(ocdTempEvent, OCD_TIMER_D2H, "NW Item Set Copy", ocdTempTimer)
+	// only the score and the path leave the device
+	clKernel_tb = clCreateKernel(clProgram, "needle_traceback", &errcode);
+	CHECKERR(errcode);
+	moves_cuda = clCreateBuffer(clContext, CL_MEM_WRITE_ONLY, m + n, NULL, &errcode);
+	CHECKERR(errcode);
+	result_cuda = clCreateBuffer(clContext, CL_MEM_WRITE_ONLY, sizeof(result), NULL, &errcode);
+	CHECKERR(errcode);
+	errcode = clSetKernelArg(clKernel_tb, 0, sizeof(cl_mem), (void *) &referrence_cuda);
+	errcode |= clSetKernelArg(clKernel_tb, 1, sizeof(cl_mem), (void *) &matrix_cuda);
+	errcode |= clSetKernelArg(clKernel_tb, 2, sizeof(int), (void *) &max_cols);
+	errcode |= clSetKernelArg(clKernel_tb, 3, sizeof(int), (void *) &penalty);
+	errcode |= clSetKernelArg(clKernel_tb, 4, sizeof(int), (void *) &m);
+	errcode |= clSetKernelArg(clKernel_tb, 5, sizeof(int), (void *) &n);
+	errcode |= clSetKernelArg(clKernel_tb, 6, sizeof(cl_mem), (void *) &moves_cuda);
+	errcode |= clSetKernelArg(clKernel_tb, 7, sizeof(cl_mem), (void *) &result_cuda);
+	CHECKERR(errcode);
+	globalWorkSize[0] = localWorkSize[0] = 1;
+	globalWorkSize[1] = localWorkSize[1] = 1;
+	errcode = clEnqueueNDRangeKernel(clCommands, clKernel_tb, 2, NULL, globalWorkSize, localWorkSize, 0, NULL, &ocdTempEvent);
+	clFinish(clCommands);
+	START_TIMER(ocdTempEvent, OCD_TIMER_KERNEL, "NW Traceback Kernel", ocdTempTimer)
 	END_TIMER(ocdTempTimer)
 	CHECKERR(errcode);
-	
-	
-#ifdef TRACE
-
-	printf("print traceback value GPU:\n");
-    
-	for (i = max_rows - 2,  j = max_rows - 2; i>=0, j>=0;){
-
-		int nw, n, w, traceback;
-
-		if ( i == max_rows - 2 && j == max_rows - 2 )
-			printf("%d ", output_itemsets[ i * max_cols + j]); //print the first element
-            
-
-		if ( i == 0 && j == 0 )
-           break;
 
+    errcode = clEnqueueReadBuffer(clCommands, result_cuda, CL_TRUE, 0, sizeof(result), (void *) result, 0, NULL, &ocdTempEvent);
+    clFinish(clCommands);
+	START_TIMER(ocdTempEvent, OCD_TIMER_D2H, "NW Score Copy", ocdTempTimer)
+	END_TIMER(ocdTempTimer)
+	CHECKERR(errcode);
 
-		if ( i > 0 && j > 0 ){
-			nw = output_itemsets[(i - 1) * max_cols + j - 1];
-		    w  = output_itemsets[ i * max_cols + j - 1 ];
-            n  = output_itemsets[(i - 1) * max_cols + j];
+	printf("Score: %d\n", result[1]);
+	if (result[1] <= NW_BAND_NEG / 2)
+		printf("The band does not reach the end of the matrix, widen it\n");
+	if (verify)
+		printf("Full matrix score on the host: %d\n",
+		       nw_score_host(a, m, b, n, penalty));
+
+	if (show) {
+		moves = (char *)malloc( m + n );
+		errcode = clEnqueueReadBuffer(clCommands, moves_cuda, CL_TRUE, 0, result[0], (void *) moves, 0, NULL, &ocdTempEvent);
+		clFinish(clCommands);
+		START_TIMER(ocdTempEvent, OCD_TIMER_D2H, "NW Alignment Copy", ocdTempTimer)
+		END_TIMER(ocdTempTimer)
+		CHECKERR(errcode);
+
+		// the kernel writes the path from (m, n) back to (0, 0)
+		for (i = 0, j = result[0] - 1; i < j; i++, j--) {
+			char t = moves[i];
+			moves[i] = moves[j];
+			moves[j] = t;
 		}
-		else if ( i == 0 ){
-		    nw = n = LIMIT;
-		    w  = output_itemsets[ i * max_cols + j - 1 ];
+		nw_print_alignment(moves, result[0]);
+		if (verify) {
+			char *host = (char *)malloc( m + n );
+			int len = nw_align_host(a, m, b, n, penalty, host);
+
+			printf("Alignment %s the host traceback\n",
+			       len == result[0] && memcmp(host, moves, len) == 0 ? "matches" : "differs from");
+			free(host);
 		}
-		else if ( j == 0 ){
-		    nw = w = LIMIT;
-            n  = output_itemsets[(i - 1) * max_cols + j];
-		}
-		else{
-		}
-
-		traceback = maximum(nw, w, n);
-		
-		printf("%d ", traceback);
-
-		if(traceback == nw )
-		{i--; j--; continue;}
-
-        else if(traceback == w )
-		{j--; continue;}
-
-        else if(traceback == n )
-		{i--; continue;}
-
-		else
-		;
+		free(moves);
 	}
-    printf("\n");
 
-#endif
 
 	clReleaseMemObject(referrence_cuda);
 	clReleaseMemObject(matrix_cuda);
-	clReleaseMemObject(matrix_cuda_out);
+	clReleaseMemObject(moves_cuda);
+	clReleaseMemObject(result_cuda);
+    clReleaseKernel(clKernel_tb);
     clReleaseKernel(clKernel_nw1);
     clReleaseKernel(clKernel_nw2);
     clReleaseProgram(clProgram);
     clReleaseCommandQueue(clCommands);
     clReleaseContext(clContext);
+	free(seq_a);
+	free(seq_b);
+	free(referrence);
+	free(input_itemsets);
 
 }
 
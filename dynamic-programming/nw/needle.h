@@ -1,3 +1,44 @@
 #define BLOCK_SIZE 16
-//#define TRACE
 
+#define NW_ALPHABET 24
+
+/* sequences of the batch mode, encoded as nw_matrix indices back to back;
+   index[4p .. 4p+3] = {a_off, a_len, b_off, b_len} for pair p */
+typedef struct {
+	unsigned char *res;
+	long total, capacity;
+	int *index;
+	int nseqs, npairs, max_pairs;
+} nw_pairs;
+
+extern int blosum62[24][24];
+extern int nw_matrix[NW_ALPHABET][NW_ALPHABET];
+extern int platform_id, n_device;
+
+double gettime();
+int maximum(int a, int b, int c);
+void nw_random_pair(unsigned char *a, int m, unsigned char *b, int n);
+
+/* needle_batch.c */
+int nw_read_matrix(const char *filename);
+int nw_read_pairs(const char *filename, nw_pairs *pairs);
+void nw_free_pairs(nw_pairs *pairs);
+int nw_score_host(const unsigned char *a, int m, const unsigned char *b, int n, int penalty);
+void runBatch(const char *filename, int penalty, int group_size, int verify);
+
+/* needle_hirschberg.c */
+int nw_traceback(const int *h, int ld, const unsigned char *a, int m,
+				 const unsigned char *b, int n, int penalty, char *moves);
+int nw_align_host(const unsigned char *a, int m, const unsigned char *b, int n,
+				  int penalty, char *moves);
+int nw_path_score(const unsigned char *a, const unsigned char *b,
+				  const char *moves, int len, int penalty);
+void nw_print_alignment(const char *moves, int len);
+void runHirschberg(const unsigned char *a, int m, const unsigned char *b, int n,
+				   int penalty, int group_size, int show, int verify);
+
+/* needle_cpu.c */
+int nw_cpu_engine(const char *name);
+int nw_striped_score(const unsigned char *a, int m, const unsigned char *b, int n, int penalty);
+void nw_cpu_scores(int engine, const nw_pairs *pairs, int penalty, int *score);
+void runCPU(const nw_pairs *pairs, int penalty, int engine, int verify);
@@ -0,0 +1,336 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include "needle.h"
+#include "../../include/rdtsc.h"
+#include "../../include/common_ocl.h"
+
+#define CHECKERR(err) \
+    if (err != CL_SUCCESS) \
+    { \
+        fprintf(stderr, "Error: %d\n", err);\
+        exit(1); \
+    }
+
+/* residue order of the rows and columns of nw_matrix */
+static const char nw_alphabet[] = "ARNDCQEGHILKMFPSTWYVBZX*";
+
+static int
+nw_index(int c)
+{
+	const char *p = strchr(nw_alphabet, toupper(c));
+
+	return (p && *p) ? (int)(p - nw_alphabet) : -1;
+}
+
+static unsigned char
+nw_encode(int c)
+{
+	int i = nw_index(c);
+
+	return i < 0 ? 22 : (unsigned char)i;	/* X */
+}
+
+/*
+   Reads a substitution matrix in the NCBI format into nw_matrix: a line
+   with the column residues, then a line per row residue followed by its
+   scores. Residues outside nw_alphabet are skipped, and pairs the file
+   does not mention keep their BLOSUM62 score.
+ */
+int
+nw_read_matrix(const char *filename)
+{
+	FILE *fp;
+	char line[1024], *tok;
+	char *name;
+	int col[64], ncols = 0, row, k;
+
+	if ((fp = fopen(filename, "r")) == NULL) {
+		fprintf(stderr, "Error: cannot open %s\n", filename);
+		return -1;
+	}
+	while (fgets(line, sizeof(line), fp)) {
+		if ((tok = strtok(line, " \t\r\n")) == NULL || *tok == '#')
+			continue;
+		if (ncols == 0) {
+			for (; tok && ncols < 64; tok = strtok(NULL, " \t\r\n"))
+				col[ncols++] = nw_index(*tok);
+			continue;
+		}
+		name = tok;
+		row = nw_index(*name);
+		for (k = 0; k < ncols && (tok = strtok(NULL, " \t\r\n")); k++)
+			if (row >= 0 && col[k] >= 0)
+				nw_matrix[row][col[k]] = atoi(tok);
+		if (k < ncols) {
+			fprintf(stderr, "Error: %s: row %s has %d of %d scores\n", filename, name, k, ncols);
+			fclose(fp);
+			return -1;
+		}
+	}
+	fclose(fp);
+	if (ncols == 0) {
+		fprintf(stderr, "Error: %s: no substitution matrix found\n", filename);
+		return -1;
+	}
+	return 0;
+}
+
+static void
+nw_append(nw_pairs *pairs, const char *seq, int len)
+{
+	int i;
+
+	if (pairs->total + len > pairs->capacity) {
+		while (pairs->total + len > pairs->capacity)
+			pairs->capacity = pairs->capacity ? 2 * pairs->capacity : 1 << 16;
+		pairs->res = (unsigned char *)realloc(pairs->res, pairs->capacity);
+	}
+	for (i = 0; i < len; i++)
+		pairs->res[pairs->total++] = nw_encode(seq[i]);
+}
+
+/* records the sequence just appended as the row or column of a pair */
+static void
+nw_close_sequence(nw_pairs *pairs, int start)
+{
+	int k = pairs->nseqs++;
+
+	if (k / 2 >= pairs->max_pairs) {
+		pairs->max_pairs = pairs->max_pairs ? 2 * pairs->max_pairs : 1024;
+		pairs->index = (int *)realloc(pairs->index, 4 * pairs->max_pairs * sizeof(int));
+	}
+	pairs->index[2 * k]     = start;
+	pairs->index[2 * k + 1] = (int)(pairs->total - start);
+}
+
+/*
+   Reads pairs of sequences for the batch mode, either as FASTA, where
+   records 2k and 2k+1 form pair k, or as a pair list with the two
+   sequences of a pair on one line separated by white space.
+ */
+int
+nw_read_pairs(const char *filename, nw_pairs *pairs)
+{
+	FILE *fp;
+	char *line = NULL;
+	size_t cap = 0;
+	ssize_t len;
+	int fasta = -1, start = 0, in_seq = 0;
+
+	memset(pairs, 0, sizeof(*pairs));
+	if ((fp = fopen(filename, "r")) == NULL) {
+		fprintf(stderr, "Error: cannot open %s\n", filename);
+		return -1;
+	}
+
+	while ((len = getline(&line, &cap, fp)) != -1) {
+		char *s = line, *tok;
+
+		while (len > 0 && isspace((unsigned char)line[len - 1]))
+			line[--len] = '\0';
+		while (isspace((unsigned char)*s))
+			s++;
+		if (*s == '\0' || *s == ';')
+			continue;
+		if (fasta < 0)
+			fasta = *s == '>';
+
+		if (fasta) {
+			if (*s == '>') {
+				if (in_seq)
+					nw_close_sequence(pairs, start);
+				start = (int)pairs->total;
+				in_seq = 1;
+			} else
+				nw_append(pairs, s, (int)strlen(s));
+			continue;
+		}
+
+		for (tok = strtok(s, " \t"); tok; tok = strtok(NULL, " \t")) {
+			start = (int)pairs->total;
+			nw_append(pairs, tok, (int)strlen(tok));
+			nw_close_sequence(pairs, start);
+		}
+		if (pairs->nseqs % 2) {
+			fprintf(stderr, "Error: %s: a pair list line needs two sequences\n", filename);
+			fclose(fp);
+			return -1;
+		}
+	}
+	if (fasta > 0 && in_seq)
+		nw_close_sequence(pairs, start);
+	free(line);
+	fclose(fp);
+
+	if (pairs->nseqs == 0 || pairs->nseqs % 2) {
+		fprintf(stderr, "Error: %s: expected an even number of sequences, found %d\n",
+				filename, pairs->nseqs);
+		return -1;
+	}
+	pairs->npairs = pairs->nseqs / 2;
+	for (start = 0; start < pairs->nseqs; start++)
+		if (pairs->index[2 * start + 1] == 0) {
+			fprintf(stderr, "Error: %s: sequence %d is empty\n", filename, start);
+			return -1;
+		}
+	return 0;
+}
+
+void
+nw_free_pairs(nw_pairs *pairs)
+{
+	free(pairs->res);
+	free(pairs->index);
+}
+
+/* global alignment score on the host, with a single row of the matrix */
+int
+nw_score_host(const unsigned char *a, int m, const unsigned char *b, int n, int penalty)
+{
+	int *row = (int *)malloc((n + 1) * sizeof(int));
+	int i, j, diag, left, up;
+
+	for (j = 0; j <= n; j++)
+		row[j] = -j * penalty;
+	for (i = 1; i <= m; i++) {
+		diag = row[0];
+		left = row[0] = -i * penalty;
+		for (j = 1; j <= n; j++) {
+			up = row[j];
+			left = maximum(diag + nw_matrix[a[i - 1]][b[j - 1]], left - penalty, up - penalty);
+			diag = up;
+			row[j] = left;
+		}
+	}
+	left = row[n];
+	free(row);
+	return left;
+}
+
+/*
+   Batch mode: aligns every pair of the input in a single launch, one
+   work-group per pair, or one work-item per pair when group_size is 0,
+   and reports alignments/s and GCUPS.
+ */
+void
+runBatch(const char *filename, int penalty, int group_size, int verify)
+{
+	nw_pairs pairs;
+	int *score;
+	long long cells = 0;
+	double start, elapsed;
+	int p, mismatches = 0;
+
+	cl_device_id clDevice;
+	cl_context clContext;
+	cl_command_queue clCommands;
+	cl_program clProgram;
+	cl_kernel clKernel;
+	cl_mem res_d, pairs_d, sub_d, scratch_d, score_d;
+	cl_int errcode, dev_type;
+	size_t localWorkSize[1], globalWorkSize[1], max_group;
+
+	if (nw_read_pairs(filename, &pairs) != 0)
+		exit(1);
+	for (p = 0; p < pairs.npairs; p++)
+		cells += (long long)pairs.index[4 * p + 1] * pairs.index[4 * p + 3];
+	score = (int *)malloc(pairs.npairs * sizeof(int));
+
+	#ifdef USEGPU
+		dev_type = CL_DEVICE_TYPE_GPU;
+	#elif defined(USE_AFPGA)
+		dev_type = CL_DEVICE_TYPE_ACCELERATOR;
+	#else
+		dev_type = CL_DEVICE_TYPE_CPU;
+	#endif
+
+	clDevice = GetDevice(platform_id, n_device, dev_type);
+	clContext = clCreateContext(NULL, 1, &clDevice, NULL, NULL, &errcode);
+	CHECKERR(errcode);
+	clCommands = clCreateCommandQueue(clContext, clDevice, CL_QUEUE_PROFILING_ENABLE, &errcode);
+	CHECKERR(errcode);
+	clProgram = ocdBuildProgramFromFile(clContext, clDevice, "needle_kernel.cl");
+
+	/* CPU runtimes vectorise across work-items, so give each lane a pair */
+	if (group_size < 0)
+		group_size = dev_type == CL_DEVICE_TYPE_CPU ? 0 : 64;
+	errcode = clGetDeviceInfo(clDevice, CL_DEVICE_MAX_WORK_GROUP_SIZE, sizeof(size_t), &max_group, NULL);
+	CHECKERR(errcode);
+	if ((size_t)group_size > max_group)
+		group_size = (int)max_group;
+
+	clKernel = clCreateKernel(clProgram, group_size ? "needle_batch_group" : "needle_batch_lane", &errcode);
+	CHECKERR(errcode);
+
+	res_d = clCreateBuffer(clContext, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, pairs.total, pairs.res, &errcode);
+	CHECKERR(errcode);
+	pairs_d = clCreateBuffer(clContext, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, 4 * pairs.npairs * sizeof(int), pairs.index, &errcode);
+	CHECKERR(errcode);
+	sub_d = clCreateBuffer(clContext, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, sizeof(nw_matrix), nw_matrix, &errcode);
+	CHECKERR(errcode);
+	scratch_d = clCreateBuffer(clContext, CL_MEM_READ_WRITE, (pairs.total + pairs.npairs) * sizeof(int), NULL, &errcode);
+	CHECKERR(errcode);
+	score_d = clCreateBuffer(clContext, CL_MEM_WRITE_ONLY, pairs.npairs * sizeof(int), NULL, &errcode);
+	CHECKERR(errcode);
+
+	errcode = clSetKernelArg(clKernel, 0, sizeof(cl_mem), (void *) &res_d);
+	errcode |= clSetKernelArg(clKernel, 1, sizeof(cl_mem), (void *) &pairs_d);
+	errcode |= clSetKernelArg(clKernel, 2, sizeof(cl_mem), (void *) &sub_d);
+	errcode |= clSetKernelArg(clKernel, 3, sizeof(cl_mem), (void *) &scratch_d);
+	errcode |= clSetKernelArg(clKernel, 4, sizeof(cl_mem), (void *) &score_d);
+	errcode |= clSetKernelArg(clKernel, 5, sizeof(int), (void *) &penalty);
+	if (group_size) {
+		errcode |= clSetKernelArg(clKernel, 6, 2 * group_size * sizeof(int), NULL);
+		localWorkSize[0] = group_size;
+		globalWorkSize[0] = (size_t)pairs.npairs * group_size;
+	} else {
+		errcode |= clSetKernelArg(clKernel, 6, sizeof(int), (void *) &pairs.npairs);
+		localWorkSize[0] = 64 < max_group ? 64 : max_group;
+		globalWorkSize[0] = (pairs.npairs + localWorkSize[0] - 1) / localWorkSize[0] * localWorkSize[0];
+	}
+	CHECKERR(errcode);
+
+	printf("Aligning %d pairs with %s\n", pairs.npairs,
+		   group_size ? "one work-group per pair" : "one work-item per pair");
+
+	start = gettime();
+	errcode = clEnqueueNDRangeKernel(clCommands, clKernel, 1, NULL, globalWorkSize, localWorkSize, 0, NULL, &ocdTempEvent);
+	clFinish(clCommands);
+	elapsed = gettime() - start;
+	START_TIMER(ocdTempEvent, OCD_TIMER_KERNEL, "NW Batch Kernel", ocdTempTimer)
+	END_TIMER(ocdTempTimer)
+	CHECKERR(errcode);
+
+	errcode = clEnqueueReadBuffer(clCommands, score_d, CL_TRUE, 0, pairs.npairs * sizeof(int), (void *) score, 0, NULL, &ocdTempEvent);
+	clFinish(clCommands);
+	START_TIMER(ocdTempEvent, OCD_TIMER_D2H, "NW Score Copy", ocdTempTimer)
+	END_TIMER(ocdTempTimer)
+	CHECKERR(errcode);
+
+	printf("%d alignments, %lld cells in %.3f ms: %.0f alignments/s, %.3f GCUPS\n",
+		   pairs.npairs, cells, elapsed * 1000, pairs.npairs / elapsed, cells / elapsed * 1e-9);
+
+	if (verify) {
+		for (p = 0; p < pairs.npairs; p++) {
+			int *ix = pairs.index + 4 * p;
+			int host = nw_score_host(pairs.res + ix[0], ix[1], pairs.res + ix[2], ix[3], penalty);
+			if (host != score[p] && mismatches++ < 10)
+				printf("pair %d: device %d, host %d\n", p, score[p], host);
+		}
+		printf("%d of %d scores match the host\n", pairs.npairs - mismatches, pairs.npairs);
+	}
+
+	clReleaseMemObject(res_d);
+	clReleaseMemObject(pairs_d);
+	clReleaseMemObject(sub_d);
+	clReleaseMemObject(scratch_d);
+	clReleaseMemObject(score_d);
+	clReleaseKernel(clKernel);
+	clReleaseProgram(clProgram);
+	clReleaseCommandQueue(clCommands);
+	clReleaseContext(clContext);
+	nw_free_pairs(&pairs);
+	free(score);
+}
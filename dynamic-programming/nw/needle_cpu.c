@@ -0,0 +1,343 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "needle.h"
+
+/*
+   Host engines for the global alignment score, used as the CPU baseline
+   and fallback of the device kernels (-e):
+
+     scalar   one row of the matrix in 32-bit ints (nw_score_host)
+     striped  Farrar's striped layout: the first sequence is split into
+              lanes of 16-bit saturating scores, and a lazy pass carries
+              the vertical gaps from each lane to the next
+     inter    one pair per 16-bit lane, all lanes stepping through their
+              own matrices together
+
+   The SIMD engines are built with SSE2, or AVX2 when the compiler targets
+   it, and fall back to the scalar engine elsewhere. Global scores drift by
+   the gap penalty per residue, so there is no 8-bit variant; a pair whose
+   score bounds do not fit 16 bits is aligned in 32 bits instead.
+ */
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+typedef __m256i nw_vec;
+#define NW_LANES 16
+#define v_set(x)       _mm256_set1_epi16(x)
+#define v_adds(a, b)   _mm256_adds_epi16(a, b)
+#define v_subs(a, b)   _mm256_subs_epi16(a, b)
+#define v_max(a, b)    _mm256_max_epi16(a, b)
+#define v_any_gt(a, b) (_mm256_movemask_epi8(_mm256_cmpgt_epi16(a, b)) != 0)
+/* moves every lane up by one, across the two 128-bit halves */
+#define v_shift(a)     _mm256_alignr_epi8(a, _mm256_permute2x128_si256(a, a, 0x08), 14)
+#define v_insert0(a, x) _mm256_insert_epi16(a, x, 0)
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+typedef __m128i nw_vec;
+#define NW_LANES 8
+#define v_set(x)       _mm_set1_epi16(x)
+#define v_adds(a, b)   _mm_adds_epi16(a, b)
+#define v_subs(a, b)   _mm_subs_epi16(a, b)
+#define v_max(a, b)    _mm_max_epi16(a, b)
+#define v_any_gt(a, b) (_mm_movemask_epi8(_mm_cmpgt_epi16(a, b)) != 0)
+#define v_shift(a)     _mm_slli_si128(a, 2)
+#define v_insert0(a, x) _mm_insert_epi16(a, x, 0)
+#endif
+
+#define NW_NEG16 (-32768)
+
+static const char *nw_engines[] = { "scalar", "striped", "inter" };
+
+int
+nw_cpu_engine(const char *name)
+{
+	int e;
+
+	for (e = 0; e < 3; e++)
+		if (strcmp(name, nw_engines[e]) == 0)
+			return e;
+	return -1;
+}
+
+/* whether every cell of an m x n matrix fits in 16 bits */
+static int
+nw_fits16(int m, int n, int penalty)
+{
+	int lo = 0, hi = 0, r, c;
+	long gap;
+
+	for (r = 0; r < NW_ALPHABET; r++)
+		for (c = 0; c < NW_ALPHABET; c++) {
+			lo = nw_matrix[r][c] < lo ? nw_matrix[r][c] : lo;
+			hi = nw_matrix[r][c] > hi ? nw_matrix[r][c] : hi;
+		}
+	/* a cell is never below the all-gap path to it, nor above all matches */
+	gap = penalty > -lo ? penalty : -lo;
+	return penalty >= 0 && (long)(m + n + 64) * gap < 32000 &&
+		   (long)(m < n ? m : n) * hi < 32000;
+}
+
+#ifdef NW_LANES
+
+static void *
+nw_alloc(size_t bytes)
+{
+	void *p;
+
+	if (posix_memalign(&p, sizeof(nw_vec), bytes) != 0) {
+		fprintf(stderr, "Error: cannot allocate memory\n");
+		exit(1);
+	}
+	return p;
+}
+
+/*
+   Row p of a (0-based) lives in lane p / seg of segment p % seg, so
+   segments s and s+1 of a lane are consecutive rows and one pass over the
+   segments moves every lane down a column. The vertical gaps leaving the
+   bottom of a lane are fed to the top of the next one afterwards, for as
+   long as they still raise a cell.
+ */
+static int
+nw_striped16(const unsigned char *a, int m, const unsigned char *b, int n, int penalty)
+{
+	int seg = (m + NW_LANES - 1) / NW_LANES;
+	nw_vec *prof = (nw_vec *)nw_alloc((size_t)NW_ALPHABET * seg * sizeof(nw_vec));
+	nw_vec *hprev = (nw_vec *)nw_alloc(seg * sizeof(nw_vec));
+	nw_vec *hcur = (nw_vec *)nw_alloc(seg * sizeof(nw_vec));
+	nw_vec vgap = v_set(penalty), vh, vf, *t;
+	short *lane, lanes[NW_LANES];
+	int r, s, k, j, score;
+
+	for (r = 0; r < NW_ALPHABET; r++)
+		for (s = 0; s < seg; s++) {
+			lane = (short *)&prof[r * seg + s];
+			for (k = 0; k < NW_LANES; k++) {
+				int p = s + k * seg;
+				lane[k] = p < m ? nw_matrix[a[p]][r] : 0;
+			}
+		}
+	for (s = 0; s < seg; s++) {
+		lane = (short *)&hprev[s];
+		for (k = 0; k < NW_LANES; k++)
+			lane[k] = -(s + k * seg + 1) * penalty;
+	}
+
+	for (j = 1; j <= n; j++) {
+		const nw_vec *vp = prof + b[j - 1] * seg;
+
+		/* diagonal of row 0 of each lane: the last row of the lane above */
+		vh = v_insert0(v_shift(hprev[seg - 1]), -(j - 1) * penalty);
+		vf = v_insert0(v_set(NW_NEG16), -(j + 1) * penalty);
+		for (s = 0; s < seg; s++) {
+			nw_vec up = vf;
+
+			vh = v_adds(vh, vp[s]);
+			vh = v_max(vh, v_subs(hprev[s], vgap));
+			vh = v_max(vh, up);
+			hcur[s] = vh;
+			vf = v_subs(vh, vgap);
+			vh = hprev[s];
+		}
+
+		/* lazy F: carry the gaps leaving each lane into the next one */
+		vf = v_insert0(v_shift(vf), NW_NEG16);
+		for (s = 0; v_any_gt(vf, hcur[s]); ) {
+			hcur[s] = v_max(hcur[s], vf);
+			vf = v_subs(hcur[s], vgap);
+			if (++s == seg) {
+				s = 0;
+				vf = v_insert0(v_shift(vf), NW_NEG16);
+			}
+		}
+
+		t = hprev;
+		hprev = hcur;
+		hcur = t;
+	}
+
+	memcpy(lanes, &hprev[(m - 1) % seg], sizeof(nw_vec));
+	score = lanes[(m - 1) / seg];
+	free(prof);
+	free(hprev);
+	free(hcur);
+	return score;
+}
+
+/*
+   NW_LANES pairs at a time, pair k in lane k. The substitution scores
+   differ per lane, so they are gathered cell by cell; rows and columns
+   past the end of a pair only feed cells after its corner, whose score
+   is taken when the column loop reaches its last column.
+ */
+static void
+nw_inter16(const nw_pairs *pairs, const int *order, int count, int penalty, int *score)
+{
+	const unsigned char *ra[NW_LANES], *rb[NW_LANES];
+	int ma[NW_LANES], nb[NW_LANES];
+	int M = 0, N = 0, i, j, k;
+	nw_vec *h, vgap = v_set(penalty), diag, up;
+	short sub[NW_LANES] __attribute__((aligned(32)));
+	short col[NW_LANES][NW_ALPHABET];
+	unsigned char *ai;
+	short lanes[NW_LANES];
+
+	for (k = 0; k < NW_LANES; k++) {
+		const int *ix = pairs->index + 4 * order[k < count ? k : 0];
+
+		ra[k] = pairs->res + ix[0];
+		ma[k] = ix[1];
+		rb[k] = pairs->res + ix[2];
+		nb[k] = ix[3];
+		M = ma[k] > M ? ma[k] : M;
+		N = nb[k] > N ? nb[k] : N;
+	}
+
+	/* the first sequences interleaved by row, padded with residue 0 */
+	ai = (unsigned char *)calloc((size_t)M * NW_LANES, 1);
+	for (k = 0; k < NW_LANES; k++)
+		for (i = 0; i < ma[k]; i++)
+			ai[i * NW_LANES + k] = ra[k][i];
+
+	h = (nw_vec *)nw_alloc((M + 1) * sizeof(nw_vec));
+	for (i = 0; i <= M; i++)
+		h[i] = v_set(-i * penalty);
+
+	for (j = 1; j <= N; j++) {
+		/* column j of the matrix for the residue of each lane */
+		for (k = 0; k < NW_LANES; k++) {
+			int r, bj = j <= nb[k] ? rb[k][j - 1] : 0;
+			for (r = 0; r < NW_ALPHABET; r++)
+				col[k][r] = nw_matrix[r][bj];
+		}
+		diag = h[0];
+		up = h[0] = v_set(-j * penalty);
+		for (i = 1; i <= M; i++) {
+			const unsigned char *row = ai + (i - 1) * NW_LANES;
+			nw_vec cur;
+
+			for (k = 0; k < NW_LANES; k++)
+				sub[k] = col[k][row[k]];
+			cur = v_adds(diag, *(nw_vec *)sub);
+			cur = v_max(cur, v_subs(h[i], vgap));
+			cur = v_max(cur, v_subs(up, vgap));
+			diag = h[i];
+			h[i] = up = cur;
+		}
+		for (k = 0; k < count; k++)
+			if (j == nb[k]) {
+				memcpy(lanes, &h[ma[k]], sizeof(nw_vec));
+				score[order[k]] = lanes[k];
+			}
+	}
+	free(ai);
+	free(h);
+}
+
+#endif
+
+int
+nw_striped_score(const unsigned char *a, int m, const unsigned char *b, int n, int penalty)
+{
+#ifdef NW_LANES
+	if (nw_fits16(m + NW_LANES, n, penalty))
+		return nw_striped16(a, m, b, n, penalty);
+#endif
+	return nw_score_host(a, m, b, n, penalty);
+}
+
+static const int *nw_sort_index;
+
+static int
+nw_by_length(const void *x, const void *y)
+{
+	const int *ix = nw_sort_index;
+	int p = *(const int *)x, q = *(const int *)y;
+	long cp = (long)ix[4 * p + 1] * ix[4 * p + 3], cq = (long)ix[4 * q + 1] * ix[4 * q + 3];
+
+	return cp < cq ? -1 : cp > cq;
+}
+
+/* scores of every pair with the given engine */
+void
+nw_cpu_scores(int engine, const nw_pairs *pairs, int penalty, int *score)
+{
+	int p;
+
+#ifdef NW_LANES
+	if (engine == 2) {
+		/* pairs of similar size share a group, so few cells are wasted */
+		int *order = (int *)malloc(pairs->npairs * sizeof(int));
+
+		for (p = 0; p < pairs->npairs; p++)
+			order[p] = p;
+		nw_sort_index = pairs->index;
+		qsort(order, pairs->npairs, sizeof(int), nw_by_length);
+		for (p = 0; p < pairs->npairs; p += NW_LANES) {
+			int count = pairs->npairs - p < NW_LANES ? pairs->npairs - p : NW_LANES;
+			int k, M = 0, N = 0;
+
+			for (k = 0; k < count; k++) {
+				const int *ix = pairs->index + 4 * order[p + k];
+				M = ix[1] > M ? ix[1] : M;
+				N = ix[3] > N ? ix[3] : N;
+			}
+			if (nw_fits16(M, N, penalty))
+				nw_inter16(pairs, order + p, count, penalty, score);
+			else
+				for (k = 0; k < count; k++) {
+					const int *ix = pairs->index + 4 * order[p + k];
+					score[order[p + k]] = nw_score_host(pairs->res + ix[0], ix[1],
+														pairs->res + ix[2], ix[3], penalty);
+				}
+		}
+		free(order);
+		return;
+	}
+#endif
+	for (p = 0; p < pairs->npairs; p++) {
+		const int *ix = pairs->index + 4 * p;
+
+		score[p] = (engine == 0 ? nw_score_host : nw_striped_score)
+				   (pairs->res + ix[0], ix[1], pairs->res + ix[2], ix[3], penalty);
+	}
+}
+
+/*
+   CPU counterpart of runBatch and of the single pair modes: aligns the
+   pairs with a host engine and reports the same rates, so the device
+   numbers have a baseline. -v checks the scores against the scalar engine.
+ */
+void
+runCPU(const nw_pairs *pairs, int penalty, int engine, int verify)
+{
+	int *score = (int *)malloc(pairs->npairs * sizeof(int));
+	long long cells = 0;
+	double start, elapsed;
+	int p, mismatches = 0;
+
+	for (p = 0; p < pairs->npairs; p++)
+		cells += (long long)pairs->index[4 * p + 1] * pairs->index[4 * p + 3];
+
+	printf("Aligning %d pairs on the host with the %s engine\n", pairs->npairs, nw_engines[engine]);
+	start = gettime();
+	nw_cpu_scores(engine, pairs, penalty, score);
+	elapsed = gettime() - start;
+
+	if (pairs->npairs == 1)
+		printf("Score: %d\n", score[0]);
+	printf("%d alignments, %lld cells in %.3f ms: %.0f alignments/s, %.3f GCUPS\n",
+		   pairs->npairs, cells, elapsed * 1000, pairs->npairs / elapsed, cells / elapsed * 1e-9);
+
+	if (verify) {
+		for (p = 0; p < pairs->npairs; p++) {
+			const int *ix = pairs->index + 4 * p;
+			int host = nw_score_host(pairs->res + ix[0], ix[1], pairs->res + ix[2], ix[3], penalty);
+			if (host != score[p] && mismatches++ < 10)
+				printf("pair %d: %s %d, scalar %d\n", p, nw_engines[engine], score[p], host);
+		}
+		printf("%d of %d scores match the scalar engine\n", pairs->npairs - mismatches, pairs->npairs);
+	}
+	free(score);
+}
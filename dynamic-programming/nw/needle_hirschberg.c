@@ -0,0 +1,358 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "needle.h"
+#include "../../include/rdtsc.h"
+#include "../../include/common_ocl.h"
+
+#define CHECKERR(err) \
+    if (err != CL_SUCCESS) \
+    { \
+        fprintf(stderr, "Error: %d\n", err);\
+        exit(1); \
+    }
+
+/* blocks of at most this many cells, or a single row, are aligned on the host */
+#ifndef NW_HB_BASE
+#define NW_HB_BASE 65536
+#endif
+
+/*
+   Traceback through a full score matrix h (m+1 rows, leading dimension
+   ld), writing the moves from (0,0) to (m,n) and returning their number.
+   Going backwards a gap in a ('I') is taken before a match ('M') and a
+   match before a gap in b ('D'), which gives the leftmost optimal path;
+   the Hirschberg mode finds the same path by splitting at the leftmost
+   optimal column.
+ */
+int
+nw_traceback(const int *h, int ld, const unsigned char *a, int m,
+			 const unsigned char *b, int n, int penalty, char *moves)
+{
+	int i = m, j = n, k = m + n, len;
+
+	while (i > 0 || j > 0) {
+		int here = h[i * ld + j];
+
+		if (j > 0 && h[i * ld + j - 1] - penalty == here) {
+			moves[--k] = 'I';
+			j--;
+		} else if (i > 0 && j > 0 &&
+				   h[(i - 1) * ld + j - 1] + nw_matrix[a[i - 1]][b[j - 1]] == here) {
+			moves[--k] = 'M';
+			i--;
+			j--;
+		} else {
+			moves[--k] = 'D';
+			i--;
+		}
+	}
+	len = m + n - k;
+	memmove(moves, moves + k, len);
+	return len;
+}
+
+/* full matrix alignment on the host, for small blocks and for -v */
+int
+nw_align_host(const unsigned char *a, int m, const unsigned char *b, int n,
+			  int penalty, char *moves)
+{
+	int *h = (int *)malloc((size_t)(m + 1) * (n + 1) * sizeof(int));
+	int i, j, len;
+
+	if (!h) {
+		fprintf(stderr, "error: can not allocate a %d x %d matrix\n", m + 1, n + 1);
+		exit(1);
+	}
+	for (j = 0; j <= n; j++)
+		h[j] = -j * penalty;
+	for (i = 1; i <= m; i++) {
+		int *row = h + (size_t)i * (n + 1), *up = row - (n + 1);
+
+		row[0] = -i * penalty;
+		for (j = 1; j <= n; j++)
+			row[j] = maximum(up[j - 1] + nw_matrix[a[i - 1]][b[j - 1]],
+							 row[j - 1] - penalty, up[j] - penalty);
+	}
+	len = nw_traceback(h, n + 1, a, m, b, n, penalty, moves);
+	free(h);
+	return len;
+}
+
+int
+nw_path_score(const unsigned char *a, const unsigned char *b,
+			  const char *moves, int len, int penalty)
+{
+	int k, i = 0, j = 0, score = 0;
+
+	for (k = 0; k < len; k++) {
+		if (moves[k] == 'M')
+			score += nw_matrix[a[i++]][b[j++]];
+		else {
+			score -= penalty;
+			if (moves[k] == 'D')
+				i++;
+			else
+				j++;
+		}
+	}
+	return score;
+}
+
+/* prints the moves run-length encoded, e.g. 12M1I30M */
+void
+nw_print_alignment(const char *moves, int len)
+{
+	int k, run;
+
+	printf("Alignment: ");
+	for (k = 0; k < len; k += run) {
+		for (run = 1; k + run < len && moves[k + run] == moves[k]; run++)
+			;
+		printf("%d%c", run, moves[k]);
+	}
+	printf("\n");
+}
+
+/* a block of the matrix the path crosses, from (i0,j0) to (i1,j1) */
+typedef struct {
+	int i0, i1, j0, j1;
+	int done;			/* aligned; its moves are moves[off .. off+len) */
+	int off, len;
+} nw_block;
+
+/*
+   Hirschberg mode: every level of the recursion splits each block still
+   too large for the host at its middle row. The last rows of the top half
+   and of the reversed bottom half are computed on the device, all blocks
+   of a level in one launch with a work-group per half, and the block is
+   cut at the leftmost column where the two add up to the best score.
+   Device and host memory are O(m+n).
+ */
+void
+runHirschberg(const unsigned char *a, int m, const unsigned char *b, int n,
+			  int penalty, int group_size, int show, int verify)
+{
+	unsigned char *res;
+	nw_block *blocks, *next;
+	int nblocks = 1, nlevels = 0;
+	int *probs, *last;
+	char *moves, *path;
+	int pool = 0, len, k, score;
+	long max_last = 2L * n + m + 2, max_scratch = 2L * m + 2;
+	double start, elapsed;
+
+	cl_device_id clDevice;
+	cl_context clContext;
+	cl_command_queue clCommands;
+	cl_program clProgram;
+	cl_kernel clKernel;
+	cl_mem res_d, probs_d, sub_d, scratch_d, last_d;
+	cl_int errcode, dev_type;
+	size_t localWorkSize[1], globalWorkSize[1], max_group;
+
+	res = (unsigned char *)malloc(m + n);
+	memcpy(res, a, m);
+	memcpy(res + m, b, n);
+	blocks = (nw_block *)malloc((m + 1) * sizeof(nw_block));
+	next = (nw_block *)malloc((m + 1) * sizeof(nw_block));
+	probs = (int *)malloc(7 * (m + 1) * sizeof(int));
+	last = (int *)malloc(max_last * sizeof(int));
+	moves = (char *)malloc(m + n);
+
+	#ifdef USEGPU
+		dev_type = CL_DEVICE_TYPE_GPU;
+	#elif defined(USE_AFPGA)
+		dev_type = CL_DEVICE_TYPE_ACCELERATOR;
+	#else
+		dev_type = CL_DEVICE_TYPE_CPU;
+	#endif
+
+	clDevice = GetDevice(platform_id, n_device, dev_type);
+	clContext = clCreateContext(NULL, 1, &clDevice, NULL, NULL, &errcode);
+	CHECKERR(errcode);
+	clCommands = clCreateCommandQueue(clContext, clDevice, CL_QUEUE_PROFILING_ENABLE, &errcode);
+	CHECKERR(errcode);
+	clProgram = ocdBuildProgramFromFile(clContext, clDevice, "needle_kernel.cl");
+	clKernel = clCreateKernel(clProgram, "needle_last_row", &errcode);
+	CHECKERR(errcode);
+
+	errcode = clGetDeviceInfo(clDevice, CL_DEVICE_MAX_WORK_GROUP_SIZE, sizeof(size_t), &max_group, NULL);
+	CHECKERR(errcode);
+	if (group_size <= 0)
+		group_size = 64;
+	if ((size_t)group_size > max_group)
+		group_size = (int)max_group;
+
+	res_d = clCreateBuffer(clContext, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, m + n, res, &errcode);
+	CHECKERR(errcode);
+	sub_d = clCreateBuffer(clContext, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, sizeof(nw_matrix), nw_matrix, &errcode);
+	CHECKERR(errcode);
+	probs_d = clCreateBuffer(clContext, CL_MEM_READ_ONLY, 7 * (m + 1) * sizeof(int), NULL, &errcode);
+	CHECKERR(errcode);
+	scratch_d = clCreateBuffer(clContext, CL_MEM_READ_WRITE, max_scratch * sizeof(int), NULL, &errcode);
+	CHECKERR(errcode);
+	last_d = clCreateBuffer(clContext, CL_MEM_WRITE_ONLY, max_last * sizeof(int), NULL, &errcode);
+	CHECKERR(errcode);
+
+	errcode = clSetKernelArg(clKernel, 0, sizeof(cl_mem), (void *) &res_d);
+	errcode |= clSetKernelArg(clKernel, 1, sizeof(cl_mem), (void *) &probs_d);
+	errcode |= clSetKernelArg(clKernel, 2, sizeof(cl_mem), (void *) &sub_d);
+	errcode |= clSetKernelArg(clKernel, 3, sizeof(cl_mem), (void *) &scratch_d);
+	errcode |= clSetKernelArg(clKernel, 4, sizeof(cl_mem), (void *) &last_d);
+	errcode |= clSetKernelArg(clKernel, 5, sizeof(int), (void *) &penalty);
+	errcode |= clSetKernelArg(clKernel, 6, 2 * group_size * sizeof(int), NULL);
+	CHECKERR(errcode);
+	localWorkSize[0] = group_size;
+
+	printf("Start Needleman-Wunsch (Hirschberg)\n");
+	printf("Device memory: %ld bytes, full matrix path: %ld bytes\n",
+		   (long)(m + n + sizeof(nw_matrix)) + (7L * (m + 1) + max_scratch + max_last) * (long)sizeof(int),
+		   3L * (m + 1) * (n + 1) * (long)sizeof(int));
+
+	blocks[0].i0 = 0;
+	blocks[0].i1 = m;
+	blocks[0].j0 = 0;
+	blocks[0].j1 = n;
+	blocks[0].done = 0;
+
+	start = gettime();
+	for (;;) {
+		int nprobs = 0, nnext = 0;
+		long out = 0, scratch = 0;
+
+		/* small blocks are aligned on the host, the rest queued for a split */
+		for (k = 0; k < nblocks; k++) {
+			nw_block *bl = blocks + k;
+			int r = bl->i1 - bl->i0, c = bl->j1 - bl->j0, mid;
+
+			if (bl->done)
+				continue;
+			if (r <= 1 || (long)r * c <= NW_HB_BASE) {
+				bl->off = pool;
+				bl->len = nw_align_host(res + bl->i0, r, res + m + bl->j0, c, penalty, moves + pool);
+				bl->done = 1;
+				pool += bl->len;
+				continue;
+			}
+			mid = (bl->i0 + bl->i1) / 2;
+			probs[7 * nprobs]     = bl->i0;
+			probs[7 * nprobs + 1] = mid - bl->i0;
+			probs[7 * nprobs + 2] = m + bl->j0;
+			probs[7 * nprobs + 3] = c;
+			probs[7 * nprobs + 4] = 0;
+			probs[7 * nprobs + 5] = out;
+			probs[7 * nprobs + 6] = scratch;
+			scratch += mid - bl->i0 + 1;
+			out += c + 1;
+			nprobs++;
+			probs[7 * nprobs]     = mid;
+			probs[7 * nprobs + 1] = bl->i1 - mid;
+			probs[7 * nprobs + 2] = m + bl->j0;
+			probs[7 * nprobs + 3] = c;
+			probs[7 * nprobs + 4] = 1;
+			probs[7 * nprobs + 5] = out;
+			probs[7 * nprobs + 6] = scratch;
+			scratch += bl->i1 - mid + 1;
+			out += c + 1;
+			nprobs++;
+		}
+		if (nprobs == 0)
+			break;
+		nlevels++;
+
+		errcode = clEnqueueWriteBuffer(clCommands, probs_d, CL_TRUE, 0, 7 * nprobs * sizeof(int), (void *) probs, 0, NULL, &ocdTempEvent);
+		clFinish(clCommands);
+		START_TIMER(ocdTempEvent, OCD_TIMER_H2D, "NW Block Copy", ocdTempTimer)
+		END_TIMER(ocdTempTimer)
+		CHECKERR(errcode);
+
+		globalWorkSize[0] = (size_t)nprobs * group_size;
+		errcode = clEnqueueNDRangeKernel(clCommands, clKernel, 1, NULL, globalWorkSize, localWorkSize, 0, NULL, &ocdTempEvent);
+		clFinish(clCommands);
+		START_TIMER(ocdTempEvent, OCD_TIMER_KERNEL, "NW Last Row Kernel", ocdTempTimer)
+		END_TIMER(ocdTempTimer)
+		CHECKERR(errcode);
+
+		errcode = clEnqueueReadBuffer(clCommands, last_d, CL_TRUE, 0, out * sizeof(int), (void *) last, 0, NULL, &ocdTempEvent);
+		clFinish(clCommands);
+		START_TIMER(ocdTempEvent, OCD_TIMER_D2H, "NW Last Row Copy", ocdTempTimer)
+		END_TIMER(ocdTempTimer)
+		CHECKERR(errcode);
+
+		/* children replace their parent in place, so the list stays in path order */
+		nprobs = 0;
+		for (k = 0; k < nblocks; k++) {
+			nw_block *bl = blocks + k;
+			const int *fwd, *rev;
+			int c = bl->j1 - bl->j0, x, best = 0, cut = 0, mid;
+
+			if (bl->done) {
+				next[nnext++] = *bl;
+				continue;
+			}
+			fwd = last + probs[7 * nprobs + 5];
+			rev = last + probs[7 * (nprobs + 1) + 5];
+			nprobs += 2;
+			for (x = 0; x <= c; x++)
+				if (x == 0 || fwd[x] + rev[c - x] > best) {
+					best = fwd[x] + rev[c - x];
+					cut = x;
+				}
+			mid = (bl->i0 + bl->i1) / 2;
+			next[nnext] = *bl;
+			next[nnext].i1 = mid;
+			next[nnext++].j1 = bl->j0 + cut;
+			next[nnext] = *bl;
+			next[nnext].i0 = mid;
+			next[nnext++].j0 = bl->j0 + cut;
+		}
+		{
+			nw_block *t = blocks;
+			blocks = next;
+			next = t;
+		}
+		nblocks = nnext;
+	}
+
+	/* concatenate the moves of the blocks in path order */
+	path = (char *)malloc(m + n);
+	for (k = 0, len = 0; k < nblocks; k++) {
+		memcpy(path + len, moves + blocks[k].off, blocks[k].len);
+		len += blocks[k].len;
+	}
+	elapsed = gettime() - start;
+
+	score = nw_path_score(res, res + m, path, len, penalty);
+	printf("%d levels, %d blocks in %.3f ms\n", nlevels, nblocks, elapsed * 1000);
+	printf("Score: %d\n", score);
+	if (show)
+		nw_print_alignment(path, len);
+
+	if (verify) {
+		int full = nw_align_host(res, m, res + m, n, penalty, moves);
+
+		if (full == len && memcmp(moves, path, len) == 0)
+			printf("Alignment matches the full matrix traceback\n");
+		else
+			printf("Alignment differs from the full matrix traceback (score %d)\n",
+				   nw_path_score(res, res + m, moves, full, penalty));
+	}
+
+	clReleaseMemObject(res_d);
+	clReleaseMemObject(probs_d);
+	clReleaseMemObject(sub_d);
+	clReleaseMemObject(scratch_d);
+	clReleaseMemObject(last_d);
+	clReleaseKernel(clKernel);
+	clReleaseProgram(clProgram);
+	clReleaseCommandQueue(clCommands);
+	clReleaseContext(clContext);
+	free(res);
+	free(blocks);
+	free(next);
+	free(probs);
+	free(last);
+	free(moves);
+	free(path);
+}
@@ -18,10 +18,52 @@ return(k);
 
 }
 
+/*
+   Fills the BLOCK_SIZE x BLOCK_SIZE tile below the top row and right of the
+   left column of temp, one anti-diagonal per step, work-item tx owning
+   column tx + 1 on the way down and row BLOCK_SIZE - tx on the way back.
+   Every work-item of the group must call it.
+ */
+void
+needle_tile( __local int temp[BLOCK_SIZE+1][BLOCK_SIZE+1],
+			 __local int ref[BLOCK_SIZE][BLOCK_SIZE],
+			 int penalty,
+			 int tx)
+{
+  for( int m = 0 ; m < BLOCK_SIZE ; m++){
+   
+	  if ( tx <= m ){
+
+		  int t_index_x =  tx + 1;
+		  int t_index_y =  m - tx + 1;
+
+          temp[t_index_y][t_index_x] = maximum( temp[t_index_y-1][t_index_x-1] + ref[t_index_y-1][t_index_x-1],
+		                                        temp[t_index_y][t_index_x-1]  - penalty, 
+												temp[t_index_y-1][t_index_x]  - penalty);
+	  }
+
+	  barrier(CLK_LOCAL_MEM_FENCE);
+    }
+
+ for( int m = BLOCK_SIZE - 2 ; m >=0 ; m--){
+   
+	  if ( tx <= m){
+
+		  int t_index_x =  tx + BLOCK_SIZE - m ;
+		  int t_index_y =  BLOCK_SIZE - tx;
+
+          temp[t_index_y][t_index_x] = maximum( temp[t_index_y-1][t_index_x-1] + ref[t_index_y-1][t_index_x-1],
+		                                        temp[t_index_y][t_index_x-1]  - penalty, 
+												temp[t_index_y-1][t_index_x]  - penalty);
+	  }
+
+	  barrier(CLK_LOCAL_MEM_FENCE);
+  }
+}
+
 __kernel void
 needle_opencl_shared_1(  __global int* referrence,
 			  __global int* matrix_opencl, 
-			  __global int* matrix_opencl_out, 
 			  int cols,
 			  int penalty,
 			  int i,
@@ -59,40 +101,7 @@ needle_opencl_shared_1(  __global int* referrence,
   barrier(CLK_LOCAL_MEM_FENCE);
   
 
-  for( int m = 0 ; m < BLOCK_SIZE ; m++){
-   
-	  if ( tx <= m ){
-
-		  int t_index_x =  tx + 1;
-		  int t_index_y =  m - tx + 1;
-
-          temp[t_index_y][t_index_x] = maximum( temp[t_index_y-1][t_index_x-1] + ref[t_index_y-1][t_index_x-1],
-		                                        temp[t_index_y][t_index_x-1]  - penalty, 
-												temp[t_index_y-1][t_index_x]  - penalty);
-
-		  
-	  
-	  }
-
-	  barrier(CLK_LOCAL_MEM_FENCE);
-  
-    }
-
- for( int m = BLOCK_SIZE - 2 ; m >=0 ; m--){
-   
-	  if ( tx <= m){
-
-		  int t_index_x =  tx + BLOCK_SIZE - m ;
-		  int t_index_y =  BLOCK_SIZE - tx;
-
-          temp[t_index_y][t_index_x] = maximum( temp[t_index_y-1][t_index_x-1] + ref[t_index_y-1][t_index_x-1],
-		                                        temp[t_index_y][t_index_x-1]  - penalty, 
-												temp[t_index_y-1][t_index_x]  - penalty);
-	   
-	  }
-
-	  barrier(CLK_LOCAL_MEM_FENCE);
-  }
+  needle_tile(temp, ref, penalty, tx);
 
   for ( int ty = 0 ; ty < BLOCK_SIZE ; ty++)
   matrix_opencl[index + ty * cols] = temp[ty+1][tx+1];
@@ -103,8 +112,6 @@ needle_opencl_shared_1(  __global int* referrence,
 __kernel void
 needle_opencl_shared_2(  __global int* referrence,
 			  __global int* matrix_opencl, 
-			  __global int* matrix_opencl_out, 
-			 
 			  int cols,
 			  int penalty,
 			  int i,
@@ -143,44 +150,296 @@ needle_opencl_shared_2(  __global int* referrence,
   barrier(CLK_LOCAL_MEM_FENCE);
   
 
-  for( int m = 0 ; m < BLOCK_SIZE ; m++){
-   
-	  if ( tx <= m ){
+  needle_tile(temp, ref, penalty, tx);
 
-		  int t_index_x =  tx + 1;
-		  int t_index_y =  m - tx + 1;
+  for ( int ty = 0 ; ty < BLOCK_SIZE ; ty++)
+  matrix_opencl[index + ty * cols] = temp[ty+1][tx+1];
 
-          temp[t_index_y][t_index_x] = maximum( temp[t_index_y-1][t_index_x-1] + ref[t_index_y-1][t_index_x-1],
-		                                        temp[t_index_y][t_index_x-1]  - penalty, 
-												temp[t_index_y-1][t_index_x]  - penalty);	  
-	  
+}
+
+/*
+   Banded mode: computes tiles lo .. lo+get_num_groups(0)-1 of block
+   anti-diagonal d, tile x being block (x, d-x). Tiles outside the band are
+   never computed and keep the large negative value the host filled them
+   with. best[bx] receives the largest score on the bottom row and right
+   column of the tile, which the host uses to steer the X-drop band.
+ */
+__kernel void
+needle_opencl_band(  __global int* referrence,
+			  __global int* matrix_opencl, 
+			  int cols,
+			  int penalty,
+			  int d,
+			  int lo,
+			  __global int* best) 
+{
+  int bx = get_group_id(0);
+  int tx = get_local_id(0);
+
+  int b_index_x = lo + bx;
+  int b_index_y = d - b_index_x;
+
+  int index   = cols * BLOCK_SIZE * b_index_y + BLOCK_SIZE * b_index_x + tx + ( cols + 1 );
+  int index_n   = cols * BLOCK_SIZE * b_index_y + BLOCK_SIZE * b_index_x + tx + ( 1 );
+  int index_w   = cols * BLOCK_SIZE * b_index_y + BLOCK_SIZE * b_index_x + ( cols );
+  int index_nw =  cols * BLOCK_SIZE * b_index_y + BLOCK_SIZE * b_index_x;
+
+  __local  int temp[BLOCK_SIZE+1][BLOCK_SIZE+1];
+  __local  int ref[BLOCK_SIZE][BLOCK_SIZE];
+
+  for ( int ty = 0 ; ty < BLOCK_SIZE ; ty++)
+  ref[ty][tx] = referrence[index + cols * ty];
+
+  if (tx == 0)
+	  temp[tx][0] = matrix_opencl[index_nw];
+
+  temp[tx + 1][0] = matrix_opencl[index_w + cols * tx];
+  temp[0][tx + 1] = matrix_opencl[index_n];
+
+  barrier(CLK_LOCAL_MEM_FENCE);
+
+  needle_tile(temp, ref, penalty, tx);
+
+  for ( int ty = 0 ; ty < BLOCK_SIZE ; ty++)
+  matrix_opencl[index + ty * cols] = temp[ty+1][tx+1];
+
+  if (tx == 0){
+	  int b = temp[BLOCK_SIZE][BLOCK_SIZE];
+	  for ( int k = 1 ; k < BLOCK_SIZE ; k++)
+		  b = maximum(b, temp[BLOCK_SIZE][k], temp[k][BLOCK_SIZE]);
+	  best[bx] = b;
+  }
+}
+
+/*
+   Traceback of the filled matrix from (m, n) by a single work-item, with
+   the rule of nw_traceback on the host: a gap in the first sequence ('I')
+   before a match ('M') before a gap in the second ('D'). moves receives
+   the path backwards; result[0] its length and result[1] the score.
+ */
+__kernel void
+needle_traceback(  __global int* referrence,
+			  __global int* matrix_opencl, 
+			  int cols,
+			  int penalty,
+			  int m,
+			  int n,
+			  __global uchar* moves,
+			  __global int* result) 
+{
+  int i = m, j = n, k = 0;
+
+  while ( i > 0 || j > 0 ){
+
+	  int here = matrix_opencl[i * cols + j];
+
+	  if ( j > 0 && matrix_opencl[i * cols + j - 1] - penalty == here ){
+		  moves[k++] = 'I';
+		  j--;
 	  }
+	  else if ( i > 0 && j > 0 &&
+	            matrix_opencl[(i - 1) * cols + j - 1] + referrence[i * cols + j] == here ){
+		  moves[k++] = 'M';
+		  i--;
+		  j--;
+	  }
+	  else {
+		  moves[k++] = 'D';
+		  i--;
+	  }
+  }
 
-	  barrier(CLK_LOCAL_MEM_FENCE);
-  
-    }
+  result[0] = k;
+  result[1] = matrix_opencl[m * cols + n];
+}
 
+/*
+   Batch mode: pair p aligns rows a = res[a_off .. a_off+m) against
+   columns b = res[b_off .. b_off+n), with pairs[4p .. 4p+3] =
+   {a_off, m, b_off, n}. sub is the 24x24 substitution matrix, and
+   scratch has m+1 (group) or n+1 (lane) ints per pair at offset
+   a_off+p or b_off+p. score[p] receives the global alignment score.
+ */
+#define NW_ALPHABET 24
+
+/*
+   One work-group per pair. The columns are processed in strips of one
+   column per work-item; within a strip work-item t computes row s-t+1 at
+   step s, taking its left neighbour from local memory (double-buffered by
+   step) and the column left of the strip from scratch.
+ */
+__kernel void
+needle_batch_group(__global const uchar* res,
+			  __global const int* pairs,
+			  __constant int* sub,
+			  __global int* scratch,
+			  __global int* score,
+			  int penalty,
+			  __local int* h)
+{
+  int p = get_group_id(0);
+  int t = get_local_id(0);
+  int L = get_local_size(0);
 
- for( int m = BLOCK_SIZE - 2 ; m >=0 ; m--){
-   
-	  if ( tx <= m){
+  int a_off = pairs[4*p];
+  int m     = pairs[4*p+1];
+  int b_off = pairs[4*p+2];
+  int n     = pairs[4*p+3];
+  __global int* col = scratch + a_off + p;
 
-		  int t_index_x =  tx + BLOCK_SIZE - m ;
-		  int t_index_y =  BLOCK_SIZE - tx;
+  for ( int i = t ; i <= m ; i += L)
+	  col[i] = -i * penalty;
 
-          temp[t_index_y][t_index_x] = maximum( temp[t_index_y-1][t_index_x-1] + ref[t_index_y-1][t_index_x-1],
-		                                        temp[t_index_y][t_index_x-1]  - penalty, 
-												temp[t_index_y-1][t_index_x]  - penalty);
+  barrier(CLK_GLOBAL_MEM_FENCE);
+
+  for ( int j0 = 0 ; j0 < n ; j0 += L){
+
+	  int j = j0 + t + 1;
+	  int width = min(L, n - j0);
+	  int active = j <= n;
+	  int bj = active ? res[b_off + j - 1] : 0;
+	  int up = -j * penalty;
+	  int diag = -(j - 1) * penalty;
 
+	  for ( int s = 0 ; s < m + width - 1 ; s++){
 
+		  int i = s - t + 1;
+		  int cur = s & 1;
+
+		  if ( active && i >= 1 && i <= m ){
+
+			  int left = t == 0 ? col[i] : h[(1 - cur) * L + t - 1];
+
+			  up = maximum( diag + sub[res[a_off + i - 1] * NW_ALPHABET + bj],
+			                left - penalty,
+			                up - penalty);
+			  h[cur * L + t] = up;
+			  diag = left;
+			  if ( t == width - 1 )
+				  col[i] = up;
+		  }
+
+		  barrier(CLK_LOCAL_MEM_FENCE | CLK_GLOBAL_MEM_FENCE);
 	  }
 
-	  barrier(CLK_LOCAL_MEM_FENCE);
+	  if ( j == n )
+		  score[p] = up;
   }
+}
 
+/*
+   One work-item per pair, keeping one row of the matrix in scratch. On
+   CPU runtimes that vectorise across work-items, each SIMD lane then
+   aligns its own pair.
+ */
+__kernel void
+needle_batch_lane(__global const uchar* res,
+			  __global const int* pairs,
+			  __constant int* sub,
+			  __global int* scratch,
+			  __global int* score,
+			  int penalty,
+			  int npairs)
+{
+  int p = get_global_id(0);
 
-  for ( int ty = 0 ; ty < BLOCK_SIZE ; ty++)
-  matrix_opencl[index + ty * cols] = temp[ty+1][tx+1];
+  if ( p >= npairs )
+	  return;
+
+  int a_off = pairs[4*p];
+  int m     = pairs[4*p+1];
+  int b_off = pairs[4*p+2];
+  int n     = pairs[4*p+3];
+  __global int* row = scratch + b_off + p;
+
+  for ( int j = 0 ; j <= n ; j++)
+	  row[j] = -j * penalty;
+
+  for ( int i = 1 ; i <= m ; i++){
+
+	  __constant int* sub_a = sub + res[a_off + i - 1] * NW_ALPHABET;
+	  int diag = row[0];
+	  int left = -i * penalty;
 
+	  row[0] = left;
+	  for ( int j = 1 ; j <= n ; j++){
+		  int up = row[j];
+		  left = maximum( diag + sub_a[res[b_off + j - 1]], left - penalty, up - penalty);
+		  diag = up;
+		  row[j] = left;
+	  }
+  }
+
+  score[p] = row[n];
 }
 
+/*
+   Score-only pass for the Hirschberg mode: problem p aligns a (m rows)
+   against b (n columns), both read backwards when reverse is set, and
+   writes the last row H(m, 0..n) to last + out_off. probs[7p .. 7p+6] =
+   {a_off, m, b_off, n, reverse, out_off, scratch_off}, scratch holding
+   m+1 ints per problem. The sweep is the one of needle_batch_group.
+ */
+__kernel void
+needle_last_row(__global const uchar* res,
+			  __global const int* probs,
+			  __constant int* sub,
+			  __global int* scratch,
+			  __global int* last,
+			  int penalty,
+			  __local int* h)
+{
+  int p = get_group_id(0);
+  int t = get_local_id(0);
+  int L = get_local_size(0);
+
+  int a_off   = probs[7*p];
+  int m       = probs[7*p+1];
+  int b_off   = probs[7*p+2];
+  int n       = probs[7*p+3];
+  int reverse = probs[7*p+4];
+  __global int* out = last + probs[7*p+5];
+  __global int* col = scratch + probs[7*p+6];
+
+  for ( int i = t ; i <= m ; i += L)
+	  col[i] = -i * penalty;
+  if ( t == 0 )
+	  out[0] = -m * penalty;
+
+  barrier(CLK_GLOBAL_MEM_FENCE);
+
+  for ( int j0 = 0 ; j0 < n ; j0 += L){
+
+	  int j = j0 + t + 1;
+	  int width = min(L, n - j0);
+	  int active = j <= n;
+	  int bj = active ? res[reverse ? b_off + n - j : b_off + j - 1] : 0;
+	  int up = -j * penalty;
+	  int diag = -(j - 1) * penalty;
+
+	  for ( int s = 0 ; s < m + width - 1 ; s++){
+
+		  int i = s - t + 1;
+		  int cur = s & 1;
+
+		  if ( active && i >= 1 && i <= m ){
+
+			  int left = t == 0 ? col[i] : h[(1 - cur) * L + t - 1];
+			  int ai = res[reverse ? a_off + m - i : a_off + i - 1];
+
+			  up = maximum( diag + sub[ai * NW_ALPHABET + bj],
+			                left - penalty,
+			                up - penalty);
+			  h[cur * L + t] = up;
+			  diag = left;
+			  if ( t == width - 1 )
+				  col[i] = up;
+		  }
+
+		  barrier(CLK_LOCAL_MEM_FENCE | CLK_GLOBAL_MEM_FENCE);
+	  }
+
+	  if ( active )
+		  out[j] = up;
+  }
+}
@@ -9,7 +9,8 @@ bin_PROGRAMS += swat
 
 swat_SOURCES = dynamic-programming/swat/alignments.cpp dynamic-programming/swat/prints.cpp \
 				 dynamic-programming/swat/sequences.cpp dynamic-programming/swat/swat.cpp \
-				 dynamic-programming/swat/param.cpp dynamic-programming/swat/timeRec.cpp
+				 dynamic-programming/swat/param.cpp dynamic-programming/swat/timeRec.cpp \
+				 dynamic-programming/swat/swat_cpu.cpp
 
 
 
@@ -72,6 +72,24 @@ int preProcessing(int rowNum,
 	return startPos;
 }
 
+//position of the first cell of every anti-diagonal launchNo, as
+//MatchStringGPUSync advances it from one launch to the next
+void diagonalStarts(int rowNum,
+					int columnNum,
+					int *diffPos,
+					int *diagStart)
+{
+	int launchNum = rowNum + columnNum - 1;
+	int launchNo;
+
+	diagStart[2] = 2 * COALESCED_OFFSET;
+	for (launchNo = 2; launchNo < launchNum - 1; launchNo++)
+	{
+		diagStart[launchNo + 1] = diagStart[launchNo] + diffPos[launchNo + 1] +
+								  (launchNo >= rowNum ? 1 : 0);
+	}
+}
+
 float maxScore(float *scoreArray, int arraySize)
 {
 	float fMaxScore = 0.0f;
@@ -86,3 +104,75 @@ float maxScore(float *scoreArray, int arraySize)
 
 	return fMaxScore;
 }
+
+//keeps the k best scores in a min-heap, hits[0] the weakest of them
+static void siftDown(SW_HIT *hits, int num, int i)
+{
+	SW_HIT tmp;
+	int child;
+
+	while ((child = 2 * i + 1) < num)
+	{
+		if (child + 1 < num && hits[child + 1].score < hits[child].score)
+		{
+			child++;
+		}
+		if (hits[i].score <= hits[child].score)
+		{
+			break;
+		}
+		tmp = hits[i];
+		hits[i] = hits[child];
+		hits[child] = tmp;
+		i = child;
+	}
+}
+
+//the k best scoring sequences, best first; returns how many there are
+int topHits(float *scores, int seqNum, int k, SW_HIT *hits)
+{
+	int i, num = 0;
+	SW_HIT tmp;
+
+	for (i = 0; i < seqNum; i++)
+	{
+		if (num < k)
+		{
+			hits[num].score = scores[i];
+			hits[num].seqNo = i;
+			num++;
+			if (num == k)
+			{
+				for (int j = k / 2 - 1; j >= 0; j--)
+				{
+					siftDown(hits, num, j);
+				}
+			}
+		}
+		else if (scores[i] > hits[0].score)
+		{
+			hits[0].score = scores[i];
+			hits[0].seqNo = i;
+			siftDown(hits, num, 0);
+		}
+	}
+
+	if (num < k)
+	{
+		for (i = num / 2 - 1; i >= 0; i--)
+		{
+			siftDown(hits, num, i);
+		}
+	}
+
+	//heap sort, leaving the best hit first
+	for (i = num - 1; i > 0; i--)
+	{
+		tmp = hits[0];
+		hits[0] = hits[i];
+		hits[i] = tmp;
+		siftDown(hits, i, 0);
+	}
+
+	return num;
+}
@@ -13,12 +13,28 @@ int preProcessing(int rowNum,
 				   int *threadNum,
 				   int *diffPos,
 				   int& matrixIniElem);
+void diagonalStarts(int rowNum,
+					int columnNum,
+					int *diffPos,
+					int *diagStart);
 float maxScore(float *scoreArray, int arraySize);
 
 int readQuerySequence(char*, char*);
 void encoding(char *, int &);
 short char2index(char);
+int readDatabase(char *, char *, SW_DATABASE *);
+int readFastaDatabase(char *, SW_DATABASE *);
+void freeDatabase(SW_DATABASE *);
+int topHits(float *scores, int seqNum, int k, SW_HIT *hits);
 
 void copyScoringMatrixToConstant();
 
+int swEngine(const char *name);
+float swScoreScalar(char *seq1, int len1, char *seq2, int len2,
+					float openPenalty, float extensionPenalty);
+void swScores(int engine, char *query, int querySize, char **dbSeqs, int *dbSizes,
+			  int dbNum, float openPenalty, float extensionPenalty, float *scores);
+int swatCPU(int engine, char *queryFilePathName, SW_DATABASE *db, int topK,
+			float openPenalty, float extensionPenalty);
+
 #endif
@@ -25,6 +25,20 @@ typedef struct {
 	int noutputlen;
 }   MAX_INFO;
 
+//database sequences, encoded and packed back to back
+typedef struct {
+	int seqNum;
+	long totalSize;
+	char *residues;
+	int *offsets, *sizes;
+	char **names;		//FASTA headers, NULL for .data/.loc databases
+} SW_DATABASE;
+
+typedef struct {
+	float score;
+	int seqNo;
+} SW_HIT;
+
 extern FILE *pDBLenFile;
 extern FILE *pDBDataFile;
 extern float blosum62[23][23];
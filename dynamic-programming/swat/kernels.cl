@@ -180,6 +180,241 @@ __kernel void  MatchStringGPUSync(__global char  *pathFlag,
 	}
 }
 
+//Barrier-free alternative to MatchStringGPUSync. The matrix is cut into
+//tiles of local size x local size cells, and one launch computes the tiles
+//(firstTile + group, tileDiag - firstTile - group) of one anti-diagonal of
+//tiles. Launches run in order, so the tiles above and left of a tile are
+//complete when it starts. Inside a tile work-item r computes row r, one
+//column behind row r - 1, with a work-group barrier per step. Cells keep
+//the layout of MatchStringGPUSync, diagStart[launchNo] being its startPos,
+//so trace_back2 works unchanged. maxInfo has an entry per row.
+__kernel void MatchStringTile(__global char  *pathFlag,
+							  __global char  *extFlag,
+							  __global float *nGapDist,
+							  __global float *hGapDist,
+							  __global float *vGapDist,
+							  __global int   *diffPos,
+							  __global int   *diagStart,
+							  int            rowNum,
+							  int            columnNum,
+							  __global char  *seq1,
+							  __global char  *seq2,
+							  int            blosumWidth,
+							  float          openPenalty,
+							  float          extensionPenalty,
+							  __global MAX_INFO *maxInfo,
+							  __global float *blosum62D,
+							  int            tileDiag,
+							  int            firstTile)
+{
+	int npos, ntablepos, step, launchNo;
+	int npreposngap, npreposhgap, npreposvgap;
+	int tileSize = get_local_size(0);
+	int nLocalID = get_local_id(0);
+	int tilei = firstTile + get_group_id(0);
+	int indexi = tilei * tileSize + nLocalID;
+	int indexj;
+
+	float fdist;
+	float fdistngap, fdisthgap, fdistvgap;
+	float ext_dist;
+	float fmaxdist;
+
+	for (step = 0; step < 2 * tileSize - 1; step++)
+	{
+		indexj = (tileDiag - tilei) * tileSize + step - nLocalID;
+		if (step >= nLocalID && step - nLocalID < tileSize &&
+			indexi < rowNum - 1 && indexj < columnNum - 1)
+		{
+			launchNo = indexi + indexj + 2;
+			npos = diagStart[launchNo] + min(launchNo - 2, rowNum - 2) - indexi;
+
+			npreposhgap = npos - diffPos[launchNo];
+			npreposvgap = npreposhgap - 1;
+			npreposngap = npreposvgap - diffPos[launchNo - 1];
+
+			ntablepos = seq1[indexi] * blosumWidth + seq2[indexj];
+			fdist = blosum62D[ntablepos];
+
+			fmaxdist = nGapDist[npreposngap];
+			fdistngap = fmaxdist + fdist;
+
+			ext_dist  = hGapDist[npreposhgap] - extensionPenalty;
+			fdisthgap = nGapDist[npreposhgap] - openPenalty;
+
+			if (fdisthgap <= ext_dist)
+			{
+				fdisthgap = ext_dist;
+				extFlag[npreposhgap] = 1;
+			}
+
+			ext_dist  = vGapDist[npreposvgap] - extensionPenalty;
+			fdistvgap = nGapDist[npreposvgap] - openPenalty;
+
+			if (fdistvgap <= ext_dist)
+			{
+				fdistvgap = ext_dist;
+				pathFlag[npreposvgap] += 8;
+			}
+
+			fdistngap = (fdistngap < 0.0f) ? 0.0f : fdistngap;
+			fdisthgap = (fdisthgap < 0.0f) ? 0.0f : fdisthgap;
+			fdistvgap = (fdistvgap < 0.0f) ? 0.0f : fdistvgap;
+
+			hGapDist[npos] = fdisthgap;
+			vGapDist[npos] = fdistvgap;
+
+			//priority 00, 01, 10
+			if (fdistngap >= fdisthgap && fdistngap >= fdistvgap)
+			{
+				fmaxdist = fdistngap;
+				pathFlag[npos] = 2;
+			}
+			else if (fdisthgap >= fdistngap && fdisthgap >= fdistvgap)
+			{
+				fmaxdist = fdisthgap;
+				pathFlag[npos] = 1;
+			}
+			else //fdistvgap >= fdistngap && fdistvgap >= fdisthgap
+			{
+				fmaxdist = fdistvgap;
+				pathFlag[npos] = 3;
+			}
+
+			nGapDist[npos] = fmaxdist;
+
+			if (fmaxdist <= 0.00000001f)
+			{
+				pathFlag[npos] = PATH_END;
+			}
+
+			if (maxInfo[indexi].fmaxscore < fmaxdist)
+			{
+				maxInfo[indexi].nposi = indexi + 1;
+				maxInfo[indexi].nposj = indexj + 1;
+				maxInfo[indexi].nmaxpos = npos;
+				maxInfo[indexi].fmaxscore = fmaxdist;
+			}
+		}
+
+		barrier(CLK_GLOBAL_MEM_FENCE);
+	}
+}
+
+//Score-only version of MatchStringGPUSync for -s: nothing is traced back,
+//so instead of the DP matrices it keeps rolling anti-diagonals indexed by
+//row, three of nGapDist and two of hGapDist and vGapDist, in diagDist
+//(7 * rowNum floats). The buffers are cleared here and every work-item
+//writes its maximum to maxInfo[threadid] at the end, so no setZero launch
+//is needed besides the mutex. With a single work-group the lock-based
+//barrier never waits on another group.
+__kernel void MatchStringScore(__global float *diagDist,
+							   __global int   *threadNum,
+							   int            rowNum,
+							   int            columnNum,
+							   __global char  *seq1,
+							   __global char  *seq2,
+							   int            blosumWidth,
+							   float          openPenalty,
+							   float          extensionPenalty,
+							   __global MAX_INFO *maxInfo,
+							   __global float *blosum62D,
+							   volatile __global int *mutexMem)
+{
+	int ntablepos, tid;
+	int nLocalID = get_local_id(0);
+	int blockNum = get_num_groups(0);
+	int blockSize = get_local_size(0);
+	int totalThreadNum = blockSize * blockNum;
+	int threadid = get_global_id(0);
+
+	int launchNo;
+	int launchNum = rowNum + columnNum - 1;
+	int indexi1 = -1;
+	int indexj1 = 0;
+	int indexi, indexj;
+
+	__global float *nGapCur, *nGapPrev, *nGapPrev2;
+	__global float *hGapCur, *hGapPrev, *vGapCur, *vGapPrev;
+
+	float fdist;
+	float fdistngap, fdisthgap, fdistvgap;
+	float ext_dist;
+	float fmaxdist;
+	MAX_INFO localMax = {0, 0, -1, 0.0f, 0};
+
+	for (tid = threadid; tid < 7 * rowNum; tid += totalThreadNum)
+	{
+		diagDist[tid] = 0.0f;
+	}
+	__barrier_opencl_lock_based(nLocalID, blockNum, mutexMem);
+
+	for (launchNo = 2; launchNo < launchNum; launchNo++)
+	{
+		if (launchNo <= rowNum)
+		{
+			indexi1++;
+		}
+		else
+		{
+			indexj1++;
+		}
+
+		nGapCur   = diagDist + (launchNo % 3) * rowNum;
+		nGapPrev  = diagDist + ((launchNo - 1) % 3) * rowNum;
+		nGapPrev2 = diagDist + ((launchNo - 2) % 3) * rowNum;
+		hGapCur   = diagDist + (3 + launchNo % 2) * rowNum;
+		hGapPrev  = diagDist + (3 + (launchNo - 1) % 2) * rowNum;
+		vGapCur   = diagDist + (5 + launchNo % 2) * rowNum;
+		vGapPrev  = diagDist + (5 + (launchNo - 1) % 2) * rowNum;
+
+		for (tid = threadid; tid < threadNum[launchNo]; tid += totalThreadNum)
+		{
+			indexi = indexi1 - tid;
+			indexj = indexj1 + tid;
+
+			ntablepos = seq1[indexi] * blosumWidth + seq2[indexj];
+			fdist = blosum62D[ntablepos];
+
+			//cell (indexi + 1, indexj + 1): the diagonal neighbour is row
+			//indexi two launches back, the upper (hGap) one row indexi and
+			//the left (vGap) one row indexi + 1 of the previous launch
+			fdistngap = nGapPrev2[indexi] + fdist;
+
+			ext_dist  = hGapPrev[indexi] - extensionPenalty;
+			fdisthgap = nGapPrev[indexi] - openPenalty;
+			fdisthgap = (fdisthgap <= ext_dist) ? ext_dist : fdisthgap;
+
+			ext_dist  = vGapPrev[indexi + 1] - extensionPenalty;
+			fdistvgap = nGapPrev[indexi + 1] - openPenalty;
+			fdistvgap = (fdistvgap <= ext_dist) ? ext_dist : fdistvgap;
+
+			fdistngap = (fdistngap < 0.0f) ? 0.0f : fdistngap;
+			fdisthgap = (fdisthgap < 0.0f) ? 0.0f : fdisthgap;
+			fdistvgap = (fdistvgap < 0.0f) ? 0.0f : fdistvgap;
+
+			hGapCur[indexi + 1] = fdisthgap;
+			vGapCur[indexi + 1] = fdistvgap;
+
+			fmaxdist = fdistngap;
+			fmaxdist = (fdisthgap > fmaxdist) ? fdisthgap : fmaxdist;
+			fmaxdist = (fdistvgap > fmaxdist) ? fdistvgap : fmaxdist;
+			nGapCur[indexi + 1] = fmaxdist;
+
+			if (localMax.fmaxscore < fmaxdist)
+			{
+				localMax.nposi = indexi + 1;
+				localMax.nposj = indexj + 1;
+				localMax.fmaxscore = fmaxdist;
+			}
+		}
+
+		__barrier_opencl_lock_based(nLocalID, launchNo * blockNum, mutexMem);
+	}
+
+	maxInfo[threadid] = localMax;
+}
+
 __kernel void trace_back2(__global char *str_npathflagp,
 						  __global char *str_nExtFlagp,
 						  __global int  *ndiffpos,
@@ -321,3 +556,68 @@ __kernel void setZero(__global char *a,
     }
 }
 
+
+//Score only database search: work-item k aligns the query with sorted
+//sequence first + k, keeping one row of H and E along the query. The rows
+//of all work-items are interleaved in scratch, so that neighbouring
+//work-items access neighbouring words.
+__kernel void swat_search(__global char  *query,
+						  int            querySize,
+						  __global char  *residues,
+						  __global int   *offsets,
+						  __global int   *sizes,
+						  int            first,
+						  int            seqNum,
+						  int            blosumWidth,
+						  float          openPenalty,
+						  float          extensionPenalty,
+						  __global float *blosum62D,
+						  __global float *scratch,
+						  __global float *scores)
+{
+	int k = get_global_id(0);
+	int stride = get_global_size(0);
+	int seqNo = first + k;
+	int i, j;
+	__global float *h = scratch + k;
+	__global float *e = scratch + querySize * stride + k;
+	__global char *subject;
+	float fmaxscore = 0.0f;
+
+	if (seqNo >= seqNum)
+	{
+		return;
+	}
+
+	for (i = 0; i < querySize; i++)
+	{
+		h[i * stride] = 0.0f;
+		e[i * stride] = 0.0f;
+	}
+
+	subject = residues + offsets[seqNo];
+	for (j = 0; j < sizes[seqNo]; j++)
+	{
+		__global float *row = blosum62D + subject[j] * blosumWidth;
+		float fdiag = 0.0f, fvgap = 0.0f, fup = 0.0f;
+
+		for (i = 0; i < querySize; i++)
+		{
+			float fleft = h[i * stride];
+			float fhgap = fmax(e[i * stride] - extensionPenalty, fleft - openPenalty);
+			float fdist;
+
+			fvgap = fmax(fvgap - extensionPenalty, fup - openPenalty);
+			fdist = fmax(fdiag + row[query[i]], 0.0f);
+			fdist = fmax(fdist, fmax(fhgap, fvgap));
+
+			e[i * stride] = fhgap;
+			h[i * stride] = fdist;
+			fdiag = fleft;
+			fup = fdist;
+			fmaxscore = fmax(fmaxscore, fdist);
+		}
+	}
+
+	scores[seqNo] = fmaxscore;
+}
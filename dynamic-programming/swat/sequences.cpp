@@ -1,5 +1,6 @@
 #include <stdlib.h>
 #include <string.h>
+#include <limits.h>
 #include "global.h"
 #include "functions.h"
 
@@ -47,6 +48,150 @@ int readQuerySequence(char *queryFileName, char *querySequence)
 	return nSeqLen;
 }
 
+//the .data/.loc pair: a count and the sizes in .loc, the encoded
+//residues back to back in .data
+int readDatabase(char *dbDataFileName, char *dbLenFileName, SW_DATABASE *db)
+{
+	int i;
+
+	pDBDataFile = fopen(dbDataFileName, "rb");
+	if (pDBDataFile == NULL)
+	{
+		printf("DB data file %s open error!\n", dbDataFileName);
+		return -1;
+	}
+	pDBLenFile = fopen(dbLenFileName, "rb");
+	if (pDBLenFile == NULL)
+	{
+		printf("DB length file %s open error!\n", dbLenFileName);
+		return -1;
+	}
+
+	fread(&db->seqNum, sizeof(int), 1, pDBLenFile);
+	db->sizes = (int *)malloc(db->seqNum * sizeof(int));
+	db->offsets = (int *)malloc(db->seqNum * sizeof(int));
+	db->names = NULL;
+	db->totalSize = 0;
+	for (i = 0; i < db->seqNum; i++)
+	{
+		fread(&db->sizes[i], sizeof(int), 1, pDBLenFile);
+		if (db->sizes[i] <= 0)
+		{
+			printf("Size %d of subject sequence %d is out of range!\n", db->sizes[i], i);
+			return -1;
+		}
+		//offsets are int on the device
+		if (db->totalSize + db->sizes[i] > INT_MAX)
+		{
+			printf("DB data file %s holds more than %d residues!\n", dbDataFileName, INT_MAX);
+			return -1;
+		}
+		db->offsets[i] = db->totalSize;
+		db->totalSize += db->sizes[i];
+	}
+	db->residues = (char *)malloc(db->totalSize);
+	fread(db->residues, sizeof(char), db->totalSize, pDBDataFile);
+
+	fclose(pDBLenFile);
+	fclose(pDBDataFile);
+	return db->seqNum;
+}
+
+//a FASTA file; lines before the first header form a sequence of their own
+int readFastaDatabase(char *fileName, SW_DATABASE *db)
+{
+	FILE *pFile;
+	char *line;
+	int capacity = 1024, lineSize;
+	long residueCapacity = 1 << 20;
+
+	pFile = fopen(fileName, "rt");
+	if (pFile == NULL)
+	{
+		printf("FASTA file %s open error!\n", fileName);
+		return -1;
+	}
+
+	line = new char[10000];
+	db->seqNum = 0;
+	db->totalSize = 0;
+	db->residues = (char *)malloc(residueCapacity);
+	db->offsets = (int *)malloc(capacity * sizeof(int));
+	db->sizes = (int *)malloc(capacity * sizeof(int));
+	db->names = (char **)malloc(capacity * sizeof(char *));
+
+	while (fgets(line, 10000, pFile) != NULL)
+	{
+		lineSize = strlen(line);
+		if (*line == '>' || db->seqNum == 0)
+		{
+			if (db->seqNum == capacity)
+			{
+				capacity *= 2;
+				db->offsets = (int *)realloc(db->offsets, capacity * sizeof(int));
+				db->sizes = (int *)realloc(db->sizes, capacity * sizeof(int));
+				db->names = (char **)realloc(db->names, capacity * sizeof(char *));
+			}
+			db->offsets[db->seqNum] = db->totalSize;
+			db->sizes[db->seqNum] = 0;
+			db->names[db->seqNum] = NULL;
+			if (*line == '>')
+			{
+				line[strcspn(line, "\r\n")] = '\0';
+				db->names[db->seqNum] = strdup(line + 1);
+				db->seqNum++;
+				continue;
+			}
+			db->seqNum++;
+		}
+
+		if (db->totalSize + lineSize > INT_MAX)
+		{
+			printf("FASTA file %s holds more than %d residues!\n", fileName, INT_MAX);
+			fclose(pFile);
+			delete[] line;
+			return -1;
+		}
+		if (db->totalSize + lineSize > residueCapacity)
+		{
+			residueCapacity = 2 * (db->totalSize + lineSize);
+			db->residues = (char *)realloc(db->residues, residueCapacity);
+		}
+		memcpy(db->residues + db->totalSize, line, lineSize);
+		encoding(db->residues + db->totalSize, lineSize);
+		db->totalSize += lineSize;
+		db->sizes[db->seqNum - 1] += lineSize;
+	}
+
+	fclose(pFile);
+	delete[] line;
+
+	for (int i = 0; i < db->seqNum; i++)
+	{
+		if (db->sizes[i] == 0)
+		{
+			printf("FASTA file %s: sequence %d is empty\n", fileName, i);
+			return -1;
+		}
+	}
+	return db->seqNum;
+}
+
+void freeDatabase(SW_DATABASE *db)
+{
+	if (db->names != NULL)
+	{
+		for (int i = 0; i < db->seqNum; i++)
+		{
+			free(db->names[i]);
+		}
+		free(db->names);
+	}
+	free(db->residues);
+	free(db->offsets);
+	free(db->sizes);
+}
+
 void encoding(char *seq, int& nsize)
 {
 	int i;
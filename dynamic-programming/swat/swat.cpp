@@ -1,6 +1,7 @@
 #include "global.h"
 #include "functions.h"
 #include "timeRec.h"
+#include <unistd.h>
 #ifdef __APPLE__
 #include <OpenCL/opencl.h>
 #else
@@ -66,15 +67,330 @@ char * loadSource(char *filePathName, size_t *fileSize)
 	return fileBuffer;
 }
 
+static int *sortSizes;
+
+static int longerFirst(const void *a, const void *b)
+{
+	return sortSizes[*(const int *)b] - sortSizes[*(const int *)a];
+}
+
+//Scores the query against every sequence of db with swat_search, for as
+//many sequences per launch as the scratch rows fit in one allocation.
+//Sequences are sorted by size so the work-items of a group finish
+//together. Returns the time of the scan in ms, excluding the allocation
+//and upload of the database.
+double searchDatabase(cl_device_id deviceID, cl_context hContext,
+					  cl_command_queue hCmdQueue, cl_program hProgram,
+					  cl_mem blosum62D, char *querySequence, int querySize,
+					  SW_DATABASE *db, float openPenalty, float extensionPenalty,
+					  float *scores)
+{
+	cl_int err;
+	cl_kernel hSearchKernel;
+	cl_mem queryD, residuesD, offsetsD, sizesD, scratchD, scoresD;
+	cl_ulong maxAlloc;
+	size_t localSize = 64, globalSize;
+	int nblosumWidth = 23, *order, *offsets, *sizes, first, i;
+	float *sortedScores;
+	struct timeval t1, t2;
+
+	hSearchKernel = clCreateKernel(hProgram, "swat_search", &err);
+	CHECK_ERR(err, "Create swat_search kernel error");
+
+	order = new int[db->seqNum];
+	offsets = new int[db->seqNum];
+	sizes = new int[db->seqNum];
+	for (i = 0; i < db->seqNum; i++)
+	{
+		order[i] = i;
+	}
+	sortSizes = db->sizes;
+	qsort(order, db->seqNum, sizeof(int), longerFirst);
+	for (i = 0; i < db->seqNum; i++)
+	{
+		offsets[i] = db->offsets[order[i]];
+		sizes[i] = db->sizes[order[i]];
+	}
+
+	//H and E rows of querySize floats per work-item
+	CHECK_ERR(clGetDeviceInfo(deviceID, CL_DEVICE_MAX_MEM_ALLOC_SIZE,
+		sizeof(cl_ulong), &maxAlloc, 0),
+		"Error while querying CL_DEVICE_MAX_MEM_ALLOC_SIZE.");
+	size_t batchSize = maxAlloc / (2 * querySize * sizeof(cl_float)) / localSize * localSize;
+	size_t seqNumUp = (db->seqNum + localSize - 1) / localSize * localSize;
+	batchSize = batchSize < localSize ? localSize : batchSize > seqNumUp ? seqNumUp : batchSize;
+
+	queryD = clCreateBuffer(hContext, CL_MEM_READ_ONLY, sizeof(cl_char) * querySize, 0, &err);
+	CHECK_ERR(err, "Create queryD memory");
+	residuesD = clCreateBuffer(hContext, CL_MEM_READ_ONLY, sizeof(cl_char) * db->totalSize, 0, &err);
+	CHECK_ERR(err, "Create residuesD memory");
+	offsetsD = clCreateBuffer(hContext, CL_MEM_READ_ONLY, sizeof(cl_int) * db->seqNum, 0, &err);
+	CHECK_ERR(err, "Create offsetsD memory");
+	sizesD = clCreateBuffer(hContext, CL_MEM_READ_ONLY, sizeof(cl_int) * db->seqNum, 0, &err);
+	CHECK_ERR(err, "Create sizesD memory");
+	scoresD = clCreateBuffer(hContext, CL_MEM_WRITE_ONLY, sizeof(cl_float) * db->seqNum, 0, &err);
+	CHECK_ERR(err, "Create scoresD memory");
+	scratchD = clCreateBuffer(hContext, CL_MEM_READ_WRITE,
+							  2 * sizeof(cl_float) * querySize * batchSize, 0, &err);
+	CHECK_ERR(err, "Create scratchD memory");
+
+	err  = clEnqueueWriteBuffer(hCmdQueue, queryD, CL_FALSE, 0, sizeof(cl_char) * querySize,
+								querySequence, 0, NULL, &ocdTempEvent);
+	clFinish(hCmdQueue);
+	START_TIMER(ocdTempEvent, OCD_TIMER_H2D, "SWAT Database Copy", ocdTempTimer)
+	END_TIMER(ocdTempTimer)
+	err |= clEnqueueWriteBuffer(hCmdQueue, residuesD, CL_FALSE, 0, sizeof(cl_char) * db->totalSize,
+								db->residues, 0, NULL, &ocdTempEvent);
+	clFinish(hCmdQueue);
+	START_TIMER(ocdTempEvent, OCD_TIMER_H2D, "SWAT Database Copy", ocdTempTimer)
+	END_TIMER(ocdTempTimer)
+	err |= clEnqueueWriteBuffer(hCmdQueue, offsetsD, CL_FALSE, 0, sizeof(cl_int) * db->seqNum,
+								offsets, 0, NULL, &ocdTempEvent);
+	clFinish(hCmdQueue);
+	START_TIMER(ocdTempEvent, OCD_TIMER_H2D, "SWAT Database Copy", ocdTempTimer)
+	END_TIMER(ocdTempTimer)
+	err |= clEnqueueWriteBuffer(hCmdQueue, sizesD, CL_FALSE, 0, sizeof(cl_int) * db->seqNum,
+								sizes, 0, NULL, &ocdTempEvent);
+	clFinish(hCmdQueue);
+	START_TIMER(ocdTempEvent, OCD_TIMER_H2D, "SWAT Database Copy", ocdTempTimer)
+	END_TIMER(ocdTempTimer)
+	CHECK_ERR(err, "copy database");
+
+	//the scan rate covers the launches and the score readback only
+	gettimeofday(&t1, NULL);
+
+	err  = clSetKernelArg(hSearchKernel, 0, sizeof(cl_mem), (void *)&queryD);
+	err |= clSetKernelArg(hSearchKernel, 1, sizeof(cl_int), (void *)&querySize);
+	err |= clSetKernelArg(hSearchKernel, 2, sizeof(cl_mem), (void *)&residuesD);
+	err |= clSetKernelArg(hSearchKernel, 3, sizeof(cl_mem), (void *)&offsetsD);
+	err |= clSetKernelArg(hSearchKernel, 4, sizeof(cl_mem), (void *)&sizesD);
+	err |= clSetKernelArg(hSearchKernel, 6, sizeof(cl_int), (void *)&db->seqNum);
+	err |= clSetKernelArg(hSearchKernel, 7, sizeof(cl_int), (void *)&nblosumWidth);
+	err |= clSetKernelArg(hSearchKernel, 8, sizeof(cl_float), (void *)&openPenalty);
+	err |= clSetKernelArg(hSearchKernel, 9, sizeof(cl_float), (void *)&extensionPenalty);
+	err |= clSetKernelArg(hSearchKernel, 10, sizeof(cl_mem), (void *)&blosum62D);
+	err |= clSetKernelArg(hSearchKernel, 11, sizeof(cl_mem), (void *)&scratchD);
+	err |= clSetKernelArg(hSearchKernel, 12, sizeof(cl_mem), (void *)&scoresD);
+	CHECK_ERR(err, "Set swat_search argument error!");
+
+	for (first = 0; first < db->seqNum; first += batchSize)
+	{
+		globalSize = db->seqNum - first < (int)batchSize ?
+					 (db->seqNum - first + localSize - 1) / localSize * localSize : batchSize;
+		err = clSetKernelArg(hSearchKernel, 5, sizeof(cl_int), (void *)&first);
+		err |= clEnqueueNDRangeKernel(hCmdQueue, hSearchKernel, 1, NULL, &globalSize,
+									  &localSize, 0, NULL, &ocdTempEvent);
+		clFinish(hCmdQueue);
+		START_TIMER(ocdTempEvent, OCD_TIMER_KERNEL, "SWAT Search Kernel", ocdTempTimer)
+		END_TIMER(ocdTempTimer)
+		CHECK_ERR(err, "Launch kernel swat_search error");
+	}
+
+	sortedScores = new float[db->seqNum];
+	err = clEnqueueReadBuffer(hCmdQueue, scoresD, CL_TRUE, 0, sizeof(cl_float) * db->seqNum,
+							  sortedScores, 0, 0, &ocdTempEvent);
+	clFinish(hCmdQueue);
+	START_TIMER(ocdTempEvent, OCD_TIMER_D2H, "SWAT Score Copy", ocdTempTimer)
+	END_TIMER(ocdTempTimer)
+	CHECK_ERR(err, "Read scores buffer error!");
+	gettimeofday(&t2, NULL);
+
+	for (i = 0; i < db->seqNum; i++)
+	{
+		scores[order[i]] = sortedScores[i];
+	}
+
+	clReleaseKernel(hSearchKernel);
+	clReleaseMemObject(queryD);
+	clReleaseMemObject(residuesD);
+	clReleaseMemObject(offsetsD);
+	clReleaseMemObject(sizesD);
+	clReleaseMemObject(scoresD);
+	clReleaseMemObject(scratchD);
+	delete[] sortedScores;
+	delete[] order;
+	delete[] offsets;
+	delete[] sizes;
+
+	return 1000.0 * (t2.tv_sec - t1.tv_sec) + (t2.tv_usec - t1.tv_usec) / 1000.0;
+}
+
+//pairs in flight: while the device aligns one pair, the host reads and
+//preprocesses the next one and uploads it on a second queue
+#define SLOT_NUM 2
+//uploads, setZero, tile launches, traceback and readback of one pair
+#define SLOT_EVENT_NUM (2 * MAX_LEN + 32)
+
+//kind of an event, mapped to the OCD timer types when it is timed
+enum { SW_H2D, SW_KERNEL, SW_D2H };
+
+typedef struct {
+	cl_event event;
+	int kind;
+	const char *name;
+	double *phase;		//strTime field the device time is added to
+} SW_EVENT;
+
+//One pair of the pipeline, with the host and device buffers that cannot
+//be reused before its commands have completed
+typedef struct {
+	char *subSequence, *outSeq1, *outSeq2;
+	int *threadNum, *diffPos, *diagStart;
+	MAX_INFO *maxInfo;
+	cl_mem seq1D, seq2D, threadNumD, diffPosD, diagStartD;
+	int subSequenceNo, subSequenceSize;
+	SW_HIT *hit;
+	const char *hitName;
+	SW_EVENT *events;
+	int eventNum;
+	int busy;
+} SW_SLOT;
+
+static cl_event *slotEvent(SW_SLOT *slot, int kind, const char *name, double *phase)
+{
+	SW_EVENT *e = &slot->events[slot->eventNum++];
+	e->kind = kind;
+	e->name = name;
+	e->phase = phase;
+	return &e->event;
+}
+
+static cl_int enqueueSetZero(cl_command_queue hCmdQueue, cl_kernel hSetZeroKernel,
+							 cl_mem mem, int arraySize, size_t blockSize,
+							 SW_SLOT *slot, const char *name)
+{
+	size_t setZeroThreadNum = ((arraySize - 1) / blockSize + 1) * blockSize;
+	cl_int err;
+	err  = clSetKernelArg(hSetZeroKernel, 0, sizeof(cl_mem), (void *)&mem);
+	err |= clSetKernelArg(hSetZeroKernel, 1, sizeof(int), (void *)&arraySize);
+	err |= clEnqueueNDRangeKernel(hCmdQueue, hSetZeroKernel, 1, NULL, &setZeroThreadNum,
+								  &blockSize, 0, NULL,
+								  slotEvent(slot, SW_KERNEL, name, &strTime.copyTimeHostToDevice));
+	return err;
+}
+
+//Waits for the pair held by slot, adds the device time of its commands
+//to strTime and prints its result. scoreNum is the number of maxima left
+//by the score-only kernel, 0 for a full alignment.
+static void retireSlot(SW_SLOT *slot, int querySize, float openPenalty,
+					   float extensionPenalty, size_t scoreNum)
+{
+	int i;
+
+	if (!slot->busy)
+	{
+		return;
+	}
+	clWaitForEvents(1, &slot->events[slot->eventNum - 1].event);
+	for (i = 0; i < slot->eventNum; i++)
+	{
+		SW_EVENT *e = &slot->events[i];
+		cl_ulong start = 0, end = 0;
+		clGetEventProfilingInfo(e->event, CL_PROFILING_COMMAND_START, sizeof(cl_ulong), &start, NULL);
+		clGetEventProfilingInfo(e->event, CL_PROFILING_COMMAND_END, sizeof(cl_ulong), &end, NULL);
+		*e->phase += (end - start) * 1e-6;
+		switch (e->kind)
+		{
+		case SW_H2D:
+			START_TIMER(e->event, OCD_TIMER_H2D, e->name, ocdTempTimer)
+			END_TIMER(ocdTempTimer)
+			break;
+		case SW_KERNEL:
+			START_TIMER(e->event, OCD_TIMER_KERNEL, e->name, ocdTempTimer)
+			END_TIMER(ocdTempTimer)
+			break;
+		default:
+			START_TIMER(e->event, OCD_TIMER_D2H, e->name, ocdTempTimer)
+			END_TIMER(ocdTempTimer)
+			break;
+		}
+		clReleaseEvent(e->event);
+	}
+	slot->eventNum = 0;
+	slot->busy = 0;
+
+	if (slot->hit)
+	{
+		printf("Hit %d: sequence %d %s, score %.1f\n", slot->subSequenceNo, slot->hit->seqNo,
+				slot->hitName ? slot->hitName : "", slot->hit->score);
+	}
+	printf("============================================================\n");
+	printf("Sequence pair %d:\n", slot->subSequenceNo);
+	MAX_INFO *maxInfo = slot->maxInfo;
+	if (scoreNum)
+	{
+		//reduce the per-work-item maxima as trace_back2 does
+		for (size_t k = 1; k < scoreNum; k++)
+		{
+			if (maxInfo->fmaxscore < slot->maxInfo[k].fmaxscore)
+			{
+				maxInfo = &slot->maxInfo[k];
+			}
+		}
+	}
+	else
+	{
+		int nlength = maxInfo->noutputlen;
+		PrintAlignment(slot->outSeq1, slot->outSeq2, nlength, CHAR_PER_LINE, openPenalty, extensionPenalty);
+	}
+	printf("Max alignment score (on device) is %.1f\n", maxInfo->fmaxscore);
+	printf("openPenalty = %.1f, extensionPenalty = %.1f\n", openPenalty, extensionPenalty);
+	printf("Input sequence size, querySize: %d, subSequenceSize: %d\n", 
+			querySize, slot->subSequenceSize);
+	printf("Max position, seq1 = %d, seq2 = %d\n", maxInfo->nposi, maxInfo->nposj);
+}
+
 int main(int argc, char ** argv)
 {
 	ocd_init(&argc, &argv, NULL);
-	if (argc < 3)
+
+	//-e engine searches on the host instead of the device, -d searches a
+	//FASTA database for the topK best hits and only aligns those, -t fills
+	//the matrix in tiles (0 keeps the lock-based global barrier kernel), -s
+	//only computes the best scores, without the DP matrices and traceback
+	char *fastaFile = NULL;
+	int engine = -1, topK = 10, tileSize = -1, scoreOnly = 0, opt, usage = 0;
+	while ((opt = getopt(argc, argv, "d:e:k:st:")) != -1)
+	{
+		switch (opt)
+		{
+		case 'd':
+			fastaFile = optarg;
+			break;
+		case 'e':
+			usage |= (engine = swEngine(optarg)) < 0;
+			break;
+		case 'k':
+			usage |= (topK = atoi(optarg)) <= 0;
+			break;
+		case 's':
+			scoreOnly = 1;
+			break;
+		case 't':
+			usage |= (tileSize = atoi(optarg)) < 0;
+			break;
+		default:
+			usage = 1;
+		}
+	}
+	argv[optind - 1] = argv[0];
+	argc -= optind - 1;
+	argv += optind - 1;
+
+	//positional arguments: query, and the database unless -d is given
+	int dbArgs = fastaFile ? 1 : 2;
+	if (usage || argc < dbArgs + 1)
 	{
 		printf("Calculate similarities between two strings.\n");
 		printf("Maximum length of each string is: %d\n", MAX_LEN);
-		printf("Usage: %s query database [openPenalty extensionPenalty block#]\n", argv[0]);
+		printf("Usage: %s [-e engine] [-s] [-t tile] query database [openPenalty extensionPenalty block#]\n", argv[0]);
+		printf("       %s -d fasta [-k hits] [-e engine] [-s] [-t tile] query [openPenalty extensionPenalty block#]\n", argv[0]);
 		printf("openPenalty (5.0), extensionPenalty (0.5)\n");
+		printf("engine: scalar, striped or inter, to search on the host\n");
+		printf("hits: number of best database hits to align (10)\n");
+		printf("tile: tile size of the wavefront scheduler, 0 for the lock-based kernel\n");
+		printf("      (32 on CPU devices, 0 otherwise)\n");
+		printf("-s: report the best score and its position only, without traceback\n");
 		return 1;
 	}
 
@@ -89,13 +405,11 @@ int main(int argc, char ** argv)
 	int coalescedOffset = COALESCED_OFFSET;
 	int nblosumWidth = 23;
 	size_t blockSize = 64;
-	size_t setZeroThreadNum, mfThreadNum;
+	size_t mfThreadNum;
 	int blockNum = 14;
 
 	cl_ulong maxLocalSize;
 
-	int arraySize;
-
     struct timeval t1, t2;
 	float tmpTime;
 	FILE *pfile;
@@ -107,11 +421,33 @@ int main(int argc, char ** argv)
 	openPenalty = 5.0f;
 	extensionPenalty = 0.5;
 
-	if (argc == 6)
+	if (argc == dbArgs + 4)
 	{
-		openPenalty = atof(argv[3]);
-		extensionPenalty = atof(argv[4]);
-		blockNum = atoi(argv[5]);
+		openPenalty = atof(argv[dbArgs + 1]);
+		extensionPenalty = atof(argv[dbArgs + 2]);
+		blockNum = atoi(argv[dbArgs + 3]);
+	}
+
+	sprintf(queryFilePathName, "%s", argv[1]);
+	if (!fastaFile)
+	{
+		sprintf(dbDataFilePathName, "%s.data", argv[2]);
+		sprintf(dbLenFilePathName, "%s.loc", argv[2]);
+	}
+
+	SW_DATABASE db;
+	SW_HIT *hits = NULL;
+	if (engine >= 0)
+	{
+		if ((fastaFile ? readFastaDatabase(fastaFile, &db) :
+			 readDatabase(dbDataFilePathName, dbLenFilePathName, &db)) < 0)
+		{
+			return 1;
+		}
+		int ret = swatCPU(engine, queryFilePathName, &db, fastaFile ? topK : 0,
+						  openPenalty, extensionPenalty);
+		freeDatabase(&db);
+		return ret;
 	}
 
 
@@ -125,7 +461,8 @@ int main(int argc, char ** argv)
 	cl_context hContext;
 	cl_command_queue hCmdQueue;
 	cl_program hProgram;
-	cl_kernel hMatchStringKernel, hTraceBackKernel, hSetZeroKernel;
+	cl_kernel hMatchStringKernel, hTraceBackKernel, hSetZeroKernel, hTileKernel = NULL;
+	cl_kernel hScoreKernel = NULL;
 	size_t sourceFileSize;
 	char *cSourceCL = NULL;
 
@@ -158,6 +495,28 @@ int main(int argc, char ** argv)
 		blockNum = devBlockNum;
 	}
 	mfThreadNum = blockNum * blockSize;
+
+	//the lock-based kernel spins on a global barrier, which only works when
+	//every work-group is resident at once; CPU runtimes run groups in turn,
+	//so there one launch per tile diagonal is used instead
+	if (tileSize < 0)
+	{
+		tileSize = dev_type == CL_DEVICE_TYPE_CPU ? 32 : 0;
+	}
+	size_t maxGroupSize = 0;
+	CHECK_ERR(clGetDeviceInfo(deviceID, CL_DEVICE_MAX_WORK_GROUP_SIZE,\
+		sizeof(size_t), &maxGroupSize, 0), \
+		"Error while querying CL_DEVICE_MAX_WORK_GROUP_SIZE.");
+	if ((size_t)tileSize > maxGroupSize) {
+		printf("Scaling tile size from %d to %d to fit on device\n",\
+			tileSize, (int)maxGroupSize);
+		tileSize = maxGroupSize;
+	}
+	//the tiled kernel keeps one maximum per matrix row
+	int maxInfoNum = tileSize > 0 ? MAX_LEN : mfThreadNum;
+	//the score-only kernel runs in a single work-group where the tiled
+	//scheduler is used, as its lock-based barrier needs resident groups
+	size_t scoreThreadNum = tileSize > 0 ? blockSize : mfThreadNum;
 	
 	CHECK_ERR(clGetDeviceInfo(deviceID, CL_DEVICE_LOCAL_MEM_SIZE,\
 		sizeof(cl_ulong), &maxLocalSize, 0), \
@@ -196,28 +555,27 @@ int main(int argc, char ** argv)
 	CHECK_ERR(err, "Create trace_back2 kernel error");
 	hSetZeroKernel = clCreateKernel(hProgram, "setZero", &err);
 	CHECK_ERR(err, "Create setZero kernel error");
+	if (tileSize > 0 && !scoreOnly)
+	{
+		hTileKernel = clCreateKernel(hProgram, "MatchStringTile", &err);
+		CHECK_ERR(err, "Create MatchStringTile kernel error");
+	}
+	if (scoreOnly)
+	{
+		hScoreKernel = clCreateKernel(hProgram, "MatchStringScore", &err);
+		CHECK_ERR(err, "Create MatchStringScore kernel error");
+	}
 
-	sprintf(queryFilePathName, "%s", argv[1]);
-	sprintf(dbDataFilePathName, "%s.data", argv[2]);
-	sprintf(dbLenFilePathName, "%s.loc", argv[2]);
-
-	char *allSequences, *querySequence, *subSequence;
+	char *querySequence;
 	char *seq1, *seq2;
-	cl_mem seq1D, seq2D;
 
-	allSequences = new char[2 * (MAX_LEN)];
-	if (allSequences == NULL)
+	querySequence = new char[MAX_LEN];
+	if (querySequence == NULL)
 	{
 		printf("Allocate sequence buffer error!\n");
 		return 1;
 	}
-	querySequence = allSequences;
 
-	seq1D = clCreateBuffer(hContext, CL_MEM_READ_ONLY, sizeof(cl_char) * MAX_LEN, 0, &err);
-	CHECK_ERR(err, "Create seq1D memory");
-	seq2D = clCreateBuffer(hContext, CL_MEM_READ_ONLY, sizeof(cl_char) * MAX_LEN, 0, &err);
-	CHECK_ERR(err, "Create seq2D memory");
-	
 	//read query sequence
 	querySize = readQuerySequence(queryFilePathName, querySequence);
 	if (querySize <= 0 || querySize > MAX_LEN)
@@ -228,18 +586,6 @@ int main(int argc, char ** argv)
 		return 1;
 	}
 	encoding(querySequence, querySize);
-	subSequence = allSequences + querySize;
-
-	//allocate output sequence buffer
-	char *outSeq1, *outSeq2;
-	outSeq1 = new char[2 * MAX_LEN];
-	outSeq2 = new char[2 * MAX_LEN];
-	if (outSeq1 == NULL ||
-		outSeq2 == NULL)
-	{
-		printf("Allocate output sequence buffer on host error!\n");
-		return 1;
-	}
 
 	cl_mem outSeq1D, outSeq2D;
 	outSeq1D = clCreateBuffer(hContext, CL_MEM_READ_WRITE, sizeof(cl_char) * MAX_LEN * 2, 0, &err);
@@ -247,66 +593,96 @@ int main(int argc, char ** argv)
 	outSeq2D = clCreateBuffer(hContext, CL_MEM_READ_WRITE, sizeof(cl_char) * MAX_LEN * 2, 0, &err);
 	CHECK_ERR(err, "Create outSeq2D memory");
 
-	//allocate thread number per launch and 
-	//location difference information
-	int *threadNum, *diffPos;
-	threadNum = new int[2 * MAX_LEN];
-	diffPos = new int[2 * MAX_LEN];
-	if (threadNum == NULL ||
-		diffPos == NULL)
+	//allocate the sequences, thread number per launch, location
+	//difference information and outputs of each pair in flight
+	SW_SLOT slots[SLOT_NUM];
+	for (int k = 0; k < SLOT_NUM; k++)
 	{
-		printf("Allocate location buffer on host error!\n");
-		return 1;
+		SW_SLOT *slot = &slots[k];
+		slot->subSequence = new char[MAX_LEN];
+		slot->outSeq1 = new char[2 * MAX_LEN];
+		slot->outSeq2 = new char[2 * MAX_LEN];
+		slot->threadNum = new int[2 * MAX_LEN];
+		slot->diffPos = new int[2 * MAX_LEN];
+		slot->diagStart = new int[2 * MAX_LEN];
+		slot->maxInfo = new MAX_INFO[maxInfoNum];
+		slot->events = new SW_EVENT[SLOT_EVENT_NUM];
+		if (slot->subSequence == NULL ||
+			slot->outSeq1 == NULL ||
+			slot->outSeq2 == NULL ||
+			slot->threadNum == NULL ||
+			slot->diffPos == NULL ||
+			slot->diagStart == NULL ||
+			slot->maxInfo == NULL ||
+			slot->events == NULL)
+		{
+			printf("Allocate pipeline buffers on host error!\n");
+			return 1;
+		}
+		slot->eventNum = 0;
+		slot->busy = 0;
+
+		slot->seq1D = clCreateBuffer(hContext, CL_MEM_READ_ONLY, sizeof(cl_char) * MAX_LEN, 0, &err);
+		CHECK_ERR(err, "Create seq1D memory");
+		slot->seq2D = clCreateBuffer(hContext, CL_MEM_READ_ONLY, sizeof(cl_char) * MAX_LEN, 0, &err);
+		CHECK_ERR(err, "Create seq2D memory");
+		slot->threadNumD = clCreateBuffer(hContext, CL_MEM_READ_ONLY, sizeof(cl_int) * (2 * MAX_LEN), 0, &err);
+		CHECK_ERR(err, "Create threadNumD memory");
+		slot->diffPosD = clCreateBuffer(hContext, CL_MEM_READ_ONLY, sizeof(cl_int) * (2 * MAX_LEN), 0, &err);
+		CHECK_ERR(err, "Create diffPosD memory");
+		slot->diagStartD = clCreateBuffer(hContext, CL_MEM_READ_ONLY, sizeof(cl_int) * (2 * MAX_LEN), 0, &err);
+		CHECK_ERR(err, "Create diagStartD memory");
 	}
 
-	cl_mem threadNumD, diffPosD;
-	threadNumD = clCreateBuffer(hContext, CL_MEM_READ_ONLY, sizeof(cl_int) * (2 * MAX_LEN), 0, &err);
-	CHECK_ERR(err, "Create threadNumD memory");
-	diffPosD = clCreateBuffer(hContext, CL_MEM_READ_ONLY, sizeof(cl_int) * (2 * MAX_LEN), 0, &err);
-	CHECK_ERR(err, "Create diffPosD memory");
-
-	//allocate matrix buffer
-	char *pathFlag, *extFlag; 
-	float *nGapDist, *hGapDist, *vGapDist;
-	int maxElemNum = (MAX_LEN + 1) * (MAX_LEN + 1);
-	pathFlag  = new char[maxElemNum];
-	extFlag   = new char[maxElemNum];
-	nGapDist = new float[maxElemNum];
-	hGapDist = new float[maxElemNum];
-	vGapDist = new float[maxElemNum];
-	if (pathFlag  == NULL ||
-		extFlag   == NULL ||
-		nGapDist == NULL ||
-		hGapDist == NULL ||
-		vGapDist == NULL)
-	{
-		printf("Allocate DP matrices on host error!\n");
-		return 1;
+	//uploads go to their own queue, so they overlap the kernels of the
+	//previous pair on hCmdQueue
+	cl_command_queue hCopyQueue;
+	hCopyQueue = clCreateCommandQueue(hContext, deviceID, CL_QUEUE_PROFILING_ENABLE, &err);
+	CHECK_ERR(err, "Create copy command queue error");
+
+	//allocate matrix buffer, -s only needs rolling anti-diagonals of
+	//nGapDist, hGapDist and vGapDist
+	char *pathFlag = NULL, *extFlag = NULL;
+	float *nGapDist = NULL, *hGapDist = NULL, *vGapDist = NULL;
+	cl_mem pathFlagD, extFlagD,	nGapDistD, hGapDistD, vGapDistD, diagDistD;
+	if (scoreOnly)
+	{
+		diagDistD = clCreateBuffer(hContext, CL_MEM_READ_WRITE, sizeof(cl_float) * 7 * (MAX_LEN + 1), 0, &err);
+		CHECK_ERR(err, "Create diagDistD memory");
 	}
+	else
+	{
+		int maxElemNum = (MAX_LEN + 1) * (MAX_LEN + 1);
+		pathFlag  = new char[maxElemNum];
+		extFlag   = new char[maxElemNum];
+		nGapDist = new float[maxElemNum];
+		hGapDist = new float[maxElemNum];
+		vGapDist = new float[maxElemNum];
+		if (pathFlag  == NULL ||
+			extFlag   == NULL ||
+			nGapDist == NULL ||
+			hGapDist == NULL ||
+			vGapDist == NULL)
+		{
+			printf("Allocate DP matrices on host error!\n");
+			return 1;
+		}
 
-	cl_mem pathFlagD, extFlagD,	nGapDistD, hGapDistD, vGapDistD;
-	pathFlagD = clCreateBuffer(hContext, CL_MEM_READ_WRITE, sizeof(cl_char) * maxElemNum, 0, &err);
-	CHECK_ERR(err, "Create pathFlagD memory");
-	extFlagD = clCreateBuffer(hContext, CL_MEM_READ_WRITE, sizeof(cl_char) * maxElemNum, 0, &err);
-	CHECK_ERR(err, "Create extFlagD memory");
-	nGapDistD = clCreateBuffer(hContext, CL_MEM_READ_WRITE, sizeof(cl_float) * maxElemNum, 0, &err);
-	CHECK_ERR(err, "Create nGapDistD memory");
-	hGapDistD = clCreateBuffer(hContext, CL_MEM_READ_WRITE, sizeof(cl_float) * maxElemNum, 0, &err);
-	CHECK_ERR(err, "Create hGapDistD memory");
-	vGapDistD = clCreateBuffer(hContext, CL_MEM_READ_WRITE, sizeof(cl_float) * maxElemNum, 0, &err);
-	CHECK_ERR(err, "Create vGapDistD memory");
+		pathFlagD = clCreateBuffer(hContext, CL_MEM_READ_WRITE, sizeof(cl_char) * maxElemNum, 0, &err);
+		CHECK_ERR(err, "Create pathFlagD memory");
+		extFlagD = clCreateBuffer(hContext, CL_MEM_READ_WRITE, sizeof(cl_char) * maxElemNum, 0, &err);
+		CHECK_ERR(err, "Create extFlagD memory");
+		nGapDistD = clCreateBuffer(hContext, CL_MEM_READ_WRITE, sizeof(cl_float) * maxElemNum, 0, &err);
+		CHECK_ERR(err, "Create nGapDistD memory");
+		hGapDistD = clCreateBuffer(hContext, CL_MEM_READ_WRITE, sizeof(cl_float) * maxElemNum, 0, &err);
+		CHECK_ERR(err, "Create hGapDistD memory");
+		vGapDistD = clCreateBuffer(hContext, CL_MEM_READ_WRITE, sizeof(cl_float) * maxElemNum, 0, &err);
+		CHECK_ERR(err, "Create vGapDistD memory");
+	}
 
 	//Allocate the MAX INFO structure
-	MAX_INFO *maxInfo;
-	maxInfo = new MAX_INFO[1];
-	if (maxInfo == NULL)
-	{
-		printf("Alloate maxInfo on host error!\n");
-		return 1;
-	}
-	
 	cl_mem maxInfoD;
-	maxInfoD = clCreateBuffer(hContext, CL_MEM_READ_WRITE, sizeof(MAX_INFO) * mfThreadNum, 0, &err);
+	maxInfoD = clCreateBuffer(hContext, CL_MEM_READ_WRITE, sizeof(MAX_INFO) * maxInfoNum, 0, &err);
 	CHECK_ERR(err, "Create maxInfoD memory");
 
 	//allocate the distance table
@@ -326,54 +702,109 @@ int main(int argc, char ** argv)
 	//copy the scoring matrix to the constant memory
 	//copyScoringMatrixToConstant();
 
-	//open the database
-	pDBDataFile = fopen(dbDataFilePathName, "rb");
-	if (pDBDataFile == NULL)
+	if (fastaFile)
 	{
-		printf("DB data file %s open error!\n", dbDataFilePathName);
-		return 1;
+		//score the whole database, then align only the best hits
+		if (readFastaDatabase(fastaFile, &db) < 0)
+		{
+			return 1;
+		}
+		float *scores = new float[db.seqNum];
+		double searchTime = searchDatabase(deviceID, hContext, hCmdQueue, hProgram, blosum62D,
+										   querySequence, querySize, &db, openPenalty,
+										   extensionPenalty, scores);
+		long long cells = (long long)querySize * db.totalSize;
+		printf("Searched %d sequences, %lld cells in %.3f ms: %.3f GCUPS\n",
+				db.seqNum, cells, searchTime, cells / searchTime * 1e-6);
+
+		hits = new SW_HIT[topK];
+		subSequenceNum = topHits(scores, db.seqNum, topK, hits);
+		delete[] scores;
 	}
-
-	pDBLenFile = fopen(dbLenFilePathName, "rb");
-	if (pDBLenFile == NULL)
+	else
 	{
-		printf("DB length file %s open error!\n", dbLenFilePathName);
-		return 1;
+		//open the database
+		pDBDataFile = fopen(dbDataFilePathName, "rb");
+		if (pDBDataFile == NULL)
+		{
+			printf("DB data file %s open error!\n", dbDataFilePathName);
+			return 1;
+		}
+
+		pDBLenFile = fopen(dbLenFilePathName, "rb");
+		if (pDBLenFile == NULL)
+		{
+			printf("DB length file %s open error!\n", dbLenFilePathName);
+			return 1;
+		}
+
+		//read the total number of sequences
+		fread(&subSequenceNum, sizeof(int), 1, pDBLenFile);
 	}
 
 	//record time
 	timerEnd();
 	strTime.iniTime = elapsedTime();
 
-	//read the total number of sequences
-	fread(&subSequenceNum, sizeof(int), 1, pDBLenFile);
-
 	//get the larger and smaller of the row and colum number
-	int subSequenceNo, launchNum, launchNo;
+	int subSequenceNo, launchNum;
 	int rowNum, columnNum, matrixIniNum;
 	int DPMatrixSize;
-	int seq1Pos, seq2Pos, nOffset, startPos;
+	size_t scoreNum = scoreOnly ? scoreThreadNum : 0;
 
+	gettimeofday(&t1, NULL);
 	for (subSequenceNo = 0; subSequenceNo < subSequenceNum; subSequenceNo++)
 	{
+		//the pair that last used this slot must be done before its
+		//buffers are refilled; the other slot keeps the device busy
+		SW_SLOT *slot = &slots[subSequenceNo % SLOT_NUM];
+		retireSlot(slot, querySize, openPenalty, extensionPenalty, scoreNum);
+
 		//record time
 		timerStart();
 
 		//read subject sequence
-		fread(&subSequenceSize, sizeof(int), 1, pDBLenFile);
-		if (subSequenceSize <= 0 || subSequenceSize > MAX_LEN)
+		slot->hit = NULL;
+		if (hits)
 		{
-			printf("Size %d of bubject sequence %d is out of range!\n",
-					subSequenceSize,
-					subSequenceNo);
-			break;
+			int seqNo = hits[subSequenceNo].seqNo;
+			subSequenceSize = db.sizes[seqNo];
+			if (subSequenceSize > MAX_LEN)
+			{
+				//print the pairs still in flight first
+				for (int k = 0; k < SLOT_NUM; k++)
+				{
+					retireSlot(&slots[(subSequenceNo + k) % SLOT_NUM], querySize,
+							   openPenalty, extensionPenalty, scoreNum);
+				}
+				printf("Hit %d: sequence %d %s, score %.1f\n", subSequenceNo, seqNo,
+						db.names[seqNo] ? db.names[seqNo] : "", hits[subSequenceNo].score);
+				printf("Size %d is over %d, not aligned\n", subSequenceSize, MAX_LEN);
+				timerEnd();
+				continue;
+			}
+			memcpy(slot->subSequence, db.residues + db.offsets[seqNo], subSequenceSize);
+			slot->hit = &hits[subSequenceNo];
+			slot->hitName = db.names[seqNo];
+		}
+		else
+		{
+			fread(&subSequenceSize, sizeof(int), 1, pDBLenFile);
+			if (subSequenceSize <= 0 || subSequenceSize > MAX_LEN)
+			{
+				printf("Size %d of bubject sequence %d is out of range!\n",
+						subSequenceSize,
+						subSequenceNo);
+				break;
+			}
+			fread(slot->subSequence, sizeof(char), subSequenceSize, pDBDataFile);
 		}
-		fread(subSequence, sizeof(char), subSequenceSize, pDBDataFile);
+		slot->subSequenceNo = subSequenceNo;
+		slot->subSequenceSize = subSequenceSize;
 
-		gettimeofday(&t1, NULL);
 		if (subSequenceSize > querySize)
 		{
-			seq1 = subSequence;
+			seq1 = slot->subSequence;
 			seq2 = querySequence;
 			rowNum = subSequenceSize + 1;
 			columnNum = querySize + 1;
@@ -381,7 +812,7 @@ int main(int argc, char ** argv)
 		else
 		{
 			seq1 = querySequence;
-			seq2 = subSequence;
+			seq2 = slot->subSequence;
 			rowNum = querySize + 1;
 			columnNum = subSequenceSize + 1;
 		}
@@ -391,210 +822,211 @@ int main(int argc, char ** argv)
 		//preprocessing for sequences
 		DPMatrixSize = preProcessing(rowNum,
 					  columnNum,
-					  threadNum,
-					  diffPos,
+					  slot->threadNum,
+					  slot->diffPos,
 					  matrixIniNum);
+		if (hTileKernel)
+		{
+			diagonalStarts(rowNum, columnNum, slot->diffPos, slot->diagStart);
+		}
 
 		//record time
 		timerEnd();
 		strTime.preprocessingTime += elapsedTime();
 
-		//record time
-		timerStart();
-
-		//use a kernel to initialize the matrix
-		arraySize = DPMatrixSize * sizeof(char);
-		setZeroThreadNum = ((arraySize - 1) / blockSize + 1) * blockSize;
-		err  = clSetKernelArg(hSetZeroKernel, 0, sizeof(cl_mem), (void *)&pathFlagD);
-		err |= clSetKernelArg(hSetZeroKernel, 1, sizeof(int), (void *)&arraySize);
-		err |= clEnqueueNDRangeKernel(hCmdQueue, hSetZeroKernel, 1, NULL, &setZeroThreadNum,
-									 &blockSize, 0, NULL, &ocdTempEvent);
-                clFinish(hCmdQueue);
-                START_TIMER(ocdTempEvent, OCD_TIMER_KERNEL, "SWAT DP Matrix Init", ocdTempTimer)
-                END_TIMER(ocdTempTimer)
-		err |= clSetKernelArg(hSetZeroKernel, 0, sizeof(cl_mem), (void *)&extFlagD);
-		err |= clEnqueueNDRangeKernel(hCmdQueue, hSetZeroKernel, 1, NULL, &setZeroThreadNum,
-									 &blockSize, 0, NULL, &ocdTempEvent);
-                clFinish(hCmdQueue);
-                START_TIMER(ocdTempEvent, OCD_TIMER_KERNEL, "SWAT DP Matrix Init", ocdTempTimer)
-                END_TIMER(ocdTempTimer)
-		CHECK_ERR(err, "Initialize flag matrice");
-
-		arraySize = matrixIniNum * sizeof(float);
-		setZeroThreadNum = ((arraySize - 1) / blockSize + 1) * blockSize;
-		err  = clSetKernelArg(hSetZeroKernel, 0, sizeof(cl_mem), (void *)&nGapDistD);
-		err |= clSetKernelArg(hSetZeroKernel, 1, sizeof(int), (void *)&arraySize);
-		err |= clEnqueueNDRangeKernel(hCmdQueue, hSetZeroKernel, 1, NULL, &setZeroThreadNum,
-									 &blockSize, 0, NULL, &ocdTempEvent);
-                clFinish(hCmdQueue);
-                START_TIMER(ocdTempEvent, OCD_TIMER_KERNEL, "SWAT Distance Matrix Init", ocdTempTimer)
-                END_TIMER(ocdTempTimer)
-		err |= clSetKernelArg(hSetZeroKernel, 0, sizeof(cl_mem), (void *)&hGapDistD);
-		err |= clEnqueueNDRangeKernel(hCmdQueue, hSetZeroKernel, 1, NULL, &setZeroThreadNum,
-									 &blockSize, 0, NULL, &ocdTempEvent);
-                clFinish(hCmdQueue);
-                START_TIMER(ocdTempEvent, OCD_TIMER_KERNEL, "SWAT Distance Matrix Init", ocdTempTimer)
-                END_TIMER(ocdTempTimer)
-		err |= clSetKernelArg(hSetZeroKernel, 0, sizeof(cl_mem), (void *)&vGapDistD);
-		err |= clEnqueueNDRangeKernel(hCmdQueue, hSetZeroKernel, 1, NULL, &setZeroThreadNum,
-									 &blockSize, 0, NULL, &ocdTempEvent);
-                clFinish(hCmdQueue);
-                START_TIMER(ocdTempEvent, OCD_TIMER_KERNEL, "SWAT Distance Matrix Init", ocdTempTimer)
-                END_TIMER(ocdTempTimer)
-		CHECK_ERR(err, "Initialize dist matrice");
-
-		arraySize = sizeof(MAX_INFO) * mfThreadNum;
-		setZeroThreadNum = ((arraySize - 1) / blockSize + 1) * blockSize;
-		err  = clSetKernelArg(hSetZeroKernel, 0, sizeof(cl_mem), (void *)&maxInfoD);
-		err |= clSetKernelArg(hSetZeroKernel, 1, sizeof(int), (void *)&arraySize);
-		err |= clEnqueueNDRangeKernel(hCmdQueue, hSetZeroKernel, 1, NULL, &setZeroThreadNum,
-									 &blockSize, 0, NULL, &ocdTempEvent);
-                clFinish(hCmdQueue);
-                START_TIMER(ocdTempEvent, OCD_TIMER_KERNEL, "SWAT Max Info Matrix Init", ocdTempTimer)
-                END_TIMER(ocdTempTimer)
-		CHECK_ERR(err, "Initialize max info");
-
-		arraySize = sizeof(int);
-		setZeroThreadNum = ((arraySize - 1) / blockSize + 1) * blockSize;
-		err  = clSetKernelArg(hSetZeroKernel, 0, sizeof(cl_mem), (void *)&mutexMem);
-		err |= clSetKernelArg(hSetZeroKernel, 1, sizeof(int), (void *)&arraySize);
-		err |= clEnqueueNDRangeKernel(hCmdQueue, hSetZeroKernel, 1, NULL, &setZeroThreadNum,
-									 &blockSize, 0, NULL, &ocdTempEvent);
-                clFinish(hCmdQueue);
-                START_TIMER(ocdTempEvent, OCD_TIMER_KERNEL, "SWAT Mutex Init", ocdTempTimer)
-                END_TIMER(ocdTempTimer)
-		CHECK_ERR(err, "Initialize mutex variable");
-
-		//copy input sequences to device
-		err  = clEnqueueWriteBuffer(hCmdQueue, seq1D, CL_FALSE, 0, (rowNum - 1) * sizeof(cl_char), seq1, 0, NULL, &ocdTempEvent);
-                clFinish(hCmdQueue);
-                START_TIMER(ocdTempEvent, OCD_TIMER_H2D, "SWAT Sequence Copy", ocdTempTimer)
-                END_TIMER(ocdTempTimer)
-		err |= clEnqueueWriteBuffer(hCmdQueue, seq2D, CL_FALSE, 0, (columnNum - 1) * sizeof(cl_char), seq2, 0, NULL, &ocdTempEvent);
-                clFinish(hCmdQueue);
-                START_TIMER(ocdTempEvent, OCD_TIMER_H2D, "SWAT Sequence Copy", ocdTempTimer)
-                END_TIMER(ocdTempTimer)
+		//copy input sequences and launch information to device, the host
+		//buffers stay untouched until the slot is retired
+		err  = clEnqueueWriteBuffer(hCopyQueue, slot->seq1D, CL_FALSE, 0, (rowNum - 1) * sizeof(cl_char), seq1, 0, NULL,
+									slotEvent(slot, SW_H2D, "SWAT Sequence Copy", &strTime.copyTimeHostToDevice));
+		err |= clEnqueueWriteBuffer(hCopyQueue, slot->seq2D, CL_FALSE, 0, (columnNum - 1) * sizeof(cl_char), seq2, 0, NULL,
+									slotEvent(slot, SW_H2D, "SWAT Sequence Copy", &strTime.copyTimeHostToDevice));
 		CHECK_ERR(err, "copy input sequence");
 
-		err  = clEnqueueWriteBuffer(hCmdQueue, diffPosD, CL_FALSE, 0, launchNum * sizeof(cl_int), diffPos, 0, NULL, &ocdTempEvent);
-                clFinish(hCmdQueue);
-                START_TIMER(ocdTempEvent, OCD_TIMER_H2D, "SWAT Mutex Info Copy", ocdTempTimer)
-                END_TIMER(ocdTempTimer)
-		err |= clEnqueueWriteBuffer(hCmdQueue, threadNumD, CL_FALSE, 0, launchNum * sizeof(cl_int), threadNum, 0, NULL, &ocdTempEvent);
-                clFinish(hCmdQueue);
-                START_TIMER(ocdTempEvent, OCD_TIMER_H2D, "SWAT Mutex Info Copy", ocdTempTimer)
-                END_TIMER(ocdTempTimer)
+		err  = clEnqueueWriteBuffer(hCopyQueue, slot->diffPosD, CL_FALSE, 0, launchNum * sizeof(cl_int), slot->diffPos, 0, NULL,
+									slotEvent(slot, SW_H2D, "SWAT Mutex Info Copy", &strTime.copyTimeHostToDevice));
+		err |= clEnqueueWriteBuffer(hCopyQueue, slot->threadNumD, CL_FALSE, 0, launchNum * sizeof(cl_int), slot->threadNum, 0, NULL,
+									slotEvent(slot, SW_H2D, "SWAT Mutex Info Copy", &strTime.copyTimeHostToDevice));
+		if (hTileKernel)
+		{
+			err |= clEnqueueWriteBuffer(hCopyQueue, slot->diagStartD, CL_FALSE, 0, launchNum * sizeof(cl_int), slot->diagStart, 0, NULL,
+										slotEvent(slot, SW_H2D, "SWAT Mutex Info Copy", &strTime.copyTimeHostToDevice));
+		}
 		CHECK_ERR(err, "copy diffpos and/or threadNum mutexMem info error!");
-		
-		//record time
-		timerEnd();
-		strTime.copyTimeHostToDevice += elapsedTime();
+		clFlush(hCopyQueue);
 
-		//record time
-		timerStart();
+		//the copy queue is in order, so the matrix filling only has to
+		//wait for its last upload
+		cl_event upload = slot->events[slot->eventNum - 1].event;
 
-		//set arguments
-		err  = clSetKernelArg(hMatchStringKernel, 0, sizeof(cl_mem), (void *)&pathFlagD);
-		err |= clSetKernelArg(hMatchStringKernel, 1, sizeof(cl_mem), (void *)&extFlagD);
-		err |= clSetKernelArg(hMatchStringKernel, 2, sizeof(cl_mem), (void *)&nGapDistD);
-		err |= clSetKernelArg(hMatchStringKernel, 3, sizeof(cl_mem), (void *)&hGapDistD);
-		err |= clSetKernelArg(hMatchStringKernel, 4, sizeof(cl_mem), (void *)&vGapDistD);
-		err |= clSetKernelArg(hMatchStringKernel, 5, sizeof(cl_mem), (void *)&diffPosD);
-		err |= clSetKernelArg(hMatchStringKernel, 6, sizeof(cl_mem), (void *)&threadNumD);
-		err |= clSetKernelArg(hMatchStringKernel, 7, sizeof(cl_int), (void *)&rowNum);
-		err |= clSetKernelArg(hMatchStringKernel, 8, sizeof(cl_int), (void *)&columnNum);
-		err |= clSetKernelArg(hMatchStringKernel, 9, sizeof(cl_mem), (void *)&seq1D);
-		err |= clSetKernelArg(hMatchStringKernel, 10, sizeof(cl_mem), (void *)&seq2D);	
-		err |= clSetKernelArg(hMatchStringKernel, 11, sizeof(cl_int), (void *)&nblosumWidth);
-		err |= clSetKernelArg(hMatchStringKernel, 12, sizeof(cl_float), (void *)&openPenalty);
-		err |= clSetKernelArg(hMatchStringKernel, 13, sizeof(cl_float), (void *)&extensionPenalty);
-		err |= clSetKernelArg(hMatchStringKernel, 14, sizeof(cl_mem), (void *)&maxInfoD);
-		err |= clSetKernelArg(hMatchStringKernel, 15, sizeof(cl_mem), (void *)&blosum62D);
-		err |= clSetKernelArg(hMatchStringKernel, 16, sizeof(cl_mem), (void *)&mutexMem);
-		err |= clSetKernelArg(hMatchStringKernel, 17, maxLocalSize, NULL);
-		CHECK_ERR(err, "Set match string argument error!");
-
-		err = clEnqueueNDRangeKernel(hCmdQueue, hMatchStringKernel, 1, NULL, &mfThreadNum,
-									 &blockSize, 0, NULL, &ocdTempEvent);
-                clFinish(hCmdQueue);
-                START_TIMER(ocdTempEvent, OCD_TIMER_KERNEL, "SWAT Kernels", ocdTempTimer)
-                END_TIMER(ocdTempTimer)
-		CHECK_ERR(err, "Launch kernel match string error");
-
-		//record time
-		timerEnd();
-		strTime.matrixFillingTime += elapsedTime();
-
-		//record time
-		timerStart();
-		err  = clSetKernelArg(hTraceBackKernel, 0, sizeof(cl_mem), (void *)&pathFlagD);
-		err |= clSetKernelArg(hTraceBackKernel, 1, sizeof(cl_mem), (void *)&extFlagD);
-		err |= clSetKernelArg(hTraceBackKernel, 2, sizeof(cl_mem), (void *)&diffPosD);
-		err |= clSetKernelArg(hTraceBackKernel, 3, sizeof(cl_mem), (void *)&seq1D);
-		err |= clSetKernelArg(hTraceBackKernel, 4, sizeof(cl_mem), (void *)&seq2D);	
-		err |= clSetKernelArg(hTraceBackKernel, 5, sizeof(cl_mem), (void *)&outSeq1D);
-		err |= clSetKernelArg(hTraceBackKernel, 6, sizeof(cl_mem), (void *)&outSeq2D);	
-		err |= clSetKernelArg(hTraceBackKernel, 7, sizeof(cl_mem), (void *)&maxInfoD);
-		err |= clSetKernelArg(hTraceBackKernel, 8, sizeof(int), (void *)&mfThreadNum);
-		
-		size_t tbGlobalSize[1] = {1};
-		size_t tbLocalSize[1]  = {1};
-		err = clEnqueueNDRangeKernel(hCmdQueue, hTraceBackKernel, 1, NULL, tbGlobalSize,
-									 tbLocalSize, 0, NULL, &ocdTempEvent);
-                clFinish(hCmdQueue);
-                START_TIMER(ocdTempEvent, OCD_TIMER_KERNEL, "SWAT Kernels", ocdTempTimer)
-                END_TIMER(ocdTempTimer)
-		CHECK_ERR(err, "Launch kernel trace back error");
-		clFinish(hCmdQueue);
-		//record time
-		timerEnd();
-		strTime.traceBackTime += elapsedTime();
+		//use a kernel to initialize the matrix, the score-only kernel
+		//clears its own buffers
+		if (!scoreOnly)
+		{
+			err  = enqueueSetZero(hCmdQueue, hSetZeroKernel, pathFlagD, DPMatrixSize * sizeof(char),
+								  blockSize, slot, "SWAT DP Matrix Init");
+			err |= enqueueSetZero(hCmdQueue, hSetZeroKernel, extFlagD, DPMatrixSize * sizeof(char),
+								  blockSize, slot, "SWAT DP Matrix Init");
+			CHECK_ERR(err, "Initialize flag matrice");
+
+			err  = enqueueSetZero(hCmdQueue, hSetZeroKernel, nGapDistD, matrixIniNum * sizeof(float),
+								  blockSize, slot, "SWAT Distance Matrix Init");
+			err |= enqueueSetZero(hCmdQueue, hSetZeroKernel, hGapDistD, matrixIniNum * sizeof(float),
+								  blockSize, slot, "SWAT Distance Matrix Init");
+			err |= enqueueSetZero(hCmdQueue, hSetZeroKernel, vGapDistD, matrixIniNum * sizeof(float),
+								  blockSize, slot, "SWAT Distance Matrix Init");
+			CHECK_ERR(err, "Initialize dist matrice");
+
+			err = enqueueSetZero(hCmdQueue, hSetZeroKernel, maxInfoD, sizeof(MAX_INFO) * maxInfoNum,
+								 blockSize, slot, "SWAT Max Info Matrix Init");
+			CHECK_ERR(err, "Initialize max info");
+		}
 
-		//record time
-		timerStart();
-		//copy matrix score structure back
-		err = clEnqueueReadBuffer(hCmdQueue, maxInfoD, CL_FALSE, 0, sizeof(MAX_INFO),
-								  maxInfo, 0, 0, &ocdTempEvent);
-                clFinish(hCmdQueue);
-                START_TIMER(ocdTempEvent, OCD_TIMER_D2H, "SWAT Max Info Copy", ocdTempTimer)
-                END_TIMER(ocdTempTimer)
-		CHECK_ERR(err, "Read maxInfo buffer error!");
-
-		int maxOutputLen = rowNum + columnNum - 2;
-		err  = clEnqueueReadBuffer(hCmdQueue, outSeq1D, CL_FALSE, 0, maxOutputLen * sizeof(cl_char),
-								   outSeq1, 0, 0, &ocdTempEvent);
-                clFinish(hCmdQueue);
-                START_TIMER(ocdTempEvent, OCD_TIMER_D2H, "SWAT Sequence Copy", ocdTempTimer)
-                END_TIMER(ocdTempTimer)
-		err != clEnqueueReadBuffer(hCmdQueue, outSeq2D, CL_FALSE, 0, maxOutputLen * sizeof(cl_char),
-								   outSeq2, 0, 0, &ocdTempEvent);
-                clFinish(hCmdQueue);
-                START_TIMER(ocdTempEvent, OCD_TIMER_D2H, "SWAT Sequence Copy", ocdTempTimer)
-                END_TIMER(ocdTempTimer)
-		CHECK_ERR(err, "Read output sequence error!");
-		//record time
-		clFinish(hCmdQueue);
-		gettimeofday(&t2, NULL);
-		timerEnd();
-		strTime.copyTimeDeviceToHost += elapsedTime();
+		err = enqueueSetZero(hCmdQueue, hSetZeroKernel, mutexMem, sizeof(int),
+							 blockSize, slot, "SWAT Mutex Init");
+		CHECK_ERR(err, "Initialize mutex variable");
 
-		//call the print function to print the match result
-		printf("============================================================\n");
-		printf("Sequence pair %d:\n", subSequenceNo);
-		int nlength = maxInfo->noutputlen;
-		PrintAlignment(outSeq1, outSeq2, nlength, CHAR_PER_LINE, openPenalty, extensionPenalty);
-		printf("Max alignment score (on device) is %.1f\n", maxInfo->fmaxscore);
-		//obtain max alignment score on host
-		//err = clEnqueueReadBuffer(hCmdQueue, nGapDistD, CL_TRUE, 0, sizeof(cl_float) * DPMatrixSize,
-		//						  nGapDist, 0, 0, 0);
-		//printf("Max alignment score (on host) is %.1f\n", maxScore(nGapDist, DPMatrixSize));
+		if (scoreOnly)
+		{
+			err  = clSetKernelArg(hScoreKernel, 0, sizeof(cl_mem), (void *)&diagDistD);
+			err |= clSetKernelArg(hScoreKernel, 1, sizeof(cl_mem), (void *)&slot->threadNumD);
+			err |= clSetKernelArg(hScoreKernel, 2, sizeof(cl_int), (void *)&rowNum);
+			err |= clSetKernelArg(hScoreKernel, 3, sizeof(cl_int), (void *)&columnNum);
+			err |= clSetKernelArg(hScoreKernel, 4, sizeof(cl_mem), (void *)&slot->seq1D);
+			err |= clSetKernelArg(hScoreKernel, 5, sizeof(cl_mem), (void *)&slot->seq2D);
+			err |= clSetKernelArg(hScoreKernel, 6, sizeof(cl_int), (void *)&nblosumWidth);
+			err |= clSetKernelArg(hScoreKernel, 7, sizeof(cl_float), (void *)&openPenalty);
+			err |= clSetKernelArg(hScoreKernel, 8, sizeof(cl_float), (void *)&extensionPenalty);
+			err |= clSetKernelArg(hScoreKernel, 9, sizeof(cl_mem), (void *)&maxInfoD);
+			err |= clSetKernelArg(hScoreKernel, 10, sizeof(cl_mem), (void *)&blosum62D);
+			err |= clSetKernelArg(hScoreKernel, 11, sizeof(cl_mem), (void *)&mutexMem);
+			CHECK_ERR(err, "Set match string score argument error!");
+
+			err = clEnqueueNDRangeKernel(hCmdQueue, hScoreKernel, 1, NULL, &scoreThreadNum,
+										 &blockSize, 1, &upload,
+										 slotEvent(slot, SW_KERNEL, "SWAT Kernels", &strTime.matrixFillingTime));
+			CHECK_ERR(err, "Launch kernel match string score error");
+		}
+		else if (hTileKernel)
+		{
+			//tiles on one anti-diagonal of tiles are independent and the
+			//in-order queue finishes each diagonal before the next starts
+			int tilesI = (rowNum - 2) / tileSize + 1;
+			int tilesJ = (columnNum - 2) / tileSize + 1;
+			size_t tileLocalSize = tileSize;
+			err  = clSetKernelArg(hTileKernel, 0, sizeof(cl_mem), (void *)&pathFlagD);
+			err |= clSetKernelArg(hTileKernel, 1, sizeof(cl_mem), (void *)&extFlagD);
+			err |= clSetKernelArg(hTileKernel, 2, sizeof(cl_mem), (void *)&nGapDistD);
+			err |= clSetKernelArg(hTileKernel, 3, sizeof(cl_mem), (void *)&hGapDistD);
+			err |= clSetKernelArg(hTileKernel, 4, sizeof(cl_mem), (void *)&vGapDistD);
+			err |= clSetKernelArg(hTileKernel, 5, sizeof(cl_mem), (void *)&slot->diffPosD);
+			err |= clSetKernelArg(hTileKernel, 6, sizeof(cl_mem), (void *)&slot->diagStartD);
+			err |= clSetKernelArg(hTileKernel, 7, sizeof(cl_int), (void *)&rowNum);
+			err |= clSetKernelArg(hTileKernel, 8, sizeof(cl_int), (void *)&columnNum);
+			err |= clSetKernelArg(hTileKernel, 9, sizeof(cl_mem), (void *)&slot->seq1D);
+			err |= clSetKernelArg(hTileKernel, 10, sizeof(cl_mem), (void *)&slot->seq2D);
+			err |= clSetKernelArg(hTileKernel, 11, sizeof(cl_int), (void *)&nblosumWidth);
+			err |= clSetKernelArg(hTileKernel, 12, sizeof(cl_float), (void *)&openPenalty);
+			err |= clSetKernelArg(hTileKernel, 13, sizeof(cl_float), (void *)&extensionPenalty);
+			err |= clSetKernelArg(hTileKernel, 14, sizeof(cl_mem), (void *)&maxInfoD);
+			err |= clSetKernelArg(hTileKernel, 15, sizeof(cl_mem), (void *)&blosum62D);
+			CHECK_ERR(err, "Set match string tile argument error!");
+
+			for (int tileDiag = 0; tileDiag < tilesI + tilesJ - 1; tileDiag++)
+			{
+				int firstTile = tileDiag < tilesJ ? 0 : tileDiag - tilesJ + 1;
+				int lastTile = MIN(tileDiag, tilesI - 1);
+				size_t tileGlobalSize = (lastTile - firstTile + 1) * tileLocalSize;
+				err  = clSetKernelArg(hTileKernel, 16, sizeof(cl_int), (void *)&tileDiag);
+				err |= clSetKernelArg(hTileKernel, 17, sizeof(cl_int), (void *)&firstTile);
+				err |= clEnqueueNDRangeKernel(hCmdQueue, hTileKernel, 1, NULL, &tileGlobalSize,
+											  &tileLocalSize, tileDiag ? 0 : 1, tileDiag ? NULL : &upload,
+											  slotEvent(slot, SW_KERNEL, "SWAT Kernels", &strTime.matrixFillingTime));
+				CHECK_ERR(err, "Launch kernel match string tile error");
+			}
+		}
+		else
+		{
+			//set arguments
+			err  = clSetKernelArg(hMatchStringKernel, 0, sizeof(cl_mem), (void *)&pathFlagD);
+			err |= clSetKernelArg(hMatchStringKernel, 1, sizeof(cl_mem), (void *)&extFlagD);
+			err |= clSetKernelArg(hMatchStringKernel, 2, sizeof(cl_mem), (void *)&nGapDistD);
+			err |= clSetKernelArg(hMatchStringKernel, 3, sizeof(cl_mem), (void *)&hGapDistD);
+			err |= clSetKernelArg(hMatchStringKernel, 4, sizeof(cl_mem), (void *)&vGapDistD);
+			err |= clSetKernelArg(hMatchStringKernel, 5, sizeof(cl_mem), (void *)&slot->diffPosD);
+			err |= clSetKernelArg(hMatchStringKernel, 6, sizeof(cl_mem), (void *)&slot->threadNumD);
+			err |= clSetKernelArg(hMatchStringKernel, 7, sizeof(cl_int), (void *)&rowNum);
+			err |= clSetKernelArg(hMatchStringKernel, 8, sizeof(cl_int), (void *)&columnNum);
+			err |= clSetKernelArg(hMatchStringKernel, 9, sizeof(cl_mem), (void *)&slot->seq1D);
+			err |= clSetKernelArg(hMatchStringKernel, 10, sizeof(cl_mem), (void *)&slot->seq2D);	
+			err |= clSetKernelArg(hMatchStringKernel, 11, sizeof(cl_int), (void *)&nblosumWidth);
+			err |= clSetKernelArg(hMatchStringKernel, 12, sizeof(cl_float), (void *)&openPenalty);
+			err |= clSetKernelArg(hMatchStringKernel, 13, sizeof(cl_float), (void *)&extensionPenalty);
+			err |= clSetKernelArg(hMatchStringKernel, 14, sizeof(cl_mem), (void *)&maxInfoD);
+			err |= clSetKernelArg(hMatchStringKernel, 15, sizeof(cl_mem), (void *)&blosum62D);
+			err |= clSetKernelArg(hMatchStringKernel, 16, sizeof(cl_mem), (void *)&mutexMem);
+			err |= clSetKernelArg(hMatchStringKernel, 17, maxLocalSize, NULL);
+			CHECK_ERR(err, "Set match string argument error!");
+
+			err = clEnqueueNDRangeKernel(hCmdQueue, hMatchStringKernel, 1, NULL, &mfThreadNum,
+										 &blockSize, 1, &upload,
+										 slotEvent(slot, SW_KERNEL, "SWAT Kernels", &strTime.matrixFillingTime));
+			CHECK_ERR(err, "Launch kernel match string error");
+		}
 
-		printf("openPenalty = %.1f, extensionPenalty = %.1f\n", openPenalty, extensionPenalty);
-		printf("Input sequence size, querySize: %d, subSequenceSize: %d\n", 
-				querySize, subSequenceSize);
+		if (scoreOnly)
+		{
+			//copy the per-work-item maxima back
+			err = clEnqueueReadBuffer(hCmdQueue, maxInfoD, CL_FALSE, 0, scoreThreadNum * sizeof(MAX_INFO),
+									  slot->maxInfo, 0, 0,
+									  slotEvent(slot, SW_D2H, "SWAT Max Info Copy", &strTime.copyTimeDeviceToHost));
+			CHECK_ERR(err, "Read maxInfo buffer error!");
+		}
+		else
+		{
+			err  = clSetKernelArg(hTraceBackKernel, 0, sizeof(cl_mem), (void *)&pathFlagD);
+			err |= clSetKernelArg(hTraceBackKernel, 1, sizeof(cl_mem), (void *)&extFlagD);
+			err |= clSetKernelArg(hTraceBackKernel, 2, sizeof(cl_mem), (void *)&slot->diffPosD);
+			err |= clSetKernelArg(hTraceBackKernel, 3, sizeof(cl_mem), (void *)&slot->seq1D);
+			err |= clSetKernelArg(hTraceBackKernel, 4, sizeof(cl_mem), (void *)&slot->seq2D);	
+			err |= clSetKernelArg(hTraceBackKernel, 5, sizeof(cl_mem), (void *)&outSeq1D);
+			err |= clSetKernelArg(hTraceBackKernel, 6, sizeof(cl_mem), (void *)&outSeq2D);	
+			err |= clSetKernelArg(hTraceBackKernel, 7, sizeof(cl_mem), (void *)&maxInfoD);
+			err |= clSetKernelArg(hTraceBackKernel, 8, sizeof(int), (void *)&maxInfoNum);
+			
+			size_t tbGlobalSize[1] = {1};
+			size_t tbLocalSize[1]  = {1};
+			err = clEnqueueNDRangeKernel(hCmdQueue, hTraceBackKernel, 1, NULL, tbGlobalSize,
+										 tbLocalSize, 0, NULL,
+										 slotEvent(slot, SW_KERNEL, "SWAT Kernels", &strTime.traceBackTime));
+			CHECK_ERR(err, "Launch kernel trace back error");
+
+			//copy matrix score structure back
+			err = clEnqueueReadBuffer(hCmdQueue, maxInfoD, CL_FALSE, 0, sizeof(MAX_INFO),
+									  slot->maxInfo, 0, 0,
+									  slotEvent(slot, SW_D2H, "SWAT Max Info Copy", &strTime.copyTimeDeviceToHost));
+			CHECK_ERR(err, "Read maxInfo buffer error!");
+
+			int maxOutputLen = rowNum + columnNum - 2;
+			err  = clEnqueueReadBuffer(hCmdQueue, outSeq1D, CL_FALSE, 0, maxOutputLen * sizeof(cl_char),
+									   slot->outSeq1, 0, 0,
+									   slotEvent(slot, SW_D2H, "SWAT Sequence Copy", &strTime.copyTimeDeviceToHost));
+			err |= clEnqueueReadBuffer(hCmdQueue, outSeq2D, CL_FALSE, 0, maxOutputLen * sizeof(cl_char),
+									   slot->outSeq2, 0, 0,
+									   slotEvent(slot, SW_D2H, "SWAT Sequence Copy", &strTime.copyTimeDeviceToHost));
+			CHECK_ERR(err, "Read output sequence error!");
+		}
+		clFlush(hCmdQueue);
+		slot->busy = 1;
+	}
 
-		printf("Max position, seq1 = %d, seq2 = %d\n", maxInfo->nposi, maxInfo->nposj);
+	//drain the pipeline, oldest pair first
+	for (int k = 0; k < SLOT_NUM; k++)
+	{
+		retireSlot(&slots[(subSequenceNo + k) % SLOT_NUM], querySize,
+				   openPenalty, extensionPenalty, scoreNum);
 	}
+	gettimeofday(&t2, NULL);
+
 	tmpTime = 1000.0 * (t2.tv_sec - t1.tv_sec) + (t2.tv_usec - t1.tv_usec) / 1000.0;
 	pfile = fopen("../kernelTime.txt", "at");
 	fprintf(pfile, "verOpencl4:\t%.3f\n", tmpTime);
@@ -604,39 +1036,69 @@ int main(int argc, char ** argv)
 	printTime_toStandardOutput();
 	printTime_toFile();
 
-	fclose(pDBLenFile);
-	fclose(pDBDataFile);
+	if (hits)
+	{
+		delete[] hits;
+		freeDatabase(&db);
+	}
+	else
+	{
+		fclose(pDBLenFile);
+		fclose(pDBDataFile);
+	}
 
 	clReleaseKernel(hMatchStringKernel);
 	clReleaseKernel(hTraceBackKernel);
 	clReleaseKernel(hSetZeroKernel);
+	if (hTileKernel)
+	{
+		clReleaseKernel(hTileKernel);
+	}
+	if (hScoreKernel)
+	{
+		clReleaseKernel(hScoreKernel);
+	}
 
-	delete allSequences;
-	clReleaseMemObject(seq1D);
-	clReleaseMemObject(seq2D);
-
-	delete outSeq1;
-	delete outSeq2;
+	delete querySequence;
 	clReleaseMemObject(outSeq1D);
 	clReleaseMemObject(outSeq2D);
 
-	delete threadNum;
-	clReleaseMemObject(threadNumD);
-	delete diffPos;
-	clReleaseMemObject(diffPosD);
-
-	delete pathFlag;
-	delete extFlag;
-	delete nGapDist;
-	delete hGapDist;
-	delete vGapDist;
-	clReleaseMemObject(pathFlagD);
-	clReleaseMemObject(extFlagD);
-	clReleaseMemObject(nGapDistD);
-	clReleaseMemObject(hGapDistD);
-	clReleaseMemObject(vGapDistD);
-
-	delete maxInfo;
+	for (int k = 0; k < SLOT_NUM; k++)
+	{
+		SW_SLOT *slot = &slots[k];
+		delete[] slot->subSequence;
+		delete[] slot->outSeq1;
+		delete[] slot->outSeq2;
+		delete[] slot->threadNum;
+		delete[] slot->diffPos;
+		delete[] slot->diagStart;
+		delete[] slot->maxInfo;
+		delete[] slot->events;
+		clReleaseMemObject(slot->seq1D);
+		clReleaseMemObject(slot->seq2D);
+		clReleaseMemObject(slot->threadNumD);
+		clReleaseMemObject(slot->diffPosD);
+		clReleaseMemObject(slot->diagStartD);
+	}
+
+	if (scoreOnly)
+	{
+		clReleaseMemObject(diagDistD);
+	}
+	else
+	{
+		delete pathFlag;
+		delete extFlag;
+		delete nGapDist;
+		delete hGapDist;
+		delete vGapDist;
+		clReleaseMemObject(pathFlagD);
+		clReleaseMemObject(extFlagD);
+		clReleaseMemObject(nGapDistD);
+		clReleaseMemObject(hGapDistD);
+		clReleaseMemObject(vGapDistD);
+	}
+
 	clReleaseMemObject(maxInfoD);
 
 	free(cSourceCL);
@@ -645,6 +1107,7 @@ int main(int argc, char ** argv)
 	clReleaseMemObject(mutexMem);
 
 	clReleaseProgram(hProgram);
+	clReleaseCommandQueue(hCopyQueue);
 	clReleaseCommandQueue(hCmdQueue);
 	clReleaseContext(hContext);
 	ocd_finalize();
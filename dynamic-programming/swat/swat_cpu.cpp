@@ -0,0 +1,513 @@
+#include <math.h>
+#include "global.h"
+#include "functions.h"
+
+/*************************************************************
+ Host engines for the database search score (-e), the CPU baseline
+ and fallback of the OpenCL version:
+
+	scalar	 Gotoh in floats, the same arithmetic as the kernel
+	striped	 Farrar's striped layout: the query is split across SIMD
+			 lanes, first in 8-bit unsigned saturating scores, then
+			 in 16-bit when a score reaches the top of that range
+	inter	 one database sequence per 16-bit lane, each lane moving
+			 on to the next sequence when its own one ends (Rognes)
+
+ The SIMD engines work on integers, so the scores and penalties are
+ scaled by the smallest factor that makes them whole. A sequence
+ whose score saturates 16 bits is aligned again by the scalar engine.
+ SSE2 is used, or AVX2 when the compiler targets it.
+**************************************************************/
+
+#define SW_ALPHABET 23
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+typedef __m256i sw_vec;
+#define SW_VEC_BYTES 32
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+typedef __m128i sw_vec;
+#define SW_VEC_BYTES 16
+#endif
+
+static const char *swEngines[] = {"scalar", "striped", "inter"};
+
+int swEngine(const char *name)
+{
+	for (int e = 0; e < 3; e++)
+	{
+		if (strcmp(name, swEngines[e]) == 0)
+		{
+			return e;
+		}
+	}
+	return -1;
+}
+
+//local alignment score, one row of H and E in floats
+float swScoreScalar(char *seq1, int len1, char *seq2, int len2,
+					float openPenalty, float extensionPenalty)
+{
+	float *h = new float[len2 + 1];
+	float *e = new float[len2 + 1];
+	float maxScore = 0.0f;
+	int i, j;
+
+	for (j = 0; j <= len2; j++)
+	{
+		h[j] = e[j] = 0.0f;
+	}
+
+	for (i = 1; i <= len1; i++)
+	{
+		float *row = blosum62[(int)seq1[i - 1]];
+		float diag = 0.0f, f = 0.0f, hleft = 0.0f;
+		for (j = 1; j <= len2; j++)
+		{
+			float hcur, gap;
+			gap = h[j] - openPenalty;
+			e[j] = e[j] - extensionPenalty > gap ? e[j] - extensionPenalty : gap;
+			gap = hleft - openPenalty;
+			f = f - extensionPenalty > gap ? f - extensionPenalty : gap;
+			hcur = diag + row[(int)seq2[j - 1]];
+			hcur = hcur > 0.0f ? hcur : 0.0f;
+			hcur = hcur > e[j] ? hcur : e[j];
+			hcur = hcur > f ? hcur : f;
+			diag = h[j];
+			h[j] = hleft = hcur;
+			maxScore = hcur > maxScore ? hcur : maxScore;
+		}
+	}
+
+	delete[] h;
+	delete[] e;
+	return maxScore;
+}
+
+#ifdef SW_VEC_BYTES
+
+//integer scoring: every score and penalty times scale
+typedef struct {
+	int scale, open, ext, bias;
+	short sub[SW_ALPHABET][SW_ALPHABET];
+} SW_INT_SCORING;
+
+static int swIntScoring(float openPenalty, float extensionPenalty, SW_INT_SCORING *s)
+{
+	for (int scale = 1; scale <= 16; scale++)
+	{
+		float o = openPenalty * scale, x = extensionPenalty * scale;
+		if (fabsf(o - rintf(o)) > 1e-4f || fabsf(x - rintf(x)) > 1e-4f ||
+			o < 0.0f || x < 0.0f || o > 127.0f)
+		{
+			continue;
+		}
+
+		s->scale = scale;
+		s->open = (int)rintf(o);
+		s->ext = (int)rintf(x);
+		s->bias = 0;
+		for (int r = 0; r < SW_ALPHABET; r++)
+		{
+			for (int c = 0; c < SW_ALPHABET; c++)
+			{
+				s->sub[r][c] = (short)rintf(blosum62[r][c] * scale);
+				if (-s->sub[r][c] > s->bias)
+				{
+					s->bias = -s->sub[r][c];
+				}
+			}
+		}
+		return 1;
+	}
+	return 0;
+}
+
+//saturating operations on 8-bit unsigned and 16-bit signed lanes,
+//the latter kept non-negative so both behave alike
+struct sw_u8 {
+	typedef unsigned char elem;
+	enum { lanes = SW_VEC_BYTES, limit = 255 };
+#if defined(__AVX2__)
+	static sw_vec set(int x) { return _mm256_set1_epi8((char)x); }
+	static sw_vec adds(sw_vec a, sw_vec b) { return _mm256_adds_epu8(a, b); }
+	static sw_vec subs(sw_vec a, sw_vec b) { return _mm256_subs_epu8(a, b); }
+	static sw_vec max(sw_vec a, sw_vec b) { return _mm256_max_epu8(a, b); }
+	static bool anyGreater(sw_vec a, sw_vec b)
+	{
+		return _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_subs_epu8(a, b),
+								   _mm256_setzero_si256())) != -1;
+	}
+	static sw_vec shift(sw_vec a)
+	{
+		return _mm256_alignr_epi8(a, _mm256_permute2x128_si256(a, a, 0x08), 15);
+	}
+#else
+	static sw_vec set(int x) { return _mm_set1_epi8((char)x); }
+	static sw_vec adds(sw_vec a, sw_vec b) { return _mm_adds_epu8(a, b); }
+	static sw_vec subs(sw_vec a, sw_vec b) { return _mm_subs_epu8(a, b); }
+	static sw_vec max(sw_vec a, sw_vec b) { return _mm_max_epu8(a, b); }
+	static bool anyGreater(sw_vec a, sw_vec b)
+	{
+		return _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_subs_epu8(a, b),
+								 _mm_setzero_si128())) != 0xffff;
+	}
+	static sw_vec shift(sw_vec a) { return _mm_slli_si128(a, 1); }
+#endif
+};
+
+struct sw_s16 {
+	typedef short elem;
+	enum { lanes = SW_VEC_BYTES / 2, limit = 32767 };
+#if defined(__AVX2__)
+	static sw_vec set(int x) { return _mm256_set1_epi16((short)x); }
+	static sw_vec adds(sw_vec a, sw_vec b) { return _mm256_adds_epi16(a, b); }
+	static sw_vec subs(sw_vec a, sw_vec b)
+	{
+		return _mm256_max_epi16(_mm256_subs_epi16(a, b), _mm256_setzero_si256());
+	}
+	static sw_vec max(sw_vec a, sw_vec b) { return _mm256_max_epi16(a, b); }
+	static bool anyGreater(sw_vec a, sw_vec b)
+	{
+		return _mm256_movemask_epi8(_mm256_cmpgt_epi16(a, b)) != 0;
+	}
+	static sw_vec shift(sw_vec a)
+	{
+		return _mm256_alignr_epi8(a, _mm256_permute2x128_si256(a, a, 0x08), 14);
+	}
+#else
+	static sw_vec set(int x) { return _mm_set1_epi16((short)x); }
+	static sw_vec adds(sw_vec a, sw_vec b) { return _mm_adds_epi16(a, b); }
+	static sw_vec subs(sw_vec a, sw_vec b)
+	{
+		return _mm_max_epi16(_mm_subs_epi16(a, b), _mm_setzero_si128());
+	}
+	static sw_vec max(sw_vec a, sw_vec b) { return _mm_max_epi16(a, b); }
+	static bool anyGreater(sw_vec a, sw_vec b)
+	{
+		return _mm_movemask_epi8(_mm_cmpgt_epi16(a, b)) != 0;
+	}
+	static sw_vec shift(sw_vec a) { return _mm_slli_si128(a, 2); }
+#endif
+};
+
+static sw_vec *swAlloc(size_t n)
+{
+	void *p;
+	if (posix_memalign(&p, sizeof(sw_vec), n * sizeof(sw_vec)) != 0)
+	{
+		printf("Allocate SIMD buffer error!\n");
+		exit(1);
+	}
+	memset(p, 0, n * sizeof(sw_vec));
+	return (sw_vec *)p;
+}
+
+//striped query profile: residue p of the query is lane p / segLen
+//of segment p % segLen, scores biased to be non-negative
+template <class T>
+static sw_vec *swStripedProfile(char *query, int querySize, SW_INT_SCORING *s)
+{
+	int segLen = (querySize + T::lanes - 1) / T::lanes;
+	sw_vec *profile = swAlloc((size_t)SW_ALPHABET * segLen);
+
+	for (int r = 0; r < SW_ALPHABET; r++)
+	{
+		for (int seg = 0; seg < segLen; seg++)
+		{
+			typename T::elem *lane = (typename T::elem *)&profile[r * segLen + seg];
+			for (int k = 0; k < T::lanes; k++)
+			{
+				int p = seg + k * segLen;
+				lane[k] = (typename T::elem)(s->bias +
+						  (p < querySize ? s->sub[(int)query[p]][r] : 0));
+			}
+		}
+	}
+	return profile;
+}
+
+//Farrar's striped Smith-Waterman, returns -1 when the score saturates
+template <class T>
+static int swStriped(sw_vec *profile, int querySize, char *dbSeq, int dbSize,
+					 SW_INT_SCORING *s)
+{
+	int segLen = (querySize + T::lanes - 1) / T::lanes;
+	sw_vec *hStore = swAlloc(segLen), *hLoad = swAlloc(segLen), *e = swAlloc(segLen);
+	sw_vec vBias = T::set(s->bias), vOpen = T::set(s->open), vExt = T::set(s->ext);
+	sw_vec vZero = T::set(0), vMax = vZero, vH, vF, vE, *tmp;
+	int i, j, maxScore = 0;
+
+	for (j = 0; j < dbSize; j++)
+	{
+		sw_vec *vP = profile + dbSeq[j] * segLen;
+
+		vF = vZero;
+		vH = T::shift(hStore[segLen - 1]);
+		tmp = hLoad;
+		hLoad = hStore;
+		hStore = tmp;
+
+		for (i = 0; i < segLen; i++)
+		{
+			vH = T::subs(T::adds(vH, vP[i]), vBias);
+			vE = e[i];
+			vH = T::max(T::max(vH, vE), vF);
+			vMax = T::max(vMax, vH);
+			hStore[i] = vH;
+
+			vH = T::subs(vH, vOpen);
+			e[i] = T::max(T::subs(vE, vExt), vH);
+			vF = T::max(T::subs(vF, vExt), vH);
+			vH = hLoad[i];
+		}
+
+		//lazy F: vertical gaps crossing from one lane into the next
+		vF = T::shift(vF);
+		i = 0;
+		while (T::anyGreater(vF, T::subs(hStore[i], vOpen)))
+		{
+			hStore[i] = T::max(hStore[i], vF);
+			e[i] = T::max(e[i], T::subs(hStore[i], vOpen));
+			vF = T::subs(vF, vExt);
+			if (++i == segLen)
+			{
+				i = 0;
+				vF = T::shift(vF);
+			}
+		}
+	}
+
+	typename T::elem lane[T::lanes];
+	memcpy(lane, &vMax, sizeof(vMax));
+	for (i = 0; i < T::lanes; i++)
+	{
+		maxScore = lane[i] > maxScore ? lane[i] : maxScore;
+	}
+	free(hStore);
+	free(hLoad);
+	free(e);
+
+	return maxScore + s->bias >= T::limit ? -1 : maxScore;
+}
+
+//Rognes' inter-sequence layout: lane k walks its own database sequence,
+//the query runs down the rows shared by all lanes
+static void swInter(char *query, int querySize, char **dbSeqs, int *dbSizes, int dbNum,
+					SW_INT_SCORING *s, float *scores)
+{
+	typedef sw_s16 T;
+	sw_vec *h = swAlloc(querySize), *e = swAlloc(querySize);
+	sw_vec *column = swAlloc(SW_ALPHABET);
+	sw_vec vOpen = T::set(s->open), vExt = T::set(s->ext), vZero = T::set(0), vMax = vZero;
+	short reset[T::lanes] __attribute__((aligned(32)));
+	int seqNo[T::lanes], pos[T::lanes];
+	int next = 0, active = 0, k, i, r;
+
+	for (k = 0; k < T::lanes; k++)
+	{
+		seqNo[k] = next < dbNum ? next++ : -1;
+		pos[k] = 0;
+		active += seqNo[k] >= 0;
+	}
+
+	while (active > 0)
+	{
+		//scores of every residue against the current residue of each lane
+		for (k = 0; k < T::lanes; k++)
+		{
+			int c = seqNo[k] >= 0 ? dbSeqs[seqNo[k]][pos[k]] : 0;
+			for (r = 0; r < SW_ALPHABET; r++)
+			{
+				((short *)&column[r])[k] = s->sub[r][c];
+			}
+		}
+
+		sw_vec vDiag = vZero, vF = vZero, vH;
+		for (i = 0; i < querySize; i++)
+		{
+			vH = T::adds(vDiag, column[(int)query[i]]);
+			vH = T::max(T::max(vH, vZero), T::max(e[i], vF));
+			vMax = T::max(vMax, vH);
+			vDiag = h[i];
+			h[i] = vH;
+
+			vH = T::subs(vH, vOpen);
+			e[i] = T::max(T::subs(e[i], vExt), vH);
+			vF = T::max(T::subs(vF, vExt), vH);
+		}
+
+		//lanes whose sequence ended take the next one
+		short laneMax[T::lanes];
+		int anyReset = 0;
+		memcpy(laneMax, &vMax, sizeof(vMax));
+		for (k = 0; k < T::lanes; k++)
+		{
+			reset[k] = 0;
+			if (seqNo[k] < 0 || ++pos[k] < dbSizes[seqNo[k]])
+			{
+				continue;
+			}
+
+			short score = laneMax[k];
+			scores[seqNo[k]] = score >= T::limit - s->bias ? -1.0f : (float)score / s->scale;
+			seqNo[k] = next < dbNum ? next++ : -1;
+			pos[k] = 0;
+			active -= seqNo[k] < 0;
+			reset[k] = -1;
+			anyReset = 1;
+		}
+		if (anyReset)
+		{
+			sw_vec vKeep = *(sw_vec *)reset;
+#if defined(__AVX2__)
+			vMax = _mm256_andnot_si256(vKeep, vMax);
+			for (i = 0; i < querySize; i++)
+			{
+				h[i] = _mm256_andnot_si256(vKeep, h[i]);
+				e[i] = _mm256_andnot_si256(vKeep, e[i]);
+			}
+#else
+			vMax = _mm_andnot_si128(vKeep, vMax);
+			for (i = 0; i < querySize; i++)
+			{
+				h[i] = _mm_andnot_si128(vKeep, h[i]);
+				e[i] = _mm_andnot_si128(vKeep, e[i]);
+			}
+#endif
+		}
+	}
+
+	free(h);
+	free(e);
+	free(column);
+}
+
+#endif
+
+//scores of the query against every database sequence
+void swScores(int engine, char *query, int querySize, char **dbSeqs, int *dbSizes,
+			  int dbNum, float openPenalty, float extensionPenalty, float *scores)
+{
+	int i;
+
+	for (i = 0; i < dbNum; i++)
+	{
+		scores[i] = -1.0f;
+	}
+
+#ifdef SW_VEC_BYTES
+	SW_INT_SCORING s;
+	if (engine != 0 && swIntScoring(openPenalty, extensionPenalty, &s))
+	{
+		if (engine == 1)
+		{
+			sw_vec *profile8 = swStripedProfile<sw_u8>(query, querySize, &s);
+			sw_vec *profile16 = NULL;
+			for (i = 0; i < dbNum; i++)
+			{
+				int score = s.bias + s.open <= 255 ?
+							swStriped<sw_u8>(profile8, querySize, dbSeqs[i], dbSizes[i], &s) : -1;
+				if (score < 0)
+				{
+					if (profile16 == NULL)
+					{
+						profile16 = swStripedProfile<sw_s16>(query, querySize, &s);
+					}
+					score = swStriped<sw_s16>(profile16, querySize, dbSeqs[i], dbSizes[i], &s);
+				}
+				if (score >= 0)
+				{
+					scores[i] = (float)score / s.scale;
+				}
+			}
+			free(profile8);
+			free(profile16);
+		}
+		else
+		{
+			swInter(query, querySize, dbSeqs, dbSizes, dbNum, &s, scores);
+		}
+	}
+#endif
+
+	//the scalar engine, and the scores that saturated
+	for (i = 0; i < dbNum; i++)
+	{
+		if (scores[i] < 0.0f)
+		{
+			scores[i] = swScoreScalar(query, querySize, dbSeqs[i], dbSizes[i],
+									  openPenalty, extensionPenalty);
+		}
+	}
+}
+
+//search the whole database on the host with the given engine, printing
+//every score, or the topK best ones when topK > 0
+int swatCPU(int engine, char *queryFilePathName, SW_DATABASE *db, int topK,
+			float openPenalty, float extensionPenalty)
+{
+	char *querySequence, **dbSeqs;
+	int querySize, i;
+	long long cells;
+	float *scores;
+	struct timeval t1, t2;
+
+	querySequence = new char[2 * MAX_LEN];
+	querySize = readQuerySequence(queryFilePathName, querySequence);
+	if (querySize <= 0 || querySize > MAX_LEN)
+	{
+		printf("Query size %d is out of range (0, %d)\n", querySize, MAX_LEN);
+		return 1;
+	}
+	encoding(querySequence, querySize);
+
+	dbSeqs = new char *[db->seqNum];
+	for (i = 0; i < db->seqNum; i++)
+	{
+		dbSeqs[i] = db->residues + db->offsets[i];
+	}
+	cells = (long long)querySize * db->totalSize;
+
+	scores = new float[db->seqNum];
+	gettimeofday(&t1, NULL);
+	swScores(engine, querySequence, querySize, dbSeqs, db->sizes, db->seqNum,
+			 openPenalty, extensionPenalty, scores);
+	gettimeofday(&t2, NULL);
+
+	if (topK > 0)
+	{
+		SW_HIT *hits = new SW_HIT[topK];
+		int hitNum = topHits(scores, db->seqNum, topK, hits);
+		for (i = 0; i < hitNum; i++)
+		{
+			int seqNo = hits[i].seqNo;
+			printf("Hit %d: sequence %d %s, size %d, score %.1f\n", i, seqNo,
+					db->names && db->names[seqNo] ? db->names[seqNo] : "",
+					db->sizes[seqNo], hits[i].score);
+		}
+		delete[] hits;
+	}
+	else
+	{
+		for (i = 0; i < db->seqNum; i++)
+		{
+			printf("============================================================\n");
+			printf("Sequence pair %d:\n", i);
+			printf("Max alignment score (on host) is %.1f\n", scores[i]);
+			printf("Input sequence size, querySize: %d, subSequenceSize: %d\n",
+					querySize, db->sizes[i]);
+		}
+	}
+
+	double ms = 1000.0 * (t2.tv_sec - t1.tv_sec) + (t2.tv_usec - t1.tv_usec) / 1000.0;
+	printf("openPenalty = %.1f, extensionPenalty = %.1f\n", openPenalty, extensionPenalty);
+	printf("%d sequences, %lld cells in %.3f ms with the %s engine: %.3f GCUPS\n",
+			db->seqNum, cells, ms, swEngines[engine], cells / ms * 1e-6);
+
+	delete[] scores;
+	delete[] dbSeqs;
+	delete[] querySequence;
+	return 0;
+}
@@ -360,11 +360,18 @@ cl_device_id GetDevice(int platform, int device, cl_int dev_type)
 }
 
 cl_program ocdBuildProgramFromFile(cl_context context,cl_device_id device_id,const char* kernel_file_name)
+{
+	return ocdBuildProgramFromFileWithOptions(context,device_id,kernel_file_name,NULL);
+}
+
+/* Same as ocdBuildProgramFromFile(), but appends 'options' (e.g. -D specialisations) to the build flags */
+cl_program ocdBuildProgramFromFileWithOptions(cl_context context,cl_device_id device_id,const char* kernel_file_name,const char* options)
 {
 	cl_int err;
 	cl_program program;
 	size_t kernelLength;
 	char* kernelSource;
+	char* buildOptions;
 	FILE* kernel_fp;
 	size_t items_read;
 
@@ -375,14 +382,14 @@ cl_program ocdBuildProgramFromFile(cl_context context,cl_device_id device_id,con
 	#endif
 
 	kernel_fp = fopen(kernel_file_name, kernel_file_mode);
-	check(kernel_fp != NULL,"common_ocl.ocdBuildProgramFromFile() - Cannot open kernel file!");
+	check(kernel_fp != NULL,"common_ocl.ocdBuildProgramFromFileWithOptions() - Cannot open kernel file!");
 	fseek(kernel_fp, 0, SEEK_END);
 	kernelLength = (size_t) ftell(kernel_fp);
 	kernelSource = malloc(sizeof(char)*kernelLength);
-	check(kernelSource != NULL,"common_ocl.ocdBuildProgramFromFile() - Heap Overflow! Cannot allocate space for kernelSource.");
+	check(kernelSource != NULL,"common_ocl.ocdBuildProgramFromFileWithOptions() - Heap Overflow! Cannot allocate space for kernelSource.");
 	rewind(kernel_fp);
 	items_read = fread((void *) kernelSource, kernelLength, 1, kernel_fp);
-	check(items_read == 1,"common_ocl.ocdBuildProgramFromFile() - Error reading from kernelFile");
+	check(items_read == 1,"common_ocl.ocdBuildProgramFromFileWithOptions() - Error reading from kernelFile");
 	fclose(kernel_fp);
 
 	/* Create the compute program from the source buffer */
@@ -391,27 +398,32 @@ cl_program ocdBuildProgramFromFile(cl_context context,cl_device_id device_id,con
 	#else //CPU or GPU
 		program = clCreateProgramWithSource(context, 1, (const char **) &kernelSource, &kernelLength, &err);
 	#endif
-	CHKERR(err, "common_ocl.ocdBuildProgramFromFile() - Failed to create a compute program!");
+	CHKERR(err, "common_ocl.ocdBuildProgramFromFileWithOptions() - Failed to create a compute program!");
+
+	buildOptions = malloc(sizeof(char)*(strlen("-DOPENCL -I. ") + (options ? strlen(options) : 0) + 1));
+	check(buildOptions != NULL,"common_ocl.ocdBuildProgramFromFileWithOptions() - Heap Overflow! Cannot allocate space for buildOptions.");
+	sprintf(buildOptions,"-DOPENCL -I. %s",options ? options : "");
 
 	/* Build the program executable */
 	#ifdef USE_AFPGA //use Altera FPGA
-		err = clBuildProgram(program,1,&device_id,"-DOPENCL -I.",NULL,NULL);
+		err = clBuildProgram(program,1,&device_id,buildOptions,NULL,NULL);
 	#else
-		err = clBuildProgram(program, 0, NULL, "-DOPENCL -I.", NULL, NULL);
+		err = clBuildProgram(program, 0, NULL, buildOptions, NULL, NULL);
 	#endif
+	free(buildOptions);
 	if (err == CL_BUILD_PROGRAM_FAILURE)
 	{
 		char *buildLog;
 		size_t logLen;
 		err = clGetProgramBuildInfo(program, device_id, CL_PROGRAM_BUILD_LOG, 0, NULL, &logLen);
 		buildLog = (char *) malloc(sizeof(char)*logLen);
-		check(buildLog != NULL,"common_ocl.ocdBuildProgramFromFile() - Heap Overflow! Cannot allocate space for buildLog.");
+		check(buildLog != NULL,"common_ocl.ocdBuildProgramFromFileWithOptions() - Heap Overflow! Cannot allocate space for buildLog.");
 		err = clGetProgramBuildInfo(program, device_id, CL_PROGRAM_BUILD_LOG, logLen, (void *) buildLog, NULL);
 		fprintf(stderr, "CL Error %d: Failed to build program! Log:\n%s", err, buildLog);
 		free(buildLog);
 		exit(1);
 	}
-	CHKERR(err,"common_ocl.ocdBuildProgramFromFile() - Failed to build program!");
+	CHKERR(err,"common_ocl.ocdBuildProgramFromFileWithOptions() - Failed to build program!");
 
 	free(kernelSource); /* Free kernel source */
 	return program;
@@ -55,10 +55,14 @@ void
 runTest( int argc, char** argv) 
 {
     int rows, cols, size_I, size_R, niter = 10, iter;
-    float *I, *J, lambda, q0sqr, sum, sum2, tmp, meanROI,varROI ;
-    int i, j, k;
+    float *I, *J, lambda;
+    int k;
+#if defined(CPU) || defined(OUTPUT)
+	int i, j;
+#endif
 
 #ifdef CPU
+	float q0sqr, sum, sum2, tmp, meanROI, varROI;
 	float Jc, G2, L, num, den, qsqr;
 	int *iN,*iS,*jE,*jW;// k;
 	float *dN,*dS,*dW,*dE;
@@ -71,14 +75,28 @@ runTest( int argc, char** argv)
     cl_context clContext;
     cl_command_queue clCommands;
     cl_program clProgram;
+#ifdef FUSED
+    cl_kernel clKernel_fused;
+#else
     cl_kernel clKernel_srad1;
     cl_kernel clKernel_srad2;
+#endif
+    cl_kernel clKernel_roiSum;
+    cl_kernel clKernel_roiQ0sqr;
 
     cl_int errcode;
 
 	cl_mem J_cuda;
+#ifdef FUSED
+	cl_mem Jn_cuda, J_swap;
+	int steps;
+#else
     cl_mem C_cuda;
 	cl_mem E_C, W_C, N_C, S_C;
+#endif
+	cl_mem partial_cuda, q0sqr_cuda;
+	int roi_r1, roi_r2, roi_c1, roi_c2, roi_groups;
+	size_t roiLocalSize, roiGlobalSize;
 
     FILE *kernelFile;
     char *kernelSource;
@@ -113,7 +131,7 @@ errcode = clGetDeviceInfo(clDevice, CL_DEVICE_MAX_WORK_ITEM_SIZES,sizeof(size_t)
 
     free(kernelSource);
 	char arg[50];
-	sprintf(arg,"-D BLOCK_SIZE=%d",BLOCK_SIZE);
+	sprintf(arg,"-D BLOCK_SIZE=%d -D FUSED_STEPS=%d",BLOCK_SIZE,FUSED_STEPS);
     errcode = clBuildProgram(clProgram, 1, &clDevice, arg, NULL, NULL);
     if (errcode == CL_BUILD_PROGRAM_FAILURE)
     {
@@ -128,10 +146,19 @@ errcode = clGetDeviceInfo(clDevice, CL_DEVICE_MAX_WORK_ITEM_SIZES,sizeof(size_t)
     }
     CHECKERR(errcode);
 
+#ifdef FUSED
+    clKernel_fused = clCreateKernel(clProgram, "srad_fused", &errcode);
+    CHECKERR(errcode);
+#else
     clKernel_srad1 = clCreateKernel(clProgram, "srad_cuda_1", &errcode);
     CHECKERR(errcode);
     clKernel_srad2 = clCreateKernel(clProgram, "srad_cuda_2", &errcode);
     CHECKERR(errcode);
+#endif
+    clKernel_roiSum = clCreateKernel(clProgram, "srad_roi_sum", &errcode);
+    CHECKERR(errcode);
+    clKernel_roiQ0sqr = clCreateKernel(clProgram, "srad_roi_q0sqr", &errcode);
+    CHECKERR(errcode);
 
 #endif
 
@@ -203,6 +230,12 @@ errcode = clGetDeviceInfo(clDevice, CL_DEVICE_MAX_WORK_ITEM_SIZES,sizeof(size_t)
 	//Allocate device memory
     J_cuda = clCreateBuffer(clContext, CL_MEM_READ_WRITE, sizeof(float)*size_I, NULL, &errcode);
     CHECKERR(errcode);
+#ifdef FUSED
+	//srad_fused reads the halo of neighbouring tiles, so it writes to a
+	//second image that is swapped with J_cuda after every launch
+    Jn_cuda = clCreateBuffer(clContext, CL_MEM_READ_WRITE, sizeof(float)*size_I, NULL, &errcode);
+    CHECKERR(errcode);
+#else
     C_cuda = clCreateBuffer(clContext, CL_MEM_READ_WRITE, sizeof(float)*size_I, NULL, &errcode);
     CHECKERR(errcode);
     E_C = clCreateBuffer(clContext, CL_MEM_READ_WRITE, sizeof(float)*size_I, NULL, &errcode);
@@ -213,6 +246,20 @@ errcode = clGetDeviceInfo(clDevice, CL_DEVICE_MAX_WORK_ITEM_SIZES,sizeof(size_t)
     CHECKERR(errcode);
     N_C = clCreateBuffer(clContext, CL_MEM_READ_WRITE, sizeof(float)*size_I, NULL, &errcode);
     CHECKERR(errcode);
+#endif
+
+	//The ROI statistics are reduced on the device: srad_roi_sum leaves one
+	//sum/sum2 pair per work-group and srad_roi_q0sqr folds them into q0sqr
+	roiLocalSize = BLOCK_SIZE*BLOCK_SIZE;
+	roi_groups = (size_R + roiLocalSize - 1) / roiLocalSize;
+	if (roi_groups > ROI_GROUPS)
+		roi_groups = ROI_GROUPS;
+	roiGlobalSize = roi_groups*roiLocalSize;
+	roi_r1 = r1; roi_r2 = r2; roi_c1 = c1; roi_c2 = c2;
+    partial_cuda = clCreateBuffer(clContext, CL_MEM_READ_WRITE, sizeof(float)*2*roi_groups, NULL, &errcode);
+    CHECKERR(errcode);
+    q0sqr_cuda = clCreateBuffer(clContext, CL_MEM_READ_WRITE, sizeof(float), NULL, &errcode);
+    CHECKERR(errcode);
 
 	
 #endif 
@@ -224,8 +271,75 @@ errcode = clGetDeviceInfo(clDevice, CL_DEVICE_MAX_WORK_ITEM_SIZES,sizeof(size_t)
     for (k = 0;  k < size_I; k++ ) {
      	J[k] = (float)exp(I[k]) ;
     }
+#ifdef GPU
+
+	//Currently the input size must be divided by 16 - the block size
+	int block_x = cols/BLOCK_SIZE ;
+    int block_y = rows/BLOCK_SIZE ;
+
+    size_t localWorkSize[2] = {BLOCK_SIZE, BLOCK_SIZE};
+    size_t globalWorkSize[2] = {block_x*localWorkSize[0], block_y*localWorkSize[1]};
+
+
+	//Copy data from main memory to device memory; J stays resident on the
+	//device for all iterations and is read back once after the loop
+	errcode = clEnqueueWriteBuffer(clCommands, J_cuda, CL_TRUE, 0, sizeof(float)*size_I, (void *) J, 0, NULL, &ocdTempEvent);
+
+        clFinish(clCommands);
+    	START_TIMER(ocdTempEvent, OCD_TIMER_H2D, "SRAD Data Copy", ocdTempTimer)
+	END_TIMER(ocdTempTimer)
+	CHECKERR(errcode);
+
+    errcode = clSetKernelArg(clKernel_roiSum, 0, sizeof(cl_mem), (void *) &J_cuda);
+    errcode |= clSetKernelArg(clKernel_roiSum, 1, sizeof(cl_mem), (void *) &partial_cuda);
+    errcode |= clSetKernelArg(clKernel_roiSum, 2, sizeof(int), (void *) &cols);
+    errcode |= clSetKernelArg(clKernel_roiSum, 3, sizeof(int), (void *) &roi_r1);
+    errcode |= clSetKernelArg(clKernel_roiSum, 4, sizeof(int), (void *) &roi_r2);
+    errcode |= clSetKernelArg(clKernel_roiSum, 5, sizeof(int), (void *) &roi_c1);
+    errcode |= clSetKernelArg(clKernel_roiSum, 6, sizeof(int), (void *) &roi_c2);
+    CHECKERR(errcode);
+    errcode = clSetKernelArg(clKernel_roiQ0sqr, 0, sizeof(cl_mem), (void *) &partial_cuda);
+    errcode |= clSetKernelArg(clKernel_roiQ0sqr, 1, sizeof(cl_mem), (void *) &q0sqr_cuda);
+    errcode |= clSetKernelArg(clKernel_roiQ0sqr, 2, sizeof(int), (void *) &roi_groups);
+    errcode |= clSetKernelArg(clKernel_roiQ0sqr, 3, sizeof(int), (void *) &size_R);
+    CHECKERR(errcode);
+#ifdef FUSED
+    errcode = clSetKernelArg(clKernel_fused, 2, sizeof(int), (void *) &cols);
+    errcode |= clSetKernelArg(clKernel_fused, 3, sizeof(int), (void *) &rows);
+    errcode |= clSetKernelArg(clKernel_fused, 4, sizeof(float), (void *) &lambda);
+    errcode |= clSetKernelArg(clKernel_fused, 5, sizeof(cl_mem), (void *) &q0sqr_cuda);
+    CHECKERR(errcode);
+#else
+    errcode = clSetKernelArg(clKernel_srad1, 0, sizeof(cl_mem), (void *) &E_C);
+    errcode |= clSetKernelArg(clKernel_srad1, 1, sizeof(cl_mem), (void *) &W_C);
+    errcode |= clSetKernelArg(clKernel_srad1, 2, sizeof(cl_mem), (void *) &N_C);
+    errcode |= clSetKernelArg(clKernel_srad1, 3, sizeof(cl_mem), (void *) &S_C);
+    errcode |= clSetKernelArg(clKernel_srad1, 4, sizeof(cl_mem), (void *) &J_cuda);
+    errcode |= clSetKernelArg(clKernel_srad1, 5, sizeof(cl_mem), (void *) &C_cuda);
+    errcode |= clSetKernelArg(clKernel_srad1, 6, sizeof(int), (void *) &cols);
+    errcode |= clSetKernelArg(clKernel_srad1, 7, sizeof(int), (void *) &rows);
+    errcode |= clSetKernelArg(clKernel_srad1, 8, sizeof(cl_mem), (void *) &q0sqr_cuda);
+    CHECKERR(errcode);
+    errcode = clSetKernelArg(clKernel_srad2, 0, sizeof(cl_mem), (void *) &E_C);
+    errcode |= clSetKernelArg(clKernel_srad2, 1, sizeof(cl_mem), (void *) &W_C);
+    errcode |= clSetKernelArg(clKernel_srad2, 2, sizeof(cl_mem), (void *) &N_C);
+    errcode |= clSetKernelArg(clKernel_srad2, 3, sizeof(cl_mem), (void *) &S_C);
+    errcode |= clSetKernelArg(clKernel_srad2, 4, sizeof(cl_mem), (void *) &J_cuda);
+    errcode |= clSetKernelArg(clKernel_srad2, 5, sizeof(cl_mem), (void *) &C_cuda);
+    errcode |= clSetKernelArg(clKernel_srad2, 6, sizeof(int), (void *) &cols);
+    errcode |= clSetKernelArg(clKernel_srad2, 7, sizeof(int), (void *) &rows);
+    errcode |= clSetKernelArg(clKernel_srad2, 8, sizeof(float), (void *) &lambda);
+    errcode |= clSetKernelArg(clKernel_srad2, 9, sizeof(cl_mem), (void *) &q0sqr_cuda);
+    CHECKERR(errcode);
+#endif
+
+#endif
+
 	printf("Start the SRAD main loop\n");
  for (iter=0; iter< niter; iter++){     
+
+#ifdef CPU
+
 		sum=0; sum2=0;
         for (i=r1; i<=r2; i++) {
             for (j=c1; j<=c2; j++) {
@@ -237,8 +351,6 @@ errcode = clGetDeviceInfo(clDevice, CL_DEVICE_MAX_WORK_ITEM_SIZES,sizeof(size_t)
         meanROI = sum / size_R;
         varROI  = (sum2 / size_R) - meanROI*meanROI;
         q0sqr   = varROI / (meanROI*meanROI);
-
-#ifdef CPU
         
 		for (i = 0 ; i < rows ; i++) {
             for (j = 0; j < cols; j++) { 
@@ -295,68 +407,63 @@ errcode = clGetDeviceInfo(clDevice, CL_DEVICE_MAX_WORK_ITEM_SIZES,sizeof(size_t)
 
 #ifdef GPU
 
-	//Currently the input size must be divided by 16 - the block size
-	int block_x = cols/BLOCK_SIZE ;
-    int block_y = rows/BLOCK_SIZE ;
-
-    size_t localWorkSize[2] = {BLOCK_SIZE, BLOCK_SIZE};
-    size_t globalWorkSize[2] = {block_x*localWorkSize[0], block_y*localWorkSize[1]};
-
-
-	//Copy data from main memory to device memory
-	errcode = clEnqueueWriteBuffer(clCommands, J_cuda, CL_TRUE, 0, sizeof(float)*size_I, (void *) J, 0, NULL, &ocdTempEvent);
+#ifdef FUSED
+	//One launch advances up to FUSED_STEPS iterations on the q0sqr of
+	//its first one
+	if (iter % FUSED_STEPS == 0){
+	steps = niter - iter < FUSED_STEPS ? niter - iter : FUSED_STEPS;
+    errcode = clSetKernelArg(clKernel_roiSum, 0, sizeof(cl_mem), (void *) &J_cuda);
+    errcode |= clSetKernelArg(clKernel_fused, 0, sizeof(cl_mem), (void *) &J_cuda);
+    errcode |= clSetKernelArg(clKernel_fused, 1, sizeof(cl_mem), (void *) &Jn_cuda);
+    errcode |= clSetKernelArg(clKernel_fused, 6, sizeof(int), (void *) &steps);
+    CHECKERR(errcode);
+#endif
 
-        clFinish(clCommands);
-    	START_TIMER(ocdTempEvent, OCD_TIMER_H2D, "SRAD Data Copy", ocdTempTimer)
+	//Run kernels
+    errcode = clEnqueueNDRangeKernel(clCommands, clKernel_roiSum, 1, NULL, &roiGlobalSize, &roiLocalSize, 0, NULL, &ocdTempEvent);
+    clFinish(clCommands);
+        START_TIMER(ocdTempEvent, OCD_TIMER_KERNEL, "SRAD Kernels", ocdTempTimer)
 	END_TIMER(ocdTempTimer)
 	CHECKERR(errcode);
-
-	//Run kernels
-    errcode = clSetKernelArg(clKernel_srad1, 0, sizeof(cl_mem), (void *) &E_C);
-    errcode |= clSetKernelArg(clKernel_srad1, 1, sizeof(cl_mem), (void *) &W_C);
-    errcode |= clSetKernelArg(clKernel_srad1, 2, sizeof(cl_mem), (void *) &N_C);
-    errcode |= clSetKernelArg(clKernel_srad1, 3, sizeof(cl_mem), (void *) &S_C);
-    errcode |= clSetKernelArg(clKernel_srad1, 4, sizeof(cl_mem), (void *) &J_cuda);
-    errcode |= clSetKernelArg(clKernel_srad1, 5, sizeof(cl_mem), (void *) &C_cuda);
-    errcode |= clSetKernelArg(clKernel_srad1, 6, sizeof(int), (void *) &cols);
-    errcode |= clSetKernelArg(clKernel_srad1, 7, sizeof(int), (void *) &rows);
-    errcode |= clSetKernelArg(clKernel_srad1, 8, sizeof(float), (void *) &q0sqr);
-    CHECKERR(errcode);
-    errcode = clEnqueueNDRangeKernel(clCommands, clKernel_srad1, 2, NULL, globalWorkSize, localWorkSize, 0, NULL, &ocdTempEvent);
+    errcode = clEnqueueNDRangeKernel(clCommands, clKernel_roiQ0sqr, 1, NULL, &roiLocalSize, &roiLocalSize, 0, NULL, &ocdTempEvent);
     clFinish(clCommands);
         START_TIMER(ocdTempEvent, OCD_TIMER_KERNEL, "SRAD Kernels", ocdTempTimer)
 	END_TIMER(ocdTempTimer)
 	CHECKERR(errcode);
-    errcode = clSetKernelArg(clKernel_srad2, 0, sizeof(cl_mem), (void *) &E_C);
-    errcode |= clSetKernelArg(clKernel_srad2, 1, sizeof(cl_mem), (void *) &W_C);
-    errcode |= clSetKernelArg(clKernel_srad2, 2, sizeof(cl_mem), (void *) &N_C);
-    errcode |= clSetKernelArg(clKernel_srad2, 3, sizeof(cl_mem), (void *) &S_C);
-    errcode |= clSetKernelArg(clKernel_srad2, 4, sizeof(cl_mem), (void *) &J_cuda);
-    errcode |= clSetKernelArg(clKernel_srad2, 5, sizeof(cl_mem), (void *) &C_cuda);
-    errcode |= clSetKernelArg(clKernel_srad2, 6, sizeof(int), (void *) &cols);
-    errcode |= clSetKernelArg(clKernel_srad2, 7, sizeof(int), (void *) &rows);
-    errcode |= clSetKernelArg(clKernel_srad2, 8, sizeof(float), (void *) &lambda);
-    errcode |= clSetKernelArg(clKernel_srad2, 9, sizeof(float), (void *) &q0sqr);
-    CHECKERR(errcode);
-    errcode = clEnqueueNDRangeKernel(clCommands, clKernel_srad2, 2, NULL, globalWorkSize, localWorkSize, 0, NULL, &ocdTempEvent);
+#ifdef FUSED
+    errcode = clEnqueueNDRangeKernel(clCommands, clKernel_fused, 2, NULL, globalWorkSize, localWorkSize, 0, NULL, &ocdTempEvent);
     clFinish(clCommands);
 	START_TIMER(ocdTempEvent, OCD_TIMER_KERNEL, "SRAD Kernels", ocdTempTimer)
     	END_TIMER(ocdTempTimer)
 		CHECKERR(errcode);
-
-	//Copy data from device memory to main memory
-	errcode = clEnqueueReadBuffer(clCommands, J_cuda, CL_TRUE, 0, sizeof(float)*size_I, (void *) J, 0, NULL, &ocdTempEvent);
-        clFinish(clCommands);
-    	START_TIMER(ocdTempEvent, OCD_TIMER_KERNEL, "SRAD Data Copy", ocdTempTimer)
+	J_swap = J_cuda;
+	J_cuda = Jn_cuda;
+	Jn_cuda = J_swap;
+	}
+#else
+    errcode = clEnqueueNDRangeKernel(clCommands, clKernel_srad1, 2, NULL, globalWorkSize, localWorkSize, 0, NULL, &ocdTempEvent);
+    clFinish(clCommands);
+        START_TIMER(ocdTempEvent, OCD_TIMER_KERNEL, "SRAD Kernels", ocdTempTimer)
 	END_TIMER(ocdTempTimer)
 	CHECKERR(errcode);
+    errcode = clEnqueueNDRangeKernel(clCommands, clKernel_srad2, 2, NULL, globalWorkSize, localWorkSize, 0, NULL, &ocdTempEvent);
+    clFinish(clCommands);
+	START_TIMER(ocdTempEvent, OCD_TIMER_KERNEL, "SRAD Kernels", ocdTempTimer)
+    	END_TIMER(ocdTempTimer)
+		CHECKERR(errcode);
+#endif
 
 #endif   
 }
 
 #ifdef GPU
 
-    clFinish(clCommands);
+	//Copy data from device memory to main memory
+	errcode = clEnqueueReadBuffer(clCommands, J_cuda, CL_TRUE, 0, sizeof(float)*size_I, (void *) J, 0, NULL, &ocdTempEvent);
+        clFinish(clCommands);
+    	START_TIMER(ocdTempEvent, OCD_TIMER_D2H, "SRAD Data Copy", ocdTempTimer)
+	END_TIMER(ocdTempTimer)
+	CHECKERR(errcode);
 
 #endif
 
@@ -380,14 +487,26 @@ errcode = clGetDeviceInfo(clDevice, CL_DEVICE_MAX_WORK_ITEM_SIZES,sizeof(size_t)
     free(dN); free(dS); free(dW); free(dE);
 #endif
 #ifdef GPU
-    clReleaseMemObject(C_cuda);
     clReleaseMemObject(J_cuda);
+#ifdef FUSED
+    clReleaseMemObject(Jn_cuda);
+#else
+    clReleaseMemObject(C_cuda);
     clReleaseMemObject(E_C);
     clReleaseMemObject(W_C);
     clReleaseMemObject(N_C);
     clReleaseMemObject(S_C);
+#endif
+    clReleaseMemObject(partial_cuda);
+    clReleaseMemObject(q0sqr_cuda);
+#ifdef FUSED
+    clReleaseKernel(clKernel_fused);
+#else
     clReleaseKernel(clKernel_srad1);
     clReleaseKernel(clKernel_srad2);
+#endif
+    clReleaseKernel(clKernel_roiSum);
+    clReleaseKernel(clKernel_roiQ0sqr);
     clReleaseProgram(clProgram);
     clReleaseCommandQueue(clCommands);
     clReleaseContext(clContext);
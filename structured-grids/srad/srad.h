@@ -1,7 +1,10 @@
 #define STR_SIZE 256
 #define NUM_THREAD 16
+#define ROI_GROUPS 64
 #define CPU
 //#define GPU
+#define FUSED
+#define FUSED_STEPS 1
 #define TIMER
 //#define OUTPUT
 
@@ -1,4 +1,91 @@
 
+//ROI statistics, first pass: every work-group reduces a strided share of
+//the ROI to a partial sum and sum of squares in partial[2 * group].
+//The local size is BLOCK_SIZE * BLOCK_SIZE, a power of two.
+__kernel void
+srad_roi_sum(
+		  __global float * J_cuda,
+		  __global float * partial,
+		  int cols,
+		  int r1,
+		  int r2,
+		  int c1,
+		  int c2
+)
+{
+  int tid = get_local_id(0);
+  int width = c2 - c1 + 1;
+  int size_R = (r2 - r1 + 1) * width;
+  int k;
+  float sum = 0.0f, sum2 = 0.0f, tmp;
+
+  __local float sums[BLOCK_SIZE * BLOCK_SIZE];
+  __local float sums2[BLOCK_SIZE * BLOCK_SIZE];
+
+  for ( k = get_global_id(0); k < size_R; k += get_global_size(0) ){
+    tmp   = J_cuda[(r1 + k / width) * cols + c1 + k % width];
+    sum  += tmp;
+    sum2 += tmp * tmp;
+  }
+  sums[tid]  = sum;
+  sums2[tid] = sum2;
+  barrier(CLK_LOCAL_MEM_FENCE);
+
+  for ( k = get_local_size(0) / 2; k > 0; k /= 2 ){
+    if ( tid < k ){
+      sums[tid]  += sums[tid + k];
+      sums2[tid] += sums2[tid + k];
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+  }
+
+  if ( tid == 0 ){
+    partial[2 * get_group_id(0)]     = sums[0];
+    partial[2 * get_group_id(0) + 1] = sums2[0];
+  }
+}
+
+//ROI statistics, second pass: a single work-group adds up the partial
+//sums and leaves q0sqr in q0sqr_cuda[0] for srad_cuda_1, so the image
+//never has to visit the host between iterations.
+__kernel void
+srad_roi_q0sqr(
+		  __global float * partial,
+		  __global float * q0sqr_cuda,
+		  int groups,
+		  int size_R
+)
+{
+  int tid = get_local_id(0);
+  int k;
+  float sum = 0.0f, sum2 = 0.0f, meanROI, varROI;
+
+  __local float sums[BLOCK_SIZE * BLOCK_SIZE];
+  __local float sums2[BLOCK_SIZE * BLOCK_SIZE];
+
+  for ( k = tid; k < groups; k += get_local_size(0) ){
+    sum  += partial[2 * k];
+    sum2 += partial[2 * k + 1];
+  }
+  sums[tid]  = sum;
+  sums2[tid] = sum2;
+  barrier(CLK_LOCAL_MEM_FENCE);
+
+  for ( k = get_local_size(0) / 2; k > 0; k /= 2 ){
+    if ( tid < k ){
+      sums[tid]  += sums[tid + k];
+      sums2[tid] += sums2[tid + k];
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+  }
+
+  if ( tid == 0 ){
+    meanROI = sums[0] / size_R;
+    varROI  = (sums2[0] / size_R) - meanROI * meanROI;
+    q0sqr_cuda[0] = varROI / (meanROI * meanROI);
+  }
+}
+
 __kernel void
 srad_cuda_1(
 		  __global float *E_C, 
@@ -9,7 +96,7 @@ srad_cuda_1(
 		  __global float * C_cuda, 
 		  int cols, 
 		  int rows, 
-		  float q0sqr
+		  __global float * q0sqr_cuda
 ) 
 {
 
@@ -29,6 +116,7 @@ srad_cuda_1(
   int index_e = cols * BLOCK_SIZE * by + BLOCK_SIZE * bx + cols * ty + BLOCK_SIZE;
 
   float n, w, e, s, jc, g2, l, num, den, qsqr, c;
+  float q0sqr = q0sqr_cuda[0];
 
   //shared memory allocation
   __local float temp[BLOCK_SIZE][BLOCK_SIZE];
@@ -165,7 +253,7 @@ srad_cuda_2(
 		  int cols, 
 		  int rows, 
 		  float lambda,
-		  float q0sqr
+		  __global float * q0sqr_cuda
 ) 
 {
 	//block id
@@ -256,3 +344,113 @@ srad_cuda_2(
    J_cuda[index] = c_cuda_result[ty][tx];
     
 }
+
+#ifndef FUSED_STEPS
+#define FUSED_STEPS 1
+#endif
+
+//halo and edge of the local tile; one step needs one row/column of J above
+//and to the left and two below and to the right (through C), so a tile
+//carrying 2 * FUSED_STEPS cells on every side stays exact in its centre
+#define FUSED_HALO (2 * FUSED_STEPS)
+#define FUSED_TILE (BLOCK_SIZE + 2 * FUSED_HALO)
+
+//srad_cuda_1 and srad_cuda_2 in one pass: each work-group loads an
+//overlapped tile of J_in, advances it 'steps' (<= FUSED_STEPS) iterations
+//in local memory with the same q0sqr, and writes its BLOCK_SIZE x
+//BLOCK_SIZE centre to J_out. Borders are clamped as in the two kernels.
+__kernel void
+srad_fused(
+		  __global float * J_in,
+		  __global float * J_out,
+		  int cols,
+		  int rows,
+		  float lambda,
+		  __global float * q0sqr_cuda,
+		  int steps
+)
+{
+  int tx = get_local_id(0);
+  int ty = get_local_id(1);
+
+  //global coordinates of the tile's top-left cell
+  int oy = BLOCK_SIZE * get_group_id(1) - FUSED_HALO;
+  int ox = BLOCK_SIZE * get_group_id(0) - FUSED_HALO;
+
+  int x, y, gx, gy, yn, ys, xw, xe, t, cur = 0;
+  float n, w, e, s, jc, g2, l, num, den, qsqr, c, cs, ce;
+  float q0sqr = q0sqr_cuda[0];
+
+  __local float jt[2][FUSED_TILE][FUSED_TILE];
+  __local float ct[FUSED_TILE][FUSED_TILE];
+
+  for ( y = ty; y < FUSED_TILE; y += BLOCK_SIZE ){
+    gy = clamp(oy + y, 0, rows - 1);
+    for ( x = tx; x < FUSED_TILE; x += BLOCK_SIZE ){
+      gx = clamp(ox + x, 0, cols - 1);
+      jt[0][y][x] = J_in[gy * cols + gx];
+    }
+  }
+  barrier(CLK_LOCAL_MEM_FENCE);
+
+  for ( t = 0; t < steps; t++ ){
+    //diffusion coefficient (equ 33) over the whole tile
+    for ( y = ty; y < FUSED_TILE; y += BLOCK_SIZE ){
+      gy = oy + y;
+      yn = ( gy <= 0 || y == 0 ) ? y : y - 1;
+      ys = ( gy >= rows - 1 || y == FUSED_TILE - 1 ) ? y : y + 1;
+      for ( x = tx; x < FUSED_TILE; x += BLOCK_SIZE ){
+        gx = ox + x;
+        xw = ( gx <= 0 || x == 0 ) ? x : x - 1;
+        xe = ( gx >= cols - 1 || x == FUSED_TILE - 1 ) ? x : x + 1;
+
+        jc = jt[cur][y][x];
+        n  = jt[cur][yn][x] - jc;
+        s  = jt[cur][ys][x] - jc;
+        w  = jt[cur][y][xw] - jc;
+        e  = jt[cur][y][xe] - jc;
+
+        g2 = ( n * n + s * s + w * w + e * e ) / (jc * jc);
+        l = ( n + s + w + e ) / jc;
+
+        num  = (0.5f*g2) - ((1.0f/16.0f)*(l*l)) ;
+        den  = 1 + (.25f*l);
+        qsqr = num/(den*den);
+
+        den = (qsqr-q0sqr) / (q0sqr * (1+q0sqr)) ;
+        c = 1.0f / (1.0f+den) ;
+
+        ct[y][x] = c < 0 ? 0 : ( c > 1 ? 1 : c );
+      }
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    //divergence (equ 58) and image update (equ 61)
+    for ( y = ty; y < FUSED_TILE; y += BLOCK_SIZE ){
+      gy = oy + y;
+      yn = ( gy <= 0 || y == 0 ) ? y : y - 1;
+      ys = ( gy >= rows - 1 || y == FUSED_TILE - 1 ) ? y : y + 1;
+      for ( x = tx; x < FUSED_TILE; x += BLOCK_SIZE ){
+        gx = ox + x;
+        xw = ( gx <= 0 || x == 0 ) ? x : x - 1;
+        xe = ( gx >= cols - 1 || x == FUSED_TILE - 1 ) ? x : x + 1;
+
+        jc = jt[cur][y][x];
+        n  = jt[cur][yn][x] - jc;
+        s  = jt[cur][ys][x] - jc;
+        w  = jt[cur][y][xw] - jc;
+        e  = jt[cur][y][xe] - jc;
+
+        c  = ct[y][x];
+        cs = ct[ys][x];
+        ce = ct[y][xe];
+
+        jt[cur ^ 1][y][x] = jc + 0.25f * lambda * (c * n + cs * s + c * w + ce * e);
+      }
+    }
+    cur ^= 1;
+    barrier(CLK_LOCAL_MEM_FENCE);
+  }
+
+  J_out[(oy + FUSED_HALO + ty) * cols + ox + FUSED_HALO + tx] = jt[cur][FUSED_HALO + ty][FUSED_HALO + tx];
+}